@@ -0,0 +1,88 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   Atomic.hpp
+// \author J Dupuy
+// \brief  Atomic operations on 32 bits words, for the lock free structures of
+//         the framework and of the extraction library.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef FW_ATOMIC_HPP
+#define FW_ATOMIC_HPP
+
+#include "glew.hpp"
+
+#ifdef _WIN32
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#	include <intrin.h>
+#else
+#	include <sched.h>
+#endif // _WIN32
+
+namespace fw
+{
+	// Loads acquire, stores release, read-modify-write operations are full
+	// barriers.
+
+	inline GLuint atomic_load(const volatile GLuint* word)
+	{
+#ifdef _MSC_VER
+		GLuint value = *word;
+		_ReadWriteBarrier();
+		return value;
+#else
+		return __atomic_load_n(word, __ATOMIC_ACQUIRE);
+#endif
+	}
+
+	inline void atomic_store(volatile GLuint* word, GLuint value)
+	{
+#ifdef _MSC_VER
+		_ReadWriteBarrier();
+		*word = value;
+#else
+		__atomic_store_n(word, value, __ATOMIC_RELEASE);
+#endif
+	}
+
+	inline bool atomic_compare_and_swap(volatile GLuint* word,
+	                                    GLuint expected,
+	                                    GLuint desired)
+	{
+#ifdef _MSC_VER
+		return GLuint(_InterlockedCompareExchange(
+		                  reinterpret_cast<volatile long*>(word),
+		                  long(desired), long(expected))) == expected;
+#else
+		return __sync_bool_compare_and_swap(word, expected, desired);
+#endif
+	}
+
+	// returns the previous value
+	inline GLuint atomic_fetch_add(volatile GLuint* word, GLuint value)
+	{
+#ifdef _MSC_VER
+		return GLuint(_InterlockedExchangeAdd(
+		                  reinterpret_cast<volatile long*>(word),
+		                  long(value)));
+#else
+		return __sync_fetch_and_add(word, value);
+#endif
+	}
+
+	// let other threads run
+	inline void yield_thread()
+	{
+#ifdef _WIN32
+		SwitchToThread();
+#else
+		sched_yield();
+#endif
+	}
+
+} // namespace fw
+
+#endif
+
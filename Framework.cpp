@@ -1,20 +1,49 @@
 #include "Framework.hpp"
+#include "Trace.hpp"
 
 #include <fstream> // std::ifstream
 #include <climits> // CHAR_BIT
 #include <cstring> // memcpy
 #include <sstream> // std::stringstream
 #include <iostream> // std::cerr
-#include <algorithm> // std::min std::max
+#include <algorithm> // std::min std::max std::nth_element
+#include <cmath> // std::sqrt
+#include <vector> // std::vector
+
+// OpenGL 4.3 token, missing from older GLEW headers
+#ifndef GL_CONTEXT_FLAG_DEBUG_BIT
+#	define GL_CONTEXT_FLAG_DEBUG_BIT 0x00000002
+#endif
 
 #ifdef _WIN32
 #	define NOMINMAX
 #	include <windows.h>
 #	include <winbase.h>
 #else
-#	include <sys/time.h>
+#	include <time.h>
+#	include <pthread.h>
 #endif // _WIN32
 
+// F16C (half conversions)
+#if defined(__F16C__) || defined(__AVX2__)
+#	define _FW_USE_F16C
+#	include <immintrin.h>
+#endif
+
+// SSE2 (packing)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define _FW_USE_SSE2
+#	include <emmintrin.h>
+#endif
+
+#ifdef FW_TIMER_USE_RDTSC
+#	ifdef _MSC_VER
+#		include <intrin.h>
+#	else
+#		include <x86intrin.h>
+#	endif
+#endif // FW_TIMER_USE_RDTSC
+
 namespace fw
 {
 ////////////////////////////////////////////////////////////////////////////////
@@ -112,24 +141,69 @@ static float _clamp_float(float x, float min, float max)
 
 
 ////////////////////////////////////////////////////////////////////////////////
-// Get time
-static GLdouble _get_ticks()
+// Get time from the os monotonic clock (in nanoseconds)
+static GLuint64 _get_os_nanoseconds()
 {
 #ifdef _WIN32
+	static __int64 sCpuFrequency = 0;
 	__int64 time;
-	__int64 cpuFrequency;
+	if(0 == sCpuFrequency)
+		QueryPerformanceFrequency((LARGE_INTEGER*) &sCpuFrequency);
 	QueryPerformanceCounter((LARGE_INTEGER*) &time);
-	QueryPerformanceFrequency((LARGE_INTEGER*) &cpuFrequency);
-	return time / static_cast<GLdouble>(cpuFrequency);
+	// split the conversion to avoid overflows
+	return   static_cast<GLuint64>(time / sCpuFrequency) * 1000000000u
+	       + static_cast<GLuint64>(time % sCpuFrequency) * 1000000000u
+	       / static_cast<GLuint64>(sCpuFrequency);
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return   static_cast<GLuint64>(ts.tv_sec) * 1000000000u
+	       + static_cast<GLuint64>(ts.tv_nsec);
+#endif
+}
+
+
+#ifdef FW_TIMER_USE_RDTSC
+////////////////////////////////////////////////////////////////////////////////
+// Time stamp counter period (in nanoseconds), calibrated against the os clock
+static GLdouble _get_rdtsc_period()
+{
+	static GLdouble sPeriod = 0.0;
+	if(0.0 == sPeriod)
+	{
+		const GLuint64 NS_START  = _get_os_nanoseconds();
+		const GLuint64 TSC_START = __rdtsc();
+		GLuint64 nsStop = NS_START;
+		while(nsStop - NS_START < 10000000u) // 10ms
+			nsStop = _get_os_nanoseconds();
+		const GLuint64 TSC_STOP = __rdtsc();
+		sPeriod = static_cast<GLdouble>(nsStop - NS_START)
+		        / static_cast<GLdouble>(TSC_STOP - TSC_START);
+	}
+	return sPeriod;
+}
+#endif // FW_TIMER_USE_RDTSC
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Get time (in seconds)
+static GLdouble _get_ticks(GLuint64 nanoseconds)
+{
+	return static_cast<GLdouble>(nanoseconds) / 1e9;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Floor of the base 2 logarithm (0 for 0)
+static GLuint _log2_uint64(GLuint64 x)
+{
+#ifdef __GNUC__
+	return 0 == x ? 0 : 63 - __builtin_clzll(x);
 #else
-	static GLdouble t0 = 0.0;
-	timeval tv;
-	gettimeofday(&tv, 0);
-	if (!t0) 
-		t0 = tv.tv_sec;
-
-	return   static_cast<GLdouble>(tv.tv_sec-t0)
-	       + static_cast<GLdouble>(tv.tv_usec) / 1e6;
+	GLuint log2 = 0;
+	while(x >>= 1)
+		++log2;
+	return log2;
 #endif
 }
 
@@ -185,6 +259,36 @@ static const std::string _gl_error_to_string(GLenum error)
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+// OpenGL debug output state
+// Messages are kept in a ring buffer; the callback may be invoked from a
+// driver thread when output is asynchronous, hence the mutex.
+enum
+{
+	_GL_DEBUG_LOG_SIZE           = 64,
+	_GL_DEBUG_LOG_MESSAGE_LENGTH = 256
+};
+
+static GLchar sGlDebugLog[_GL_DEBUG_LOG_SIZE][_GL_DEBUG_LOG_MESSAGE_LENGTH];
+static GLuint sGlDebugLogCount         = 0;
+static GLchar sGlDebugError[_GL_DEBUG_LOG_MESSAGE_LENGTH];
+static volatile bool sHasGlDebugError  = false;
+static GLint sGlErrorCheckMode         =
+#ifdef NDEBUG
+	GL_ERROR_CHECK_MODE_RELEASE;
+#else
+	GL_ERROR_CHECK_MODE_DEBUG;
+#endif
+static bool sIsGlDebugOutputConfigured = false;
+static bool sIsGlDebugContext          = false; // errors reach the callback
+
+static Mutex& _gl_debug_mutex()
+{
+	static Mutex sMutex;
+	return sMutex;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // OpenGL Debug ARB callback
 static GLvoid _gl_debug_message_callback( GLenum source,
@@ -195,8 +299,71 @@ static GLvoid _gl_debug_message_callback( GLenum source,
                                           const GLchar* message,
                                           GLvoid* userParam )
 {
-	std::cerr << "[DEBUG_OUTPUT] " << message << std::endl;
-	//throw _GLErrorException(message);
+	ScopedLock lock(_gl_debug_mutex());
+	GLchar* entry = sGlDebugLog[sGlDebugLogCount % _GL_DEBUG_LOG_SIZE];
+	strncpy(entry, message, _GL_DEBUG_LOG_MESSAGE_LENGTH-1);
+	entry[_GL_DEBUG_LOG_MESSAGE_LENGTH-1] = '\0';
+	++sGlDebugLogCount;
+
+	// errors are reported by the next check
+	if(GL_DEBUG_TYPE_ERROR_ARB == type && false == sHasGlDebugError)
+	{
+		memcpy(sGlDebugError, entry, _GL_DEBUG_LOG_MESSAGE_LENGTH);
+		sHasGlDebugError = true;
+	}
+
+	if(GL_ERROR_CHECK_MODE_DEBUG == sGlErrorCheckMode)
+		std::cerr << "[DEBUG_OUTPUT] " << message << std::endl;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Configure ARB_debug_output for the current mode
+static void _configure_gl_debug_output()
+{
+	if(!GLEW_ARB_debug_output)
+		return;
+	if(false == sIsGlDebugOutputConfigured)
+	{
+		glDebugMessageCallbackARB(
+			reinterpret_cast<GLDEBUGPROCARB>(&_gl_debug_message_callback),
+			NULL );
+		sIsGlDebugOutputConfigured = true;
+
+		// drivers need not report anything outside of debug contexts
+		GLint flags = 0;
+		glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+		glGetError(); // GL_CONTEXT_FLAGS is unknown before GL3
+		sIsGlDebugContext = 0 != (flags & GL_CONTEXT_FLAG_DEBUG_BIT);
+	}
+
+	const bool IS_DEBUG = GL_ERROR_CHECK_MODE_DEBUG == sGlErrorCheckMode;
+	glDebugMessageControlARB(GL_DONT_CARE,
+	                         GL_DONT_CARE,
+	                         GL_DEBUG_SEVERITY_LOW_ARB,
+	                         0,
+	                         NULL,
+	                         IS_DEBUG ? GL_TRUE : GL_FALSE);
+	if(IS_DEBUG)
+		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS_ARB);
+	else
+		glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS_ARB);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Throw the error recorded by the debug callback, if any
+static void _throw_gl_debug_error() throw(FWException)
+{
+	if(false == sHasGlDebugError)
+		return;
+	std::string message;
+	{
+		ScopedLock lock(_gl_debug_mutex());
+		message = sGlDebugError;
+		sHasGlDebugError = false;
+	}
+	throw _GLErrorException(message);
 }
 
 
@@ -225,6 +392,8 @@ GLvoid build_glsl_program( GLuint program,
                            const std::string& options,
                            GLboolean link ) throw(FWException)
 {
+	FW_TRACE_SCOPE("build_glsl_program", "shader");
+
 	// open source file
 	std::ifstream file(srcfile.c_str());
 	if(file.fail())
@@ -307,19 +476,39 @@ GLvoid build_glsl_program( GLuint program,
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+// Error check mode
+GLvoid set_gl_error_check_mode(GLint mode)
+{
+	sGlErrorCheckMode = mode;
+	_configure_gl_debug_output();
+}
+
+GLint gl_error_check_mode()
+{
+	return sGlErrorCheckMode;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // Check OpenGL error
 GLvoid check_gl_error() throw (FWException)
 {
-	static bool isArbDebugOutputConfigured = false;
-	if(GLEW_ARB_debug_output && !isArbDebugOutputConfigured)
+	if(false == sIsGlDebugOutputConfigured)
+		_configure_gl_debug_output();
+
+	// release mode: no round trip if the callback is installed on a debug
+	// context, which is the only case where it must report errors
+	if(   GL_ERROR_CHECK_MODE_RELEASE == sGlErrorCheckMode
+	   && sIsGlDebugOutputConfigured
+	   && sIsGlDebugContext)
 	{
-		glDebugMessageCallbackARB(
-			reinterpret_cast<GLDEBUGPROCARB>(&_gl_debug_message_callback),
-			NULL );
-		isArbDebugOutputConfigured = true;
+		_throw_gl_debug_error();
+		return;
 	}
+
 	GLenum error = glGetError();
+	_throw_gl_debug_error(); // more informative
 	if(GL_NO_ERROR != error)
 	{
 		throw _GLErrorException(_gl_error_to_string(error));
@@ -327,6 +516,44 @@ GLvoid check_gl_error() throw (FWException)
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+// Check OpenGL call
+GLvoid check_gl_call(const GLchar* call,
+                     const GLchar* file,
+                     GLint line) throw(FWException)
+{
+	if(GL_ERROR_CHECK_MODE_DEBUG != sGlErrorCheckMode)
+		return;
+	try
+	{
+		check_gl_error();
+	}
+	catch(FWException& e)
+	{
+		std::stringstream ss;
+		ss << e.what() << " in " << call << " (" << file << ':' << line << ')';
+		throw _GLErrorException(ss.str());
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Save debug log
+GLvoid save_gl_debug_log(const std::string& filename) throw(FWException)
+{
+	std::ofstream fileStream(filename.c_str());
+	if(!fileStream)
+		throw _FileNotFoundException(filename);
+
+	ScopedLock lock(_gl_debug_mutex());
+	const GLuint FIRST = sGlDebugLogCount > _GL_DEBUG_LOG_SIZE
+	                   ? sGlDebugLogCount - _GL_DEBUG_LOG_SIZE : 0;
+	for(GLuint i=FIRST; i<sGlDebugLogCount; ++i)
+		fileStream << sGlDebugLog[i % _GL_DEBUG_LOG_SIZE] << '\n';
+	fileStream.close();
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // Take a screen shot
 GLvoid save_gl_front_buffer( GLint x,
@@ -442,16 +669,16 @@ GLuint pack_4f_to_uint_10_10_10_2(GLfloat x,
                                   GLfloat z,
                                   GLfloat w)
 {
-	// clamp the values
-	x = _clamp_float(x, 0.0f, 1.0f)*1023.0f;
-	y = _clamp_float(y, 0.0f, 1.0f)*1023.0f;
-	z = _clamp_float(z, 0.0f, 1.0f)*1023.0f;
-	w = _clamp_float(w, 0.0f, 1.0f);
+	// clamp the values and round to nearest
+	x = _clamp_float(x, 0.0f, 1.0f)*1023.0f + 0.5f;
+	y = _clamp_float(y, 0.0f, 1.0f)*1023.0f + 0.5f;
+	z = _clamp_float(z, 0.0f, 1.0f)*1023.0f + 0.5f;
+	w = _clamp_float(w, 0.0f, 1.0f)*3.0f    + 0.5f;
 
 	return (   (GLuint(x) /* << 0 */ & 0x3FFu)
-	         | (GLuint(y)   << 9    & 0xFFC00u)
-	         | (GLuint(z)   << 19    & 0x3FF00000u)
-	         | (GLuint(w)   << 29    & 0xC0000000u) );
+	         | (GLuint(y)   << 10    & 0xFFC00u)
+	         | (GLuint(z)   << 20    & 0x3FF00000u)
+	         | (GLuint(w)   << 30    & 0xC0000000u) );
 }
 
 GLuint pack_4fv_to_uint_10_10_10_2(const GLfloat *v)
@@ -467,26 +694,21 @@ GLint pack_4f_to_int_10_10_10_2(GLfloat x,
                                 GLfloat z,
                                 GLfloat w)
 {
-	// clamp the values
+	// clamp the values and round to nearest (half away from zero)
 	x = _clamp_float(x, -1.0f, 1.0f)*511.0f;
 	y = _clamp_float(y, -1.0f, 1.0f)*511.0f;
 	z = _clamp_float(z, -1.0f, 1.0f)*511.0f;
 	w = _clamp_float(w, -1.0f, 1.0f);
-
-	// save signs
-	GLint signx = x < 0.0f ? 1 : 0;
-	GLint signy = y < 0.0f ? 1 : 0;
-	GLint signz = z < 0.0f ? 1 : 0;
-	GLint signw = w < 0.0f ? 1 : 0;
-
-	return (   GLint(x)
-	         | (signx << 8 & 1)
-	         | (GLint(y) << 9)
-	         | (signy << 18 & 1)
-	         | (GLint(z) << 19)
-	         | (signz << 28 & 1)
-	         | (GLint(w) << 29)
-	         | (signw << 30 & 1) );
+	x+= x < 0.0f ? -0.5f : 0.5f;
+	y+= y < 0.0f ? -0.5f : 0.5f;
+	z+= z < 0.0f ? -0.5f : 0.5f;
+	w+= w < 0.0f ? -0.5f : 0.5f;
+
+	// two's complement fields
+	return static_cast<GLint>(   (GLuint(GLint(x)) /* << 0 */ & 0x3FFu)
+	                           | (GLuint(GLint(y))   << 10    & 0xFFC00u)
+	                           | (GLuint(GLint(z))   << 20    & 0x3FF00000u)
+	                           | (GLuint(GLint(w))   << 30    & 0xC0000000u) );
 }
 
 GLint pack_4fv_to_int_10_10_10_2(const GLfloat *v)
@@ -495,6 +717,187 @@ GLint pack_4fv_to_int_10_10_10_2(const GLfloat *v)
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+// Pack arrays to 10_10_10_2
+#ifdef _FW_USE_SSE2
+// pack four vectors, given component wise (structure of arrays)
+static inline __m128i _pack_uint_10_10_10_2_x4(__m128 x,
+                                               __m128 y,
+                                               __m128 z,
+                                               __m128 w)
+{
+	const __m128 ZERO = _mm_setzero_ps();
+	const __m128 ONE  = _mm_set1_ps(1.0f);
+	const __m128 HALF = _mm_set1_ps(0.5f);
+	const __m128 MAX3 = _mm_set1_ps(1023.0f);
+	const __m128i MASK3 = _mm_set1_epi32(0x3FF);
+	x = _mm_add_ps(_mm_mul_ps(_mm_min_ps(ONE, _mm_max_ps(ZERO, x)), MAX3), HALF);
+	y = _mm_add_ps(_mm_mul_ps(_mm_min_ps(ONE, _mm_max_ps(ZERO, y)), MAX3), HALF);
+	z = _mm_add_ps(_mm_mul_ps(_mm_min_ps(ONE, _mm_max_ps(ZERO, z)), MAX3), HALF);
+	w = _mm_add_ps(_mm_mul_ps(_mm_min_ps(ONE, _mm_max_ps(ZERO, w)),
+	                          _mm_set1_ps(3.0f)),
+	               HALF);
+	__m128i p = _mm_and_si128(_mm_cvttps_epi32(x), MASK3);
+	p = _mm_or_si128(p, _mm_slli_epi32(_mm_and_si128(_mm_cvttps_epi32(y),
+	                                                 MASK3), 10));
+	p = _mm_or_si128(p, _mm_slli_epi32(_mm_and_si128(_mm_cvttps_epi32(z),
+	                                                 MASK3), 20));
+	p = _mm_or_si128(p, _mm_slli_epi32(_mm_cvttps_epi32(w), 30));
+	return p;
+}
+
+static inline __m128i _pack_int_10_10_10_2_x4(__m128 x,
+                                              __m128 y,
+                                              __m128 z,
+                                              __m128 w)
+{
+	const __m128 ONE   = _mm_set1_ps(1.0f);
+	const __m128 MONE  = _mm_set1_ps(-1.0f);
+	const __m128 ZERO  = _mm_setzero_ps();
+	const __m128 HALF  = _mm_set1_ps(0.5f);
+	const __m128 MHALF = _mm_set1_ps(-0.5f);
+	const __m128 MAX3  = _mm_set1_ps(511.0f);
+	const __m128i MASK3 = _mm_set1_epi32(0x3FF);
+	x = _mm_mul_ps(_mm_min_ps(ONE, _mm_max_ps(MONE, x)), MAX3);
+	y = _mm_mul_ps(_mm_min_ps(ONE, _mm_max_ps(MONE, y)), MAX3);
+	z = _mm_mul_ps(_mm_min_ps(ONE, _mm_max_ps(MONE, z)), MAX3);
+	w = _mm_min_ps(ONE, _mm_max_ps(MONE, w));
+	// add +/-0.5 depending on sign (round half away from zero)
+	__m128 sx = _mm_cmplt_ps(x, ZERO);
+	__m128 sy = _mm_cmplt_ps(y, ZERO);
+	__m128 sz = _mm_cmplt_ps(z, ZERO);
+	__m128 sw = _mm_cmplt_ps(w, ZERO);
+	x = _mm_add_ps(x, _mm_or_ps(_mm_and_ps(sx, MHALF), _mm_andnot_ps(sx, HALF)));
+	y = _mm_add_ps(y, _mm_or_ps(_mm_and_ps(sy, MHALF), _mm_andnot_ps(sy, HALF)));
+	z = _mm_add_ps(z, _mm_or_ps(_mm_and_ps(sz, MHALF), _mm_andnot_ps(sz, HALF)));
+	w = _mm_add_ps(w, _mm_or_ps(_mm_and_ps(sw, MHALF), _mm_andnot_ps(sw, HALF)));
+	__m128i p = _mm_and_si128(_mm_cvttps_epi32(x), MASK3);
+	p = _mm_or_si128(p, _mm_slli_epi32(_mm_and_si128(_mm_cvttps_epi32(y),
+	                                                 MASK3), 10));
+	p = _mm_or_si128(p, _mm_slli_epi32(_mm_and_si128(_mm_cvttps_epi32(z),
+	                                                 MASK3), 20));
+	p = _mm_or_si128(p, _mm_slli_epi32(_mm_cvttps_epi32(w), 30));
+	return p;
+}
+
+// load four xyz vectors (structure of arrays)
+static inline void _load_xyz_x4(const GLfloat* v,
+                                __m128& x,
+                                __m128& y,
+                                __m128& z)
+{
+	__m128 a = _mm_loadu_ps(v);   // x0 y0 z0 x1
+	__m128 b = _mm_loadu_ps(v+4); // y1 z1 x2 y2
+	__m128 c = _mm_loadu_ps(v+8); // z2 x3 y3 z3
+	x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1,1,2,2)),
+	                   _MM_SHUFFLE(2,0,3,0));
+	y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0,0,1,1)),
+	                   _mm_shuffle_ps(b, c, _MM_SHUFFLE(2,2,3,3)),
+	                   _MM_SHUFFLE(2,0,2,0));
+	z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1,1,2,2)),
+	                   _mm_shuffle_ps(c, c, _MM_SHUFFLE(3,3,0,0)),
+	                   _MM_SHUFFLE(2,0,2,0));
+}
+#endif // _FW_USE_SSE2
+
+GLvoid pack_4fv_to_uint_10_10_10_2_array(const GLfloat *v,
+                                         GLuint *packed,
+                                         size_t count)
+{
+	size_t i = 0;
+#ifdef _FW_USE_SSE2
+	for(; i+4<=count; i+=4)
+	{
+		__m128 x = _mm_loadu_ps(v+i*4);
+		__m128 y = _mm_loadu_ps(v+i*4+4);
+		__m128 z = _mm_loadu_ps(v+i*4+8);
+		__m128 w = _mm_loadu_ps(v+i*4+12);
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(packed+i),
+		                 _pack_uint_10_10_10_2_x4(x, y, z, w));
+	}
+#endif
+	for(; i<count; ++i)
+		packed[i] = pack_4fv_to_uint_10_10_10_2(v+i*4);
+}
+
+GLvoid pack_4fv_to_int_10_10_10_2_array(const GLfloat *v,
+                                        GLint *packed,
+                                        size_t count)
+{
+	size_t i = 0;
+#ifdef _FW_USE_SSE2
+	for(; i+4<=count; i+=4)
+	{
+		__m128 x = _mm_loadu_ps(v+i*4);
+		__m128 y = _mm_loadu_ps(v+i*4+4);
+		__m128 z = _mm_loadu_ps(v+i*4+8);
+		__m128 w = _mm_loadu_ps(v+i*4+12);
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(packed+i),
+		                 _pack_int_10_10_10_2_x4(x, y, z, w));
+	}
+#endif
+	for(; i<count; ++i)
+		packed[i] = pack_4fv_to_int_10_10_10_2(v+i*4);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Pack compact vertices
+GLvoid pack_compact_vertices(const GLfloat *positions,
+                             const GLfloat *normals,
+                             size_t count,
+                             const GLfloat *brickOrigin,
+                             GLfloat brickSize,
+                             GLuint *packed)
+{
+	const GLfloat INV_BRICK_SIZE = 1.0f/brickSize;
+	size_t i = 0;
+#ifdef _FW_USE_SSE2
+	const __m128 ZERO = _mm_setzero_ps();
+	const __m128 SCALE = _mm_set1_ps(INV_BRICK_SIZE);
+	const __m128 OX = _mm_set1_ps(brickOrigin[0]);
+	const __m128 OY = _mm_set1_ps(brickOrigin[1]);
+	const __m128 OZ = _mm_set1_ps(brickOrigin[2]);
+	for(; i+4<=count; i+=4)
+	{
+		__m128 x, y, z, nx, ny, nz;
+		_load_xyz_x4(positions+i*3, x, y, z);
+		x = _mm_mul_ps(_mm_sub_ps(x, OX), SCALE);
+		y = _mm_mul_ps(_mm_sub_ps(y, OY), SCALE);
+		z = _mm_mul_ps(_mm_sub_ps(z, OZ), SCALE);
+		__m128i p = _pack_uint_10_10_10_2_x4(x, y, z, ZERO);
+		__m128i n = _mm_setzero_si128();
+		if(NULL != normals)
+		{
+			_load_xyz_x4(normals+i*3, nx, ny, nz);
+			n = _pack_int_10_10_10_2_x4(nx, ny, nz, ZERO);
+		}
+		// interleave position and normal
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(packed+i*2),
+		                 _mm_unpacklo_epi32(p, n));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(packed+i*2+4),
+		                 _mm_unpackhi_epi32(p, n));
+	}
+#endif
+	for(; i<count; ++i)
+	{
+		const GLfloat* p = positions+i*3;
+		packed[i*2] = pack_4f_to_uint_10_10_10_2(
+			(p[0]-brickOrigin[0])*INV_BRICK_SIZE,
+			(p[1]-brickOrigin[1])*INV_BRICK_SIZE,
+			(p[2]-brickOrigin[2])*INV_BRICK_SIZE,
+			0.0f );
+		packed[i*2+1] = NULL == normals ? 0 :
+			static_cast<GLuint>(pack_4f_to_int_10_10_10_2(normals[i*3],
+			                                              normals[i*3+1],
+			                                              normals[i*3+2],
+			                                              0.0f));
+	}
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // Half to float and float to half conversions
 // Left the work to others (see comments below)
@@ -776,6 +1179,107 @@ float half_to_float(GLhalf h)
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+// Half to float and float to half conversions of arrays
+#ifdef _FW_USE_F16C
+// float to half of four values
+// F16C only rounds to nearest even, whereas float_to_half rounds half
+// away from zero: adding half an ulp to the magnitude and truncating gives
+// the same result for values in the normal half range. Other values
+// (denormals, overflows, NaNs) go through the scalar code.
+static inline bool _float_to_half_x4(const GLfloat* floats, GLhalf* halfs)
+{
+	const __m128i F_ABS_MASK  = _mm_set1_epi32(0x7fffffff);
+	const __m128i F_H_MIN     = _mm_set1_epi32(0x38800000 - 1); // 2^-14
+	const __m128i F_H_MAX     = _mm_set1_epi32(0x477ff000);     // overflow
+	const __m128i F_ROUND_BIT = _mm_set1_epi32(0x00001000);
+	__m128i f    = _mm_castps_si128(_mm_loadu_ps(floats));
+	__m128i fAbs = _mm_and_si128(f, F_ABS_MASK);
+	__m128i isZero   = _mm_cmpeq_epi32(fAbs, _mm_setzero_si128());
+	__m128i isNormal = _mm_and_si128(_mm_cmpgt_epi32(fAbs, F_H_MIN),
+	                                 _mm_cmplt_epi32(fAbs, F_H_MAX));
+	if(0xFFFF != _mm_movemask_epi8(_mm_or_si128(isZero, isNormal)))
+		return false;
+	__m128i fRounded = _mm_add_epi32(f, _mm_and_si128(isNormal, F_ROUND_BIT));
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(halfs),
+	                 _mm_cvtps_ph(_mm_castsi128_ps(fRounded),
+	                              _MM_FROUND_TO_ZERO));
+	return true;
+}
+
+// half to float of four values
+// F16C is exact, except that it quiets signaling NaNs where half_to_float
+// keeps the payload untouched.
+static inline void _half_to_float_x4(const GLhalf* halfs, GLfloat* floats)
+{
+	const __m128i H_E_MASK = _mm_set1_epi32(0x00007c00);
+	const __m128i H_M_MASK = _mm_set1_epi32(0x000003ff);
+	const __m128i H_S_MASK = _mm_set1_epi32(0x00008000);
+	const __m128i F_E_MASK = _mm_set1_epi32(0x7f800000);
+	__m128i h = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(halfs));
+	__m128 f  = _mm_cvtph_ps(h);
+	h = _mm_unpacklo_epi16(h, _mm_setzero_si128());
+	__m128i hM    = _mm_and_si128(h, H_M_MASK);
+	__m128i isNan = _mm_andnot_si128(
+		_mm_cmpeq_epi32(hM, _mm_setzero_si128()),
+		_mm_cmpeq_epi32(_mm_and_si128(h, H_E_MASK), H_E_MASK));
+	__m128i fNan  = _mm_or_si128(_mm_or_si128(F_E_MASK,
+	                                          _mm_slli_epi32(hM, 13)),
+	                             _mm_slli_epi32(_mm_and_si128(h, H_S_MASK),
+	                                            16));
+	f = _mm_or_ps(_mm_andnot_ps(_mm_castsi128_ps(isNan), f),
+	              _mm_and_ps(_mm_castsi128_ps(isNan),
+	                         _mm_castsi128_ps(fNan)));
+	_mm_storeu_ps(floats, f);
+}
+#endif // _FW_USE_F16C
+
+GLvoid float_to_half_array(const GLfloat* floats,
+                           GLhalf* halfs,
+                           size_t count)
+{
+	size_t i = 0;
+#ifdef _FW_USE_F16C
+	for(; i+4<=count; i+=4)
+		if(false == _float_to_half_x4(floats+i, halfs+i))
+		{
+			halfs[i]   = float_to_half(floats[i]);
+			halfs[i+1] = float_to_half(floats[i+1]);
+			halfs[i+2] = float_to_half(floats[i+2]);
+			halfs[i+3] = float_to_half(floats[i+3]);
+		}
+#endif
+	for(; i<count; ++i)
+		halfs[i] = float_to_half(floats[i]);
+}
+
+GLvoid half_to_float_array(const GLhalf* halfs,
+                           GLfloat* floats,
+                           size_t count)
+{
+	size_t i = 0;
+#ifdef _FW_USE_F16C
+	for(; i+4<=count; i+=4)
+		_half_to_float_x4(halfs+i, floats+i);
+#endif
+	for(; i<count; ++i)
+		floats[i] = half_to_float(halfs[i]);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Monotonic clock
+GLuint64 get_nanoseconds()
+{
+#ifdef FW_TIMER_USE_RDTSC
+	static const GLdouble PERIOD = _get_rdtsc_period();
+	return static_cast<GLuint64>(static_cast<GLdouble>(__rdtsc()) * PERIOD);
+#else
+	return _get_os_nanoseconds();
+#endif
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // Timer implementation
 //
@@ -784,7 +1288,7 @@ float half_to_float(GLhalf h)
 ////////////////////////////////////////////////////////////////////////////////
 // Timer Constructor
 Timer::Timer() : 
-	mStartTicks(0.0), mStopTicks(0.0), mIsTicking()
+	mStartTicks(0), mStopTicks(0), mIsTicking()
 {}
 
 
@@ -795,7 +1299,7 @@ void Timer::Start()
 	if(false == mIsTicking)
 	{
 		mIsTicking  = true;
-		mStartTicks = _get_ticks();
+		mStartTicks = get_nanoseconds();
 	}
 }
 
@@ -807,7 +1311,7 @@ void Timer::Stop()
 	if(true == mIsTicking)
 	{
 		mIsTicking = false;
-		mStopTicks = _get_ticks();
+		mStopTicks = get_nanoseconds();
 	}
 }
 
@@ -816,493 +1320,906 @@ void Timer::Stop()
 // Timer::Ticks()
 double Timer::Ticks() const
 {
-	return true==mIsTicking ? _get_ticks() - mStartTicks : mStopTicks - mStartTicks;
+	return _get_ticks(Nanoseconds());
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
-// Tga local functions/constants
-//
-////////////////////////////////////////////////////////////////////////////////
-
-// thanks to : http://paulbourke.net/dataformats/tga/
-enum _TgaImageType
+// Timer::Nanoseconds()
+GLuint64 Timer::Nanoseconds() const
 {
-	_TGA_TYPE_CM            = 1,
-	_TGA_TYPE_RGB           = 2,
-	_TGA_TYPE_LUMINANCE     = 3,
-	_TGA_TYPE_CM_RLE        = 9,
-	_TGA_TYPE_RGB_RLE       = 10,
-	_TGA_TYPE_LUMINANCE_RLE = 11
-};
+	return true==mIsTicking ? get_nanoseconds() - mStartTicks
+	                        : mStopTicks - mStartTicks;
+}
 
 
 ////////////////////////////////////////////////////////////////////////////////
-// Tga specific exceptions
+// TimerStatistics implementation
 //
 ////////////////////////////////////////////////////////////////////////////////
-class _TgaLoaderException : public FWException
-{
-public:
-	_TgaLoaderException(const std::string& filename, const std::string& log)
-	{
-		mMessage = "In file "+filename+": "+log;
-	}
-};
 
-class _TgaInvalidDescriptorException : public FWException
+////////////////////////////////////////////////////////////////////////////////
+// histogram bucket of a time interval
+static GLuint _histogram_bucket(GLuint64 nanoseconds)
 {
-public:
-	_TgaInvalidDescriptorException()
-	{
-		mMessage = "Invalid TGA image descriptor.";
-	}
-};
+	// four buckets per power of two
+	const GLuint LOG2 = _log2_uint64(nanoseconds);
+	if(LOG2 < 2)
+		return static_cast<GLuint>(nanoseconds);
+	return LOG2*4 + static_cast<GLuint>(nanoseconds >> (LOG2-2) & 3u);
+}
 
-class _TgaInvalidBppValueException : public FWException
+// centre of a histogram bucket
+static GLdouble _histogram_bucket_centre(GLuint bucket)
 {
-public:
-	_TgaInvalidBppValueException()
-	{
-		mMessage = "Invalid TGA bits per pixel amount.";
-	}
-};
+	if(bucket < 8)
+		return static_cast<GLdouble>(bucket);
+	const GLuint LOG2 = bucket / 4;
+	const GLdouble WIDTH = static_cast<GLdouble>(GLuint64(1) << (LOG2-2));
+	return WIDTH * static_cast<GLdouble>(4 + bucket % 4) + 0.5 * WIDTH;
+}
 
-class _TgaInvalidCmSizeException : public FWException
-{
-public:
-	_TgaInvalidCmSizeException()
-	{
-		mMessage = "Invalid TGA colour map size.";
-	}
-};
 
-class _TgaInvalidImageDescriptorByteException : public FWException
+////////////////////////////////////////////////////////////////////////////////
+// TimerStatistics Constructor
+TimerStatistics::TimerStatistics()
 {
-public:
-	_TgaInvalidImageDescriptorByteException()
-	{
-		mMessage = "Invalid TGA image descriptor byte.";
-	}
-};
+	Reset();
+}
 
 
 ////////////////////////////////////////////////////////////////////////////////
-// Tga implementation
-//
-////////////////////////////////////////////////////////////////////////////////
+// TimerStatistics::Add (Welford's online algorithm)
+void TimerStatistics::Add(GLuint64 nanoseconds)
+{
+	const GLdouble X     = static_cast<GLdouble>(nanoseconds);
+	const GLdouble DELTA = X - mMean;
+	++mCount;
+	mMean+= DELTA / static_cast<GLdouble>(mCount);
+	mM2  += DELTA * (X - mMean);
+	mMin  = std::min(mMin, nanoseconds);
+	mMax  = std::max(mMax, nanoseconds);
+	++mHistogram[_histogram_bucket(nanoseconds)];
+}
 
 
 ////////////////////////////////////////////////////////////////////////////////
-// Flip horizontally
-void Tga::_Flip()
+// TimerStatistics::Merge (Chan's parallel algorithm)
+void TimerStatistics::Merge(const TimerStatistics& statistics)
 {
-	GLubyte* flippedData = new GLubyte[mWidth*mHeight*mPixelFormat];
-	for(GLushort y = 0; y<mHeight; ++y)
-		for(GLushort x = 0; x<mWidth; ++x)
-			memcpy( &flippedData[y*mWidth*mPixelFormat+x*mPixelFormat],
-			       &mPixels[(mWidth-y)*mWidth*mPixelFormat+x*mPixelFormat],
-			       mPixelFormat );
-	delete[] mPixels;
-	mPixels = flippedData;
+	if(0 == statistics.mCount)
+		return;
+	const GLdouble N1    = static_cast<GLdouble>(mCount);
+	const GLdouble N2    = static_cast<GLdouble>(statistics.mCount);
+	const GLdouble DELTA = statistics.mMean - mMean;
+	mCount+= statistics.mCount;
+	mMean += DELTA * N2 / (N1 + N2);
+	mM2   += statistics.mM2 + DELTA * DELTA * N1 * N2 / (N1 + N2);
+	mMin   = std::min(mMin, statistics.mMin);
+	mMax   = std::max(mMax, statistics.mMax);
+	for(GLuint i=0; i<HISTOGRAM_SIZE; ++i)
+		mHistogram[i]+= statistics.mHistogram[i];
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
-// colour mapped images
-void Tga::_LoadColourMapped( std::ifstream& fileStream,
-                             GLchar* header )  throw(FWException)
+// TimerStatistics::Reset
+void TimerStatistics::Reset()
 {
-	// set offset
-	GLushort offset = _unpack_uint16(header[4], header[3])+header[0];
-	fileStream.seekg(offset, std::ifstream::cur);
-
-	// check image descriptor byte
-	if(header[17]!=0)
-		throw _TgaInvalidDescriptorException();
-
-	// get colourMap indexes
-	GLuint indexSize = header[16];
-	if(indexSize<1)
-		throw _TgaInvalidBppValueException();
-
-	// check cm size
-	GLuint colourMapSize = _unpack_uint16(header[5], header[6]);
-	if(colourMapSize < 1)
-		throw _TgaInvalidCmSizeException();
+	memset(mHistogram, 0, sizeof(mHistogram));
+	mCount = 0;
+	mMin   = ~GLuint64(0);
+	mMax   = 0;
+	mMean  = 0.0;
+	mM2    = 0.0;
+}
 
-	GLubyte* colourMap = NULL;
-	mPixelFormat = header[7]>>3;
-	if(mPixelFormat==4 || mPixelFormat==3)
-	{
-		GLuint colourMapByteCnt = colourMapSize * mPixelFormat;
-		colourMap = new GLubyte[colourMapByteCnt];
-		fileStream.read( reinterpret_cast<GLchar*>(colourMap),
-		                 colourMapByteCnt );
-	}
-	else if(mPixelFormat==2)
-	{
-		colourMapSize = _unpack_uint16(header[5], header[6]);
-		GLuint colourMapByteCnt = colourMapSize * 3;
-		colourMap = new GLubyte[colourMapByteCnt];
 
-		GLuint maxIter_cm 	= colourMapSize*2;
-		GLushort rgb16 			= 0;
-		for(GLuint i=0; i<maxIter_cm; ++i)
-		{
-			fileStream.read(reinterpret_cast<GLchar*>(&rgb16), 2);
-			colourMap[i*3]   = static_cast<GLubyte>((rgb16 & 0x001F)<<3);
-			colourMap[i*3+1] = static_cast<GLubyte>(((rgb16 & 0x03E0)>>5)<<3);
-			colourMap[i*3+2] = static_cast<GLubyte>(((rgb16 & 0x7C00)>>10)<<3);
-		}
-		mPixelFormat = Tga::PIXEL_FORMAT_BGR; // convert to bgr
-	}
-	else
-		throw _TgaInvalidBppValueException();
+////////////////////////////////////////////////////////////////////////////////
+// TimerStatistics queries
+GLuint64 TimerStatistics::Count() const
+{
+	return mCount;
+}
 
-	// allocate pixel data
-	mPixels = new GLubyte[mWidth*mHeight*mPixelFormat];
+GLuint64 TimerStatistics::Min() const
+{
+	return 0 == mCount ? 0 : mMin;
+}
 
-	// read data
-	GLuint maxIter = static_cast<GLuint>(mWidth)*static_cast<GLuint>(mHeight);
-	GLubyte bytesPerIndex = header[16]>>3;
-	GLuint index = 0;
-	for(GLuint i=0; i<maxIter; ++i)
-	{
-		// read index
-		fileStream.read(reinterpret_cast<GLchar*>(&index), bytesPerIndex);
-		// get color
-		memcpy( &mPixels[i*mPixelFormat],
-		        &colourMap[index*mPixelFormat],
-		        mPixelFormat );
-	}
+GLuint64 TimerStatistics::Max() const
+{
+	return mMax;
+}
 
-	// flip if necessary
-	if(1==(header[17]>>5 & 0x01))
-		_Flip();
+GLdouble TimerStatistics::Total() const
+{
+	return mMean * static_cast<GLdouble>(mCount);
+}
 
-	// free memory
-	delete[] colourMap;
+GLdouble TimerStatistics::Mean() const
+{
+	return mMean;
 }
 
+GLdouble TimerStatistics::Variance() const
+{
+	return mCount < 2 ? 0.0 : mM2 / static_cast<GLdouble>(mCount - 1);
+}
 
-////////////////////////////////////////////////////////////////////////////////
-void Tga::_LoadLuminance( std::ifstream& fileStream,
-                          GLchar* header ) throw(FWException)
+GLdouble TimerStatistics::StandardDeviation() const
 {
-	// set offset
-	GLuint offset = header[0]
-	              + header[1]
-	              * ( _unpack_uint16(header[4], header[3])
-	              + _unpack_uint16(header[6], header[5] )
-	              * (header[7]>>3));
-	fileStream.seekg(offset, std::ifstream::cur);
+	return std::sqrt(Variance());
+}
 
-	// read data depending on bits per pixel
-	if(header[16]==8 || header[16]==16)
+GLdouble TimerStatistics::Percentile(GLdouble percentile) const
+{
+	if(0 == mCount)
+		return 0.0;
+	const GLdouble RANK = std::min(100.0, std::max(0.0, percentile))
+	                    * 0.01 * static_cast<GLdouble>(mCount);
+	GLuint64 cumulated = 0;
+	for(GLuint i=0; i<HISTOGRAM_SIZE; ++i)
 	{
-		mPixelFormat = header[16] >> 3;
-		mPixels      = new GLubyte[mWidth*mHeight*mPixelFormat];
-		fileStream.read( reinterpret_cast<GLchar*>(mPixels),
-		                 mWidth*mHeight*mPixelFormat);
+		cumulated+= mHistogram[i];
+		if(cumulated > 0 && static_cast<GLdouble>(cumulated) >= RANK)
+			return std::min(static_cast<GLdouble>(mMax),
+			                std::max(static_cast<GLdouble>(mMin),
+			                         _histogram_bucket_centre(i)));
 	}
-	else
-		throw _TgaInvalidBppValueException();
-
-	// flip if necessary
-	if(1==(header[17]>>5 & 0x01))
-		_Flip();
+	return static_cast<GLdouble>(mMax);
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
-// unmapped
-void Tga::_LoadUnmapped( std::ifstream& fileStream,
-                         GLchar* header ) throw(FWException)
-{
-	// set offset
-	GLuint offset = header[0]
-	              + header[1]
-	              * ( _unpack_uint16(header[4], header[3])
-	              + _unpack_uint16(header[6], header[5] )
-	              * (header[7]>>3));
-	fileStream.seekg(offset, std::ifstream::cur);
+// ScopedTimer implementation
+//
+////////////////////////////////////////////////////////////////////////////////
 
-	// read data depending on bits per pixel
-	if(header[16]==16)
+////////////////////////////////////////////////////////////////////////////////
+// ScopedTimer Constructor
+ScopedTimer::ScopedTimer(TimerStatistics& statistics) :
+	mStatistics(statistics), mStartTicks(get_nanoseconds())
+{}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// ScopedTimer Destructor
+ScopedTimer::~ScopedTimer()
+{
+	mStatistics.Add(get_nanoseconds() - mStartTicks);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FrameProfiler implementation
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// FrameProfiler Constructor
+FrameProfiler::FrameProfiler(GLuint passCount) :
+	mPassNames(NULL), mQueries(NULL), mIsIssued(NULL),
+	mSamples(NULL), mSampleCounts(NULL),
+	mPassCount(passCount), mFrame(0)
+{
+	const GLuint QUERY_COUNT = FRAME_LATENCY * mPassCount * 2;
+
+	mPassNames    = new std::string[mPassCount];
+	mQueries      = new GLuint[QUERY_COUNT];
+	mIsIssued     = new GLboolean[FRAME_LATENCY * mPassCount];
+	mSamples      = new GLfloat[SAMPLE_COUNT * mPassCount];
+	mSampleCounts = new GLuint[mPassCount];
+
+	for(GLuint i=0; i<FRAME_LATENCY*mPassCount; ++i)
+		mIsIssued[i] = GL_FALSE;
+	for(GLuint i=0; i<mPassCount; ++i)
 	{
-		mPixelFormat = 3;
-		mPixels = new GLubyte[mWidth*mHeight*mPixelFormat];
-		// load variables
-		GLuint maxIter  = static_cast<GLuint>(mWidth)
-		                * static_cast<GLuint>(mHeight);
-		GLushort rgb16  = 0;
-		for(GLuint i=0; i<maxIter; ++i)
-		{
-			fileStream.read(reinterpret_cast<GLchar*>(&rgb16), 2);
-			mPixels[i*3]     = static_cast<GLubyte>((rgb16 & 0x001F)<<3);
-			mPixels[i*3+1]   = static_cast<GLubyte>(((rgb16 & 0x03E0)>>5)<<3);
-			mPixels[i*3+2]   = static_cast<GLubyte>(((rgb16 & 0x7C00)>>10)<<3);
-		}
+		std::stringstream ss;
+		ss << "pass" << i;
+		mPassNames[i]    = ss.str();
+		mSampleCounts[i] = 0;
 	}
-	else if(header[16]==24 || header[16]==32)
+	glGenQueries(QUERY_COUNT, mQueries);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FrameProfiler Destructor
+FrameProfiler::~FrameProfiler()
+{
+	glDeleteQueries(FRAME_LATENCY * mPassCount * 2, mQueries);
+	delete[] mPassNames;
+	delete[] mQueries;
+	delete[] mIsIssued;
+	delete[] mSamples;
+	delete[] mSampleCounts;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FrameProfiler::SetPassName
+void FrameProfiler::SetPassName(GLuint pass, const std::string& name)
+{
+	mPassNames[pass] = name;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FrameProfiler::BeginFrame
+void FrameProfiler::BeginFrame()
+{
+	// the slot we are about to reuse was issued FRAME_LATENCY frames ago
+	_Collect(mFrame % FRAME_LATENCY);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FrameProfiler::EndFrame
+void FrameProfiler::EndFrame()
+{
+	++mFrame;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FrameProfiler::BeginPass
+void FrameProfiler::BeginPass(GLuint pass)
+{
+	const GLuint slot = (mFrame % FRAME_LATENCY) * mPassCount + pass;
+	glQueryCounter(mQueries[slot*2], GL_TIMESTAMP);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FrameProfiler::EndPass
+void FrameProfiler::EndPass(GLuint pass)
+{
+	const GLuint slot = (mFrame % FRAME_LATENCY) * mPassCount + pass;
+	glQueryCounter(mQueries[slot*2+1], GL_TIMESTAMP);
+	mIsIssued[slot] = GL_TRUE;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FrameProfiler::_Collect (read back the queries of a frame slot)
+void FrameProfiler::_Collect(GLuint frame)
+{
+	for(GLuint pass=0; pass<mPassCount; ++pass)
 	{
-		mPixelFormat = header[16] >> 3;
-		mPixels      = new GLubyte[mWidth*mHeight*mPixelFormat];
-		fileStream.read( reinterpret_cast<GLchar*>(mPixels),
-		                 mWidth*mHeight*mPixelFormat );
+		const GLuint slot = frame * mPassCount + pass;
+		if(GL_FALSE == mIsIssued[slot])
+			continue;
+		mIsIssued[slot] = GL_FALSE;
+
+		// never wait for the GPU: drop the sample if it is not ready
+		GLint isAvailable = GL_FALSE;
+		glGetQueryObjectiv(mQueries[slot*2+1],
+		                   GL_QUERY_RESULT_AVAILABLE,
+		                   &isAvailable);
+		if(GL_FALSE == isAvailable)
+			continue;
+
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(mQueries[slot*2],   GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(mQueries[slot*2+1], GL_QUERY_RESULT, &end);
+		mSamples[pass*SAMPLE_COUNT + mSampleCounts[pass] % SAMPLE_COUNT]
+			= static_cast<GLfloat>(static_cast<GLdouble>(end - begin) / 1e6);
+		++mSampleCounts[pass];
 	}
-	else
-		throw _TgaInvalidBppValueException();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FrameProfiler::Dump
+void FrameProfiler::Dump(const std::string& filename) const throw(FWException)
+{
+	std::ofstream fileStream(filename.c_str());
+	if(!fileStream)
+		throw _FileNotFoundException(filename);
 
-	// flip if necessary
-	if(1==(header[17]>>5 & 0x01))
-		_Flip();
+	fileStream << "# pass min(ms) avg(ms) p99(ms) samples\n";
+	for(GLuint pass=0; pass<mPassCount; ++pass)
+		fileStream << mPassNames[pass]         << ' '
+		           << PassMin(pass)            << ' '
+		           << PassAverage(pass)        << ' '
+		           << PassPercentile(pass, 99) << ' '
+		           << PassSampleCount(pass)    << '\n';
+	fileStream.close();
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
-// unmapped rle
-void Tga::_LoadUnmappedRle( std::ifstream& fileStream,
-                            GLchar* header ) throw(FWException)
+// FrameProfiler queries
+GLuint FrameProfiler::PassCount() const
 {
-	// set offset
-	GLuint offset = header[0]
-	              + header[1]
-	              * ( _unpack_uint16(header[4], header[3])
-	              + _unpack_uint16(header[6], header[5] )
-	              * (header[7]>>3));
-	fileStream.seekg(offset, std::ifstream::cur);
+	return mPassCount;
+}
 
-	// read data depending on bits per pixel
-	if(header[16]==16)
+const std::string& FrameProfiler::PassName(GLuint pass) const
+{
+	return mPassNames[pass];
+}
+
+GLuint FrameProfiler::PassSampleCount(GLuint pass) const
+{
+	return std::min<GLuint>(mSampleCounts[pass], SAMPLE_COUNT);
+}
+
+GLfloat FrameProfiler::PassMin(GLuint pass) const
+{
+	const GLuint count = PassSampleCount(pass);
+	if(0 == count)
+		return 0.0f;
+	const GLfloat* samples = &mSamples[pass*SAMPLE_COUNT];
+	return *std::min_element(samples, samples + count);
+}
+
+GLfloat FrameProfiler::PassAverage(GLuint pass) const
+{
+	const GLuint count = PassSampleCount(pass);
+	if(0 == count)
+		return 0.0f;
+	const GLfloat* samples = &mSamples[pass*SAMPLE_COUNT];
+	GLdouble sum = 0.0;
+	for(GLuint i=0; i<count; ++i)
+		sum+= samples[i];
+	return static_cast<GLfloat>(sum / count);
+}
+
+GLfloat FrameProfiler::PassPercentile(GLuint pass, GLfloat percentile) const
+{
+	const GLuint count = PassSampleCount(pass);
+	if(0 == count)
+		return 0.0f;
+	std::vector<GLfloat> samples(&mSamples[pass*SAMPLE_COUNT],
+	                             &mSamples[pass*SAMPLE_COUNT] + count);
+	GLuint rank = static_cast<GLuint>(_clamp_float(percentile, 0.0f, 100.0f)
+	                                  * 0.01f * (count-1) + 0.5f);
+	std::nth_element(samples.begin(), samples.begin()+rank, samples.end());
+	return samples[rank];
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Mutex implementation
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Mutex Constructor
+Mutex::Mutex() : mHandle(NULL)
+{
+#ifdef _WIN32
+	CRITICAL_SECTION* criticalSection = new CRITICAL_SECTION;
+	InitializeCriticalSection(criticalSection);
+	mHandle = criticalSection;
+#else
+	pthread_mutex_t* mutex = new pthread_mutex_t;
+	pthread_mutex_init(mutex, NULL);
+	mHandle = mutex;
+#endif
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Mutex Destructor
+Mutex::~Mutex()
+{
+#ifdef _WIN32
+	DeleteCriticalSection(static_cast<CRITICAL_SECTION*>(mHandle));
+	delete static_cast<CRITICAL_SECTION*>(mHandle);
+#else
+	pthread_mutex_destroy(static_cast<pthread_mutex_t*>(mHandle));
+	delete static_cast<pthread_mutex_t*>(mHandle);
+#endif
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Mutex::Lock
+void Mutex::Lock()
+{
+#ifdef _WIN32
+	EnterCriticalSection(static_cast<CRITICAL_SECTION*>(mHandle));
+#else
+	pthread_mutex_lock(static_cast<pthread_mutex_t*>(mHandle));
+#endif
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Mutex::Unlock
+void Mutex::Unlock()
+{
+#ifdef _WIN32
+	LeaveCriticalSection(static_cast<CRITICAL_SECTION*>(mHandle));
+#else
+	pthread_mutex_unlock(static_cast<pthread_mutex_t*>(mHandle));
+#endif
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// ConditionVariable
+ConditionVariable::ConditionVariable() : mHandle(NULL)
+{
+#ifdef _WIN32
+	CONDITION_VARIABLE* condition = new CONDITION_VARIABLE;
+	InitializeConditionVariable(condition);
+	mHandle = condition;
+#else
+	pthread_cond_t* condition = new pthread_cond_t;
+	pthread_cond_init(condition, NULL);
+	mHandle = condition;
+#endif
+}
+
+ConditionVariable::~ConditionVariable()
+{
+#ifdef _WIN32
+	delete static_cast<CONDITION_VARIABLE*>(mHandle);
+#else
+	pthread_cond_destroy(static_cast<pthread_cond_t*>(mHandle));
+	delete static_cast<pthread_cond_t*>(mHandle);
+#endif
+}
+
+void ConditionVariable::Wait(Mutex& mutex)
+{
+#ifdef _WIN32
+	SleepConditionVariableCS(static_cast<CONDITION_VARIABLE*>(mHandle),
+	                         static_cast<CRITICAL_SECTION*>(mutex.mHandle),
+	                         INFINITE);
+#else
+	pthread_cond_wait(static_cast<pthread_cond_t*>(mHandle),
+	                  static_cast<pthread_mutex_t*>(mutex.mHandle));
+#endif
+}
+
+void ConditionVariable::Broadcast()
+{
+#ifdef _WIN32
+	WakeAllConditionVariable(static_cast<CONDITION_VARIABLE*>(mHandle));
+#else
+	pthread_cond_broadcast(static_cast<pthread_cond_t*>(mHandle));
+#endif
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// ScopedLock
+ScopedLock::ScopedLock(Mutex& mutex) : mMutex(mutex)
+{
+	mMutex.Lock();
+}
+
+ScopedLock::~ScopedLock()
+{
+	mMutex.Unlock();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Tga local functions/constants
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// thanks to : http://paulbourke.net/dataformats/tga/
+enum _TgaImageType
+{
+	_TGA_TYPE_CM            = 1,
+	_TGA_TYPE_RGB           = 2,
+	_TGA_TYPE_LUMINANCE     = 3,
+	_TGA_TYPE_CM_RLE        = 9,
+	_TGA_TYPE_RGB_RLE       = 10,
+	_TGA_TYPE_LUMINANCE_RLE = 11
+};
+
+// header size (in bytes)
+static const size_t _TGA_HEADER_SIZE = 18;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Tga specific exceptions
+//
+////////////////////////////////////////////////////////////////////////////////
+class _TgaLoaderException : public FWException
+{
+public:
+	_TgaLoaderException(const std::string& filename, const std::string& log)
 	{
-		mPixelFormat = 3;   // will be converted to bgr
-		mPixels = new GLubyte[mWidth*mHeight*mPixelFormat];
-		GLubyte* dataPtrMax = mPixels + (mWidth*mHeight*mPixelFormat);
-		GLubyte* dataPtr = mPixels;
-		GLint blockSize, blockIter;
-		GLubyte packetHeader = 0;
-		GLushort rgb16 = 0;  // compressed data
-		while(dataPtr < dataPtrMax)
-		{
-			// reset data block iterator
-			blockIter = 1;
-			// read first byte
-			fileStream.read( reinterpret_cast<GLchar*>(&packetHeader),
-			                 sizeof(GLubyte));
-			blockSize = 1 + (packetHeader & 0x7F);
-			fileStream.read(reinterpret_cast<GLchar*>(&rgb16), 16);  // read 16 bits
-			dataPtr[0] = static_cast<GLubyte>((rgb16 & 0x001F) << 3);
-			dataPtr[1] = static_cast<GLubyte>(((rgb16 & 0x03E0) >> 5) << 3);
-			dataPtr[2] = static_cast<GLubyte>(((rgb16 & 0x7C00) >> 10) << 3);
-			if(packetHeader & 0x80)   // rle
-			{
-				for(; blockIter<blockSize; ++blockIter)
-					memcpy( dataPtr + blockIter * mPixelFormat,
-					        dataPtr,
-					        mPixelFormat );
-			}
-			else
-				for(; blockIter<blockSize; ++blockIter)
-				{
-					fileStream.read(reinterpret_cast<GLchar*>(&rgb16), 16);  // read 16 bits
-					dataPtr[blockIter*mPixelFormat+0] = static_cast<GLubyte>((rgb16 & 0x001F) << 3);
-					dataPtr[blockIter*mPixelFormat+1] = static_cast<GLubyte>(((rgb16 & 0x03E0) >> 5) << 3);
-					dataPtr[blockIter*mPixelFormat+2] = static_cast<GLubyte>(((rgb16 & 0x7C00) >> 10) << 3);
-				}
-			// increment pixel ptr
-			dataPtr+=mPixelFormat*blockSize;
-		}
+		mMessage = "In file "+filename+": "+log;
 	}
-	else if(header[16]==24 || header[16]==32)
+};
+
+class _TgaInvalidBppValueException : public FWException
+{
+public:
+	_TgaInvalidBppValueException()
 	{
-		mPixelFormat = header[16] >> 3;
-		mPixels      = new GLubyte[mWidth*mHeight*mPixelFormat];
-
-		// read rle
-		GLuint blockSize, blockIter;
-		GLubyte* dataPtrMax  = mPixels + mWidth*mHeight*mPixelFormat;
-		GLubyte* dataPtr     = mPixels;
-		GLubyte packetHeader = 0u;
-		while(dataPtr < dataPtrMax)
-		{
-			// reset data block iterator
-			blockIter = 1u;
-			// read first byte
-			fileStream.read(reinterpret_cast<GLchar*>(&packetHeader), 1);
-			blockSize = 1u + (packetHeader & 0x7F);
-			fileStream.read(reinterpret_cast<GLchar*>(dataPtr), mPixelFormat);
-			if(packetHeader & 0x80u)   // rle
-				for(; blockIter<blockSize; ++blockIter)
-					memcpy(dataPtr+blockIter*mPixelFormat, dataPtr, mPixelFormat);
-			else
-				for(; blockIter<blockSize; ++blockIter)
-					fileStream.read(reinterpret_cast<GLchar*>(dataPtr
-					                                         +blockIter
-					                                         *mPixelFormat),
-					                mPixelFormat);
-			// increment pixel ptr
-			dataPtr+=mPixelFormat*blockSize;
-		}
+		mMessage = "Invalid TGA bits per pixel amount.";
 	}
-	else
-		throw _TgaInvalidBppValueException();
+};
+
+class _TgaInvalidCmSizeException : public FWException
+{
+public:
+	_TgaInvalidCmSizeException()
+	{
+		mMessage = "Invalid TGA colour map size.";
+	}
+};
 
+class _TgaInvalidCmIndexException : public FWException
+{
+public:
+	_TgaInvalidCmIndexException()
+	{
+		mMessage = "Invalid TGA colour map index.";
+	}
+};
 
-	// flip if necessary
-	if(1==(header[17]>>5 & 0x01))
-		_Flip();
+class _TgaTruncatedDataException : public FWException
+{
+public:
+	_TgaTruncatedDataException()
+	{
+		mMessage = "Truncated TGA pixel data.";
+	}
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Offset of the colour map, and of the pixels
+static size_t _tga_colour_map_offset(const GLubyte* header)
+{
+	return _TGA_HEADER_SIZE + header[0];
+}
+
+static size_t _tga_pixel_offset(const GLubyte* header)
+{
+	if(header[1] == 0) // no colour map
+		return _tga_colour_map_offset(header);
+	return _tga_colour_map_offset(header)
+	     + size_t(_unpack_uint16(header[6], header[5])) * ((header[7]+7)>>3);
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
-// colour mapped images rle
-void Tga::_LoadColourMappedRle( std::ifstream& fileStream,
-                                GLchar* header) throw(FWException)
+// Expand a BGR555 pixel to BGR888
+static void _tga_expand_bgr16(const GLubyte* bgr16, GLubyte* bgr)
 {
-	// set offset
-	GLushort offset = _unpack_uint16(header[4], header[3])+header[0];
-	fileStream.seekg(offset, std::ifstream::cur);
+	GLushort bits = _unpack_uint16(bgr16[1], bgr16[0]);
+	bgr[0] = static_cast<GLubyte>((bits & 0x001F)<<3);
+	bgr[1] = static_cast<GLubyte>(((bits & 0x03E0)>>5)<<3);
+	bgr[2] = static_cast<GLubyte>(((bits & 0x7C00)>>10)<<3);
+}
 
-	// check image descriptor byte
-	if(header[17]!=0)
-		throw _TgaInvalidImageDescriptorByteException();
 
-	// get colourMap indexes
-	GLuint indexSize = header[16];
-	if(indexSize<1)
-		throw _TgaInvalidBppValueException();
+////////////////////////////////////////////////////////////////////////////////
+// Fill count pixels with a value, with stores as wide as possible
+static void _tga_fill(GLubyte* pixels,
+                      const GLubyte* value,
+                      GLuint count,
+                      GLuint pixelSize)
+{
+	if(pixelSize == 1)
+		memset(pixels, value[0], count);
+	else if(pixelSize == 2)
+	{
+		GLushort word;
+		memcpy(&word, value, 2);
+		GLushort* words = reinterpret_cast<GLushort*>(pixels);
+		for(GLuint i=0; i<count; ++i)
+			memcpy(words+i, &word, 2); // may be unaligned
+	}
+	else if(pixelSize == 4)
+	{
+		GLuint word;
+		memcpy(&word, value, 4);
+		GLuint* words = reinterpret_cast<GLuint*>(pixels);
+		for(GLuint i=0; i<count; ++i)
+			memcpy(words+i, &word, 4); // may be unaligned
+	}
+	else
+	{
+		// copy the filled part onto the rest, doubling each time
+		const size_t byteCount = size_t(count)*pixelSize;
+		memcpy(pixels, value, pixelSize);
+		for(size_t filled = pixelSize; filled < byteCount; )
+		{
+			size_t n = std::min(filled, byteCount-filled);
+			memcpy(pixels+filled, pixels, n);
+			filled+= n;
+		}
+	}
+}
 
-	// check cm size
-	GLuint colourMapSize = _unpack_uint16(header[5], header[6]);
-	if(colourMapSize < 1)
-		throw _TgaInvalidCmSizeException();
 
-	GLubyte* colourMap = NULL;
-	mPixelFormat = header[7]>>3;
-	if(mPixelFormat==4 || mPixelFormat==3)
+////////////////////////////////////////////////////////////////////////////////
+// Row writer: walks the pixels of an image in file order, and gives spans
+// of rows in bottom to top order (rows are flipped while they are written)
+class _TgaRowWriter
+{
+public:
+	_TgaRowWriter(GLubyte* pixels,
+	              GLuint width,
+	              GLuint height,
+	              GLuint pixelSize,
+	              bool isTopOrigin):
+		mPixels(pixels), mWidth(width), mHeight(height),
+		mPixelSize(pixelSize), mIsTopOrigin(isTopOrigin), mX(0), mY(0)
+	{
+		mRow = _Row(0);
+	}
+
+	// number of pixels left
+	size_t Remaining() const
 	{
-		GLuint colourMapByteCnt = colourMapSize * mPixelFormat;
-		colourMap = new GLubyte[colourMapByteCnt];
-		fileStream.read(reinterpret_cast<GLchar*>(colourMap), colourMapByteCnt);
+		return size_t(mHeight-mY)*mWidth - mX;
 	}
-	else if(mPixelFormat==2)
+
+	// next pixels (count is clamped to the end of the row)
+	GLubyte* Span(GLuint& count) const
 	{
-		colourMapSize = _unpack_uint16(header[5], header[6]);
-		GLuint colourMapByteCnt = colourMapSize * 3;
-		colourMap = new GLubyte[colourMapByteCnt];
+		count = std::min(count, mWidth-mX);
+		return mRow + size_t(mX)*mPixelSize;
+	}
 
-		GLuint maxIter_cm = colourMapSize*2;
-		GLushort rgb16    = 0;
-		for(GLuint i=0; i<maxIter_cm; ++i)
+	// move past count pixels of a span
+	void Advance(GLuint count)
+	{
+		mX+= count;
+		if(mX == mWidth)
 		{
-			fileStream.read(reinterpret_cast<GLchar*>(&rgb16), 2);
-			colourMap[i*3]   = static_cast<GLubyte>((rgb16 & 0x001F)<<3);
-			colourMap[i*3+1] = static_cast<GLubyte>(((rgb16 & 0x03E0)>>5)<<3);
-			colourMap[i*3+2] = static_cast<GLubyte>(((rgb16 & 0x7C00)>>10)<<3);
+			mX = 0;
+			if(++mY < mHeight)
+				mRow = _Row(mY);
 		}
-		mPixelFormat = 3; // convert to bgr
 	}
-	else
-		throw _TgaInvalidBppValueException();
 
-	// allocate pixel data
-	mPixels = new GLubyte[mWidth*mHeight*mPixelFormat];
+private:
+	GLubyte* _Row(GLuint y) const
+	{
+		return mPixels
+		     + size_t(mIsTopOrigin ? mHeight-1-y : y)*mWidth*mPixelSize;
+	}
 
-	// read rle
-	GLubyte* dataPtrMax = mPixels + mWidth*mHeight*mPixelFormat;
-	GLubyte* dataPtr = mPixels;
-	GLuint blockSize, blockIter;
-	GLubyte packetHeader = 0u;
-	GLubyte bytesPerIndex = header[16]>>3;
-	GLuint index = 0;
-	while(dataPtr < dataPtrMax)
+	GLubyte* mPixels;
+	GLubyte* mRow;
+	GLuint   mWidth;
+	GLuint   mHeight;
+	GLuint   mPixelSize;
+	bool     mIsTopOrigin;
+	GLuint   mX;
+	GLuint   mY;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Pixel converters: copy or expand a pixel of the file to the image
+class _TgaCopy
+{
+public:
+	explicit _TgaCopy(GLuint size): mSize(size) {}
+	GLuint SourceSize() const {return mSize;}
+	bool   IsCopy()     const {return true;}
+	void   operator()(const GLubyte* in, GLubyte* out) const
 	{
-		// reset data block iterator
-		blockIter = 1u;
-		// read first byte
-		fileStream.read(reinterpret_cast<GLchar*>(&packetHeader), 1);
-		blockSize = 1u + (packetHeader & 0x7F);
-		fileStream.read(reinterpret_cast<GLchar*>(&index), bytesPerIndex);
-		memcpy(dataPtr, &colourMap[index*mPixelFormat], mPixelFormat);
-		if(packetHeader & 0x80u)   // rle
-			for(; blockIter<blockSize; ++blockIter)
-				memcpy(dataPtr+blockIter*mPixelFormat, dataPtr, mPixelFormat);
-		else // raw
-			for(; blockIter<blockSize; ++blockIter)
-			{
-				fileStream.read(reinterpret_cast<GLchar*>(&index),
-				                bytesPerIndex);
-				memcpy( dataPtr+blockIter*mPixelFormat,
-				        &colourMap[index*mPixelFormat], 
-				        mPixelFormat );
-			}
-		// increment pixel ptr
-		dataPtr+=blockSize*mPixelFormat;
+		memcpy(out, in, mSize);
 	}
+private:
+	GLuint mSize;
+};
 
-	// flip if necessary
-	if(1==(header[17]>>5 & 0x01))
-		_Flip();
+class _TgaBgr16
+{
+public:
+	GLuint SourceSize() const {return 2;}
+	bool   IsCopy()     const {return false;}
+	void   operator()(const GLubyte* in, GLubyte* out) const
+	{
+		_tga_expand_bgr16(in, out);
+	}
+};
+
+class _TgaColourMap
+{
+public:
+	_TgaColourMap(const std::vector<GLubyte>& colours,
+	              GLuint first,
+	              GLuint indexSize,
+	              GLuint pixelSize):
+		mColours(colours), mFirst(first),
+		mIndexSize(indexSize), mPixelSize(pixelSize) {}
+	GLuint SourceSize() const {return mIndexSize;}
+	bool   IsCopy()     const {return false;}
+	void   operator()(const GLubyte* in, GLubyte* out) const
+		throw(FWException)
+	{
+		GLuint index = mIndexSize == 1 ? in[0] : _unpack_uint16(in[1], in[0]);
+		index-= mFirst; // indexes below the first entry wrap around
+		if(index >= mColours.size()/mPixelSize)
+			throw _TgaInvalidCmIndexException();
+		memcpy(out, &mColours[size_t(index)*mPixelSize], mPixelSize);
+	}
+private:
+	const std::vector<GLubyte>& mColours;
+	GLuint mFirst;
+	GLuint mIndexSize;
+	GLuint mPixelSize;
+};
 
-	// free memory
-	delete[] colourMap;
-}
 
 ////////////////////////////////////////////////////////////////////////////////
-// luminance images rle
-void Tga::_LoadLuminanceRle( std::ifstream& fileStream,
-                             GLchar* header) throw(FWException)
+// Image sink: writes the packets of walk_tga_packets to an image, row span by
+// row span. Raw packets are copied (or converted), and runs are converted
+// once and filled.
+template<typename Converter>
+class _TgaImageSink
 {
-	// set offset
-	GLuint offset = header[0]
-	              + header[1]
-	              *( _unpack_uint16(header[4], header[3])
-	              + _unpack_uint16(header[6], header[5])
-	              * (header[7]>>3) );
-	fileStream.seekg(offset, std::ifstream::cur);
+public:
+	_TgaImageSink(const Converter& convert,
+	              _TgaRowWriter& writer,
+	              GLuint pixelSize):
+		mConvert(convert), mWriter(writer), mPixelSize(pixelSize) {}
 
-	// read data depending on bits per pixel
-	if(header[16]==8 || header[16]==16)
+	void Run(const GLubyte* pixel, GLuint count) throw(FWException)
+	{
+		GLubyte value[4];
+		mConvert(pixel, value);
+		while(count > 0)
+		{
+			GLuint n = count;
+			GLubyte* pixels = mWriter.Span(n);
+			_tga_fill(pixels, value, n, mPixelSize);
+			mWriter.Advance(n);
+			count-= n;
+		}
+	}
+
+	void Raw(const GLubyte* data, GLuint count) throw(FWException)
 	{
-		mPixelFormat = header[16] >> 3;
-		mPixels      = new GLubyte[mWidth*mHeight*mPixelFormat];
-
-		// read rle
-		GLubyte* dataPtrMax = mPixels + mWidth*mHeight*mPixelFormat;
-		GLubyte* dataPtr = mPixels;
-		GLuint blockSize, blockIter;
-		GLubyte packetHeader = 0u;
-		while(dataPtr < dataPtrMax)
+		const GLuint sourceSize = mConvert.SourceSize();
+		while(count > 0)
 		{
-			// reset data block iterator
-			blockIter = 1u;
-			// read first byte
-			fileStream.read(reinterpret_cast<GLchar*>(&packetHeader), 1);
-			blockSize = 1u + (packetHeader & 0x7F);
-			fileStream.read(reinterpret_cast<GLchar*>(dataPtr), mPixelFormat);
-			if(packetHeader & 0x80u)   // rle
-				for(; blockIter<blockSize; ++blockIter)
-					memcpy( dataPtr+blockIter*mPixelFormat,
-					        dataPtr,
-					        mPixelFormat );
+			GLuint n = count;
+			GLubyte* pixels = mWriter.Span(n);
+			if(mConvert.IsCopy())
+				memcpy(pixels, data, size_t(n)*mPixelSize);
 			else
-				for(; blockIter<blockSize; ++blockIter)
-					fileStream.read( reinterpret_cast<GLchar*>(dataPtr
-					                                          +blockIter
-					                                          *mPixelFormat),
-					                 mPixelFormat );
-			// increment pixel ptr
-			dataPtr+=mPixelFormat*blockSize;
+				for(GLuint i=0; i<n; ++i)
+					mConvert(data + size_t(i)*sourceSize,
+					         pixels + size_t(i)*mPixelSize);
+			data+= size_t(n)*sourceSize;
+			mWriter.Advance(n);
+			count-= n;
 		}
 	}
+
+private:
+	const Converter& mConvert;
+	_TgaRowWriter&   mWriter;
+	GLuint           mPixelSize;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Decode the pixels of a file to an image of width*height pixels
+template<typename Converter>
+static void _tga_decode(const GLubyte* data,
+                        const GLubyte* end,
+                        bool isRle,
+                        const Converter& convert,
+                        _TgaRowWriter& writer,
+                        GLuint pixelSize) throw(FWException)
+{
+	_TgaImageSink<Converter> sink(convert, writer, pixelSize);
+	if(!walk_tga_packets(data, end, isRle, convert.SourceSize(),
+	                     writer.Remaining(), sink))
+		throw _TgaTruncatedDataException();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Tga implementation
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+////////////////////////////////////////////////////////////////////////////////
+// colour mapped images
+void Tga::_LoadColourMapped( const GLubyte* data,
+                             size_t size ) throw(FWException)
+{
+	// get colourMap indexes
+	GLuint indexSize = data[16]>>3;
+	if(indexSize<1 || indexSize>2)
+		throw _TgaInvalidBppValueException();
+
+	// check cm size
+	GLuint colourMapFirst = _unpack_uint16(data[4], data[3]);
+	GLuint colourMapSize  = _unpack_uint16(data[6], data[5]);
+	if(data[1] == 0 || colourMapSize < 1)
+		throw _TgaInvalidCmSizeException();
+
+	// read the colour map (16 bits colours are converted to bgr)
+	GLuint entrySize = (data[7]+7)>>3;
+	if(entrySize<2 || entrySize>4)
+		throw _TgaInvalidBppValueException();
+	mPixelFormat = entrySize == 2 ? GLint(PIXEL_FORMAT_BGR) : GLint(entrySize);
+	if(_tga_pixel_offset(data) > size)
+		throw _TgaTruncatedDataException();
+	std::vector<GLubyte> colours(size_t(colourMapSize)*mPixelFormat);
+	const GLubyte* entries = data + _tga_colour_map_offset(data);
+	if(entrySize == 2)
+		for(GLuint i=0; i<colourMapSize; ++i)
+			_tga_expand_bgr16(entries + i*2, &colours[i*3]);
+	else
+		memcpy(&colours[0], entries, colours.size());
+
+	// decode
+	mPixels = new GLubyte[size_t(mWidth)*mHeight*mPixelFormat];
+	_TgaRowWriter writer(mPixels, mWidth, mHeight, mPixelFormat,
+	                     1==(data[17]>>5 & 0x01));
+	_tga_decode(data + _tga_pixel_offset(data), data + size,
+	            data[2]==_TGA_TYPE_CM_RLE,
+	            _TgaColourMap(colours, colourMapFirst, indexSize, mPixelFormat),
+	            writer, mPixelFormat);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// luminance images
+void Tga::_LoadLuminance( const GLubyte* data,
+                          size_t size ) throw(FWException)
+{
+	// read data depending on bits per pixel
+	if(data[16]==8 || data[16]==16)
+		mPixelFormat = data[16] >> 3;
 	else
 		throw _TgaInvalidBppValueException();
+	if(_tga_pixel_offset(data) > size)
+		throw _TgaTruncatedDataException();
+
+	// decode
+	mPixels = new GLubyte[size_t(mWidth)*mHeight*mPixelFormat];
+	_TgaRowWriter writer(mPixels, mWidth, mHeight, mPixelFormat,
+	                     1==(data[17]>>5 & 0x01));
+	_tga_decode(data + _tga_pixel_offset(data), data + size,
+	            data[2]==_TGA_TYPE_LUMINANCE_RLE,
+	            _TgaCopy(mPixelFormat), writer, mPixelFormat);
+}
+
 
-	// flip if necessary
-	if(1==(header[17]>>5 & 0x01))
-		_Flip();
+////////////////////////////////////////////////////////////////////////////////
+// unmapped images (16 bits images are converted to bgr)
+void Tga::_LoadUnmapped( const GLubyte* data,
+                         size_t size ) throw(FWException)
+{
+	// read data depending on bits per pixel
+	if(data[16]==16 || data[16]==15)
+		mPixelFormat = PIXEL_FORMAT_BGR;
+	else if(data[16]==24 || data[16]==32)
+		mPixelFormat = data[16] >> 3;
+	else
+		throw _TgaInvalidBppValueException();
+	if(_tga_pixel_offset(data) > size)
+		throw _TgaTruncatedDataException();
+
+	// decode
+	mPixels = new GLubyte[size_t(mWidth)*mHeight*mPixelFormat];
+	_TgaRowWriter writer(mPixels, mWidth, mHeight, mPixelFormat,
+	                     1==(data[17]>>5 & 0x01));
+	const GLubyte* pixels = data + _tga_pixel_offset(data);
+	const bool isRle = data[2]==_TGA_TYPE_RGB_RLE;
+	if(data[16]==24 || data[16]==32)
+		_tga_decode(pixels, data + size, isRle,
+		            _TgaCopy(mPixelFormat), writer, mPixelFormat);
+	else
+		_tga_decode(pixels, data + size, isRle,
+		            _TgaBgr16(), writer, mPixelFormat);
 }
 
 
@@ -1347,46 +2264,50 @@ void Tga::Load(const std::string& filename) throw(FWException)
 	if(!fileStream)
 		throw _FileNotFoundException(filename);
 
-	// read header
-	GLchar header[18];   // header is 18 bytes
-	fileStream.read(reinterpret_cast<char*>(header), 18);
+	// read the whole file
+	fileStream.seekg(0, std::ifstream::end);
+	std::vector<GLubyte> data(std::max(size_t(fileStream.tellg()),
+	                                   _TGA_HEADER_SIZE));
+	fileStream.seekg(0, std::ifstream::beg);
+	fileStream.read(reinterpret_cast<GLchar*>(&data[0]), data.size());
+	if(fileStream.gcount() < std::streamsize(_TGA_HEADER_SIZE))
+		throw _TgaLoaderException(filename, "Invalid TGA header.");
+	fileStream.close();
+	const size_t size = size_t(fileStream.gcount());
 
 	// get data
-	mWidth  = _unpack_uint16(header[13],header[12]);
-	mHeight = _unpack_uint16(header[15],header[14]);
+	mWidth  = _unpack_uint16(data[13],data[12]);
+	mHeight = _unpack_uint16(data[15],data[14]);
 
 	// check image dimensions and pixel data
 	if(0 == mWidth * mHeight)
 		throw _TgaLoaderException(filename, "Invalid TGA dimensions.");
 
 	// load data according to image type code
+	if(data[2]!=_TGA_TYPE_RGB && data[2]!=_TGA_TYPE_RGB_RLE
+	   && data[2]!=_TGA_TYPE_CM && data[2]!=_TGA_TYPE_CM_RLE
+	   && data[2]!=_TGA_TYPE_LUMINANCE && data[2]!=_TGA_TYPE_LUMINANCE_RLE)
+		throw _TgaLoaderException(filename, "Unknown TGA image type code.");
 	try
 	{
-		if(header[2]==_TGA_TYPE_RGB)
-			_LoadUnmapped(fileStream, header);
-		else if(header[2]==_TGA_TYPE_CM)
-			_LoadColourMapped(fileStream, header);
-		else if(header[2]==_TGA_TYPE_LUMINANCE)
-			_LoadLuminance(fileStream, header);
-		else if(header[2]==_TGA_TYPE_CM_RLE)
-			_LoadColourMappedRle(fileStream, header);
-		else if(header[2]==_TGA_TYPE_RGB_RLE)
-			_LoadUnmappedRle(fileStream, header);
-		else if(header[2]==_TGA_TYPE_LUMINANCE_RLE)
-			_LoadLuminanceRle(fileStream, header);
-		else
-			throw _TgaLoaderException(filename, "Unknown TGA image type code.");
+		if(data[2]==_TGA_TYPE_RGB || data[2]==_TGA_TYPE_RGB_RLE)
+			_LoadUnmapped(&data[0], size);
+		else if(data[2]==_TGA_TYPE_CM || data[2]==_TGA_TYPE_CM_RLE)
+			_LoadColourMapped(&data[0], size);
+		else if(data[2]==_TGA_TYPE_LUMINANCE
+		        || data[2]==_TGA_TYPE_LUMINANCE_RLE)
+			_LoadLuminance(&data[0], size);
 	}
 	catch(FWException& e)
 	{
+		_Clear();
 		throw _TgaLoaderException(filename, e.what());
 	}
 	catch(...)
 	{
+		_Clear();
 		throw _TgaLoaderException(filename, "Unknown error occured.");
 	}
-
-	fileStream.close();
 }
 
 
@@ -1443,3 +2364,215 @@ GLubyte* Tga::Pixels()   const {return mPixels;}
 
 } // namespace fw
 
+
+
+// Benchmark of the TGA loader on large rle images
+// (build with -DTGA_BENCHMARK Framework.cpp Trace.cpp and the OpenGL
+// libraries)
+#ifdef TGA_BENCHMARK
+#include <cstdio>
+#include <cstdlib>
+
+// reference: the stream loader (one read per packet and per raw pixel,
+// one copy per run pixel, flip pass)
+static GLubyte* _load_rle_stream(const std::string& filename)
+{
+	std::ifstream fileStream( filename.c_str(),
+	                          std::ifstream::in | std::ifstream::binary );
+	GLchar header[18];
+	fileStream.read(header, 18);
+	GLuint width  = fw::_unpack_uint16(header[13],header[12]);
+	GLuint height = fw::_unpack_uint16(header[15],header[14]);
+	GLuint pixelFormat = GLubyte(header[16]) >> 3;
+	fileStream.seekg(GLubyte(header[0]), std::ifstream::cur);
+	GLubyte* pixels = new GLubyte[width*height*pixelFormat];
+	GLubyte* dataPtrMax = pixels + width*height*pixelFormat;
+	GLubyte* dataPtr = pixels;
+	GLubyte packetHeader = 0u;
+	while(dataPtr < dataPtrMax)
+	{
+		fileStream.read(reinterpret_cast<GLchar*>(&packetHeader), 1);
+		GLuint blockSize = 1u + (packetHeader & 0x7F);
+		fileStream.read(reinterpret_cast<GLchar*>(dataPtr), pixelFormat);
+		for(GLuint blockIter=1; blockIter<blockSize; ++blockIter)
+			if(packetHeader & 0x80u)
+				memcpy(dataPtr+blockIter*pixelFormat, dataPtr, pixelFormat);
+			else
+				fileStream.read(reinterpret_cast<GLchar*>(dataPtr
+				                                         +blockIter
+				                                         *pixelFormat),
+				                pixelFormat);
+		dataPtr+= pixelFormat*blockSize;
+	}
+	if(header[17]>>5 & 0x01)
+	{
+		GLubyte* flipped = new GLubyte[width*height*pixelFormat];
+		for(GLuint y=0; y<height; ++y)
+			for(GLuint x=0; x<width; ++x)
+				memcpy(&flipped[(y*width+x)*pixelFormat],
+				       &pixels[((height-1-y)*width+x)*pixelFormat],
+				       pixelFormat);
+		delete[] pixels;
+		pixels = flipped;
+	}
+	return pixels;
+}
+
+// write a top origin rle image: runs of random lengths, one packet in
+// four is raw (noise)
+static void _write_rle(const std::string& filename,
+                       GLuint size,
+                       GLuint pixelFormat,
+                       GLuint maxRun)
+{
+	std::ofstream file(filename.c_str(), std::ios::out | std::ios::binary);
+	const GLchar header[18] =
+	{
+		0, 0, fw::_TGA_TYPE_RGB_RLE, 0,0,0,0,0, 0,0, 0,0,
+		GLchar(size & 255), GLchar(size >> 8),
+		GLchar(size & 255), GLchar(size >> 8),
+		GLchar(pixelFormat << 3), 0x20
+	};
+	file.write(header, 18);
+	std::srand(1);
+	for(size_t left = size_t(size)*size; left > 0; )
+	{
+		GLuint count = std::min(size_t(1 + std::rand() % maxRun),
+		                        std::min(left, size_t(128)));
+		bool isRaw = std::rand() % 4 == 0;
+		file.put(GLchar((isRaw ? 0 : 0x80) | (count-1)));
+		for(GLuint i=0; i<(isRaw ? count : 1); ++i)
+			for(GLuint c=0; c<pixelFormat; ++c)
+				file.put(GLchar(std::rand()));
+		left-= count;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const GLuint SIZE = 4096;
+	const GLuint RUN_COUNT = 5;
+	const GLuint MAX_RUNS[] = {4, 128};
+	const std::string filename = "tga_benchmark.tga";
+
+	for(GLuint pixelFormat=3; pixelFormat<=4; ++pixelFormat)
+	for(GLuint r=0; r<2; ++r)
+	{
+		_write_rle(filename, SIZE, pixelFormat, MAX_RUNS[r]);
+		fw::TimerStatistics stream, buffered;
+		bool isEqual = true;
+		for(GLuint i=0; i<RUN_COUNT; ++i)
+		{
+			GLubyte* reference = NULL;
+			fw::Tga tga;
+			{
+				fw::ScopedTimer timer(stream);
+				reference = _load_rle_stream(filename);
+			}
+			{
+				fw::ScopedTimer timer(buffered);
+				tga.Load(filename);
+			}
+			isEqual = isEqual && 0 == memcmp(reference, tga.Pixels(),
+			                                 size_t(SIZE)*SIZE*pixelFormat);
+			delete[] reference;
+		}
+		std::printf("%ux%u, %u bytes per pixel, runs up to %3u (check %s)\n",
+		            SIZE, SIZE, pixelFormat, MAX_RUNS[r],
+		            isEqual ? "ok" : "FAILED");
+		std::printf("  stream:   %8.3f ms (min %8.3f ms)\n",
+		            stream.Mean()*1e-6, stream.Min()*1e-6);
+		std::printf("  buffered: %8.3f ms (min %8.3f ms)\n",
+		            buffered.Mean()*1e-6, buffered.Min()*1e-6);
+	}
+	std::remove(filename.c_str());
+	return 0;
+}
+#endif // TGA_BENCHMARK
+
+
+// Tests of the array half conversions against the scalar ones, on every
+// half and every float
+// (build with -DHALF_TEST Framework.cpp Trace.cpp and the OpenGL libraries,
+// with and without -mf16c)
+#ifdef HALF_TEST
+#include <cstdio>
+#include <cstdlib>
+
+// converts the floats with the bits [first, first+count) and compares with
+// the scalar conversion (returns the number of failures)
+static GLuint _check_float_to_half(GLuint64 first, size_t count,
+                                   std::vector<GLfloat>& floats,
+                                   std::vector<GLhalf>& halfs)
+{
+	GLuint failures = 0;
+	for(size_t i=0; i<count; ++i)
+	{
+		GLuint bits = GLuint(first + i);
+		memcpy(&floats[i], &bits, sizeof(GLuint));
+	}
+	fw::float_to_half_array(&floats[0], &halfs[0], count);
+	for(size_t i=0; i<count; ++i)
+		if(fw::float_to_half(floats[i]) != halfs[i])
+			if(++failures <= 10)
+				std::fprintf(stderr, "float_to_half_array failed on 0x%08x\n",
+				             GLuint(first + i));
+	return failures;
+}
+
+// converts the halfs [first, first+count) and compares the bits with the
+// scalar conversion (NaN payloads must be kept)
+static GLuint _check_half_to_float(size_t first, size_t count,
+                                   std::vector<GLhalf>& halfs,
+                                   std::vector<GLfloat>& floats)
+{
+	GLuint failures = 0;
+	for(size_t i=0; i<count; ++i)
+		halfs[i] = GLhalf(first + i);
+	fw::half_to_float_array(&halfs[0], &floats[0], count);
+	for(size_t i=0; i<count; ++i)
+	{
+		GLfloat f = fw::half_to_float(halfs[i]);
+		if(0 != memcmp(&f, &floats[i], sizeof(GLfloat)))
+			if(++failures <= 10)
+				std::fprintf(stderr, "half_to_float_array failed on 0x%04x\n",
+				             GLuint(halfs[i]));
+	}
+	return failures;
+}
+
+int main(int argc, char **argv)
+{
+	const size_t CHUNK_SIZE = 65536;
+	const GLuint64 FLOAT_COUNT = GLuint64(1) << 32;
+	std::vector<GLhalf>  halfs(CHUNK_SIZE);
+	std::vector<GLfloat> floats(CHUNK_SIZE);
+	GLuint failures = 0;
+
+	// every half and every float, the last chunk ends with the range
+	failures+= _check_half_to_float(0, CHUNK_SIZE, halfs, floats);
+	for(GLuint64 first=0; first<FLOAT_COUNT; first+=CHUNK_SIZE)
+		failures+= _check_float_to_half(first,
+		                                size_t(std::min(GLuint64(CHUNK_SIZE),
+		                                                FLOAT_COUNT - first)),
+		                                floats, halfs);
+
+	// odd counts exercise the scalar tail: consecutive chunks of 1 to 15
+	// elements around the special cases (denormals, overflow, infinities
+	// and NaNs), each value is converted
+	const GLuint FLOAT_CASES[] = {0x00000000u, 0x387fc000u, 0x477fe000u,
+	                              0x7f800000u, 0xff7ffff0u};
+	const GLuint HALF_CASES[]  = {0x0000u, 0x03f0u, 0x7bf0u, 0x7c00u, 0xfc00u};
+	for(size_t c=0; c<5; ++c)
+	for(size_t count=1, offset=0; count<16; offset+=count, ++count)
+	{
+		failures+= _check_float_to_half(FLOAT_CASES[c] + offset, count,
+		                                floats, halfs);
+		failures+= _check_half_to_float(HALF_CASES[c] + offset, count,
+		                                halfs, floats);
+	}
+
+	std::printf("%s (%u failures)\n", failures ? "FAILED" : "PASSED", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif // HALF_TEST
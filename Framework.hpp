@@ -7,12 +7,24 @@
 #ifndef FRAMEWORK_HPP
 #define FRAMEWORK_HPP
 
+#include <algorithm>
 #include <string>
 #include "glew.hpp"
 
 // offset for buffer objects
 #define FW_BUFFER_OFFSET(i)    ((char*)NULL + (i))
 
+// validate an OpenGL call (only in GL_ERROR_CHECK_MODE_DEBUG)
+#define FW_GL_CHECK(call) \
+	do { call; fw::check_gl_call(#call, __FILE__, __LINE__); } while(0)
+
+// thread local storage qualifier
+#ifdef _MSC_VER
+#	define FW_THREAD_LOCAL __declspec(thread)
+#else
+#	define FW_THREAD_LOCAL __thread
+#endif
+
 namespace fw 
 {
 	// Framework exception
@@ -37,10 +49,37 @@ namespace fw
 	                           GLboolean link ) throw(FWException);
 
 
-	// Check OpenGL errors (uses ARB_debug_output if available)
+	// OpenGL error checking modes
+	enum
+	{
+		// errors are reported by the ARB_debug_output callback only, so
+		// checks never synchronize with the driver (low severity messages
+		// are filtered out). Falls back to glGetError if the extension is
+		// not available or if the context is not a debug context.
+		GL_ERROR_CHECK_MODE_RELEASE = 0,
+		// glGetError round trip on every check and synchronous debug output
+		// with all messages enabled.
+		GL_ERROR_CHECK_MODE_DEBUG
+	};
+
+	// Set / get the error checking mode (can be changed at runtime)
+	GLvoid set_gl_error_check_mode(GLint mode);
+	GLint gl_error_check_mode();
+
+
+	// Check OpenGL errors (see error checking modes)
 	// (throws an exception if an error is detected)
 	GLvoid check_gl_error() throw(FWException);
 
+	// Check OpenGL errors after a call in debug mode (see FW_GL_CHECK)
+	GLvoid check_gl_call(const GLchar* call,
+	                     const GLchar* file,
+	                     GLint line) throw(FWException);
+
+
+	// Save the last debug output messages in a text file
+	GLvoid save_gl_debug_log(const std::string& filename) throw(FWException);
+
 
 	// Save a portion of the OpenGL front buffer (= take a screenshot).
 	// File will be a TGA in BGR format, uncompressed.
@@ -69,11 +108,47 @@ namespace fw
 	                                GLfloat w);
 	GLint pack_4fv_to_int_10_10_10_2(const GLfloat *v);
 
+	// Pack arrays of four floats (xyzw, interleaved)
+	// (same results as the functions above, uses SSE2 if available)
+	GLvoid pack_4fv_to_uint_10_10_10_2_array(const GLfloat *v,
+	                                         GLuint *packed,
+	                                         size_t count);
+	GLvoid pack_4fv_to_int_10_10_10_2_array(const GLfloat *v,
+	                                        GLint *packed,
+	                                        size_t count);
+
+	// Pack vertices in the compact vertex format (8 bytes per vertex)
+	// - position: GL_UNSIGNED_INT_2_10_10_10_REV, normalized, relative to
+	//   the brick, i.e. (position-brickOrigin)/brickSize (w is 0)
+	// - normal:   GL_INT_2_10_10_10_REV, normalized (w is 0)
+	// Positions and normals are xyz interleaved, normals may be NULL.
+	GLvoid pack_compact_vertices(const GLfloat *positions,
+	                             const GLfloat *normals,
+	                             size_t count,
+	                             const GLfloat *brickOrigin,
+	                             GLfloat brickSize,
+	                             GLuint *packed);
+
 
 	// Half to float conversion
 	GLhalf float_to_half(GLfloat f);
 	GLfloat half_to_float(GLhalf h);
 
+	// Half to float conversion of arrays
+	// (uses F16C if enabled at compile time, results are bit exact with
+	// the scalar conversions above)
+	GLvoid float_to_half_array(const GLfloat* floats,
+	                           GLhalf* halfs,
+	                           size_t count);
+	GLvoid half_to_float_array(const GLhalf* halfs,
+	                           GLfloat* floats,
+	                           size_t count);
+
+
+	// Monotonic clock, in nanoseconds
+	// (uses the time stamp counter if FW_TIMER_USE_RDTSC is defined)
+	GLuint64 get_nanoseconds();
+
 
 	// Basic timer class
 	class Timer
@@ -87,13 +162,193 @@ namespace fw
 		void Stop() ;
 
 		// Queries
-		double Ticks()   const;
+		double Ticks()         const; // in seconds
+		GLuint64 Nanoseconds() const;
 
 		// Members
 	private:
-		double mStartTicks;
-		double mStopTicks;
-		bool   mIsTicking;
+		GLuint64 mStartTicks;
+		GLuint64 mStopTicks;
+		bool     mIsTicking;
+	};
+
+
+	// Running statistics of time intervals
+	// Percentiles are estimated from a fixed size histogram with four
+	// buckets per power of two (relative error below 25%).
+	class TimerStatistics
+	{
+	public:
+		// Constants
+		enum {HISTOGRAM_SIZE = 64*4};
+
+		// Constructors / Destructor
+		TimerStatistics();
+
+		// Manipulation
+		void Add(GLuint64 nanoseconds);
+		void Merge(const TimerStatistics& statistics);
+		void Reset();
+
+		// Queries (in nanoseconds)
+		GLuint64 Count()                       const;
+		GLuint64 Min()                         const;
+		GLuint64 Max()                         const;
+		GLdouble Total()                       const;
+		GLdouble Mean()                        const;
+		GLdouble Variance()                    const;
+		GLdouble StandardDeviation()           const;
+		GLdouble Percentile(GLdouble percentile) const;
+
+	private:
+		// Members
+		GLuint64 mHistogram[HISTOGRAM_SIZE];
+		GLuint64 mCount;
+		GLuint64 mMin;
+		GLuint64 mMax;
+		GLdouble mMean;
+		GLdouble mM2;   // sum of squared differences to the mean
+	};
+
+
+	// Scoped timer: adds the lifetime of the object to a TimerStatistics
+	class ScopedTimer
+	{
+	public:
+		// Constructors / Destructor
+		explicit ScopedTimer(TimerStatistics& statistics);
+		~ScopedTimer();
+
+	private:
+		// Non copyable
+		ScopedTimer(const ScopedTimer& timer);
+		ScopedTimer& operator=(const ScopedTimer& timer);
+
+		// Members
+		TimerStatistics& mStatistics;
+		GLuint64         mStartTicks;
+	};
+
+
+	// GPU frame profiler
+	// Passes are bracketed with GL_TIMESTAMP queries, which are kept in a
+	// ring of FRAME_LATENCY frames so results are read back without stalling
+	// the pipeline. Frames whose results are not ready yet are dropped.
+	class FrameProfiler
+	{
+	public:
+		// Constants
+		enum
+		{
+			FRAME_LATENCY = 4,   // frames in flight
+			SAMPLE_COUNT  = 256  // samples kept per pass for statistics
+		};
+
+		// Constructors / Destructor
+		// (requires a valid OpenGL context)
+		explicit FrameProfiler(GLuint passCount);
+		~FrameProfiler();
+
+		// Manipulation
+		void SetPassName(GLuint pass, const std::string& name);
+		void BeginFrame();
+		void EndFrame();
+		void BeginPass(GLuint pass);
+		void EndPass(GLuint pass);
+			// write statistics to a text file
+		void Dump(const std::string& filename) const throw(FWException);
+
+		// Queries (timings are in milliseconds)
+		GLuint PassCount()                                       const;
+		const std::string& PassName(GLuint pass)                 const;
+		GLuint PassSampleCount(GLuint pass)                      const;
+		GLfloat PassMin(GLuint pass)                             const;
+		GLfloat PassAverage(GLuint pass)                         const;
+		GLfloat PassPercentile(GLuint pass, GLfloat percentile)  const;
+
+	private:
+		// Non copyable
+		FrameProfiler(const FrameProfiler& profiler);
+		FrameProfiler& operator=(const FrameProfiler& profiler);
+
+		// Internal manipulation
+		void _Collect(GLuint frame);
+
+		// Members
+		std::string* mPassNames;
+		GLuint*      mQueries;      // begin/end pairs, per pass, per frame
+		GLboolean*   mIsIssued;     // per pass, per frame
+		GLfloat*     mSamples;      // SAMPLE_COUNT per pass (ring)
+		GLuint*      mSampleCounts; // per pass
+		GLuint       mPassCount;
+		GLuint       mFrame;
+	};
+
+
+	// Mutex (non recursive)
+	class Mutex
+	{
+	public:
+		// Constructors / Destructor
+		Mutex();
+		~Mutex();
+
+		// Manipulation
+		void Lock();
+		void Unlock();
+
+	private:
+		// Non copyable
+		Mutex(const Mutex& mutex);
+		Mutex& operator=(const Mutex& mutex);
+
+		// Members
+		void* mHandle; // os specific
+
+		friend class ConditionVariable;
+	};
+
+
+	// Condition variable
+	class ConditionVariable
+	{
+	public:
+		// Constructors / Destructor
+		ConditionVariable();
+		~ConditionVariable();
+
+		// Manipulation
+			// unlock the mutex (locked by the caller) until woken up, and
+			// lock it again (spurious wake ups happen, check the condition)
+		void Wait(Mutex& mutex);
+			// wake up all the waiting threads
+		void Broadcast();
+
+	private:
+		// Non copyable
+		ConditionVariable(const ConditionVariable& condition);
+		ConditionVariable& operator=(const ConditionVariable& condition);
+
+		// Members
+		void* mHandle; // os specific
+	};
+
+
+	// Scoped lock: locks a mutex for the lifetime of the object
+	class ScopedLock
+	{
+	public:
+		// Constructors / Destructor
+		explicit ScopedLock(Mutex& mutex);
+		~ScopedLock();
+
+	private:
+		// Non copyable
+		ScopedLock(const ScopedLock& lock);
+		ScopedLock& operator=(const ScopedLock& lock);
+
+		// Members
+		Mutex& mMutex;
 	};
 
 
@@ -133,13 +388,10 @@ namespace fw
 		Tga& operator=(const Tga& tga);
 
 		// Internal manipulation
-		void _Flip();
-		void _LoadColourMapped(std::ifstream&, GLchar*)    throw(FWException);
-		void _LoadLuminance(std::ifstream&, GLchar*)       throw(FWException);
-		void _LoadUnmapped(std::ifstream&, GLchar*)        throw(FWException);
-		void _LoadUnmappedRle(std::ifstream&, GLchar*)     throw(FWException);
-		void _LoadColourMappedRle(std::ifstream&, GLchar*) throw(FWException);
-		void _LoadLuminanceRle(std::ifstream&, GLchar*)    throw(FWException);
+			// decode the pixels of a file (raw or rle)
+		void _LoadColourMapped(const GLubyte*, size_t) throw(FWException);
+		void _LoadLuminance(const GLubyte*, size_t)    throw(FWException);
+		void _LoadUnmapped(const GLubyte*, size_t)     throw(FWException);
 		void _Clear();
 
 		// Members
@@ -149,6 +401,47 @@ namespace fw
 		GLint    mPixelFormat;
 	};
 
+
+	// Walk the pixel packets of a TGA image
+	// Packets of the pixel data [data, end[ are given to the sink in file
+	// order, until pixelCount pixels are walked: sink.Run(pixel, count) for
+	// a run of count copies of one pixel, sink.Raw(pixels, count) for count
+	// consecutive pixels (raw images are a single raw packet). Pixels are
+	// pixelSize bytes, the sink converts them (it may throw). Returns false
+	// if the data ends before the last pixel.
+	template<typename PixelSink>
+	bool walk_tga_packets(const GLubyte* data,
+	                      const GLubyte* end,
+	                      bool isRle,
+	                      GLuint pixelSize,
+	                      size_t pixelCount,
+	                      PixelSink& sink) throw(FWException)
+	{
+		while(pixelCount > 0)
+		{
+			GLuint count = GLuint(std::min(pixelCount, size_t(~0u)));
+			bool isRun = false;
+			if(isRle)
+			{
+				if(data >= end)
+					return false;
+				isRun = (data[0] & 0x80) != 0;
+				count = std::min(GLuint(1 + (data[0] & 0x7F)), count);
+				++data;
+			}
+			size_t packetSize = size_t(isRun ? 1 : count)*pixelSize;
+			if(size_t(end-data) < packetSize)
+				return false;
+			if(isRun)
+				sink.Run(data, count);
+			else
+				sink.Raw(data, count);
+			data+= packetSize;
+			pixelCount-= count;
+		}
+		return true;
+	}
+
 } // namespace fw
 
 #endif
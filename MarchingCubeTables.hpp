@@ -1,3 +1,14 @@
+// Marching cube tables (GPU Gems 3 conventions, see marchingCube.glsl)
+// Derived tables are precomputed literals, so all tables are read only
+// data that can be uploaded as is. Call marching_cube_tables_are_valid to
+// check the consistency of the tables (in debug builds).
+
+#ifndef MARCHING_CUBE_TABLES_HPP
+#define MARCHING_CUBE_TABLES_HPP
+
+#include "glew.hpp"
+#include <algorithm> // std::min std::max
+
 // number of faces to build depending on marching cube case
 // 256 entries
 const GLint CASE_TO_FACE_COUNT[] = {
@@ -297,3 +308,216 @@ const GLint EDGE_CONNECT_LIST[] = {
 };
 
 
+// vertex pair of each edge
+// 12*2 entries
+const GLint EDGE_TO_VERTICES[] = {
+	0, 1,   1, 2,   2, 3,   0, 3,
+	4, 5,   5, 6,   6, 7,   4, 7,
+	0, 4,   1, 5,   2, 6,   3, 7
+};
+
+// offset of each vertex from the lower corner of the voxel
+// 8*3 entries
+const GLint VERTEX_OFFSETS[] = {
+	1, 0, 0,   1, 0, 1,   1, 1, 1,   1, 1, 0,
+	0, 0, 0,   0, 0, 1,   0, 1, 1,   0, 1, 0
+};
+
+// vertices of each face, counter clockwise seen from the outside
+// 6*4 entries
+const GLint FACE_TO_VERTICES[] = {
+	0, 3, 2, 1,   4, 5, 6, 7,   0, 1, 5, 4,
+	3, 7, 6, 2,   0, 4, 7, 3,   1, 2, 6, 5
+};
+
+// edges of each face, edge i joins vertices i and i+1 of FACE_TO_VERTICES
+// 6*4 entries
+const GLint FACE_TO_EDGES[] = {
+	 3,  2,  1,  0,    4,  5,  6,  7,    0,  9,  4,  8,
+	11,  6, 10,  2,    8,  7, 11,  3,    1, 10,  5,  9
+};
+
+// packed face construction table
+// the three edges of a face are stored on 4 bits each (e0 | e1<<4 | e2<<8),
+// faces of case c are in [CASE_TO_FACE_OFFSET[c], CASE_TO_FACE_OFFSET[c+1])
+// (2154 bytes with the offsets, fits in L1)
+// 820 entries
+const GLushort FACE_EDGES_PACKED[] = {
+	0x380, 0x910, 0x381, 0x189, 0xA21, 0x380, 0xA21, 0xA29, 0x920, 0x382,
+	0x8A2, 0x89A, 0x2B3, 0x2B0, 0x0B8, 0x091, 0xB32, 0x2B1, 0xB91, 0xB89,
+	0x1A3, 0x3AB, 0x1A0, 0xA80, 0xAB8, 0x093, 0x9B3, 0x9AB, 0xA89, 0xB8A,
+	0x874, 0x034, 0x437, 0x910, 0x748, 0x914, 0x174, 0x137, 0xA21, 0x748,
+	0x743, 0x403, 0xA21, 0xA29, 0x209, 0x748, 0x9A2, 0x792, 0x372, 0x497,
+	0x748, 0x2B3, 0x74B, 0x42B, 0x402, 0x109, 0x748, 0xB32, 0xB74, 0xB49,
+	0x2B9, 0x129, 0x1A3, 0xAB3, 0x487, 0xAB1, 0xB41, 0x401, 0x4B7, 0x874,
+	0xB09, 0xAB9, 0x30B, 0xB74, 0x9B4, 0xAB9, 0x459, 0x459, 0x380, 0x450,
+	0x051, 0x458, 0x538, 0x513, 0xA21, 0x459, 0x803, 0xA21, 0x594, 0xA25,
+	0x245, 0x204, 0x5A2, 0x523, 0x453, 0x843, 0x459, 0xB32, 0x2B0, 0xB80,
+	0x594, 0x450, 0x510, 0xB32, 0x512, 0x852, 0xB82, 0x584, 0xB3A, 0x31A,
+	0x459, 0x594, 0x180, 0x1A8, 0xAB8, 0x045, 0xB05, 0xAB5, 0x30B, 0x845,
+	0xA85, 0xB8A, 0x879, 0x975, 0x039, 0x359, 0x375, 0x870, 0x710, 0x751,
+	0x351, 0x753, 0x879, 0x759, 0x21A, 0x21A, 0x059, 0x035, 0x375, 0x208,
+	0x528, 0x758, 0x25A, 0x5A2, 0x352, 0x753, 0x597, 0x987, 0x2B3, 0x759,
+	0x279, 0x029, 0xB72, 0xB32, 0x810, 0x871, 0x751, 0x12B, 0x71B, 0x517,
+	0x859, 0x758, 0x31A, 0xB3A, 0x075, 0x905, 0x0B7, 0xA01, 0x0AB, 0x0AB,
+	0x30B, 0x05A, 0x708, 0x075, 0x5AB, 0x5B7, 0x56A, 0x380, 0x6A5, 0x109,
+	0x6A5, 0x381, 0x891, 0x6A5, 0x561, 0x162, 0x561, 0x621, 0x803, 0x569,
+	0x609, 0x620, 0x895, 0x285, 0x625, 0x823, 0xB32, 0x56A, 0x80B, 0x02B,
+	0x56A, 0x910, 0xB32, 0x6A5, 0x6A5, 0x291, 0x2B9, 0xB89, 0xB36, 0x356,
+	0x315, 0xB80, 0x5B0, 0x150, 0x6B5, 0x6B3, 0x630, 0x560, 0x950, 0x956,
+	0xB96, 0x89B, 0x6A5, 0x874, 0x034, 0x374, 0xA56, 0x091, 0x6A5, 0x748,
+	0x56A, 0x791, 0x371, 0x497, 0x216, 0x156, 0x874, 0x521, 0x625, 0x403,
+	0x743, 0x748, 0x509, 0x560, 0x620, 0x937, 0x497, 0x923, 0x695, 0x962,
+	0x2B3, 0x487, 0x56A, 0x6A5, 0x274, 0x024, 0xB72, 0x910, 0x874, 0xB32,
+	0x6A5, 0x129, 0x2B9, 0xB49, 0x4B7, 0x6A5, 0x748, 0x5B3, 0x153, 0x6B5,
+	0xB15, 0x6B5, 0xB01, 0x4B7, 0xB40, 0x950, 0x560, 0x630, 0x36B, 0x748,
+	0x956, 0xB96, 0x974, 0x9B7, 0x94A, 0xA46, 0x6A4, 0xA94, 0x380, 0x10A,
+	0x06A, 0x046, 0x138, 0x618, 0x468, 0xA16, 0x941, 0x421, 0x462, 0x803,
+	0x921, 0x942, 0x462, 0x420, 0x624, 0x238, 0x428, 0x624, 0x94A, 0x46A,
+	0x32B, 0x280, 0xB82, 0xA94, 0x6A4, 0x2B3, 0x610, 0x460, 0xA16, 0x146,
+	0xA16, 0x184, 0xB12, 0x1B8, 0x469, 0x639, 0x319, 0x36B, 0x1B8, 0x018,
+	0x16B, 0x419, 0x146, 0x6B3, 0x063, 0x460, 0x846, 0x86B, 0x6A7, 0xA87,
+	0xA98, 0x370, 0x7A0, 0xA90, 0xA76, 0x76A, 0x7A1, 0x871, 0x081, 0x76A,
+	0x17A, 0x371, 0x621, 0x861, 0x981, 0x768, 0x962, 0x192, 0x976, 0x390,
+	0x937, 0x087, 0x607, 0x206, 0x237, 0x276, 0xB32, 0x86A, 0x98A, 0x768,
+	0x702, 0xB72, 0x790, 0xA76, 0x7A9, 0x081, 0x871, 0x7A1, 0xA76, 0xB32,
+	0x12B, 0x71B, 0x16A, 0x176, 0x698, 0x768, 0x619, 0x36B, 0x631, 0x190,
+	0x76B, 0x087, 0x607, 0x0B3, 0x06B, 0x6B7, 0xB67, 0x803, 0x67B, 0x910,
+	0x67B, 0x918, 0x138, 0x67B, 0x21A, 0x7B6, 0xA21, 0x803, 0x7B6, 0x092,
+	0x9A2, 0x7B6, 0x7B6, 0x3A2, 0x38A, 0x89A, 0x327, 0x726, 0x807, 0x067,
+	0x026, 0x672, 0x732, 0x910, 0x261, 0x681, 0x891, 0x678, 0x67A, 0x71A,
+	0x731, 0x67A, 0xA71, 0x781, 0x801, 0x730, 0xA70, 0x9A0, 0x7A6, 0xA67,
+	0x8A7, 0x9A8, 0x486, 0x68B, 0xB63, 0x603, 0x640, 0xB68, 0x648, 0x109,
+	0x649, 0x369, 0x139, 0x63B, 0x486, 0x8B6, 0x1A2, 0xA21, 0xB03, 0xB60,
+	0x640, 0x8B4, 0xB64, 0x920, 0x9A2, 0x39A, 0x23A, 0x349, 0x63B, 0x364,
+	0x328, 0x248, 0x264, 0x240, 0x264, 0x091, 0x432, 0x642, 0x834, 0x491,
+	0x241, 0x642, 0x318, 0x168, 0x648, 0x1A6, 0x01A, 0x60A, 0x406, 0x364,
+	0x834, 0x3A6, 0x930, 0x39A, 0x49A, 0x4A6, 0x594, 0xB67, 0x380, 0x594,
+	0x67B, 0x105, 0x045, 0xB67, 0x67B, 0x438, 0x453, 0x513, 0x459, 0x21A,
+	0xB67, 0x7B6, 0xA21, 0x380, 0x594, 0xB67, 0xA45, 0xA24, 0x204, 0x843,
+	0x453, 0x523, 0x25A, 0x67B, 0x327, 0x267, 0x945, 0x459, 0x680, 0x260,
+	0x786, 0x263, 0x673, 0x051, 0x045, 0x826, 0x786, 0x812, 0x584, 0x851,
+	0x459, 0x61A, 0x671, 0x731, 0xA61, 0x671, 0x701, 0x078, 0x459, 0xA04,
+	0x5A4, 0xA30, 0x7A6, 0xA73, 0xA67, 0x8A7, 0xA45, 0xA84, 0x596, 0x9B6,
+	0x98B, 0xB63, 0x360, 0x650, 0x590, 0x8B0, 0xB50, 0x510, 0xB65, 0x3B6,
+	0x536, 0x135, 0xA21, 0xB59, 0x8B9, 0x65B, 0x3B0, 0xB60, 0x690, 0x965,
+	0xA21, 0x58B, 0x65B, 0x508, 0x25A, 0x520, 0x3B6, 0x536, 0x3A2, 0x35A,
+	0x985, 0x825, 0x265, 0x283, 0x659, 0x069, 0x260, 0x851, 0x081, 0x865,
+	0x283, 0x826, 0x651, 0x612, 0x631, 0xA61, 0x683, 0x965, 0x698, 0x01A,
+	0x60A, 0x059, 0x065, 0x830, 0xA65, 0x65A, 0xA5B, 0xB57, 0xA5B, 0x57B,
+	0x038, 0x7B5, 0xBA5, 0x091, 0x57A, 0x7BA, 0x189, 0x138, 0x21B, 0x17B,
+	0x157, 0x380, 0x721, 0x571, 0xB27, 0x579, 0x729, 0x209, 0x7B2, 0x257,
+	0xB27, 0x295, 0x823, 0x289, 0xA52, 0x532, 0x573, 0x028, 0x258, 0x578,
+	0x52A, 0x109, 0x3A5, 0x735, 0x2A3, 0x289, 0x129, 0x278, 0x52A, 0x257,
+	0x531, 0x573, 0x780, 0x170, 0x571, 0x309, 0x539, 0x735, 0x789, 0x795,
+	0x485, 0x8A5, 0x8BA, 0x405, 0x0B5, 0xBA5, 0x03B, 0x910, 0xA48, 0xBA8,
+	0x54A, 0x4BA, 0x54A, 0x43B, 0x149, 0x413, 0x152, 0x582, 0x8B2, 0x854,
+	0xB40, 0x3B0, 0xB54, 0x1B2, 0xB15, 0x520, 0x950, 0x5B2, 0x854, 0x58B,
+	0x549, 0x3B2, 0xA52, 0x253, 0x543, 0x483, 0x2A5, 0x425, 0x024, 0x2A3,
+	0xA53, 0x583, 0x854, 0x910, 0x2A5, 0x425, 0x291, 0x249, 0x548, 0x358,
+	0x153, 0x540, 0x501, 0x548, 0x358, 0x509, 0x530, 0x549, 0x7B4, 0xB94,
+	0xBA9, 0x380, 0x794, 0x7B9, 0xBA9, 0xBA1, 0x4B1, 0x041, 0xB47, 0x413,
+	0x843, 0x4A1, 0xB47, 0x4BA, 0x7B4, 0x4B9, 0xB29, 0x219, 0x479, 0x7B9,
+	0xB19, 0x1B2, 0x380, 0x47B, 0x24B, 0x042, 0x47B, 0x24B, 0x438, 0x423,
+	0xA92, 0x972, 0x732, 0x947, 0x7A9, 0x479, 0x72A, 0x078, 0x702, 0xA73,
+	0x2A3, 0xA47, 0x0A1, 0xA04, 0x2A1, 0x478, 0x194, 0x714, 0x317, 0x194,
+	0x714, 0x180, 0x178, 0x304, 0x347, 0x784, 0x8A9, 0x8BA, 0x903, 0xB93,
+	0xA9B, 0xA10, 0x8A0, 0xBA8, 0xA13, 0xA3B, 0xB21, 0x9B1, 0x8B9, 0x903,
+	0xB93, 0x921, 0x9B2, 0xB20, 0xB08, 0xB23, 0x832, 0xA82, 0x98A, 0x2A9,
+	0x290, 0x832, 0xA82, 0x810, 0x8A1, 0x2A1, 0x831, 0x819, 0x190, 0x830
+};
+
+// offset of the first face of each case in FACE_EDGES_PACKED
+// 257 entries
+const GLushort CASE_TO_FACE_OFFSET[] = {
+	   0,    0,    1,    2,    4,    5,    7,    9,   12,   13,
+	  15,   17,   20,   22,   25,   28,   30,   31,   33,   35,
+	  38,   40,   43,   46,   50,   52,   55,   58,   62,   65,
+	  69,   73,   76,   77,   79,   81,   84,   86,   89,   92,
+	  96,   98,  101,  104,  108,  111,  115,  119,  122,  124,
+	 127,  130,  132,  135,  139,  143,  146,  149,  153,  157,
+	 160,  164,  169,  174,  176,  177,  179,  181,  184,  186,
+	 189,  192,  196,  198,  201,  204,  208,  211,  215,  219,
+	 222,  224,  227,  230,  234,  237,  241,  245,  250,  253,
+	 257,  261,  266,  270,  275,  280,  284,  286,  289,  292,
+	 296,  299,  303,  305,  308,  311,  315,  319,  324,  328,
+	 333,  336,  338,  341,  345,  349,  352,  356,  361,  364,
+	 366,  370,  375,  380,  384,  389,  391,  395,  396,  397,
+	 399,  401,  404,  406,  409,  412,  416,  418,  421,  424,
+	 428,  431,  435,  439,  442,  444,  447,  450,  454,  457,
+	 461,  465,  470,  473,  475,  479,  482,  486,  489,  494,
+	 496,  498,  501,  504,  508,  511,  515,  519,  524,  527,
+	 531,  535,  540,  544,  549,  554,  558,  561,  565,  569,
+	 572,  576,  581,  586,  590,  594,  597,  602,  604,  609,
+	 613,  615,  616,  618,  621,  624,  628,  631,  635,  639,
+	 644,  647,  651,  655,  660,  662,  665,  668,  670,  673,
+	 677,  681,  686,  690,  695,  700,  702,  706,  709,  714,
+	 718,  721,  723,  727,  728,  731,  735,  739,  744,  748,
+	 753,  756,  760,  764,  769,  774,  776,  779,  783,  785,
+	 786,  788,  791,  794,  796,  799,  803,  805,  806,  809,
+	 811,  815,  816,  818,  819,  820,  820
+};
+
+// size checks
+typedef char CASE_TO_FACE_COUNT_SIZE_CHECK
+	[sizeof(CASE_TO_FACE_COUNT) == 256*sizeof(GLint) ? 1 : -1];
+typedef char EDGE_CONNECT_LIST_SIZE_CHECK
+	[sizeof(EDGE_CONNECT_LIST) == 256*5*4*sizeof(GLint) ? 1 : -1];
+typedef char EDGE_TO_VERTICES_SIZE_CHECK
+	[sizeof(EDGE_TO_VERTICES) == 12*2*sizeof(GLint) ? 1 : -1];
+typedef char VERTEX_OFFSETS_SIZE_CHECK
+	[sizeof(VERTEX_OFFSETS) == 8*3*sizeof(GLint) ? 1 : -1];
+typedef char FACE_TO_VERTICES_SIZE_CHECK
+	[sizeof(FACE_TO_VERTICES) == 6*4*sizeof(GLint) ? 1 : -1];
+typedef char FACE_TO_EDGES_SIZE_CHECK
+	[sizeof(FACE_TO_EDGES) == 6*4*sizeof(GLint) ? 1 : -1];
+typedef char FACE_EDGES_PACKED_SIZE_CHECK
+	[sizeof(FACE_EDGES_PACKED) == 820*sizeof(GLushort) ? 1 : -1];
+typedef char CASE_TO_FACE_OFFSET_SIZE_CHECK
+	[sizeof(CASE_TO_FACE_OFFSET) == 257*sizeof(GLushort) ? 1 : -1];
+
+// check the consistency of the tables
+inline bool marching_cube_tables_are_valid() {
+	// edges join vertices one step apart along a single axis
+	for(GLint e=0; e<12; ++e) {
+		const GLint* v0 = &VERTEX_OFFSETS[EDGE_TO_VERTICES[e*2]*3];
+		const GLint* v1 = &VERTEX_OFFSETS[EDGE_TO_VERTICES[e*2+1]*3];
+		GLint distance = 0;
+		for(GLint a=0; a<3; ++a)
+			distance+= v0[a] != v1[a];
+		if(distance != 1)
+			return false;
+	}
+	// face edges join consecutive face vertices
+	for(GLint f=0; f<6; ++f)
+		for(GLint i=0; i<4; ++i) {
+			GLint e  = FACE_TO_EDGES[f*4+i];
+			GLint v0 = FACE_TO_VERTICES[f*4+i];
+			GLint v1 = FACE_TO_VERTICES[f*4+(i+1)%4];
+			if(   std::min(v0, v1) != EDGE_TO_VERTICES[e*2]
+			   || std::max(v0, v1) != EDGE_TO_VERTICES[e*2+1])
+				return false;
+		}
+	for(GLint c=0; c<256; ++c) {
+		if(CASE_TO_FACE_OFFSET[c+1]-CASE_TO_FACE_OFFSET[c]
+		   != CASE_TO_FACE_COUNT[c])
+			return false;
+		for(GLint f=0; f<5; ++f) {
+			const GLint* edges = &EDGE_CONNECT_LIST[(c*5+f)*4];
+			if(edges[3] != -1)
+				return false;
+			for(GLint i=0; i<3; ++i) {
+				// faces are valid up to the face count, unused afterwards
+				if((f < CASE_TO_FACE_COUNT[c]) != (edges[i] >= 0))
+					return false;
+			}
+			if(f < CASE_TO_FACE_COUNT[c]
+			   && FACE_EDGES_PACKED[CASE_TO_FACE_OFFSET[c]+f]
+			      != (edges[0] | edges[1]<<4 | edges[2]<<8))
+				return false;
+		}
+	}
+	return true;
+}
+
+#endif // MARCHING_CUBE_TABLES_HPP
@@ -0,0 +1,248 @@
+#include "Trace.hpp"
+#include "Atomic.hpp"
+
+#include <fstream> // std::ofstream
+#include <algorithm> // std::min
+
+namespace fw
+{
+////////////////////////////////////////////////////////////////////////////////
+// Exceptions
+//
+////////////////////////////////////////////////////////////////////////////////
+class _TraceFileException : public FWException
+{
+public:
+	_TraceFileException(const std::string& file)
+	{
+		mMessage = "Could not write trace file " + file + ".";
+	}
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Local data
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Event
+struct _TraceEvent
+{
+	const char* name;
+	const char* category;
+	GLuint64    begin;
+	GLuint64    end;
+};
+
+// Per thread event buffer
+// Single producer, single consumer ring: only the owning thread appends
+// (and advances head), only trace_write reads (and advances tail). The
+// counters are published with release stores and read with acquire loads,
+// so events can be written while threads are still recording. Buffers are
+// never freed.
+struct _TraceBuffer
+{
+	enum {CAPACITY = 16384}; // power of two
+
+	_TraceEvent     events[CAPACITY];
+	volatile GLuint head;         // events appended (modulo 2^32)
+	volatile GLuint tail;         // events written
+	volatile GLuint droppedCount; // events dropped (buffer full)
+	GLuint          writeHead;    // end of the events being written
+	GLuint          writtenDroppedCount; // dropped events already reported
+	GLuint          threadId;
+	_TraceBuffer*   next;
+};
+
+static volatile GLuint sIsRecording = 0;
+static _TraceBuffer* sBuffers     = NULL; // list of all buffers
+static GLuint sBufferCount        = 0;
+static Mutex& _buffers_mutex()
+{
+	static Mutex sMutex;
+	return sMutex;
+}
+
+static FW_THREAD_LOCAL _TraceBuffer* sThreadBuffer = NULL;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Local functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Get the buffer of the calling thread (registers it on first call)
+static _TraceBuffer* _thread_buffer()
+{
+	if(NULL == sThreadBuffer)
+	{
+		_TraceBuffer* buffer = new _TraceBuffer;
+		buffer->head                = 0;
+		buffer->tail                = 0;
+		buffer->droppedCount        = 0;
+		buffer->writtenDroppedCount = 0;
+
+		ScopedLock lock(_buffers_mutex());
+		buffer->threadId = ++sBufferCount;
+		buffer->next     = sBuffers;
+		sBuffers         = buffer;
+		sThreadBuffer    = buffer;
+	}
+	return sThreadBuffer;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Write a JSON string (names are literals, escape quotes and backslashes)
+static void _write_json_string(std::ofstream& fileStream, const char* string)
+{
+	fileStream << '"';
+	for(; *string; ++string)
+	{
+		if('"' == *string || '\\' == *string)
+			fileStream << '\\';
+		fileStream << *string;
+	}
+	fileStream << '"';
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Functions implementation
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Start / stop recording
+void trace_start()
+{
+	atomic_store(&sIsRecording, 1);
+}
+
+void trace_stop()
+{
+	atomic_store(&sIsRecording, 0);
+}
+
+bool trace_is_recording()
+{
+	return atomic_load(&sIsRecording) != 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Record an event
+void trace_event(const char* name,
+                 const char* category,
+                 GLuint64 begin,
+                 GLuint64 end)
+{
+	if(false == trace_is_recording())
+		return;
+
+	_TraceBuffer* buffer = _thread_buffer();
+	const GLuint head = buffer->head; // only written by this thread
+	if(head - atomic_load(&buffer->tail) == _TraceBuffer::CAPACITY)
+	{
+		atomic_store(&buffer->droppedCount, buffer->droppedCount + 1);
+		return;
+	}
+	_TraceEvent& event = buffer->events[head % _TraceBuffer::CAPACITY];
+	event.name     = name;
+	event.category = category;
+	event.begin    = begin;
+	event.end      = end;
+	atomic_store(&buffer->head, head + 1); // publish the event
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Write trace
+void trace_write(const std::string& filename) throw(FWException)
+{
+	trace_stop();
+
+	std::ofstream fileStream(filename.c_str());
+	if(!fileStream)
+		throw _TraceFileException(filename);
+
+	// events published so far (threads may still be recording, later
+	// events are left for the next write)
+	ScopedLock lock(_buffers_mutex());
+	GLuint64 origin = ~GLuint64(0);
+	for(_TraceBuffer* buffer = sBuffers; buffer; buffer = buffer->next)
+	{
+		buffer->writeHead = atomic_load(&buffer->head);
+		for(GLuint i=buffer->tail; i!=buffer->writeHead; ++i)
+			origin = std::min(origin,
+			                  buffer->events[i % _TraceBuffer::CAPACITY].begin);
+	}
+
+	// emit complete events (timestamps are in microseconds)
+	bool isFirst = true;
+	fileStream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	for(_TraceBuffer* buffer = sBuffers; buffer; buffer = buffer->next)
+	{
+		for(GLuint i=buffer->tail; i!=buffer->writeHead; ++i)
+		{
+			const _TraceEvent& event
+				= buffer->events[i % _TraceBuffer::CAPACITY];
+			if(false == isFirst)
+				fileStream << ",\n";
+			isFirst = false;
+			fileStream << "{\"name\":";
+			_write_json_string(fileStream, event.name);
+			fileStream << ",\"cat\":";
+			_write_json_string(fileStream, event.category);
+			fileStream << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+			           << ",\"ts\":" << (event.begin - origin) / 1000
+			           << '.' << (event.begin - origin) / 100 % 10
+			           << ",\"dur\":" << (event.end - event.begin) / 1000
+			           << '.' << (event.end - event.begin) / 100 % 10
+			           << '}';
+		}
+		const GLuint droppedCount = atomic_load(&buffer->droppedCount);
+		if(droppedCount != buffer->writtenDroppedCount)
+		{
+			if(false == isFirst)
+				fileStream << ",\n";
+			isFirst = false;
+			fileStream << "{\"name\":\"dropped events\",\"ph\":\"C\",\"pid\":1"
+			           << ",\"tid\":" << buffer->threadId << ",\"ts\":0"
+			           << ",\"args\":{\"count\":"
+			           << droppedCount - buffer->writtenDroppedCount
+			           << "}}";
+			buffer->writtenDroppedCount = droppedCount;
+		}
+		// release the written events to the recording thread
+		atomic_store(&buffer->tail, buffer->writeHead);
+	}
+	fileStream << "\n]}\n";
+	fileStream.close();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// TraceScope implementation
+//
+////////////////////////////////////////////////////////////////////////////////
+TraceScope::TraceScope(const char* name, const char* category) :
+	mName(name), mCategory(category),
+	mBegin(trace_is_recording() ? get_nanoseconds() : 0)
+{}
+
+TraceScope::~TraceScope()
+{
+	End();
+}
+
+void TraceScope::End()
+{
+	if(NULL != mName && 0 != mBegin)
+		trace_event(mName, mCategory, mBegin, get_nanoseconds());
+	mName = NULL;
+}
+
+} // namespace fw
+
@@ -0,0 +1,82 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   Trace.hpp
+// \author J Dupuy
+// \brief  Low overhead event tracing. Events are appended to thread local
+//         buffers without locking and written as Chrome trace JSON, which
+//         can be opened with chrome://tracing or ui.perfetto.dev.
+//         Notes:
+//         - recording is off until trace_start() is called
+//         - event names and categories must be string literals
+//         - define FW_TRACE_DISABLE to compile the FW_TRACE_* macros out
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include "Framework.hpp"
+
+// trace macros
+#ifndef FW_TRACE_DISABLE
+#	define _FW_TRACE_CONCAT_(a, b) a##b
+#	define _FW_TRACE_CONCAT(a, b)  _FW_TRACE_CONCAT_(a, b)
+#	define FW_TRACE_SCOPE(name, category) \
+		fw::TraceScope _FW_TRACE_CONCAT(fwTraceScope, __LINE__)(name, category)
+#	define FW_TRACE_BEGIN(variable, name, category) \
+		fw::TraceScope variable(name, category)
+#	define FW_TRACE_END(variable) variable.End()
+#else
+#	define FW_TRACE_SCOPE(name, category)
+#	define FW_TRACE_BEGIN(variable, name, category)
+#	define FW_TRACE_END(variable)
+#endif // FW_TRACE_DISABLE
+
+namespace fw
+{
+	// Start / stop recording
+	void trace_start();
+	void trace_stop();
+	bool trace_is_recording();
+
+
+	// Write the recorded events to a JSON file and clear the buffers.
+	// Recording is stopped. Threads may still be finishing events: the
+	// events they published before the call are written, the others are
+	// kept for the next write.
+	void trace_write(const std::string& filename) throw(FWException);
+
+
+	// Record a complete event (timestamps from fw::get_nanoseconds)
+	void trace_event(const char* name,
+	                 const char* category,
+	                 GLuint64 begin,
+	                 GLuint64 end);
+
+
+	// Scoped trace event
+	class TraceScope
+	{
+	public:
+		// Constructors / Destructor
+		TraceScope(const char* name, const char* category);
+		~TraceScope();
+
+		// Manipulation
+			// record the event now rather than on destruction
+		void End();
+
+	private:
+		// Non copyable
+		TraceScope(const TraceScope& scope);
+		TraceScope& operator=(const TraceScope& scope);
+
+		// Members
+		const char* mName;
+		const char* mCategory;
+		GLuint64    mBegin;
+	};
+
+} // namespace fw
+
+#endif
+
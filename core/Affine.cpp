@@ -163,6 +163,20 @@ Matrix4x4 Affine::ExtractInverseTransformMatrix() const
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+// Batch transformations
+void Affine::TransformArrays(float* x,
+                             float* y,
+                             float* z,
+                             float* nx,
+                             float* ny,
+                             float* nz,
+                             size_t count) const
+{
+	ExtractTransformMatrix().TransformArrays(x, y, z, nx, ny, nz, count);
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // Axis queries
 const Vector3& Affine::UnitXAxis() const { return mUnitAxis[0]; }
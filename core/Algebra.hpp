@@ -606,6 +606,18 @@ public:
 	Matrix4x4 Floor()  const;
 	Matrix4x4 Frac()   const;
 
+	// Batch transformations of structure of arrays (in place)
+	// Points are transformed by the upper 3x4 block (the last row is
+	// ignored). Normals are transformed by the inverse transpose of the upper
+	// 3x3 block, and normalized. Pass NULL normals to skip them.
+	void TransformArrays(float* x,
+	                     float* y,
+	                     float* z,
+	                     float* nx,
+	                     float* ny,
+	                     float* nz,
+	                     size_t count) const;
+
 	// Constants
 	static const Matrix4x4 IDENTITY;
 
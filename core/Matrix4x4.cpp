@@ -3,6 +3,16 @@
 
 #include "Algebra.hpp"
 
+// SSE implementation of the products, the inverse and the transpose
+// (define ALGEBRA_NO_SIMD to use the scalar implementation). Operations
+// are performed in the same order as the scalar code, so results are the
+// same unless the compiler contracts the scalar code to fused multiply-adds.
+#if !defined(ALGEBRA_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#	define ALGEBRA_USE_SSE
+#	include <xmmintrin.h>
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 // Constants
 const Matrix4x4 Matrix4x4::IDENTITY(1,0,0,0,
@@ -347,6 +357,26 @@ Matrix4x4 Matrix4x4::operator-() const
 
 Matrix4x4 Matrix4x4::operator*(const Matrix4x4& m) const
 {
+#ifdef ALGEBRA_USE_SSE
+	// columns of the product are linear combinations of the columns
+	const float* a = &mC0[0];
+	const float* b = &m.mC0[0];
+	__m128 c0 = _mm_loadu_ps(a);
+	__m128 c1 = _mm_loadu_ps(a+4);
+	__m128 c2 = _mm_loadu_ps(a+8);
+	__m128 c3 = _mm_loadu_ps(a+12);
+	Matrix4x4 r;
+	float* p = &r.mC0[0];
+	for(int i=0; i<16; i+=4)
+	{
+		__m128 v = _mm_mul_ps(c0, _mm_set1_ps(b[i]));
+		v = _mm_add_ps(v, _mm_mul_ps(c1, _mm_set1_ps(b[i+1])));
+		v = _mm_add_ps(v, _mm_mul_ps(c2, _mm_set1_ps(b[i+2])));
+		v = _mm_add_ps(v, _mm_mul_ps(c3, _mm_set1_ps(b[i+3])));
+		_mm_storeu_ps(p+i, v);
+	}
+	return r;
+#else
 	return Matrix4x4(  (*this)[0][0]*m[0][0]+(*this)[1][0]*m[0][1]
 	                  +(*this)[2][0]*m[0][2]+(*this)[3][0]*m[0][3],
 	                   (*this)[0][0]*m[1][0]+(*this)[1][0]*m[1][1]
@@ -377,12 +407,23 @@ Matrix4x4 Matrix4x4::operator*(const Matrix4x4& m) const
 	                  +(*this)[2][3]*m[1][2]+(*this)[3][3]*m[1][3],
 	                   (*this)[0][3]*m[2][0]+(*this)[1][3]*m[2][1]
 	                  +(*this)[2][3]*m[2][2]+(*this)[3][3]*m[2][3],
-	                   (*this)[0][3]*m[3][0]+(*this)[1][3]*m[2][1]
+	                   (*this)[0][3]*m[3][0]+(*this)[1][3]*m[3][1]
 	                  +(*this)[2][3]*m[3][2]+(*this)[3][3]*m[3][3]  );
+#endif
 }
 
 Vector4 Matrix4x4::operator*(const Vector4& v) const
 {
+#ifdef ALGEBRA_USE_SSE
+	const float* a = &mC0[0];
+	__m128 r = _mm_mul_ps(_mm_loadu_ps(a), _mm_set1_ps(v[0]));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(a+4),  _mm_set1_ps(v[1])));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(a+8),  _mm_set1_ps(v[2])));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(a+12), _mm_set1_ps(v[3])));
+	Vector4 result;
+	_mm_storeu_ps(&result[0], r);
+	return result;
+#else
 	return Vector4(  (*this)[0][0]*v[0]+(*this)[1][0]*v[1]
 	                +(*this)[2][0]*v[2]+(*this)[3][0]*v[3],
 	                 (*this)[0][1]*v[0]+(*this)[1][1]*v[1]
@@ -391,6 +432,7 @@ Vector4 Matrix4x4::operator*(const Vector4& v) const
 	                +(*this)[2][2]*v[2]+(*this)[3][2]*v[3],
 	                 (*this)[0][3]*v[0]+(*this)[1][3]*v[1]
 	                +(*this)[2][3]*v[2]+(*this)[3][3]*v[3]  );
+#endif
 }
 
 
@@ -443,7 +485,7 @@ float Matrix4x4::Determinant() const
 {
 	return (  ((*this)[0][0]*(*this)[1][1] - (*this)[1][0]*(*this)[0][1])
 	         *((*this)[2][2]*(*this)[3][3] - (*this)[3][2]*(*this)[2][3])
-	         -((*this)[0][0]*(*this)[2][1] - (*this)[2][0]*(*this)[1][0])
+	         -((*this)[0][0]*(*this)[2][1] - (*this)[2][0]*(*this)[0][1])
 	         *((*this)[1][2]*(*this)[3][3] - (*this)[3][2]*(*this)[1][3])
 	         +((*this)[0][0]*(*this)[3][1] - (*this)[3][0]*(*this)[0][1])
 	         *((*this)[1][2]*(*this)[2][3] - (*this)[2][2]*(*this)[1][3])
@@ -463,6 +505,81 @@ Matrix4x4 Matrix4x4::Inverse() const
 #ifndef NDEBUG
 	assert(IsInvertible());
 #endif
+#ifdef ALGEBRA_USE_SSE
+	// same expansion as below, cofactors are computed row by row
+	const float* a = &mC0[0];
+	__m128 c0 = _mm_loadu_ps(a);
+	__m128 c1 = _mm_loadu_ps(a+4);
+	__m128 c2 = _mm_loadu_ps(a+8);
+	__m128 c3 = _mm_loadu_ps(a+12);
+	__m128 r0 = c0, r1 = c1, r2 = c2, r3 = c3;
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+	// (s0,s1,s2,s3), (c0,c1,c2,c3) and (s4,s5,c4,c5)
+	__m128 s0123 = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(r0, r0, _MM_SHUFFLE(1,0,0,0)),
+		           _mm_shuffle_ps(r1, r1, _MM_SHUFFLE(2,3,2,1))),
+		_mm_mul_ps(_mm_shuffle_ps(r0, r0, _MM_SHUFFLE(2,3,2,1)),
+		           _mm_shuffle_ps(r1, r1, _MM_SHUFFLE(1,0,0,0))));
+	__m128 c0123 = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(r2, r2, _MM_SHUFFLE(1,0,0,0)),
+		           _mm_shuffle_ps(r3, r3, _MM_SHUFFLE(2,3,2,1))),
+		_mm_mul_ps(_mm_shuffle_ps(r2, r2, _MM_SHUFFLE(2,3,2,1)),
+		           _mm_shuffle_ps(r3, r3, _MM_SHUFFLE(1,0,0,0))));
+	__m128 s45c45 = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2,1,2,1)),
+		           _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3,3,3,3))),
+		_mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3,3,3,3)),
+		           _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2,1,2,1))));
+
+	// compute inverse of determinant
+	float s[4], c[4], sc[4];
+	_mm_storeu_ps(s, s0123);
+	_mm_storeu_ps(c, c0123);
+	_mm_storeu_ps(sc, s45c45);
+	float invDet = 1.0f/(  s[0]*sc[3] - s[1]*sc[2] + s[2]*c[3]
+	                     + s[3]*c[2] - sc[0]*c[1] + sc[1]*c[0]);
+
+	// (ck,ck,sk,sk) factors
+	__m128 d5 = _mm_shuffle_ps(s45c45, s45c45, _MM_SHUFFLE(1,1,3,3));
+	__m128 d4 = _mm_shuffle_ps(s45c45, s45c45, _MM_SHUFFLE(0,0,2,2));
+	__m128 d3 = _mm_shuffle_ps(c0123, s0123, _MM_SHUFFLE(3,3,3,3));
+	__m128 d2 = _mm_shuffle_ps(c0123, s0123, _MM_SHUFFLE(2,2,2,2));
+	__m128 d1 = _mm_shuffle_ps(c0123, s0123, _MM_SHUFFLE(1,1,1,1));
+	__m128 d0 = _mm_shuffle_ps(c0123, s0123, _MM_SHUFFLE(0,0,0,0));
+
+	// swizzled columns (m[k][1], m[k][0], m[k][3], m[k][2])
+	__m128 p0 = _mm_shuffle_ps(c0, c0, _MM_SHUFFLE(2,3,0,1));
+	__m128 p1 = _mm_shuffle_ps(c1, c1, _MM_SHUFFLE(2,3,0,1));
+	__m128 p2 = _mm_shuffle_ps(c2, c2, _MM_SHUFFLE(2,3,0,1));
+	__m128 p3 = _mm_shuffle_ps(c3, c3, _MM_SHUFFLE(2,3,0,1));
+
+	// rows of the inverse (signs are flipped with xors)
+	const __m128 SIGN_EVEN = _mm_setr_ps(0.0f, -0.0f, 0.0f, -0.0f);
+	const __m128 SIGN_ODD  = _mm_setr_ps(-0.0f, 0.0f, -0.0f, 0.0f);
+	const __m128 INV_DET   = _mm_set1_ps(invDet);
+	r0 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(p1, d5), _mm_mul_ps(p2, d4)),
+	                _mm_mul_ps(p3, d3));
+	r1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(p0, d5), _mm_mul_ps(p2, d2)),
+	                _mm_mul_ps(p3, d1));
+	r2 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(p0, d4), _mm_mul_ps(p1, d2)),
+	                _mm_mul_ps(p3, d0));
+	r3 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(p0, d3), _mm_mul_ps(p1, d1)),
+	                _mm_mul_ps(p2, d0));
+	r0 = _mm_mul_ps(INV_DET, _mm_xor_ps(r0, SIGN_EVEN));
+	r1 = _mm_mul_ps(INV_DET, _mm_xor_ps(r1, SIGN_ODD));
+	r2 = _mm_mul_ps(INV_DET, _mm_xor_ps(r2, SIGN_EVEN));
+	r3 = _mm_mul_ps(INV_DET, _mm_xor_ps(r3, SIGN_ODD));
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+	Matrix4x4 inverse;
+	float* p = &inverse.mC0[0];
+	_mm_storeu_ps(p,    r0);
+	_mm_storeu_ps(p+4,  r1);
+	_mm_storeu_ps(p+8,  r2);
+	_mm_storeu_ps(p+12, r3);
+	return inverse;
+#else
 	// use laplace expansion theorem
 	float s0 = (*this)[0][0] * (*this)[1][1] - (*this)[1][0] * (*this)[0][1];
 	float s1 = (*this)[0][0] * (*this)[2][1] - (*this)[2][0] * (*this)[0][1];
@@ -502,6 +619,7 @@ Matrix4x4 Matrix4x4::Inverse() const
 	                  + (*this)[0][0]*c3 - (*this)[1][0]*c1 + (*this)[2][0]*c0,
 	                  - (*this)[0][3]*s3 + (*this)[1][3]*s1 - (*this)[2][3]*s0,
 	                  + (*this)[0][2]*s3 - (*this)[1][2]*s1 + (*this)[2][2]*s0);
+#endif
 }
 
 
@@ -509,11 +627,27 @@ Matrix4x4 Matrix4x4::Inverse() const
 // Transpose
 Matrix4x4 Matrix4x4::Transpose() const
 {
+#ifdef ALGEBRA_USE_SSE
+	const float* a = &mC0[0];
+	__m128 c0 = _mm_loadu_ps(a);
+	__m128 c1 = _mm_loadu_ps(a+4);
+	__m128 c2 = _mm_loadu_ps(a+8);
+	__m128 c3 = _mm_loadu_ps(a+12);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	Matrix4x4 transpose;
+	float* p = &transpose.mC0[0];
+	_mm_storeu_ps(p,    c0);
+	_mm_storeu_ps(p+4,  c1);
+	_mm_storeu_ps(p+8,  c2);
+	_mm_storeu_ps(p+12, c3);
+	return transpose;
+#else
 	return Matrix4x4((*this)[0][0], (*this)[0][1], (*this)[0][2], (*this)[0][3],
 	                 (*this)[1][0], (*this)[1][1], (*this)[1][2], (*this)[1][3],
 	                 (*this)[2][0], (*this)[2][1], (*this)[2][2], (*this)[2][3],
 	                 (*this)[3][0], (*this)[3][1], (*this)[3][2], (*this)[3][3]
 	                );
+#endif
 }
 
 
@@ -621,6 +755,113 @@ Matrix4x4 Matrix4x4::Frac() const
                    mC2.Frac(),
                    mC3.Frac()); }
 
+////////////////////////////////////////////////////////////////////////////////
+// Batch transformations
+void Matrix4x4::TransformArrays(float* x,
+                                float* y,
+                                float* z,
+                                float* nx,
+                                float* ny,
+                                float* nz,
+                                size_t count) const
+{
+#ifndef NDEBUG
+	assert(x && y && z);
+	assert((nx && ny && nz) || (!nx && !ny && !nz));
+#endif
+	const Matrix4x4& m = *this;
+	size_t i = 0;
+
+	// points
+#ifdef ALGEBRA_USE_SSE
+	const __m128 M00 = _mm_set1_ps(m[0][0]), M10 = _mm_set1_ps(m[1][0]);
+	const __m128 M20 = _mm_set1_ps(m[2][0]), M30 = _mm_set1_ps(m[3][0]);
+	const __m128 M01 = _mm_set1_ps(m[0][1]), M11 = _mm_set1_ps(m[1][1]);
+	const __m128 M21 = _mm_set1_ps(m[2][1]), M31 = _mm_set1_ps(m[3][1]);
+	const __m128 M02 = _mm_set1_ps(m[0][2]), M12 = _mm_set1_ps(m[1][2]);
+	const __m128 M22 = _mm_set1_ps(m[2][2]), M32 = _mm_set1_ps(m[3][2]);
+	for(; i+4<=count; i+=4)
+	{
+		__m128 px = _mm_loadu_ps(x+i);
+		__m128 py = _mm_loadu_ps(y+i);
+		__m128 pz = _mm_loadu_ps(z+i);
+		_mm_storeu_ps(x+i, _mm_add_ps(_mm_add_ps(_mm_add_ps(
+		                   _mm_mul_ps(M00, px), _mm_mul_ps(M10, py)),
+		                   _mm_mul_ps(M20, pz)), M30));
+		_mm_storeu_ps(y+i, _mm_add_ps(_mm_add_ps(_mm_add_ps(
+		                   _mm_mul_ps(M01, px), _mm_mul_ps(M11, py)),
+		                   _mm_mul_ps(M21, pz)), M31));
+		_mm_storeu_ps(z+i, _mm_add_ps(_mm_add_ps(_mm_add_ps(
+		                   _mm_mul_ps(M02, px), _mm_mul_ps(M12, py)),
+		                   _mm_mul_ps(M22, pz)), M32));
+	}
+#endif
+	for(; i<count; ++i)
+	{
+		float px = x[i], py = y[i], pz = z[i];
+		x[i] = m[0][0]*px + m[1][0]*py + m[2][0]*pz + m[3][0];
+		y[i] = m[0][1]*px + m[1][1]*py + m[2][1]*pz + m[3][1];
+		z[i] = m[0][2]*px + m[1][2]*py + m[2][2]*pz + m[3][2];
+	}
+
+	if(NULL == nx)
+		return;
+
+	// normals
+	const Matrix3x3 n = Matrix3x3(Vector3(m[0][0], m[0][1], m[0][2]),
+	                              Vector3(m[1][0], m[1][1], m[1][2]),
+	                              Vector3(m[2][0], m[2][1], m[2][2]))
+	                    .Inverse().Transpose();
+	i = 0;
+#ifdef ALGEBRA_USE_SSE
+	const __m128 N00 = _mm_set1_ps(n[0][0]), N10 = _mm_set1_ps(n[1][0]);
+	const __m128 N20 = _mm_set1_ps(n[2][0]), N01 = _mm_set1_ps(n[0][1]);
+	const __m128 N11 = _mm_set1_ps(n[1][1]), N21 = _mm_set1_ps(n[2][1]);
+	const __m128 N02 = _mm_set1_ps(n[0][2]), N12 = _mm_set1_ps(n[1][2]);
+	const __m128 N22 = _mm_set1_ps(n[2][2]);
+	const __m128 ZERO = _mm_setzero_ps();
+	const __m128 ONE  = _mm_set1_ps(1.0f);
+	for(; i+4<=count; i+=4)
+	{
+		__m128 px = _mm_loadu_ps(nx+i);
+		__m128 py = _mm_loadu_ps(ny+i);
+		__m128 pz = _mm_loadu_ps(nz+i);
+		__m128 tx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(N00, px),
+		                                  _mm_mul_ps(N10, py)),
+		                       _mm_mul_ps(N20, pz));
+		__m128 ty = _mm_add_ps(_mm_add_ps(_mm_mul_ps(N01, px),
+		                                  _mm_mul_ps(N11, py)),
+		                       _mm_mul_ps(N21, pz));
+		__m128 tz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(N02, px),
+		                                  _mm_mul_ps(N12, py)),
+		                       _mm_mul_ps(N22, pz));
+		__m128 l = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, tx),
+		                                             _mm_mul_ps(ty, ty)),
+		                                  _mm_mul_ps(tz, tz)));
+		// zero length normals are left untouched
+		__m128 isZero = _mm_cmpeq_ps(l, ZERO);
+		__m128 s = _mm_div_ps(ONE, _mm_or_ps(_mm_and_ps(isZero, ONE),
+		                                     _mm_andnot_ps(isZero, l)));
+		_mm_storeu_ps(nx+i, _mm_mul_ps(tx, s));
+		_mm_storeu_ps(ny+i, _mm_mul_ps(ty, s));
+		_mm_storeu_ps(nz+i, _mm_mul_ps(tz, s));
+	}
+#endif
+	for(; i<count; ++i)
+	{
+		float px = nx[i], py = ny[i], pz = nz[i];
+		float tx = n[0][0]*px + n[1][0]*py + n[2][0]*pz;
+		float ty = n[0][1]*px + n[1][1]*py + n[2][1]*pz;
+		float tz = n[0][2]*px + n[1][2]*py + n[2][2]*pz;
+		float l  = std::sqrt(tx*tx + ty*ty + tz*tz);
+		float s  = 1.0f/(l == 0.0f ? 1.0f : l);
+		nx[i] = tx*s;
+		ny[i] = ty*s;
+		nz[i] = tz*s;
+	}
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // Mat3 construtor
 Matrix4x4::Matrix4x4(const Matrix3x3& m) : 
@@ -640,12 +881,140 @@ Matrix4x4 operator*(const float& s, const Matrix4x4& m)
 }
 
 
-#if 0
+// Tests against a reference implementation
+// (build with -DMATRIX4X4_TEST core/*.cpp, with and without ALGEBRA_NO_SIMD)
+#ifdef MATRIX4X4_TEST
+#include <cstdio>
+#include <cstdlib>
 
-int main(int argc, char **argv)
+static float _random_float()
 {
-	Matrix4x4 m = Matrix4x4::IDENTITY;
+	return 2.0f*float(std::rand())/float(RAND_MAX) - 1.0f;
+}
 
+static Matrix4x4 _random_matrix()
+{
+	Matrix4x4 m;
+	for(size_t i=0; i<16; ++i)
+		m[i/4][i%4] = _random_float();
+	return m;
+}
+
+// reference batch transformation (double precision, normals by the
+// cofactors of the upper 3x3 block, divided by its determinant)
+static void _transform_arrays(const Matrix4x4& m,
+                              float* p, float* n, size_t count)
+{
+	double c[3][3], det = 0.0;
+	for(size_t r=0; r<3; ++r)
+	for(size_t k=0; k<3; ++k)
+	{
+		size_t r1 = (r+1)%3, r2 = (r+2)%3, k1 = (k+1)%3, k2 = (k+2)%3;
+		c[r][k] = double(m[k1][r1])*m[k2][r2] - double(m[k2][r1])*m[k1][r2];
+	}
+	for(size_t k=0; k<3; ++k)
+		det+= double(m[k][0])*c[0][k];
+	for(size_t i=0; i<count; ++i)
+	{
+		double tp[3], tn[3], length = 0.0;
+		for(size_t r=0; r<3; ++r)
+		{
+			tp[r] = m[3][r];
+			tn[r] = 0.0;
+			for(size_t k=0; k<3; ++k)
+			{
+				tp[r]+= double(m[k][r])*p[k*count+i];
+				tn[r]+= c[r][k]*n[k*count+i]/det;
+			}
+			length+= tn[r]*tn[r];
+		}
+		for(size_t r=0; r<3; ++r)
+		{
+			p[r*count+i] = float(tp[r]);
+			n[r*count+i] = float(tn[r]/std::sqrt(length));
+		}
+	}
 }
-#endif
 
+static bool _equal(const Matrix4x4& m1, const Matrix4x4& m2, float epsilon)
+{
+	for(size_t i=0; i<16; ++i)
+		if(std::fabs(m1[i/4][i%4]-m2[i/4][i%4]) > epsilon)
+			return false;
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	const int TEST_COUNT = 100000;
+	int failures = 0;
+	for(int t=0; t<TEST_COUNT; ++t)
+	{
+		Matrix4x4 a = _random_matrix();
+		Matrix4x4 b = _random_matrix();
+		Vector4 v(_random_float(), _random_float(),
+		          _random_float(), _random_float());
+
+		// reference product (double precision, column major)
+		Matrix4x4 ab;
+		Vector4 av;
+		for(size_t c=0; c<4; ++c)
+		for(size_t r=0; r<4; ++r)
+		{
+			double sum = 0.0, sumv = 0.0;
+			for(size_t k=0; k<4; ++k)
+			{
+				sum += double(a[k][r])*double(b[c][k]);
+				sumv+= double(a[k][r])*double(v[k]);
+			}
+			ab[c][r] = float(sum);
+			if(c==0)
+				av[r] = float(sumv);
+		}
+		Matrix4x4 at;
+		for(size_t i=0; i<16; ++i)
+			at[i/4][i%4] = a[i%4][i/4];
+
+		if(!_equal(a*b, ab, 1e-5f))
+			++failures, std::fprintf(stderr, "product failed\n");
+		if((a*v-av).Length() > 1e-5f)
+			++failures, std::fprintf(stderr, "vector product failed\n");
+		if(a.Transpose() != at)
+			++failures, std::fprintf(stderr, "transpose failed\n");
+		if(std::fabs(a.Determinant()) > 1e-2f
+		   && !_equal(a*a.Inverse(), Matrix4x4::IDENTITY, 1e-3f))
+			++failures, std::fprintf(stderr, "inverse failed\n");
+
+		// batch transformation (seven elements, so the SIMD loop and its
+		// tail both run), with a general (non orthogonal) matrix
+		const size_t COUNT = 7;
+		float p[3*COUNT], n[3*COUNT], pRef[3*COUNT], nRef[3*COUNT];
+		for(size_t i=0; i<3*COUNT; ++i)
+		{
+			pRef[i] = p[i] = _random_float();
+			nRef[i] = n[i] = _random_float();
+		}
+		Matrix3x3 a3(Vector3(a[0][0], a[0][1], a[0][2]),
+		             Vector3(a[1][0], a[1][1], a[1][2]),
+		             Vector3(a[2][0], a[2][1], a[2][2]));
+		if(std::fabs(a3.Determinant()) > 1e-2f)
+		{
+			a.TransformArrays(p, p+COUNT, p+2*COUNT,
+			                  n, n+COUNT, n+2*COUNT, COUNT);
+			_transform_arrays(a, pRef, nRef, COUNT);
+			for(size_t i=0; i<3*COUNT; ++i)
+				if(std::fabs(p[i]-pRef[i]) > 1e-5f
+				   || std::fabs(n[i]-nRef[i]) > 1e-3f)
+				{
+					++failures;
+					std::fprintf(stderr, "batch transformation failed\n");
+					break;
+				}
+		}
+		if(failures > 10)
+			break;
+	}
+	std::printf("%s (%d failures)\n", failures ? "FAILED" : "PASSED", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif // MATRIX4X4_TEST
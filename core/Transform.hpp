@@ -64,6 +64,15 @@ public:
 	Matrix4x4 ExtractTransformMatrix()          const;
 	Matrix4x4 ExtractInverseTransformMatrix()   const;
 
+	// Batch transformations (see Matrix4x4::TransformArrays)
+	void TransformArrays(float* x,
+	                     float* y,
+	                     float* z,
+	                     float* nx,
+	                     float* ny,
+	                     float* nz,
+	                     size_t count) const;
+
 	// Axis queries
 	const Vector3& UnitXAxis()      const;
 	const Vector3& UnitYAxis()      const;
@@ -1,13 +1,16 @@
 #version 410
 
 uniform mat4 uModelViewProjection;
+uniform vec3 uBrickOrigin; // compact vertex format
+uniform float uBrickSize;
 
 
 #ifdef _VERTEX_
-layout(location = 0)  in vec4 iPosition;
+layout(location = 0)  in vec4 iPosition; // normalized, relative to the brick
 
 void main() {
-	gl_Position = uModelViewProjection * iPosition;
+	vec3 position = uBrickOrigin + uBrickSize * iPosition.xyz;
+	gl_Position = uModelViewProjection * vec4(position, 1.0);
 }
 #endif
 
@@ -20,11 +20,13 @@
 #include <vector>
 #include <stdexcept>
 #include <cmath>
+#include <cassert>
 
 // Custom libraries
 #include "Algebra.hpp"      // Basic algebra library
 #include "Transform.hpp"    // Basic transformations
 #include "Framework.hpp"    // utility classes/functions
+#include "Trace.hpp"        // event tracing
 
 #include "MarchingCubeTables.hpp" // tables for marching cube
 
@@ -42,8 +44,8 @@ enum {
 	// buffers
 	BUFFER_CUBE_VERTICES = 0,
 	BUFFER_CUBE_INDEXES,
-	BUFFER_CASE_TO_FACE_COUNT,
-	BUFFER_EDGE_CONNECT_LIST,
+	BUFFER_CASE_TO_FACE_OFFSET,
+	BUFFER_FACE_EDGES,
 	BUFFER_COUNT,
 
 	// vertex arrays
@@ -52,13 +54,20 @@ enum {
 	VERTEX_ARRAY_COUNT,
 
 	// textures
-	TEXTURE_EDGE_CONNECT_LIST = 0,
+	TEXTURE_CASE_TO_FACE_OFFSET = 0,
+	TEXTURE_FACE_EDGES,
 	TEXTURE_COUNT,
 
 	// programs
 	PROGRAM_CUBE = 0,
 	PROGRAM_MARCHING_CUBE,
-	PROGRAM_COUNT
+	PROGRAM_COUNT,
+
+	// profiled passes
+	PASS_CUBE = 0,
+	PASS_MARCHING_CUBE,
+	PASS_GUI,
+	PASS_COUNT
 };
 
 // OpenGL objects
@@ -67,6 +76,9 @@ GLuint *vertexArrays = NULL;
 GLuint *textures     = NULL;
 GLuint *programs     = NULL;
 
+// GPU profiler
+fw::FrameProfiler *frameProfiler = NULL;
+
 // Tools
 Affine cameraInvWorld       = Affine::Translation(Vector3(0,0,-2.5));
 Projection cameraProjection = Projection::Perspective(FOVY,
@@ -79,9 +91,12 @@ bool mouseRight = false;
 
 GLfloat deltaTicks = 0.0f;
 GLint marchingCubeCase = 0;
+GLfloat marchingCubeIsolevel = 0.0f; // corners are at -1 (inside) or +1
 
 #ifdef _ANT_ENABLE
 GLfloat speed = 0.0f; // app speed (in ms)
+GLfloat passAverages[PASS_COUNT];    // gpu pass timings (in ms)
+GLfloat passPercentiles[PASS_COUNT]; // gpu pass timings (in ms)
 #endif
 
 
@@ -90,27 +105,6 @@ GLfloat speed = 0.0f; // app speed (in ms)
 //
 ////////////////////////////////////////////////////////////////////////////////
 
-// convert nvidia indexes to compressed index
-static GLint voxel_edge_to_vertices(GLint edge) {
-	GLint edges = 0;
-	switch(edge) {
-		case  0: edges = 0x0 | 0x1<<3; break;
-		case  1: edges = 0x1 | 0x2<<3; break;
-		case  2: edges = 0x2 | 0x3<<3; break;
-		case  3: edges = 0x0 | 0x3<<3; break;
-		case  4: edges = 0x4 | 0x5<<3; break;
-		case  5: edges = 0x5 | 0x6<<3; break;
-		case  6: edges = 0x6 | 0x7<<3; break;
-		case  7: edges = 0x4 | 0x7<<3; break;
-		case  8: edges = 0x0 | 0x4<<3; break;
-		case  9: edges = 0x1 | 0x5<<3; break;
-		case 10: edges = 0x2 | 0x6<<3; break;
-		case 11: edges = 0x3 | 0x7<<3; break;
-		default: break;
-	}
-	return edges;
-}
-
 #ifdef _ANT_ENABLE
 
 static void TW_CALL toggle_fullscreen(void *data) {
@@ -118,6 +112,22 @@ static void TW_CALL toggle_fullscreen(void *data) {
 	glutFullScreenToggle();
 }
 
+static void TW_CALL dump_profile(void *data) {
+	// save gpu timings
+	frameProfiler->Dump("profile.txt");
+}
+
+static void TW_CALL set_gl_debug(const void *value, void *data) {
+	fw::set_gl_error_check_mode(*static_cast<const bool*>(value)
+	                            ? fw::GL_ERROR_CHECK_MODE_DEBUG
+	                            : fw::GL_ERROR_CHECK_MODE_RELEASE);
+}
+
+static void TW_CALL get_gl_debug(void *value, void *data) {
+	*static_cast<bool*>(value) = fw::GL_ERROR_CHECK_MODE_DEBUG
+	                          == fw::gl_error_check_mode();
+}
+
 #endif // _USE_GUI
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -126,31 +136,24 @@ void on_init() {
 // GLint maxUniformBlockSize = 0;
 // glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &maxUniformBlockSize);
 // std::cout << "GL_MAX_UNIFORM_BLOCK_SIZE : " << maxUniformBlockSize << std::endl;
-	const GLfloat CUBE_VERTICES[] = { -0.5f, -0.5f,  0.5f, 1,   // 0 
-	                                  -0.5f,  0.5f,  0.5f, 1,   // 1
-	                                   0.5f,  0.5f,  0.5f, 1,   // 2
-	                                   0.5f, -0.5f,  0.5f, 1,   // 3
-	                                  -0.5f, -0.5f, -0.5f, 1,   // 4
-	                                  -0.5f,  0.5f, -0.5f, 1,   // 5
-	                                   0.5f,  0.5f, -0.5f, 1,   // 6
-	                                   0.5f, -0.5f, -0.5f, 1 }; // 7
+	const GLfloat CUBE_VERTICES[] = { -0.5f, -0.5f,  0.5f,   // 0 
+	                                  -0.5f,  0.5f,  0.5f,   // 1
+	                                   0.5f,  0.5f,  0.5f,   // 2
+	                                   0.5f, -0.5f,  0.5f,   // 3
+	                                  -0.5f, -0.5f, -0.5f,   // 4
+	                                  -0.5f,  0.5f, -0.5f,   // 5
+	                                   0.5f,  0.5f, -0.5f,   // 6
+	                                   0.5f, -0.5f, -0.5f }; // 7
+	const GLfloat CUBE_BRICK_ORIGIN[] = {-0.5f, -0.5f, -0.5f};
+	const GLfloat CUBE_BRICK_SIZE     = 1.0f;
+	GLuint cubeVertices[8*2]; // compact vertex format
 	const GLushort CUBE_INDEXES[] = { 2,1,1,0,0,3,     // front
 	                                  6,2,2,3,3,7,     // right
 	                                  5,6,6,7,7,4,     // back
 	                                  1,5,5,4,4,0 };   // left
-	GLint* edgeList = new GLint[2048];
-	GLint compressedVertexIndex = 0;
-
-	// compress table
-	for(GLint i = 0; i<256*5*4; i+=4) {
-		compressedVertexIndex = voxel_edge_to_vertices(EDGE_CONNECT_LIST[i]);
-		compressedVertexIndex|= voxel_edge_to_vertices(EDGE_CONNECT_LIST[i+1])
-		                      << 6;
-		compressedVertexIndex|= voxel_edge_to_vertices(EDGE_CONNECT_LIST[i+2])
-		                      << 12;
-		// drop fourth component (which is always -1)
-		edgeList[i/4] = compressedVertexIndex;
-	}
+#ifndef NDEBUG
+	assert(marching_cube_tables_are_valid());
+#endif
 
 	// alloc names
 	buffers      = new GLuint[BUFFER_COUNT];
@@ -158,6 +161,12 @@ void on_init() {
 	textures     = new GLuint[TEXTURE_COUNT];
 	programs     = new GLuint[PROGRAM_COUNT];
 
+	// build profiler
+	frameProfiler = new fw::FrameProfiler(PASS_COUNT);
+	frameProfiler->SetPassName(PASS_CUBE, "cube");
+	frameProfiler->SetPassName(PASS_MARCHING_CUBE, "marching_cube");
+	frameProfiler->SetPassName(PASS_GUI, "gui");
+
 	// gen names
 	glGenBuffers(BUFFER_COUNT, buffers);
 	glGenVertexArrays(VERTEX_ARRAY_COUNT, vertexArrays);
@@ -166,10 +175,16 @@ void on_init() {
 		programs[i] = glCreateProgram();
 
 	// configure buffers
+	fw::pack_compact_vertices(CUBE_VERTICES,
+	                          NULL,
+	                          8,
+	                          CUBE_BRICK_ORIGIN,
+	                          CUBE_BRICK_SIZE,
+	                          cubeVertices);
 	glBindBuffer(GL_ARRAY_BUFFER, buffers[BUFFER_CUBE_VERTICES]);
 		glBufferData(GL_ARRAY_BUFFER,
-		             sizeof(CUBE_VERTICES),
-		             CUBE_VERTICES,
+		             sizeof(cubeVertices),
+		             cubeVertices,
 		             GL_STATIC_DRAW);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[BUFFER_CUBE_INDEXES]);
@@ -178,38 +193,39 @@ void on_init() {
 		             CUBE_INDEXES,
 		             GL_STATIC_DRAW);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_UNIFORM_BUFFER, buffers[BUFFER_CASE_TO_FACE_COUNT]);
-		glBufferData(GL_UNIFORM_BUFFER,
-		             sizeof(CASE_TO_FACE_COUNT),
-		             CASE_TO_FACE_COUNT,
+	glBindBuffer(GL_TEXTURE_BUFFER, buffers[BUFFER_CASE_TO_FACE_OFFSET]);
+		glBufferData(GL_TEXTURE_BUFFER,
+		             sizeof(CASE_TO_FACE_OFFSET),
+		             CASE_TO_FACE_OFFSET,
 		             GL_STATIC_DRAW);
-	glBindBuffer(GL_UNIFORM_BUFFER, buffers[BUFFER_EDGE_CONNECT_LIST]);
-		glBufferData(GL_UNIFORM_BUFFER,
-		             sizeof(GLint)*2048,
-		             edgeList,
+	glBindBuffer(GL_TEXTURE_BUFFER, buffers[BUFFER_FACE_EDGES]);
+		glBufferData(GL_TEXTURE_BUFFER,
+		             sizeof(FACE_EDGES_PACKED),
+		             FACE_EDGES_PACKED,
 		             GL_STATIC_DRAW);
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
-	// bind bases
-	glBindBufferBase(GL_UNIFORM_BUFFER,
-	                 BUFFER_CASE_TO_FACE_COUNT,
-	                 buffers[BUFFER_CASE_TO_FACE_COUNT]);
-//	glBindBufferBase(GL_UNIFORM_BUFFER,
-//	                 BUFFER_EDGE_CONNECT_LIST,
-//	                 buffers[BUFFER_EDGE_CONNECT_LIST]);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
 
 	// configure textures
-	glActiveTexture(GL_TEXTURE0 + TEXTURE_EDGE_CONNECT_LIST);
-	glBindTexture(GL_TEXTURE_BUFFER, textures[TEXTURE_EDGE_CONNECT_LIST]);
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_CASE_TO_FACE_OFFSET);
+	glBindTexture(GL_TEXTURE_BUFFER, textures[TEXTURE_CASE_TO_FACE_OFFSET]);
 		glTexBuffer(GL_TEXTURE_BUFFER,
-		            GL_RGBA32I,
-		            buffers[BUFFER_EDGE_CONNECT_LIST]);
+		            GL_R16UI,
+		            buffers[BUFFER_CASE_TO_FACE_OFFSET]);
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_FACE_EDGES);
+	glBindTexture(GL_TEXTURE_BUFFER, textures[TEXTURE_FACE_EDGES]);
+		glTexBuffer(GL_TEXTURE_BUFFER,
+		            GL_R16UI,
+		            buffers[BUFFER_FACE_EDGES]);
 
 	// vertex arrays
 	glBindVertexArray(vertexArrays[VERTEX_ARRAY_CUBE]);
 		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
 		glBindBuffer(GL_ARRAY_BUFFER, buffers[BUFFER_CUBE_VERTICES]);
-		glVertexAttribPointer(0,4,GL_FLOAT,0,0,FW_BUFFER_OFFSET(0));
+		glVertexAttribPointer(0,4,GL_UNSIGNED_INT_2_10_10_10_REV,GL_TRUE,
+		                      2*sizeof(GLuint),FW_BUFFER_OFFSET(0));
+		glVertexAttribPointer(1,4,GL_INT_2_10_10_10_REV,GL_TRUE,
+		                      2*sizeof(GLuint),FW_BUFFER_OFFSET(sizeof(GLuint)));
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[BUFFER_CUBE_INDEXES]);
 	glBindVertexArray(vertexArrays[VERTEX_ARRAY_EMPTY]);
 	glBindVertexArray(0);
@@ -219,6 +235,15 @@ void on_init() {
 	                       "cube.glsl",
 	                       "",
 	                       GL_TRUE);
+	glProgramUniform3fv(programs[PROGRAM_CUBE],
+	                    glGetUniformLocation(programs[PROGRAM_CUBE],
+	                                         "uBrickOrigin"),
+	                    1,
+	                    CUBE_BRICK_ORIGIN);
+	glProgramUniform1f(programs[PROGRAM_CUBE],
+	                   glGetUniformLocation(programs[PROGRAM_CUBE],
+	                                        "uBrickSize"),
+	                   CUBE_BRICK_SIZE);
 
 	fw::build_glsl_program(programs[PROGRAM_MARCHING_CUBE],
 	                       "marchingCube.glsl",
@@ -226,25 +251,18 @@ void on_init() {
 	                       GL_TRUE);
 	glProgramUniform1i(programs[PROGRAM_MARCHING_CUBE],
 	                   glGetUniformLocation(programs[PROGRAM_MARCHING_CUBE],
-	                                         "sEdgeConnectList"),
-	                   TEXTURE_EDGE_CONNECT_LIST);
-	glUniformBlockBinding(programs[PROGRAM_MARCHING_CUBE],
-	                      glGetUniformBlockIndex(programs[PROGRAM_MARCHING_CUBE],
-	                                             "CaseToNumPolys"),
-	                      BUFFER_CASE_TO_FACE_COUNT);
-//	glUniformBlockBinding(programs[PROGRAM_MARCHING_CUBE],
-//	                      glGetUniformBlockIndex(programs[PROGRAM_MARCHING_CUBE],
-//	                                             "EdgeConnectList"),
-//	                      BUFFER_EDGE_CONNECT_LIST);
+	                                         "sCaseToFaceOffset"),
+	                   TEXTURE_CASE_TO_FACE_OFFSET);
+	glProgramUniform1i(programs[PROGRAM_MARCHING_CUBE],
+	                   glGetUniformLocation(programs[PROGRAM_MARCHING_CUBE],
+	                                         "sFaceEdges"),
+	                   TEXTURE_FACE_EDGES);
 
 	// set global state
 	glEnable(GL_DEPTH_TEST);
 	glDisable(GL_CULL_FACE);
 	glClearColor(0.13,0.13,0.15,1.0);
 
-	// clean up
-	delete[] edgeList;
-
 #ifdef _ANT_ENABLE
 	// start ant
 	TwInit(TW_OPENGL, NULL);
@@ -253,7 +271,7 @@ void on_init() {
 
 	// Create a new bar
 	TwBar* menuBar = TwNewBar("menu");
-	TwDefine("menu size='200 100'");
+	TwDefine("menu size='220 260'");
 
 	TwAddButton(menuBar,
 	            "fullscreen",
@@ -270,6 +288,36 @@ void on_init() {
 	           TW_TYPE_INT32,
 	           &marchingCubeCase,
 	           "min=0 max=255 step=1");
+	TwAddVarRW(menuBar,
+	           "isolevel",
+	           TW_TYPE_FLOAT,
+	           &marchingCubeIsolevel,
+	           "min=-0.95 max=0.95 step=0.05");
+	TwAddVarCB(menuBar,
+	           "gl debug",
+	           TW_TYPE_BOOLCPP,
+	           &set_gl_debug,
+	           &get_gl_debug,
+	           NULL,
+	           "help='validate every OpenGL call'");
+	TwAddButton(menuBar,
+	            "dump",
+	            &dump_profile,
+	            NULL,
+	            "label='dump gpu timings' group='gpu (ms)'");
+	for(GLuint i=0; i<PASS_COUNT; ++i) {
+		const std::string NAME = frameProfiler->PassName(i);
+		TwAddVarRO(menuBar,
+		           (NAME + " avg").c_str(),
+		           TW_TYPE_FLOAT,
+		           &passAverages[i],
+		           "group='gpu (ms)' precision=3");
+		TwAddVarRO(menuBar,
+		           (NAME + " p99").c_str(),
+		           TW_TYPE_FLOAT,
+		           &passPercentiles[i],
+		           "group='gpu (ms)' precision=3");
+	}
 
 #endif // _ANT_ENABLE
 	fw::check_gl_error();
@@ -291,6 +339,7 @@ void on_clean() {
 	delete[] vertexArrays;
 	delete[] textures;
 	delete[] programs;
+	delete frameProfiler;
 
 #ifdef _ANT_ENABLE
 	TwTerminate();
@@ -303,6 +352,8 @@ void on_clean() {
 ////////////////////////////////////////////////////////////////////////////////
 // on update cb
 void on_update() {
+	FW_TRACE_SCOPE("frame", "frame");
+
 	// Variables
 	static fw::Timer deltaTimer;
 	GLint windowWidth  = glutGet(GLUT_WINDOW_WIDTH);
@@ -313,8 +364,15 @@ void on_update() {
 	deltaTicks = deltaTimer.Ticks();
 #ifdef _ANT_ENABLE
 	speed = deltaTicks*1000.0f;
+	for(GLuint i=0; i<PASS_COUNT; ++i) {
+		passAverages[i]    = frameProfiler->PassAverage(i);
+		passPercentiles[i] = frameProfiler->PassPercentile(i, 99.0f);
+	}
 #endif
 
+	// retrieve gpu timings from previous frames
+	frameProfiler->BeginFrame();
+
 	// update transformations
 	Matrix4x4 mvp = cameraProjection.ExtractTransformMatrix()
 	              * cameraInvWorld.ExtractTransformMatrix();
@@ -336,6 +394,18 @@ void on_update() {
 	                   glGetUniformLocation(programs[PROGRAM_MARCHING_CUBE],
 	                                         "uCase"),
 	                   marchingCubeCase);
+	GLfloat cornerValues[8];
+	for(GLint i=0; i<8; ++i)
+		cornerValues[i] = (marchingCubeCase >> i & 1) ? -1.0f : 1.0f;
+	glProgramUniform1fv(programs[PROGRAM_MARCHING_CUBE],
+	                    glGetUniformLocation(programs[PROGRAM_MARCHING_CUBE],
+	                                         "uValues"),
+	                    8,
+	                    cornerValues);
+	glProgramUniform1f(programs[PROGRAM_MARCHING_CUBE],
+	                   glGetUniformLocation(programs[PROGRAM_MARCHING_CUBE],
+	                                         "uIsolevel"),
+	                   marchingCubeIsolevel);
 
 	// set viewport
 	glViewport(0,0,windowWidth, windowHeight);
@@ -344,26 +414,39 @@ void on_update() {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	// render the cube
+	FW_TRACE_BEGIN(cubeTrace, "cube", "frame");
+	frameProfiler->BeginPass(PASS_CUBE);
 	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 	glUseProgram(programs[PROGRAM_CUBE]);
 	glBindVertexArray(vertexArrays[VERTEX_ARRAY_CUBE]);
-	glDrawElements(GL_LINES,
-	               24,
-	               GL_UNSIGNED_SHORT,
-	               FW_BUFFER_OFFSET(0));
+	FW_GL_CHECK(glDrawElements(GL_LINES,
+	                           24,
+	                           GL_UNSIGNED_SHORT,
+	                           FW_BUFFER_OFFSET(0)));
+	frameProfiler->EndPass(PASS_CUBE);
+	FW_TRACE_END(cubeTrace);
 
 	// run marching cube
+	FW_TRACE_BEGIN(marchingCubeTrace, "marching_cube", "frame");
+	frameProfiler->BeginPass(PASS_MARCHING_CUBE);
 	glUseProgram(programs[PROGRAM_MARCHING_CUBE]);
 //	glBindVertexArray(vertexArrays[VERTEX_ARRAY_EMPTY]);
 	glBindVertexArray(vertexArrays[VERTEX_ARRAY_CUBE]); // hack for amd
-		glDrawArrays(GL_POINTS, 0, 1);
+		FW_GL_CHECK(glDrawArrays(GL_POINTS, 0, 1));
+	frameProfiler->EndPass(PASS_MARCHING_CUBE);
+	FW_TRACE_END(marchingCubeTrace);
 
 	glBindVertexArray(0);
 
+	FW_TRACE_BEGIN(guiTrace, "gui", "frame");
+	frameProfiler->BeginPass(PASS_GUI);
 #ifdef _ANT_ENABLE
 	// back to default vertex array
 	TwDraw();
 #endif // _ANT_ENABLE
+	frameProfiler->EndPass(PASS_GUI);
+	FW_TRACE_END(guiTrace);
+	frameProfiler->EndFrame();
 
 	fw::check_gl_error();
 
@@ -402,6 +485,17 @@ void on_key_down(GLubyte key, GLint x, GLint y) {
 		                         0,
 		                         glutGet(GLUT_WINDOW_WIDTH),
 		                         glutGet(GLUT_WINDOW_HEIGHT));
+	if(key=='t')
+		frameProfiler->Dump("profile.txt");
+	if(key=='l')
+		fw::save_gl_debug_log("gl_debug.txt");
+	if(key=='r') {
+		// toggle event recording, write the trace when done
+		if(fw::trace_is_recording())
+			fw::trace_write("trace.json");
+		else
+			fw::trace_start();
+	}
 
 }
 
@@ -522,8 +616,10 @@ int main(int argc, char** argv) {
 	// run
 	try
 	{
-		// run demo
+		// run demo (record start up events)
+		fw::trace_start();
 		on_init();
+		fw::trace_stop();
 		glutMainLoop();
 	}
 	catch(std::exception& e)
@@ -2,16 +2,11 @@
 
 uniform mat4 uModelViewProjection;
 uniform int uCase;
+uniform float uValues[8]; // corner values (follow tables convention)
+uniform float uIsolevel;
 
-uniform isamplerBuffer sEdgeConnectList;
-
-layout(std140)  uniform CaseToNumPolys {
-	ivec4 uCaseToNumPolys[64];
-};
-
-//layout(std140)  uniform EdgeConnectList {
-//	ivec4 uEdgeConnectList[512];
-//};
+uniform usamplerBuffer sCaseToFaceOffset; // CASE_TO_FACE_OFFSET
+uniform usamplerBuffer sFaceEdges;        // FACE_EDGES_PACKED
 
 #ifdef _VERTEX_
 
@@ -81,6 +76,23 @@ void main() {
 layout(points)         in;
 layout(triangle_strip, max_vertices = 15)  out;
 
+// vertex pair of each edge
+const ivec2 EDGE_TO_VERTICES[12] = ivec2[12](ivec2(0,1), ivec2(1,2),
+                                             ivec2(2,3), ivec2(0,3),
+                                             ivec2(4,5), ivec2(5,6),
+                                             ivec2(6,7), ivec2(4,7),
+                                             ivec2(0,4), ivec2(1,5),
+                                             ivec2(2,6), ivec2(3,7));
+
+// vertex at the crossing of the isolevel along an edge
+vec3 edge_vertex(in vec3 voxelVertices[8], int edge) {
+	ivec2 idx = EDGE_TO_VERTICES[edge];
+	float v0  = uValues[idx.x];
+	float v1  = uValues[idx.y];
+	float t   = clamp((uIsolevel - v0) / (v1 - v0), 0.0, 1.0);
+	return mix(voxelVertices[idx.x], voxelVertices[idx.y], t);
+}
+
 void main() {
 	// compute the edges of the voxel
 	float voxelHalfSize = 0.5;
@@ -103,31 +115,19 @@ void main() {
 	voxelVertices[7] = vec3(xmin, ymax, zmin);
 
 	// emit vertices using the marching cube tables
-	int numPolys = uCaseToNumPolys[uCase/4][uCase%4];
-	int i = 0;
-	int edgeList, idx1, idx2;
-	vec3 vertex;
-	while(i<numPolys) {
-		int offset = uCase*5 + i;
-//		edgeList   = uEdgeConnectList[offset/4][offset%4];
-		edgeList   = texelFetch(sEdgeConnectList, offset/4)[offset%4];
-		idx1 = edgeList    & 0x7;
-		idx2 = edgeList>>3 & 0x7;
-		vertex = 0.5 * voxelVertices[idx1]
-		       + 0.5 * voxelVertices[idx2];
-		gl_Position = uModelViewProjection * vec4(vertex,1.0);
+	int i    = int(texelFetch(sCaseToFaceOffset, uCase).r);
+	int last = int(texelFetch(sCaseToFaceOffset, uCase+1).r);
+	int edges;
+	while(i<last) {
+		edges = int(texelFetch(sFaceEdges, i).r);
+		gl_Position = uModelViewProjection
+		            * vec4(edge_vertex(voxelVertices, edges & 0xF), 1.0);
 		EmitVertex();
-		idx1 = edgeList>>6 & 0x7;
-		idx2 = edgeList>>9 & 0x7;
-		vertex = 0.5 * voxelVertices[idx1]
-		       + 0.5 * voxelVertices[idx2];
-		gl_Position = uModelViewProjection * vec4(vertex,1.0);
+		gl_Position = uModelViewProjection
+		            * vec4(edge_vertex(voxelVertices, edges>>4 & 0xF), 1.0);
 		EmitVertex();
-		idx1 = edgeList>>12 & 0x7;
-		idx2 = edgeList>>15 & 0x7;
-		vertex = 0.5 * voxelVertices[idx1]
-		       + 0.5 * voxelVertices[idx2];
-		gl_Position = uModelViewProjection * vec4(vertex,1.0);
+		gl_Position = uModelViewProjection
+		            * vec4(edge_vertex(voxelVertices, edges>>8 & 0xF), 1.0);
 		EmitVertex();
 		EndPrimitive();
 		++i;
@@ -0,0 +1,661 @@
+#include "AdaptiveMarchingCube.hpp"
+#include "Arena.hpp"
+#include "MarchingCubeCell.hpp"
+#include "MarchingCubeTables.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace mc
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// Constants
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// children of leaves and of nodes outside of the volume
+static const GLuint LEAF_CHILDREN    = ~0u;
+static const GLuint OUTSIDE_CHILDREN = ~1u;
+
+// unset node
+static const GLuint INVALID_NODE = ~0u;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Containers
+// Scratch memory comes from the arena of the thread (see ArenaScope).
+//
+////////////////////////////////////////////////////////////////////////////////
+
+typedef std::vector<GLuint, ArenaAllocator<GLuint> > _IndexVector;
+typedef std::map< GLuint, GLuint, std::less<GLuint>,
+                  ArenaAllocator<std::pair<const GLuint, GLuint> > >
+        _IndexMap;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Static functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Trilinear interpolation of eight values (corners numbered x | y<<1 | z<<2)
+static GLfloat _trilinear(const GLfloat* v, GLfloat u, GLfloat s, GLfloat t)
+{
+	GLfloat v00 = v[0] + u*(v[1]-v[0]);
+	GLfloat v10 = v[2] + u*(v[3]-v[2]);
+	GLfloat v01 = v[4] + u*(v[5]-v[4]);
+	GLfloat v11 = v[6] + u*(v[7]-v[6]);
+	GLfloat v0  = v00 + s*(v10-v00);
+	GLfloat v1  = v01 + s*(v11-v01);
+	return v0 + t*(v1-v0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Octree
+// Nodes cover cubes of cells, children are stored consecutively and numbered
+// x | y<<1 | z<<2. Nodes partially outside of the volume are always split,
+// nodes outside of it are kept with OUTSIDE_CHILDREN.
+class _Octree
+{
+public:
+	struct Node
+	{
+		GLuint origin[3]; // lower corner, in samples
+		GLuint size;      // in cells
+		GLuint children;  // index of the first child
+	};
+
+	_Octree(const Volume& volume, GLfloat tolerance):
+		mVolume(volume), mTolerance(tolerance)
+	{
+		mCellCounts[0] = volume.Width()  - 1;
+		mCellCounts[1] = volume.Height() - 1;
+		mCellCounts[2] = volume.Depth()  - 1;
+		GLuint size = 1;
+		while(size < std::max(mCellCounts[0],
+		                      std::max(mCellCounts[1], mCellCounts[2])))
+			size*= 2;
+
+		Node root = {{0, 0, 0}, size, LEAF_CHILDREN};
+		mNodes.push_back(root);
+		_IndexVector stack(1, 0);
+		while(!stack.empty())
+		{
+			GLuint n = stack.back();
+			stack.pop_back();
+			if(!_Split(n))
+				continue;
+			for(GLuint i=0; i<8; ++i)
+				stack.push_back(mNodes[n].children + i);
+		}
+	}
+
+	// get a node
+	const Node& At(GLuint node) const {return mNodes[node];}
+
+	// get the leaves inside the volume
+	const _IndexVector& Leaves() const {return mLeaves;}
+
+	// get the leaf containing a cell (INVALID_NODE outside of the volume)
+	GLuint FindLeaf(GLint x, GLint y, GLint z) const
+	{
+		const GLint cell[3] = {x, y, z};
+		for(GLuint a=0; a<3; ++a)
+			if(cell[a] < 0 || cell[a] >= GLint(mCellCounts[a]))
+				return INVALID_NODE;
+
+		GLuint n = 0;
+		while(mNodes[n].children != LEAF_CHILDREN)
+		{
+			const Node& node = mNodes[n];
+			if(node.children == OUTSIDE_CHILDREN)
+				return INVALID_NODE;
+			GLuint half  = node.size/2;
+			GLuint child = 0;
+			for(GLuint a=0; a<3; ++a)
+				child|= GLuint(GLuint(cell[a]) >= node.origin[a] + half) << a;
+			n = node.children + child;
+		}
+		return n;
+	}
+
+	// get the leaves overlapping a box of cells ([boxMin, boxMax[)
+	void FindLeaves(const GLuint* boxMin,
+	                const GLuint* boxMax,
+	                _IndexVector& leaves) const
+	{
+		_IndexVector stack(1, 0);
+		while(!stack.empty())
+		{
+			GLuint n = stack.back();
+			stack.pop_back();
+			const Node& node = mNodes[n];
+			if(node.children == OUTSIDE_CHILDREN)
+				continue;
+
+			bool overlaps = true;
+			for(GLuint a=0; a<3; ++a)
+				overlaps = overlaps && node.origin[a] < boxMax[a]
+				                    && node.origin[a] + node.size > boxMin[a];
+			if(!overlaps)
+				continue;
+
+			if(node.children == LEAF_CHILDREN)
+				leaves.push_back(n);
+			else
+				for(GLuint i=0; i<8; ++i)
+					stack.push_back(node.children + i);
+		}
+	}
+
+private:
+	// classify a node, and create its children if it must be split
+	bool _Split(GLuint n)
+	{
+		Node node = mNodes[n];
+		bool split = false;
+		for(GLuint a=0; a<3; ++a)
+		{
+			if(node.origin[a] >= mCellCounts[a])
+			{
+				mNodes[n].children = OUTSIDE_CHILDREN;
+				return false;
+			}
+			split = split || node.origin[a] + node.size > mCellCounts[a];
+		}
+		split = split || (node.size > 1 && _IsInaccurate(node));
+		if(!split)
+		{
+			mLeaves.push_back(n);
+			return false;
+		}
+
+		GLuint half = node.size/2;
+		mNodes[n].children = GLuint(mNodes.size());
+		for(GLuint i=0; i<8; ++i)
+		{
+			Node child = {{node.origin[0] + (i&1)*half,
+			               node.origin[1] + (i>>1&1)*half,
+			               node.origin[2] + (i>>2)*half},
+			              half, LEAF_CHILDREN};
+			mNodes.push_back(child);
+		}
+		return true;
+	}
+
+	// check if the trilinear interpolation of the corners of a node is
+	// further than the tolerance from one of its samples
+	bool _IsInaccurate(const Node& node) const
+	{
+		const GLuint* o = node.origin;
+		const GLuint size = node.size;
+		GLfloat corners[8];
+		for(GLuint i=0; i<8; ++i)
+			corners[i] = mVolume.At(o[0] + (i&1)*size,
+			                        o[1] + (i>>1&1)*size,
+			                        o[2] + (i>>2)*size);
+
+		const GLfloat scale = 1.0f/size;
+		for(GLuint z=0; z<=size; ++z)
+		for(GLuint y=0; y<=size; ++y)
+		for(GLuint x=0; x<=size; ++x)
+		{
+			GLfloat value = mVolume.At(o[0]+x, o[1]+y, o[2]+z);
+			GLfloat interpolated = _trilinear(corners,
+			                                  x*scale, y*scale, z*scale);
+			if(std::fabs(value - interpolated) > mTolerance)
+				return true;
+		}
+		return false;
+	}
+
+	// Members
+	std::vector<Node, ArenaAllocator<Node> > mNodes;
+	_IndexVector  mLeaves;
+	const Volume& mVolume;
+	GLfloat       mTolerance;
+	GLuint        mCellCounts[3];
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Leaf polygonizer
+// Values at the corners of the leaves, vertices keyed by the edge of the
+// volume containing their crossing (so the long edges of a leaf and the short
+// edges of its neighbours get the same vertices), and the isolines left by
+// each leaf on its faces (boundary edges of its triangles, with their mesh
+// orientation).
+class _LeafPolygonizer
+{
+public:
+	_LeafPolygonizer(const Volume& volume,
+	                 const _Octree& octree,
+	                 GLfloat isolevel,
+	                 Mesh& mesh):
+		mVolume(volume), mOctree(octree), mMesh(mesh), mIsolevel(isolevel)
+	{
+		for(GLuint e=0; e<12; ++e)
+			mEdgeFaces[e] = 0;
+		for(GLuint f=0; f<6; ++f)
+		for(GLuint k=0; k<4; ++k)
+			mEdgeFaces[FACE_TO_EDGES[f*4+k]]|= 1u << f;
+	}
+
+	// value at a corner of a leaf
+	// Corners inside a face or an edge of a larger leaf interpolate the
+	// corners of the largest such leaf, so the values are linear along the
+	// edges of the leaves.
+	GLfloat Value(GLuint x, GLuint y, GLuint z)
+	{
+		const GLuint64 key = (GLuint64(z)*mVolume.Height() + y)
+		                   * mVolume.Width() + x;
+		ValueMap::const_iterator it = mValues.find(key);
+		if(it != mValues.end())
+			return it->second;
+
+		GLuint best = INVALID_NODE;
+		GLuint bestSize = 0;
+		for(GLuint i=0; i<8; ++i)
+		{
+			GLuint leaf = mOctree.FindLeaf(GLint(x) - 1 + GLint(i&1),
+			                               GLint(y) - 1 + GLint(i>>1&1),
+			                               GLint(z) - 1 + GLint(i>>2));
+			if(leaf == INVALID_NODE)
+				continue;
+
+			const _Octree::Node& node = mOctree.At(leaf);
+			const GLuint p[3] = {x, y, z};
+			bool isCorner = true;
+			for(GLuint a=0; a<3; ++a)
+				isCorner = isCorner && (p[a] == node.origin[a]
+				                     || p[a] == node.origin[a] + node.size);
+			if(!isCorner && node.size > bestSize)
+			{
+				best = leaf;
+				bestSize = node.size;
+			}
+		}
+
+		GLfloat value = 0.0f;
+		if(best == INVALID_NODE)
+			value = mVolume.At(x, y, z);
+		else
+		{
+			const _Octree::Node& node = mOctree.At(best);
+			const GLuint* o = node.origin;
+			GLfloat corners[8];
+			for(GLuint i=0; i<8; ++i)
+				corners[i] = Value(o[0] + (i&1)*node.size,
+				                   o[1] + (i>>1&1)*node.size,
+				                   o[2] + (i>>2)*node.size);
+			const GLfloat scale = 1.0f/node.size;
+			value = _trilinear(corners,
+			                   (x - o[0])*scale,
+			                   (y - o[1])*scale,
+			                   (z - o[2])*scale);
+		}
+		mValues[key] = value;
+		return value;
+	}
+
+	// polygonize a leaf with the tables
+	void Polygonize(GLuint leaf)
+	{
+		const _Octree::Node& node = mOctree.At(leaf);
+		GLfloat values[8];
+		GLuint cubeCase = 0;
+		for(GLuint i=0; i<8; ++i)
+		{
+			values[i] = Value(node.origin[0] + vertex_offset(i, 0)*node.size,
+			                  node.origin[1] + vertex_offset(i, 1)*node.size,
+			                  node.origin[2] + vertex_offset(i, 2)*node.size);
+			cubeCase|= GLuint(values[i] < mIsolevel) << i;
+		}
+		if(cubeCase == 0 || cubeCase == 255)
+			return;
+
+		// emit faces (vertices and edges in mesh order)
+		GLuint vertices[5][3], edges[5][3];
+		GLuint count = 0;
+		for(GLuint f =  CASE_TO_FACE_OFFSET[cubeCase];
+		           f <  CASE_TO_FACE_OFFSET[cubeCase+1];
+		         ++f, ++count)
+		{
+			GLuint packed = FACE_EDGES_PACKED[f];
+			// tables wind faces towards the lower values
+			edges[count][0] = packed & 0xF;
+			edges[count][1] = packed >> 8;
+			edges[count][2] = packed >> 4 & 0xF;
+			for(GLuint k=0; k<3; ++k)
+				vertices[count][k] = _Vertex(node, edges[count][k], values);
+			mMesh.AddTriangle(vertices[count][0],
+			                  vertices[count][1],
+			                  vertices[count][2]);
+		}
+
+		// boundary edges of the triangles lie on the faces of the leaf
+		for(GLuint i=0; i<count; ++i)
+		for(GLuint k=0; k<3; ++k)
+		{
+			GLuint a = vertices[i][k], b = vertices[i][(k+1)%3];
+			GLuint shared = 0;
+			for(GLuint j=0; j<count; ++j)
+			for(GLuint l=0; l<3; ++l)
+			{
+				GLuint c = vertices[j][l], d = vertices[j][(l+1)%3];
+				shared+= (a == c && b == d) || (a == d && b == c);
+			}
+			GLuint faces = mEdgeFaces[edges[i][k]]
+			             & mEdgeFaces[edges[i][(k+1)%3]];
+			if(shared != 1 || faces == 0)
+				continue;
+
+			GLuint face = 0;
+			while(!(faces >> face & 1u))
+				++face;
+			Segment segment = {face, a, b};
+			mSegments[leaf].push_back(segment);
+		}
+	}
+
+	// fill the gaps between the isolines on the faces of a leaf and those of
+	// the smaller leaves next to it
+	void Stitch(GLuint leaf)
+	{
+		const _Octree::Node& node = mOctree.At(leaf);
+		SegmentMap::const_iterator segments = mSegments.find(leaf);
+
+		for(GLuint f=0; f<6; ++f)
+		{
+			// normal axis and side of the face
+			const GLint* c = &FACE_TO_VERTICES[f*4];
+			GLuint axis = 0;
+			while(vertex_offset(c[0], axis) != vertex_offset(c[2], axis))
+				++axis;
+			GLuint side = vertex_offset(c[0], axis);
+			if(side == 0 && node.origin[axis] == 0)
+				continue;
+
+			// cells on the other side of the face
+			GLuint boxMin[3], boxMax[3];
+			GLint center[3];
+			for(GLuint a=0; a<3; ++a)
+			{
+				boxMin[a] = node.origin[a];
+				boxMax[a] = node.origin[a] + node.size;
+				center[a] = GLint(node.origin[a] + node.size/2);
+			}
+			boxMin[axis] = side ? node.origin[axis] + node.size
+			                    : node.origin[axis] - 1;
+			boxMax[axis] = boxMin[axis] + 1;
+			center[axis] = GLint(boxMin[axis]);
+
+			// only faces split between smaller leaves have gaps
+			GLuint neighbour = mOctree.FindLeaf(center[0], center[1], center[2]);
+			if(neighbour == INVALID_NODE
+			   || mOctree.At(neighbour).size >= node.size)
+				continue;
+
+			// link the isolines, reversed: each vertex has one successor
+			// (temporaries are freed face by face)
+			ArenaScope scope;
+			_IndexMap previous;
+			if(segments != mSegments.end())
+				_Link(segments->second, f, previous);
+			_IndexVector neighbours;
+			mOctree.FindLeaves(boxMin, boxMax, neighbours);
+			for(size_t i=0; i<neighbours.size(); ++i)
+			{
+				SegmentMap::const_iterator it = mSegments.find(neighbours[i]);
+				if(it != mSegments.end())
+					_Link(it->second, f^1u, previous);
+			}
+
+			// triangulate the loops
+			_IndexVector loop;
+			while(!previous.empty())
+			{
+				const GLuint first = previous.begin()->first;
+				GLuint vertex = first;
+				bool closed = false;
+				loop.clear();
+				for(;;)
+				{
+					_IndexMap::iterator it = previous.find(vertex);
+					if(it == previous.end())
+						break;
+					loop.push_back(vertex);
+					vertex = it->second;
+					previous.erase(it);
+					if(vertex == first)
+					{
+						closed = true;
+						break;
+					}
+				}
+				if(!closed)
+					continue;
+				for(size_t i=1; i+1<loop.size(); ++i)
+					mMesh.AddTriangle(loop[0], loop[i], loop[i+1]);
+			}
+		}
+	}
+
+private:
+	// isoline segment on a face of a leaf
+	struct Segment
+	{
+		GLuint face;
+		GLuint from, to;
+	};
+	typedef std::vector<Segment, ArenaAllocator<Segment> > SegmentVector;
+	typedef std::map< GLuint, SegmentVector, std::less<GLuint>,
+	                  ArenaAllocator<std::pair<const GLuint, SegmentVector> > >
+	        SegmentMap;
+	typedef std::map< GLuint64, GLfloat, std::less<GLuint64>,
+	                  ArenaAllocator<std::pair<const GLuint64, GLfloat> > >
+	        ValueMap;
+	typedef std::map< GLuint64, GLuint, std::less<GLuint64>,
+	                  ArenaAllocator<std::pair<const GLuint64, GLuint> > >
+	        VertexMap;
+
+	// link the reversed segments of a face
+	static void _Link(const SegmentVector& segments,
+	                  GLuint face,
+	                  _IndexMap& previous)
+	{
+		for(size_t i=0; i<segments.size(); ++i)
+			if(segments[i].face == face)
+				previous[segments[i].to] = segments[i].from;
+	}
+
+	// get the vertex of an edge of a leaf (created if needed)
+	GLuint _Vertex(const _Octree::Node& node,
+	               GLuint edge,
+	               const GLfloat* values)
+	{
+		const GLuint lower = edge_lower_vertex(edge);
+		const GLuint upper = edge_upper_vertex(edge);
+		const GLuint axis  = edge_axis(edge);
+		GLfloat t = (mIsolevel - values[lower])
+		          / (values[upper] - values[lower]);
+
+		// edge of the volume containing the crossing (a crossing at the end
+		// of an edge belongs to the edge before it)
+		GLfloat s = t*node.size;
+		GLint step = std::min(std::max(GLint(std::ceil(s)) - 1, 0),
+		                      GLint(node.size) - 1);
+		GLuint e[3];
+		for(GLuint a=0; a<3; ++a)
+			e[a] = node.origin[a] + vertex_offset(lower, a)*node.size;
+		e[axis]+= step;
+
+		const GLuint64 key = ((GLuint64(e[2])*mVolume.Height() + e[1])
+		                   * mVolume.Width() + e[0])*3 + axis;
+		VertexMap::const_iterator it = mVertices.find(key);
+		if(it != mVertices.end())
+			return it->second;
+
+		// position and normal along the edge of the volume
+		const Vector3& o = mVolume.Origin();
+		const Vector3& sp = mVolume.Spacing();
+		GLfloat g0[3], g1[3];
+		mVolume.Gradient(e[0], e[1], e[2], g0);
+		mVolume.Gradient(e[0] + (axis == 0), e[1] + (axis == 1),
+		                 e[2] + (axis == 2), g1);
+		GLfloat u = s - step;
+		GLfloat p[3] = {GLfloat(e[0]), GLfloat(e[1]), GLfloat(e[2])};
+		p[axis]+= u;
+		GLuint index = mMesh.AddVertex(o[0] + sp[0]*p[0],
+		                               o[1] + sp[1]*p[1],
+		                               o[2] + sp[2]*p[2]);
+		GLfloat n[3] = {g0[0] + u*(g1[0]-g0[0]),
+		                g0[1] + u*(g1[1]-g0[1]),
+		                g0[2] + u*(g1[2]-g0[2])};
+		GLfloat length = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+		if(length > 0.0f)
+			mMesh.AddNormal(n[0]/length, n[1]/length, n[2]/length);
+		else
+			mMesh.AddNormal(0.0f, 0.0f, 0.0f);
+		mVertices[key] = index;
+		return index;
+	}
+
+	// Members
+	ValueMap   mValues;
+	VertexMap  mVertices;
+	SegmentMap mSegments; // per leaf
+	GLuint mEdgeFaces[12]; // bit f is set if the edge is on face f
+	const Volume&  mVolume;
+	const _Octree& mOctree;
+	Mesh&          mMesh;
+	GLfloat        mIsolevel;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Adaptive marching cube extraction
+GLuint extract_adaptive_marching_cube(const Volume& volume,
+                                      GLfloat isolevel,
+                                      GLfloat tolerance,
+                                      Mesh& mesh)
+{
+	mesh.Clear();
+	if(volume.Width() < 2 || volume.Height() < 2 || volume.Depth() < 2)
+		return 0;
+
+	ArenaScope scope;
+	_Octree octree(volume, tolerance);
+	_LeafPolygonizer polygonizer(volume, octree, isolevel, mesh);
+	const _IndexVector& leaves = octree.Leaves();
+	for(size_t i=0; i<leaves.size(); ++i)
+		polygonizer.Polygonize(leaves[i]);
+	for(size_t i=0; i<leaves.size(); ++i)
+		polygonizer.Stitch(leaves[i]);
+	return GLuint(leaves.size());
+}
+
+} // namespace mc
+
+
+
+// Tests of the extraction: closed and manifold meshes (each edge has one
+// opposite half edge) of surfaces inside the volume, with and without
+// tolerance, and as many leaves as cells without tolerance
+// (build with -DADAPTIVE_MARCHING_CUBE_TEST mc/*.cpp core/*.cpp
+// Framework.cpp Trace.cpp and the OpenGL libraries)
+#ifdef ADAPTIVE_MARCHING_CUBE_TEST
+#include <cstdio>
+#include <cstdlib>
+
+// fields, positive on the borders of the volume
+static GLfloat _field(GLuint field, GLfloat x, GLfloat y, GLfloat z)
+{
+	GLfloat sphere = std::sqrt(x*x + y*y + z*z) - 0.75f;
+	switch(field)
+	{
+	case 0:
+		return sphere;
+	case 1: // torus
+	{
+		GLfloat r = std::sqrt(x*x + y*y) - 0.55f;
+		return std::sqrt(r*r + z*z) - 0.25f;
+	}
+	default: // gyroid in a sphere
+		return std::max(sphere, std::sin(x*9.0f)*std::cos(y*9.0f)
+		                      + std::sin(y*9.0f)*std::cos(z*9.0f)
+		                      + std::sin(z*9.0f)*std::cos(x*9.0f));
+	}
+}
+
+// each half edge has one opposite half edge, and no other half edge with
+// the same vertices
+static bool _is_closed_manifold(const mc::Mesh& mesh)
+{
+	std::map<std::pair<GLuint, GLuint>, GLuint> halfEdges;
+	const std::vector<GLuint>& indexes = mesh.Indexes();
+	for(size_t i=0; i<indexes.size(); ++i)
+	{
+		GLuint i0 = indexes[i], i1 = indexes[i - i%3 + (i+1)%3];
+		if(i0 == i1)
+			return false;
+		++halfEdges[std::make_pair(i0, i1)];
+	}
+	std::map<std::pair<GLuint, GLuint>, GLuint>::const_iterator it;
+	for(it = halfEdges.begin(); it != halfEdges.end(); ++it)
+	{
+		std::map<std::pair<GLuint, GLuint>, GLuint>::const_iterator opposite
+			= halfEdges.find(std::make_pair(it->first.second,
+			                                it->first.first));
+		if(it->second != 1 || opposite == halfEdges.end()
+		   || opposite->second != 1)
+			return false;
+	}
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	// not a power of two, so some nodes are partially outside
+	const GLuint W = 41, H = 37, D = 45;
+	const GLfloat TOLERANCES[] = {0.0f, 0.005f, 0.02f};
+	int failures = 0;
+	mc::Volume volume(W, H, D);
+	for(GLuint f=0; f<3; ++f)
+	{
+		for(GLuint z=0; z<D; ++z)
+		for(GLuint y=0; y<H; ++y)
+		for(GLuint x=0; x<W; ++x)
+			volume.At(x,y,z) = _field(f, (x*2.0f + 0.3f)/(W-1) - 1.0f,
+			                             (y*2.0f - 0.2f)/(H-1) - 1.0f,
+			                             (z*2.0f + 0.1f)/(D-1) - 1.0f);
+		for(GLuint t=0; t<3; ++t)
+		{
+			mc::Mesh mesh;
+			GLuint leafCount = mc::extract_adaptive_marching_cube(
+			                       volume, 0.0f, TOLERANCES[t], mesh);
+			bool isValid = mesh.TriangleCount() > 0
+			            && mesh.Normals().size() == mesh.Positions().size()
+			            && _is_closed_manifold(mesh);
+			if(TOLERANCES[t] == 0.0f)
+				isValid = isValid && leafCount == (W-1)*(H-1)*(D-1);
+			else
+				isValid = isValid && leafCount < (W-1)*(H-1)*(D-1);
+			if(!isValid)
+			{
+				++failures;
+				std::fprintf(stderr, "field %u, tolerance %g failed "
+				             "(%u leaves, %u triangles)\n", f, TOLERANCES[t],
+				             leafCount, mesh.TriangleCount());
+			}
+		}
+	}
+
+	std::printf("%s (%d failures)\n", failures ? "FAILED" : "PASSED", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif // ADAPTIVE_MARCHING_CUBE_TEST
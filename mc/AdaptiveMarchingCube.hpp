@@ -0,0 +1,36 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   AdaptiveMarchingCube.hpp
+// \author J Dupuy
+// \brief  CPU marching cube isosurface extraction on an adaptive octree.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MC_ADAPTIVE_MARCHING_CUBE_HPP
+#define MC_ADAPTIVE_MARCHING_CUBE_HPP
+
+#include "Volume.hpp"
+#include "Mesh.hpp"
+
+namespace mc
+{
+	// Extract the isosurface of a volume on an adaptive octree
+	// Octree nodes are cubes of a power of two cells. A node is split if the
+	// trilinear interpolation of its corners is further than tolerance from
+	// one of its samples, so smooth regions end up in large leaves. Each leaf
+	// is polygonized with the tables, from the values at its corners. Corners
+	// lying on a face or an edge of a larger leaf take the interpolated value
+	// of that leaf (within tolerance of the samples), so crossings on shared
+	// edges match, and the gaps between the isolines of a large face and those
+	// of the smaller leaves next to it are filled with triangles lying in the
+	// face: the mesh is closed.
+	// Samples below the isolevel are inside the surface, normals are set. The
+	// mesh is cleared first. Returns the number of leaves.
+	GLuint extract_adaptive_marching_cube(const Volume& volume,
+	                                      GLfloat isolevel,
+	                                      GLfloat tolerance,
+	                                      Mesh& mesh);
+
+} // namespace mc
+
+#endif
+
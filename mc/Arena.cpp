@@ -0,0 +1,177 @@
+#include "Arena.hpp"
+#include "Framework.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace mc
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// Constants
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// arena of each thread (deleted by ReleaseThreadArena, the main thread
+// keeps its own until the program ends)
+static FW_THREAD_LOCAL Arena* sThreadArena = NULL;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Arena
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors / Destructor
+Arena::Arena(size_t blockSize):
+	mBlockSize(blockSize),
+	mBlock(0), mOffset(0), mUsed(0),
+	mReserved(0), mPeakUsed(0)
+{
+#ifndef NDEBUG
+	assert(blockSize > 0);
+#endif
+}
+
+Arena::~Arena()
+{
+	Release();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Manipulation
+void* Arena::Allocate(size_t byteCount, size_t alignment)
+{
+#ifndef NDEBUG
+	assert(alignment > 0 && (alignment & (alignment-1)) == 0);
+#endif
+	for(;;)
+	{
+		if(mBlock < mBlocks.size())
+		{
+			// align the address, not the offset (blocks are only aligned
+			// for the fundamental types)
+			const Block& block = mBlocks[mBlock];
+			size_t address = reinterpret_cast<size_t>(block.data) + mOffset;
+			size_t offset  = mOffset + ((alignment - address%alignment)
+			                            & (alignment-1));
+			if(offset + byteCount <= block.size)
+			{
+				mOffset = offset + byteCount;
+				mPeakUsed = std::max(mPeakUsed, mUsed + mOffset);
+				return block.data + offset;
+			}
+
+			// next block
+			mUsed+= mOffset;
+			mOffset = 0;
+			++mBlock;
+			if(mBlock < mBlocks.size()
+			   && mBlocks[mBlock].size >= byteCount + alignment)
+				continue;
+		}
+
+		// insert a new block (kept blocks that are too small are skipped
+		// next time, they are reused by smaller allocations after a rewind)
+		Block block;
+		block.size = std::max(mBlockSize, byteCount + alignment);
+		block.data = new char[block.size];
+		mBlocks.insert(mBlocks.begin() + mBlock, block);
+		mReserved+= block.size;
+	}
+}
+
+void Arena::Rewind(const Marker& marker)
+{
+#ifndef NDEBUG
+	assert(marker.block <= mBlock);
+	assert(marker.block < mBlock || marker.offset <= mOffset);
+#endif
+	mBlock  = marker.block;
+	mOffset = marker.offset;
+	mUsed   = marker.used;
+}
+
+void Arena::Reset()
+{
+	mBlock  = 0;
+	mOffset = 0;
+	mUsed   = 0;
+}
+
+void Arena::Release()
+{
+	for(size_t i=0; i<mBlocks.size(); ++i)
+		delete[] mBlocks[i].data;
+	mBlocks.clear();
+	Reset();
+	mReserved = 0;
+	mPeakUsed = 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Queries
+Arena::Marker Arena::GetMarker() const
+{
+	Marker marker = {mBlock, mOffset, mUsed};
+	return marker;
+}
+
+size_t Arena::BytesReserved() const
+{
+	return mReserved;
+}
+
+size_t Arena::BytesUsed() const
+{
+	return mUsed + mOffset;
+}
+
+size_t Arena::PeakBytesUsed() const
+{
+	return mPeakUsed;
+}
+
+Arena& Arena::ThreadArena()
+{
+	if(NULL == sThreadArena)
+		sThreadArena = new Arena;
+	return *sThreadArena;
+}
+
+void Arena::ReleaseThreadArena()
+{
+	delete sThreadArena;
+	sThreadArena = NULL;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// ArenaScope
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors / Destructor
+ArenaScope::ArenaScope(Arena& arena):
+	mArena(arena), mMarker(arena.GetMarker())
+{}
+
+ArenaScope::~ArenaScope()
+{
+	mArena.Rewind(mMarker);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Access
+Arena& ArenaScope::GetArena() const
+{
+	return mArena;
+}
+
+} // namespace mc
+
@@ -0,0 +1,180 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   Arena.hpp
+// \author J Dupuy
+// \brief  Arena allocator for the scratch memory of the extraction algorithms.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MC_ARENA_HPP
+#define MC_ARENA_HPP
+
+#include <cstddef>
+#include <new>
+#include <vector>
+#include "glew.hpp"
+
+namespace mc
+{
+	// Arena allocator
+	// Memory is taken from large blocks by bumping a pointer, and is given
+	// back all at once by rewinding the arena (see ArenaScope). Blocks are
+	// kept until the arena is released, so work done brick after brick stops
+	// reaching the heap once the arena has grown to the size of one brick.
+	// Allocations larger than the block size get a block of their own.
+	// An arena must only be used by one thread, see ThreadArena.
+	class Arena
+	{
+	public:
+		// Constants
+		enum {DEFAULT_BLOCK_SIZE = 1<<20}; // in bytes
+
+		// Position of the arena (see GetMarker and Rewind)
+		struct Marker
+		{
+			size_t block;
+			size_t offset;
+			size_t used;
+		};
+
+		// Constructors / Destructor
+		explicit Arena(size_t blockSize = DEFAULT_BLOCK_SIZE);
+		~Arena();
+
+		// Manipulation
+			// allocate uninitialized memory (alignment is a power of two, the
+			// default suits all the types and SSE registers)
+		void* Allocate(size_t byteCount, size_t alignment = 16);
+			// allocate an uninitialized array (for plain old data only)
+		template<typename T> T* Allocate(size_t count);
+			// free all the allocations made since a marker was taken
+		void Rewind(const Marker& marker);
+			// free all the allocations (blocks are kept)
+		void Reset();
+			// free all the allocations and the blocks
+		void Release();
+
+		// Queries (in bytes)
+		Marker GetMarker()       const;
+		size_t BytesReserved()   const; // in blocks
+		size_t BytesUsed()       const; // by live allocations
+		size_t PeakBytesUsed()   const; // since construction or Release
+
+		// Arena of the calling thread (created on first call)
+		static Arena& ThreadArena();
+			// delete the arena of the calling thread, if any (threads
+			// must call it before they exit, the workers of ThreadPool do)
+		static void ReleaseThreadArena();
+
+	private:
+		// Non copyable
+		Arena(const Arena& arena);
+		Arena& operator=(const Arena& arena);
+
+		// Block
+		struct Block
+		{
+			char*  data;
+			size_t size;
+		};
+
+		// Members
+		std::vector<Block> mBlocks;
+		size_t mBlockSize;
+		size_t mBlock;     // current block
+		size_t mOffset;    // in the current block
+		size_t mUsed;      // in the blocks before the current one
+		size_t mReserved;
+		size_t mPeakUsed;
+	};
+
+
+	// Scoped arena: rewinds an arena to its state at construction
+	// (one per brick, or per call for temporary buffers)
+	class ArenaScope
+	{
+	public:
+		// Constructors / Destructor
+		explicit ArenaScope(Arena& arena = Arena::ThreadArena());
+		~ArenaScope();
+
+		// Access
+		Arena& GetArena() const;
+
+	private:
+		// Non copyable
+		ArenaScope(const ArenaScope& scope);
+		ArenaScope& operator=(const ArenaScope& scope);
+
+		// Members
+		Arena&        mArena;
+		Arena::Marker mMarker;
+	};
+
+
+	// Standard allocator on an arena, for the containers of the engines
+	// (deallocation does nothing, memory comes back when the arena is
+	// rewound: containers must not outlive the scope they were made in)
+	template<typename T>
+	class ArenaAllocator
+	{
+	public:
+		typedef T         value_type;
+		typedef T*        pointer;
+		typedef const T*  const_pointer;
+		typedef T&        reference;
+		typedef const T&  const_reference;
+		typedef size_t    size_type;
+		typedef ptrdiff_t difference_type;
+		template<typename U> struct rebind {typedef ArenaAllocator<U> other;};
+
+		// Constructors / Destructor
+		explicit ArenaAllocator(Arena& arena = Arena::ThreadArena()):
+			mArena(&arena) {}
+		template<typename U> ArenaAllocator(const ArenaAllocator<U>& allocator):
+			mArena(&allocator.GetArena()) {}
+
+		// Manipulation
+		pointer allocate(size_type count, const void* = 0)
+		{
+			return static_cast<pointer>(mArena->Allocate(count*sizeof(T)));
+		}
+		void deallocate(pointer, size_type) {}
+		void construct(pointer p, const T& value) {new(p) T(value);}
+		void destroy(pointer p) {p->~T();}
+
+		// Queries
+		pointer address(reference x) const             {return &x;}
+		const_pointer address(const_reference x) const {return &x;}
+		size_type max_size() const {return size_type(-1)/sizeof(T);}
+		Arena& GetArena() const {return *mArena;}
+
+	private:
+		// Members
+		Arena* mArena;
+	};
+
+	template<typename T, typename U>
+	bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+	{
+		return &a.GetArena() == &b.GetArena();
+	}
+
+	template<typename T, typename U>
+	bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+	{
+		return &a.GetArena() != &b.GetArena();
+	}
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// Arena inline functions
+	template<typename T>
+	T* Arena::Allocate(size_t count)
+	{
+		return static_cast<T*>(Allocate(count*sizeof(T)));
+	}
+
+} // namespace mc
+
+#endif
+
@@ -0,0 +1,780 @@
+#include "BrickVolume.hpp"
+#include "Arena.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace mc
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// Constants
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// unset brick or cache slot
+static const GLuint INVALID_INDEX = ~0u;
+
+// quotients of the Rice codes from which residuals are stored raw
+static const GLuint RICE_ESCAPE = 32;
+
+// file header
+static const char   FILE_MAGIC[4] = {'M', 'C', 'B', 'V'};
+static const GLuint FILE_VERSION  = 1;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Exceptions
+//
+////////////////////////////////////////////////////////////////////////////////
+class _FileReadException : public fw::FWException
+{
+public:
+	_FileReadException(const std::string& file)
+	{
+		mMessage = "Could not read file " + file + ".";
+	}
+};
+
+class _FileWriteException : public fw::FWException
+{
+public:
+	_FileWriteException(const std::string& file)
+	{
+		mMessage = "Could not write file " + file + ".";
+	}
+};
+
+class _InvalidBrickVolumeException : public fw::FWException
+{
+public:
+	_InvalidBrickVolumeException(const std::string& file)
+	{
+		mMessage = "File " + file + " is not a compressed volume.";
+	}
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Static functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Lossless codes: bits of the samples, ordered as the samples
+static GLuint _float_to_code(GLfloat value)
+{
+	GLuint bits;
+	std::memcpy(&bits, &value, 4);
+	return bits & 0x80000000u ? ~bits : bits | 0x80000000u;
+}
+
+static GLfloat _code_to_float(GLuint code)
+{
+	GLuint bits = code & 0x80000000u ? code & 0x7FFFFFFFu : ~code;
+	GLfloat value;
+	std::memcpy(&value, &bits, 4);
+	return value;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Lorenzo prediction of value (x,y,z) of a brick from its lower neighbours
+// (neighbours outside the brick are zero). Quantization codes are predicted
+// from codes (arithmetic wraps around), lossless codes from the samples:
+// sums of sample bits predict poorly across exponents.
+template<typename T>
+static T _predict(const T* values,
+                  GLuint x, GLuint y, GLuint z,
+                  const GLuint* extent)
+{
+	const size_t sy = extent[0];
+	const size_t sz = size_t(extent[0])*extent[1];
+	const T* v = values + x + y*sy + z*sz;
+	T prediction = T(0);
+	if(x)           prediction+= v[-1];
+	if(y)           prediction+= v[-sy];
+	if(z)           prediction+= v[-sz];
+	if(x && y)      prediction-= v[-1-sy];
+	if(x && z)      prediction-= v[-1-sz];
+	if(y && z)      prediction-= v[-sy-sz];
+	if(x && y && z) prediction+= v[-1-sy-sz];
+	return prediction;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Map signed residuals to small unsigned integers (0,-1,1,-2... to 0,1,2,3...)
+static GLuint _zigzag(GLuint residual)
+{
+	return residual << 1 ^ GLuint(GLint(residual) >> 31);
+}
+
+static GLuint _unzigzag(GLuint value)
+{
+	return value >> 1 ^ (0u - (value & 1u));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Bit streams (least significant bits first)
+class _BitWriter
+{
+public:
+	explicit _BitWriter(std::vector<GLubyte>& bytes):
+		mBytes(bytes), mBits(0), mCount(0) {}
+
+	// write the bitCount low bits of value (bitCount <= 32)
+	void Write(GLuint value, GLuint bitCount)
+	{
+		mBits|= (GLuint64(value) & ((GLuint64(1) << bitCount) - 1)) << mCount;
+		mCount+= bitCount;
+		for(; mCount >= 8; mCount-= 8, mBits>>= 8)
+			mBytes.push_back(GLubyte(mBits));
+	}
+
+	// write the last bits
+	void Flush()
+	{
+		if(mCount > 0)
+			mBytes.push_back(GLubyte(mBits));
+		mBits  = 0;
+		mCount = 0;
+	}
+
+private:
+	std::vector<GLubyte>& mBytes;
+	GLuint64 mBits;
+	GLuint   mCount;
+};
+
+class _BitReader
+{
+public:
+	_BitReader(const GLubyte* begin, const GLubyte* end):
+		mByte(begin), mEnd(end), mBits(0), mCount(0) {}
+
+	// read bitCount bits (bitCount <= 32, zeros past the end)
+	GLuint Read(GLuint bitCount)
+	{
+		for(; mCount < bitCount; mCount+= 8)
+			mBits|= GLuint64(mByte < mEnd ? *mByte++ : 0) << mCount;
+		GLuint value = GLuint(mBits & ((GLuint64(1) << bitCount) - 1));
+		mBits>>= bitCount;
+		mCount-= bitCount;
+		return value;
+	}
+
+private:
+	const GLubyte* mByte;
+	const GLubyte* mEnd;
+	GLuint64       mBits;
+	GLuint         mCount;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Rice codes: quotient in unary, k bit remainder (escaped values are raw)
+static void _write_rice(_BitWriter& writer, GLuint value, GLuint k)
+{
+	GLuint quotient = value >> k;
+	if(quotient < RICE_ESCAPE)
+	{
+		writer.Write((1u << quotient) - 1u, quotient);
+		writer.Write(0, 1);
+		writer.Write(value, k);
+	}
+	else
+	{
+		writer.Write(~0u, RICE_ESCAPE);
+		writer.Write(value, 32);
+	}
+}
+
+static GLuint _read_rice(_BitReader& reader, GLuint k)
+{
+	GLuint quotient = 0;
+	while(quotient < RICE_ESCAPE && reader.Read(1))
+		++quotient;
+	if(quotient == RICE_ESCAPE)
+		return reader.Read(32);
+	return quotient << k | reader.Read(k);
+}
+
+// parameter with the shortest codes (the length is convex in k)
+static GLuint _rice_parameter(const GLuint* values, size_t count)
+{
+	GLuint64 bestLength = ~GLuint64(0);
+	GLuint best = 0;
+	for(GLuint k=0; k<32; ++k)
+	{
+		GLuint64 length = 0;
+		for(size_t i=0; i<count; ++i)
+		{
+			GLuint quotient = values[i] >> k;
+			length+= quotient < RICE_ESCAPE ? quotient + 1 + k
+			                                : RICE_ESCAPE + 32;
+		}
+		if(length >= bestLength)
+			break;
+		bestLength = length;
+		best = k;
+	}
+	return best;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Little endian file fields
+static void _write_uint(std::ofstream& file, GLuint64 value, GLuint byteCount)
+{
+	GLubyte bytes[8];
+	for(GLuint i=0; i<byteCount; ++i)
+		bytes[i] = GLubyte(value >> (8*i));
+	file.write(reinterpret_cast<const char*>(bytes), byteCount);
+}
+
+static void _write_float(std::ofstream& file, GLfloat value)
+{
+	GLuint bits;
+	std::memcpy(&bits, &value, 4);
+	_write_uint(file, bits, 4);
+}
+
+static GLuint64 _read_uint(std::ifstream& file, GLuint byteCount)
+{
+	GLubyte bytes[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	file.read(reinterpret_cast<char*>(bytes), byteCount);
+	GLuint64 value = 0;
+	for(GLuint i=0; i<byteCount; ++i)
+		value|= GLuint64(bytes[i]) << (8*i);
+	return value;
+}
+
+static GLfloat _read_float(std::ifstream& file)
+{
+	GLuint bits = GLuint(_read_uint(file, 4));
+	GLfloat value;
+	std::memcpy(&value, &bits, 4);
+	return value;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// BrickVolume
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors
+BrickVolume::BrickVolume():
+	mData(), mBrickOffsets(),
+	mWidth(0), mHeight(0), mDepth(0), mBrickSize(DEFAULT_BRICK_SIZE),
+	mErrorBound(0.0f), mMinimum(0.0f), mStep(0.0),
+	mSpacing(1,1,1), mOrigin(0,0,0), mCacheSize(0),
+	mCacheSamples(), mCacheBricks(), mCacheTimes(), mBrickSlots(),
+	mTime(0), mDecompressedCount(0)
+{
+	mBrickCounts[0] = mBrickCounts[1] = mBrickCounts[2] = 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Manipulation
+void BrickVolume::Compress(const Volume& volume,
+                           GLfloat errorBound,
+                           GLuint brickSize)
+{
+#ifndef NDEBUG
+	assert(brickSize > 0 && errorBound >= 0.0f);
+#endif
+	Clear();
+	mWidth     = volume.Width();
+	mHeight    = volume.Height();
+	mDepth     = volume.Depth();
+	mBrickSize = brickSize;
+	mSpacing   = volume.Spacing();
+	mOrigin    = volume.Origin();
+	mBrickCounts[0] = (mWidth + brickSize - 1) / brickSize;
+	mBrickCounts[1] = (mHeight + brickSize - 1) / brickSize;
+	mBrickCounts[2] = (mDepth + brickSize - 1) / brickSize;
+
+	// quantization step (0 for lossless codes), with room for the rounding
+	// of the decompressed samples
+	if(errorBound > 0.0f && volume.SampleCount() > 0)
+	{
+		const GLfloat* samples = volume.Samples();
+		GLfloat minimum = *std::min_element(samples,
+		                                    samples + volume.SampleCount());
+		GLfloat maximum = *std::max_element(samples,
+		                                    samples + volume.SampleCount());
+		GLdouble magnitude = std::max(std::fabs(minimum), std::fabs(maximum));
+		GLdouble step = 2.0*(GLdouble(errorBound) - magnitude*FLT_EPSILON);
+		if(step > 0.0
+		   && (GLdouble(maximum) - minimum)/step < GLdouble(1u << 31))
+		{
+			mErrorBound = errorBound;
+			mMinimum    = minimum;
+			mStep       = step;
+		}
+	}
+
+	mBrickOffsets.push_back(0);
+	for(GLuint bz=0; bz<mBrickCounts[2]; ++bz)
+	for(GLuint by=0; by<mBrickCounts[1]; ++by)
+	for(GLuint bx=0; bx<mBrickCounts[0]; ++bx)
+		_EncodeBrick(volume, bx, by, bz);
+	_ResetCache();
+}
+
+void BrickVolume::Clear()
+{
+	std::vector<GLubyte>().swap(mData);
+	std::vector<GLuint64>().swap(mBrickOffsets);
+	mWidth = mHeight = mDepth = 0;
+	mBrickCounts[0] = mBrickCounts[1] = mBrickCounts[2] = 0;
+	mErrorBound = mMinimum = 0.0f;
+	mStep = 0.0;
+	_ResetCache();
+}
+
+void BrickVolume::SetCacheSize(GLuint brickCount)
+{
+	mCacheSize = brickCount;
+	_ResetCache();
+}
+
+void BrickVolume::Save(const std::string& filename) const
+throw(fw::FWException)
+{
+	std::ofstream file(filename.c_str(), std::ios::out | std::ios::binary);
+	if(!file)
+		throw _FileWriteException(filename);
+
+	file.write(FILE_MAGIC, 4);
+	_write_uint(file, FILE_VERSION, 4);
+	_write_uint(file, mWidth, 4);
+	_write_uint(file, mHeight, 4);
+	_write_uint(file, mDepth, 4);
+	_write_uint(file, mBrickSize, 4);
+	_write_float(file, mErrorBound);
+	_write_float(file, mMinimum);
+	GLuint64 stepBits;
+	std::memcpy(&stepBits, &mStep, 8);
+	_write_uint(file, stepBits, 8);
+	for(GLuint i=0; i<3; ++i)
+		_write_float(file, mSpacing[i]);
+	for(GLuint i=0; i<3; ++i)
+		_write_float(file, mOrigin[i]);
+	for(size_t i=0; i<mBrickOffsets.size(); ++i)
+		_write_uint(file, mBrickOffsets[i], 8);
+	if(!mData.empty())
+		file.write(reinterpret_cast<const char*>(&mData[0]), mData.size());
+	if(!file)
+		throw _FileWriteException(filename);
+}
+
+void BrickVolume::Load(const std::string& filename) throw(fw::FWException)
+{
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+	if(!file)
+		throw _FileReadException(filename);
+
+	char magic[4] = {0, 0, 0, 0};
+	file.read(magic, 4);
+	if(!std::equal(magic, magic + 4, FILE_MAGIC)
+	   || _read_uint(file, 4) != FILE_VERSION)
+		throw _InvalidBrickVolumeException(filename);
+
+	Clear();
+	mWidth      = GLuint(_read_uint(file, 4));
+	mHeight     = GLuint(_read_uint(file, 4));
+	mDepth      = GLuint(_read_uint(file, 4));
+	mBrickSize  = GLuint(_read_uint(file, 4));
+	mErrorBound = _read_float(file);
+	mMinimum    = _read_float(file);
+	GLuint64 stepBits = _read_uint(file, 8);
+	std::memcpy(&mStep, &stepBits, 8);
+	for(GLuint i=0; i<3; ++i)
+		mSpacing[i] = _read_float(file);
+	for(GLuint i=0; i<3; ++i)
+		mOrigin[i] = _read_float(file);
+	if(!file || mBrickSize == 0 || (mStep > 0.0) != (mErrorBound > 0.0f))
+	{
+		Clear();
+		throw _InvalidBrickVolumeException(filename);
+	}
+	mBrickCounts[0] = (mWidth + mBrickSize - 1) / mBrickSize;
+	mBrickCounts[1] = (mHeight + mBrickSize - 1) / mBrickSize;
+	mBrickCounts[2] = (mDepth + mBrickSize - 1) / mBrickSize;
+
+	// the offsets and the data of the bricks must fit in the file, and the
+	// offsets must increase (each brick stores at least its Rice parameter)
+	const std::streampos offsetsPosition = file.tellg();
+	file.seekg(0, std::ios::end);
+	const GLuint64 remaining = GLuint64(file.tellg() - offsetsPosition);
+	file.seekg(offsetsPosition);
+	if(!file || (GLuint64(BrickCount()) + 1)*8 > remaining)
+	{
+		Clear();
+		throw _InvalidBrickVolumeException(filename);
+	}
+	mBrickOffsets.resize(BrickCount() + 1);
+	bool isValid = true;
+	for(size_t i=0; i<mBrickOffsets.size(); ++i)
+	{
+		mBrickOffsets[i] = _read_uint(file, 8);
+		isValid = isValid && (i > 0 ? mBrickOffsets[i] > mBrickOffsets[i-1]
+		                            : mBrickOffsets[i] == 0);
+	}
+	if(!file || !isValid
+	   || mBrickOffsets.back() > remaining - mBrickOffsets.size()*8)
+	{
+		Clear();
+		throw _InvalidBrickVolumeException(filename);
+	}
+	mData.resize(size_t(mBrickOffsets.back()));
+	if(!mData.empty())
+		file.read(reinterpret_cast<char*>(&mData[0]), mData.size());
+	if(!file)
+	{
+		Clear();
+		throw _FileReadException(filename);
+	}
+
+	// the Rice parameters must be valid shifts
+	for(size_t i=0; i+1<mBrickOffsets.size(); ++i)
+		if(mData[size_t(mBrickOffsets[i])] >= 32)
+		{
+			Clear();
+			throw _InvalidBrickVolumeException(filename);
+		}
+	_ResetCache();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Decompression
+void BrickVolume::Decompress(Volume& volume) const
+{
+	DecompressSlices(0, mDepth, volume);
+}
+
+void BrickVolume::DecompressSlices(GLuint first,
+                                   GLuint end,
+                                   Volume& volume) const
+{
+#ifndef NDEBUG
+	assert(first <= end && end <= mDepth);
+#endif
+	volume.Resize(mWidth, mHeight, end - first);
+	volume.SetSpacing(mSpacing);
+	volume.SetOrigin(Vector3(mOrigin[0], mOrigin[1],
+	                         mOrigin[2] + mSpacing[2]*GLfloat(first)));
+	if(first == end)
+		return;
+
+	// copy the rows of the bricks overlapping the slices
+	const GLuint B = mBrickSize;
+	GLfloat* samples = volume.Samples();
+	for(GLuint bz=first/B; bz<=(end-1)/B; ++bz)
+	for(GLuint by=0; by<mBrickCounts[1]; ++by)
+	for(GLuint bx=0; bx<mBrickCounts[0]; ++bx)
+	{
+		const GLfloat* brick = _Brick(bx, by, bz);
+		GLuint extent[3];
+		_BrickExtent(bx, by, bz, extent);
+		GLuint z0 = std::max(first, bz*B);
+		GLuint z1 = std::min(end, bz*B + extent[2]);
+		for(GLuint z=z0; z<z1; ++z)
+		for(GLuint y=0; y<extent[1]; ++y)
+		{
+			const GLfloat* row = brick + ((z - bz*B)*B + y)*B;
+			std::copy(row, row + extent[0],
+			          samples + (size_t(z - first)*mHeight + by*B + y)
+			                    *mWidth + bx*B);
+		}
+	}
+}
+
+GLfloat BrickVolume::At(GLuint x, GLuint y, GLuint z) const
+{
+#ifndef NDEBUG
+	assert(x < mWidth && y < mHeight && z < mDepth);
+#endif
+	const GLuint B = mBrickSize;
+	const GLfloat* brick = _Brick(x/B, y/B, z/B);
+	return brick[((z%B)*B + y%B)*B + x%B];
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Queries
+GLuint BrickVolume::Width()            const {return mWidth;}
+GLuint BrickVolume::Height()           const {return mHeight;}
+GLuint BrickVolume::Depth()            const {return mDepth;}
+GLuint BrickVolume::BrickSize()        const {return mBrickSize;}
+GLfloat BrickVolume::ErrorBound()      const {return mErrorBound;}
+bool BrickVolume::IsLossless()         const {return mErrorBound == 0.0f;}
+const Vector3& BrickVolume::Spacing()  const {return mSpacing;}
+const Vector3& BrickVolume::Origin()   const {return mOrigin;}
+GLuint BrickVolume::CacheSize()        const {return GLuint(mCacheBricks.size());}
+GLuint64 BrickVolume::DecompressedCount() const {return mDecompressedCount;}
+
+GLuint BrickVolume::BrickCount() const
+{
+	return mBrickCounts[0]*mBrickCounts[1]*mBrickCounts[2];
+}
+
+size_t BrickVolume::CompressedSize() const
+{
+	return mData.size() + mBrickOffsets.size()*sizeof(GLuint64);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Internal manipulation
+void BrickVolume::_BrickExtent(GLuint bx, GLuint by, GLuint bz,
+                               GLuint* extent) const
+{
+	extent[0] = std::min(mBrickSize, mWidth - bx*mBrickSize);
+	extent[1] = std::min(mBrickSize, mHeight - by*mBrickSize);
+	extent[2] = std::min(mBrickSize, mDepth - bz*mBrickSize);
+}
+
+void BrickVolume::_EncodeBrick(const Volume& volume,
+                               GLuint bx, GLuint by, GLuint bz)
+{
+	GLuint extent[3];
+	_BrickExtent(bx, by, bz, extent);
+	const size_t count = size_t(extent[0])*extent[1]*extent[2];
+
+	ArenaScope scope;
+	GLfloat* samples  = scope.GetArena().Allocate<GLfloat>(count);
+	GLuint* codes     = scope.GetArena().Allocate<GLuint>(count);
+	GLuint* residuals = scope.GetArena().Allocate<GLuint>(count);
+	size_t i = 0;
+	for(GLuint z=0; z<extent[2]; ++z)
+	for(GLuint y=0; y<extent[1]; ++y)
+	for(GLuint x=0; x<extent[0]; ++x, ++i)
+	{
+		samples[i] = volume.At(bx*mBrickSize + x,
+		                       by*mBrickSize + y,
+		                       bz*mBrickSize + z);
+		codes[i] = mStep > 0.0
+		         ? GLuint(std::floor((samples[i] - GLdouble(mMinimum))/mStep
+		                             + 0.5))
+		         : _float_to_code(samples[i]);
+	}
+	i = 0;
+	for(GLuint z=0; z<extent[2]; ++z)
+	for(GLuint y=0; y<extent[1]; ++y)
+	for(GLuint x=0; x<extent[0]; ++x, ++i)
+	{
+		GLuint prediction = mStep > 0.0
+		    ? _predict(codes, x, y, z, extent)
+		    : _float_to_code(_predict(samples, x, y, z, extent));
+		residuals[i] = _zigzag(codes[i] - prediction);
+	}
+
+	GLuint k = _rice_parameter(residuals, count);
+	mData.push_back(GLubyte(k));
+	_BitWriter writer(mData);
+	for(i=0; i<count; ++i)
+		_write_rice(writer, residuals[i], k);
+	writer.Flush();
+	mBrickOffsets.push_back(mData.size());
+}
+
+const GLfloat* BrickVolume::_Brick(GLuint bx, GLuint by, GLuint bz) const
+{
+	const GLuint B = mBrickSize;
+	const size_t brickSampleCount = size_t(B)*B*B;
+	const GLuint index = (bz*mBrickCounts[1] + by)*mBrickCounts[0] + bx;
+#ifndef NDEBUG
+	assert(index < BrickCount());
+#endif
+	GLuint& slot = mBrickSlots[index];
+	if(slot != INVALID_INDEX)
+	{
+		mCacheTimes[slot] = ++mTime;
+		return &mCacheSamples[slot*brickSampleCount];
+	}
+
+	// least recently used slot (unused slots first)
+	slot = GLuint(std::min_element(mCacheTimes.begin(), mCacheTimes.end())
+	              - mCacheTimes.begin());
+	if(mCacheBricks[slot] != INVALID_INDEX)
+		mBrickSlots[mCacheBricks[slot]] = INVALID_INDEX;
+	mCacheBricks[slot] = index;
+	mCacheTimes[slot]  = ++mTime;
+	++mDecompressedCount;
+
+	// decode the samples (in place of the codes for lossless bricks)
+	GLuint extent[3];
+	_BrickExtent(bx, by, bz, extent);
+	const size_t count = size_t(extent[0])*extent[1]*extent[2];
+	ArenaScope scope;
+	GLuint* codes     = scope.GetArena().Allocate<GLuint>(count);
+	GLfloat* decoded  = scope.GetArena().Allocate<GLfloat>(count);
+	const GLubyte* data = &mData[0] + mBrickOffsets[index];
+	const GLuint k = *data;
+	_BitReader reader(data + 1, &mData[0] + mBrickOffsets[index+1]);
+	size_t i = 0;
+	for(GLuint z=0; z<extent[2]; ++z)
+	for(GLuint y=0; y<extent[1]; ++y)
+	for(GLuint x=0; x<extent[0]; ++x, ++i)
+	{
+		GLuint residual = _unzigzag(_read_rice(reader, k));
+		if(mStep > 0.0)
+		{
+			codes[i]   = residual + _predict(codes, x, y, z, extent);
+			decoded[i] = GLfloat(mMinimum + codes[i]*mStep);
+		}
+		else
+			decoded[i] = _code_to_float(residual + _float_to_code(
+			                 _predict(decoded, x, y, z, extent)));
+	}
+
+	// copy with the stride of the cache
+	GLfloat* samples = &mCacheSamples[slot*brickSampleCount];
+	i = 0;
+	for(GLuint z=0; z<extent[2]; ++z)
+	for(GLuint y=0; y<extent[1]; ++y, i+=extent[0])
+		std::copy(decoded + i, decoded + i + extent[0],
+		          samples + (z*B + y)*B);
+	return samples;
+}
+
+void BrickVolume::_ResetCache() const
+{
+	GLuint slotCount = mCacheSize > 0 ? mCacheSize
+	                                  : 2*mBrickCounts[0]*mBrickCounts[1];
+	slotCount = std::min(slotCount, BrickCount());
+	mCacheSamples.assign(size_t(slotCount)*mBrickSize*mBrickSize*mBrickSize,
+	                     0.0f);
+	mCacheBricks.assign(slotCount, INVALID_INDEX);
+	mCacheTimes.assign(slotCount, 0);
+	mBrickSlots.assign(BrickCount(), INVALID_INDEX);
+	mTime = 0;
+}
+
+} // namespace mc
+
+
+
+// Tests of the compression: lossless and lossy round trips, in memory and
+// through a file, and rejection of corrupted files
+// (build with -DBRICK_VOLUME_TEST mc/*.cpp core/*.cpp Framework.cpp Trace.cpp
+// and the OpenGL libraries)
+#ifdef BRICK_VOLUME_TEST
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+
+static bool _load_fails(const std::string& filename,
+                        const std::vector<char>& bytes)
+{
+	{
+		std::ofstream file(filename.c_str(), std::ios::binary);
+		file.write(&bytes[0], bytes.size());
+	}
+	try
+	{
+		mc::BrickVolume volume;
+		volume.Load(filename);
+	}
+	catch(fw::FWException&)
+	{
+		return true;
+	}
+	return false;
+}
+
+int main(int argc, char **argv)
+{
+	// a smooth field with noise, not a multiple of the brick size
+	const GLuint W = 37, H = 20, D = 45;
+	const std::string filename = "brick_volume_test.mcb";
+	int failures = 0;
+	mc::Volume volume(W, H, D);
+	std::srand(1);
+	for(GLuint z=0; z<D; ++z)
+	for(GLuint y=0; y<H; ++y)
+	for(GLuint x=0; x<W; ++x)
+		volume.At(x,y,z) = std::sin(x*0.3f)*std::cos(y*0.2f)
+		                 + std::sin(z*0.1f)
+		                 + 1e-3f*GLfloat(std::rand())/GLfloat(RAND_MAX);
+	volume.At(0,0,0) = -FLT_MAX;
+	volume.At(W-1,H-1,D-1) = FLT_MIN;
+
+	const GLfloat ERROR_BOUNDS[] = {0.0f, 1e-4f};
+	for(GLuint e=0; e<2; ++e)
+	{
+		mc::BrickVolume bricks, loaded;
+		bricks.Compress(volume, ERROR_BOUNDS[e], 8);
+		bricks.Save(filename);
+		loaded.Load(filename);
+		mc::Volume decompressed, reloaded;
+		bricks.Decompress(decompressed);
+		loaded.Decompress(reloaded);
+		for(size_t i=0; i<volume.SampleCount(); ++i)
+		{
+			GLfloat sample = volume.Samples()[i];
+			GLfloat error = std::fabs(decompressed.Samples()[i] - sample);
+			bool isValid = 0.0f == ERROR_BOUNDS[e]
+			             ? 0 == std::memcmp(&decompressed.Samples()[i],
+			                                &sample, sizeof(GLfloat))
+			             : error <= ERROR_BOUNDS[e];
+			isValid = isValid && 0 == std::memcmp(&decompressed.Samples()[i],
+			                                      &reloaded.Samples()[i],
+			                                      sizeof(GLfloat));
+			if(!isValid)
+			{
+				++failures;
+				std::fprintf(stderr, "sample %u failed (error bound %g)\n",
+				             GLuint(i), ERROR_BOUNDS[e]);
+				break;
+			}
+		}
+	}
+
+	// corrupted files: truncated, offsets decreasing, empty last brick and
+	// invalid Rice parameter
+	std::vector<char> bytes;
+	{
+		std::ifstream file(filename.c_str(), std::ios::binary);
+		bytes.assign(std::istreambuf_iterator<char>(file),
+		             std::istreambuf_iterator<char>());
+	}
+	const size_t OFFSETS = 64; // first brick offset in the file
+	const size_t BRICKS  = ((W+7)/8)*((H+7)/8)*((D+7)/8);
+	std::vector<char> corrupted(bytes.begin(), bytes.end() - 1);
+	if(!_load_fails(filename, corrupted))
+		++failures, std::fprintf(stderr, "truncated file loaded\n");
+	corrupted = bytes;
+	std::swap_ranges(&corrupted[OFFSETS+8], &corrupted[OFFSETS+16],
+	                 &corrupted[OFFSETS+16]);
+	if(!_load_fails(filename, corrupted))
+		++failures, std::fprintf(stderr, "decreasing offsets loaded\n");
+	corrupted = bytes;
+	std::copy(&corrupted[OFFSETS+8*(BRICKS-1)], &corrupted[OFFSETS+8*BRICKS],
+	          &corrupted[OFFSETS+8*BRICKS]);
+	if(!_load_fails(filename, corrupted))
+		++failures, std::fprintf(stderr, "empty last brick loaded\n");
+	corrupted = bytes;
+	corrupted[OFFSETS+8*(BRICKS+1)] = char(200);
+	if(!_load_fails(filename, corrupted))
+		++failures, std::fprintf(stderr, "invalid Rice parameter loaded\n");
+	if(_load_fails(filename, bytes))
+		++failures, std::fprintf(stderr, "valid file rejected\n");
+	std::remove(filename.c_str());
+
+	std::printf("%s (%d failures)\n", failures ? "FAILED" : "PASSED", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif // BRICK_VOLUME_TEST
@@ -0,0 +1,121 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   BrickVolume.hpp
+// \author J Dupuy
+// \brief  Compressed scalar volume, decompressed brick by brick on demand.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MC_BRICK_VOLUME_HPP
+#define MC_BRICK_VOLUME_HPP
+
+#include <string>
+#include <vector>
+#include "Framework.hpp"
+#include "Volume.hpp"
+
+namespace mc
+{
+	// Brick compressed volume
+	// Samples are split in cubic bricks, compressed independently: each
+	// sample is mapped to an integer code, predicted from its neighbours in
+	// the brick (Lorenzo predictor) and the residual is Rice coded with the
+	// best parameter of the brick. Codes are the bits of the samples (the
+	// volume is lossless, gains are modest on noisy mantissas) or the samples
+	// quantized to steps of about twice the error bound (samples stay within
+	// the error bound). With an error bound of a fraction of a percent of
+	// their range, smooth volumes shrink by 4-10x or more.
+	// Decompressed bricks are kept in an LRU cache, so extractions going
+	// through the volume slab by slab decompress each brick once (see
+	// extract_marching_cube). The cache is modified by the const members:
+	// a volume must only be read by one thread at a time.
+	class BrickVolume
+	{
+	public:
+		// Constants
+		enum {DEFAULT_BRICK_SIZE = 16}; // in samples
+
+		// Constructors
+		BrickVolume();
+
+		// Manipulation
+			// compress a volume (lossless if errorBound is zero, error
+			// bounds too small to quantize the range of the volume on 31
+			// bits are lossless as well)
+		void Compress(const Volume& volume,
+		              GLfloat errorBound = 0.0f,
+		              GLuint brickSize = DEFAULT_BRICK_SIZE);
+		void Clear();
+			// maximum number of decompressed bricks (0 keeps two layers
+			// of bricks along z, the default)
+		void SetCacheSize(GLuint brickCount);
+			// compressed file (little endian)
+		void Save(const std::string& filename) const throw(fw::FWException);
+		void Load(const std::string& filename) throw(fw::FWException);
+
+		// Decompression
+			// all the samples / samples of slices [first, end[ along z
+			// (the origin of the volume is moved to slice first)
+		void Decompress(Volume& volume) const;
+		void DecompressSlices(GLuint first, GLuint end, Volume& volume) const;
+		GLfloat At(GLuint x, GLuint y, GLuint z) const;
+
+		// Queries
+		GLuint Width()                 const;
+		GLuint Height()                const;
+		GLuint Depth()                 const;
+		GLuint BrickSize()             const;
+		GLuint BrickCount()            const;
+		GLfloat ErrorBound()           const;
+		bool IsLossless()              const;
+		const Vector3& Spacing()       const;
+		const Vector3& Origin()        const;
+			// in bytes
+		size_t CompressedSize()        const;
+		GLuint CacheSize()             const;
+			// number of bricks decompressed so far (cache misses)
+		GLuint64 DecompressedCount()   const;
+
+	private:
+		// Non copyable
+		BrickVolume(const BrickVolume& volume);
+		BrickVolume& operator=(const BrickVolume& volume);
+
+		// Internal manipulation
+			// samples in each direction of brick (bx,by,bz)
+		void _BrickExtent(GLuint bx, GLuint by, GLuint bz,
+		                  GLuint* extent) const;
+		void _EncodeBrick(const Volume& volume,
+		                  GLuint bx, GLuint by, GLuint bz);
+			// decompressed samples of a brick, with a stride of BrickSize
+			// (from the cache)
+		const GLfloat* _Brick(GLuint bx, GLuint by, GLuint bz) const;
+		void _ResetCache() const;
+
+		// Members
+		std::vector<GLubyte>  mData;
+		std::vector<GLuint64> mBrickOffsets; // in mData, one per brick + 1
+		GLuint  mWidth;
+		GLuint  mHeight;
+		GLuint  mDepth;
+		GLuint  mBrickSize;
+		GLuint  mBrickCounts[3];
+		GLfloat mErrorBound;
+		GLfloat  mMinimum;                   // lossy codes are from minimum
+		GLdouble mStep;                      // in steps, 0 if lossless
+		Vector3 mSpacing;
+		Vector3 mOrigin;
+		GLuint  mCacheSize;                  // 0 for two layers
+
+		// Cache
+		mutable std::vector<GLfloat>  mCacheSamples;
+		mutable std::vector<GLuint>   mCacheBricks;  // brick of each slot
+		mutable std::vector<GLuint64> mCacheTimes;   // last use of each slot
+		mutable std::vector<GLuint>   mBrickSlots;   // slot of each brick
+		mutable GLuint64              mTime;
+		mutable GLuint64              mDecompressedCount;
+	};
+
+} // namespace mc
+
+#endif
+
@@ -0,0 +1,257 @@
+#include "ChunkQueue.hpp"
+#include "Atomic.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace mc
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// Constants
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// busy iterations before a waiting thread yields
+static const GLuint SPIN_COUNT = 64;
+
+// unset vertex index
+static const GLuint INVALID_INDEX = ~0u;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// ChunkQueue
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors / Destructor
+ChunkQueue::ChunkQueue(GLuint chunkCount):
+	mChunks(NULL), mChunkCount(chunkCount),
+	mIsClosed(0), mAcquireWaitCount(0)
+{
+#ifndef NDEBUG
+	assert(chunkCount > 0);
+#endif
+	// rings are large enough for all the chunks, enqueuing never fails
+	GLuint capacity = 2;
+	while(capacity < chunkCount)
+		capacity*= 2;
+	_Init(mFree, capacity);
+	_Init(mQueued, capacity);
+
+	mChunks = new TriangleChunk[chunkCount];
+	for(GLuint i=0; i<chunkCount; ++i)
+	{
+		mChunks[i].vertexCount   = 0;
+		mChunks[i].triangleCount = 0;
+		_Enqueue(mFree, mChunks + i);
+	}
+}
+
+ChunkQueue::~ChunkQueue()
+{
+	delete[] mFree.slots;
+	delete[] mQueued.slots;
+	delete[] mChunks;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Producers
+TriangleChunk* ChunkQueue::Acquire()
+{
+	TriangleChunk* chunk = _Dequeue(mFree);
+	if(chunk)
+		return chunk;
+
+	fw::atomic_fetch_add(&mAcquireWaitCount, 1);
+	for(GLuint i=0; NULL == (chunk = _Dequeue(mFree)); ++i)
+		if(i >= SPIN_COUNT)
+			fw::yield_thread();
+	return chunk;
+}
+
+TriangleChunk* ChunkQueue::TryAcquire()
+{
+	return _Dequeue(mFree);
+}
+
+void ChunkQueue::Push(TriangleChunk* chunk)
+{
+#ifndef NDEBUG
+	assert(chunk >= mChunks && chunk < mChunks + mChunkCount);
+	assert(chunk->triangleCount <= TriangleChunk::CAPACITY);
+	assert(chunk->vertexCount <= TriangleChunk::VERTEX_CAPACITY);
+	assert(!IsClosed());
+#endif
+	_Enqueue(mQueued, chunk);
+}
+
+void ChunkQueue::Close()
+{
+	fw::atomic_store(&mIsClosed, 1);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Consumers
+TriangleChunk* ChunkQueue::Pop()
+{
+	for(GLuint i=0; ; ++i)
+	{
+		// read the flag first: if it is set, all the chunks are queued
+		bool isClosed = IsClosed();
+		TriangleChunk* chunk = _Dequeue(mQueued);
+		if(chunk || isClosed)
+			return chunk;
+		if(i >= SPIN_COUNT)
+			fw::yield_thread();
+	}
+}
+
+TriangleChunk* ChunkQueue::TryPop()
+{
+	return _Dequeue(mQueued);
+}
+
+void ChunkQueue::Release(TriangleChunk* chunk)
+{
+#ifndef NDEBUG
+	assert(chunk >= mChunks && chunk < mChunks + mChunkCount);
+#endif
+	chunk->vertexCount   = 0;
+	chunk->triangleCount = 0;
+	_Enqueue(mFree, chunk);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Queries
+GLuint ChunkQueue::ChunkCount() const
+{
+	return mChunkCount;
+}
+
+bool ChunkQueue::IsClosed() const
+{
+	return fw::atomic_load(&mIsClosed) != 0;
+}
+
+GLuint ChunkQueue::AcquireWaitCount() const
+{
+	return fw::atomic_load(&mAcquireWaitCount);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Internal manipulation
+// Slot i is free for the enqueue at position p when its sequence is p, and
+// full for the dequeue at position p when its sequence is p+1. Positions
+// wrap around, differences are signed.
+void ChunkQueue::_Init(Ring& ring, GLuint capacity)
+{
+	ring.slots = new Slot[capacity];
+	ring.mask  = capacity - 1;
+	for(GLuint i=0; i<capacity; ++i)
+	{
+		ring.slots[i].sequence = i;
+		ring.slots[i].chunk    = NULL;
+	}
+	ring.enqueuePosition = 0;
+	ring.dequeuePosition = 0;
+}
+
+bool ChunkQueue::_Enqueue(Ring& ring, TriangleChunk* chunk)
+{
+	GLuint position = fw::atomic_load(&ring.enqueuePosition);
+	for(;;)
+	{
+		Slot& slot = ring.slots[position & ring.mask];
+		GLint difference = GLint(fw::atomic_load(&slot.sequence) - position);
+		if(difference == 0)
+		{
+			if(fw::atomic_compare_and_swap(&ring.enqueuePosition,
+			                                position, position+1))
+			{
+				slot.chunk = chunk;
+				fw::atomic_store(&slot.sequence, position+1);
+				return true;
+			}
+		}
+		else if(difference < 0)
+			return false; // full
+		position = fw::atomic_load(&ring.enqueuePosition);
+	}
+}
+
+TriangleChunk* ChunkQueue::_Dequeue(Ring& ring)
+{
+	GLuint position = fw::atomic_load(&ring.dequeuePosition);
+	for(;;)
+	{
+		Slot& slot = ring.slots[position & ring.mask];
+		GLint difference = GLint(fw::atomic_load(&slot.sequence)
+		                         - (position+1));
+		if(difference == 0)
+		{
+			if(fw::atomic_compare_and_swap(&ring.dequeuePosition,
+			                                position, position+1))
+			{
+				TriangleChunk* chunk = slot.chunk;
+				fw::atomic_store(&slot.sequence, position + ring.mask + 1);
+				return chunk;
+			}
+		}
+		else if(difference < 0)
+			return NULL; // empty
+		position = fw::atomic_load(&ring.dequeuePosition);
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Push mesh triangles
+GLuint push_mesh_triangles(const Mesh& mesh, ChunkQueue& queue)
+{
+	const std::vector<GLfloat>& positions = mesh.Positions();
+	const std::vector<GLfloat>& normals   = mesh.Normals();
+	const std::vector<GLuint>& indexes    = mesh.Indexes();
+	const GLuint triangleCount = mesh.TriangleCount();
+	const bool hasNormals = mesh.HasNormals();
+	GLuint chunkCount = 0;
+
+	// chunk index of the vertices of the mesh (reset after each chunk)
+	std::vector<GLuint> local(mesh.VertexCount(), INVALID_INDEX);
+	for(GLuint first=0; first<triangleCount; first+=TriangleChunk::CAPACITY)
+	{
+		TriangleChunk* chunk = queue.Acquire();
+		chunk->triangleCount = std::min(triangleCount - first,
+		                                GLuint(TriangleChunk::CAPACITY));
+		chunk->vertexCount   = 0;
+		const GLuint* chunkIndexes = &indexes[size_t(first)*3];
+		for(GLuint i=0; i<chunk->triangleCount*3; ++i)
+		{
+			const GLuint index = chunkIndexes[i];
+			if(local[index] == INVALID_INDEX)
+			{
+				GLfloat* p = chunk->positions + chunk->vertexCount*3;
+				GLfloat* n = chunk->normals + chunk->vertexCount*3;
+				for(GLuint j=0; j<3; ++j)
+				{
+					p[j] = positions[size_t(index)*3+j];
+					n[j] = hasNormals ? normals[size_t(index)*3+j] : 0.0f;
+				}
+				local[index] = chunk->vertexCount++;
+			}
+			chunk->indexes[i] = local[index];
+		}
+		for(GLuint i=0; i<chunk->triangleCount*3; ++i)
+			local[chunkIndexes[i]] = INVALID_INDEX;
+		queue.Push(chunk);
+		++chunkCount;
+	}
+	return chunkCount;
+}
+
+} // namespace mc
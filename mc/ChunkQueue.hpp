@@ -0,0 +1,116 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   ChunkQueue.hpp
+// \author J Dupuy
+// \brief  Lock free queue of triangle chunks, between the extraction threads
+//         and the threads writing or uploading the triangles.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MC_CHUNK_QUEUE_HPP
+#define MC_CHUNK_QUEUE_HPP
+
+#include "glew.hpp"
+#include "Mesh.hpp"
+
+namespace mc
+{
+	// Triangle chunk
+	// Fixed size indexed sub-mesh: positions and normals of the vertices (xyz
+	// interleaved) and three indexes per triangle, local to the chunk. Any
+	// triangles fit, as there is room for three vertices per triangle.
+	struct TriangleChunk
+	{
+		enum {CAPACITY = 1024}; // in triangles
+		enum {VERTEX_CAPACITY = CAPACITY*3};
+
+		GLfloat positions[VERTEX_CAPACITY*3];
+		GLfloat normals[VERTEX_CAPACITY*3];
+		GLuint  indexes[CAPACITY*3];
+		GLuint  vertexCount;
+		GLuint  triangleCount;
+	};
+
+
+	// Chunk queue
+	// Bounded multi producer / multi consumer queue. All the chunks are
+	// allocated up front and recycled through a free list: producers acquire
+	// a free chunk, fill it and push it, consumers pop it and release it once
+	// its triangles are written. When every chunk is in flight, producers
+	// wait in Acquire until consumers release one (backpressure), memory never
+	// grows. The free list and the queue are lock free rings (a sequence
+	// number per slot, as in D. Vyukov's bounded queue), waiting threads spin
+	// briefly and then yield.
+	class ChunkQueue
+	{
+	public:
+		// Constructors / Destructor
+		explicit ChunkQueue(GLuint chunkCount = 64);
+		~ChunkQueue();
+
+		// Producers
+			// get a free chunk (waits for one) / NULL if none is free
+		TriangleChunk* Acquire();
+		TriangleChunk* TryAcquire();
+			// queue a chunk (from Acquire)
+		void Push(TriangleChunk* chunk);
+			// end of the stream (call once all the producers are done)
+		void Close();
+
+		// Consumers
+			// get a queued chunk (waits for one, NULL once the queue is
+			// closed and empty) / NULL if the queue is empty
+		TriangleChunk* Pop();
+		TriangleChunk* TryPop();
+			// give a chunk (from Pop) back to the producers
+		void Release(TriangleChunk* chunk);
+
+		// Queries
+		GLuint ChunkCount()       const;
+		bool IsClosed()           const;
+			// number of Acquire calls that had to wait
+		GLuint AcquireWaitCount() const;
+
+	private:
+		// Non copyable
+		ChunkQueue(const ChunkQueue& queue);
+		ChunkQueue& operator=(const ChunkQueue& queue);
+
+		// Ring
+		struct Slot
+		{
+			volatile GLuint sequence;
+			TriangleChunk*  chunk;
+		};
+		struct Ring
+		{
+			Slot*           slots;
+			GLuint          mask;
+			volatile GLuint enqueuePosition;
+			char            padding[60]; // producers and consumers
+			volatile GLuint dequeuePosition; // use different cache lines
+		};
+
+		// Internal manipulation
+		static void _Init(Ring& ring, GLuint capacity);
+		static bool _Enqueue(Ring& ring, TriangleChunk* chunk);
+		static TriangleChunk* _Dequeue(Ring& ring);
+
+		// Members
+		TriangleChunk*  mChunks;
+		Ring            mFree;
+		Ring            mQueued;
+		GLuint          mChunkCount;
+		volatile GLuint mIsClosed;
+		volatile GLuint mAcquireWaitCount;
+	};
+
+
+	// Push the triangles of a mesh into a queue, in order, as sub-meshes of
+	// CAPACITY triangles (vertices shared by several chunks are duplicated,
+	// normals are zero if the mesh has none). Returns the number of chunks.
+	GLuint push_mesh_triangles(const Mesh& mesh, ChunkQueue& queue);
+
+} // namespace mc
+
+#endif
+
@@ -0,0 +1,257 @@
+#include "ChunkWriter.hpp"
+#include "Trace.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace mc
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// Constants
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// width of the element counts in PLY headers (patched at the end)
+static const GLuint PLY_COUNT_WIDTH = 10;
+
+// largest vertex count of PLY files (indexes are 32 bit unsigned)
+static const GLuint64 PLY_MAX_VERTEX_COUNT = GLuint64(1) << 32;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Exceptions
+//
+////////////////////////////////////////////////////////////////////////////////
+class _FileWriteException : public fw::FWException
+{
+public:
+	_FileWriteException(const std::string& file)
+	{
+		mMessage = "Could not write file " + file + ".";
+	}
+};
+
+class _PlyIndexOverflowException : public fw::FWException
+{
+public:
+	_PlyIndexOverflowException(const std::string& file)
+	{
+		mMessage = "Too many vertices for the 32 bit indexes of PLY file "
+		         + file + ".";
+	}
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Static functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Release the chunks of a queue until it is closed
+static void _drain(ChunkQueue& queue)
+{
+	for(TriangleChunk* chunk = queue.Pop(); chunk; chunk = queue.Pop())
+		queue.Release(chunk);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Store 32 bit floats in little endian order
+static void _store_little_endian(const GLfloat* floats,
+                                 size_t count,
+                                 GLubyte* bytes)
+{
+	for(size_t i=0; i<count; ++i)
+	{
+		GLuint bits;
+		std::memcpy(&bits, floats+i, 4);
+		bytes[i*4]   = GLubyte(bits);
+		bytes[i*4+1] = GLubyte(bits >> 8);
+		bytes[i*4+2] = GLubyte(bits >> 16);
+		bytes[i*4+3] = GLubyte(bits >> 24);
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// PLY header (counts are padded with spaces to a fixed width)
+static std::string _ply_header(GLuint64 vertexCount, GLuint64 faceCount)
+{
+	std::stringstream header;
+	header << "ply\n"
+	       << "format binary_little_endian 1.0\n"
+	       << "element vertex ";
+	header.width(PLY_COUNT_WIDTH);
+	header << vertexCount << "\n"
+	       << "property float x\n"
+	       << "property float y\n"
+	       << "property float z\n"
+	       << "property float nx\n"
+	       << "property float ny\n"
+	       << "property float nz\n"
+	       << "element face ";
+	header.width(PLY_COUNT_WIDTH);
+	header << faceCount << "\n"
+	       << "property list uchar uint vertex_indices\n"
+	       << "end_header\n";
+	return header.str();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Functions implementation
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Write OBJ
+GLuint64 write_chunks_obj(ChunkQueue& queue,
+                          const std::string& filename)
+                          throw(fw::FWException)
+{
+	std::ofstream file(filename.c_str());
+	if(!file)
+	{
+		_drain(queue);
+		throw _FileWriteException(filename);
+	}
+
+	GLuint64 vertexCount = 0, triangleCount = 0;
+	for(TriangleChunk* chunk = queue.Pop(); chunk; chunk = queue.Pop())
+	{
+		FW_TRACE_SCOPE("output", "extraction");
+		// one line per element (snprintf is much faster than the streams),
+		// floats with 9 significant digits are read back exactly
+		char line[256];
+		for(GLuint i=0; i<chunk->vertexCount; ++i)
+		{
+			const GLfloat* p = chunk->positions + i*3;
+			const GLfloat* n = chunk->normals + i*3;
+			GLint size = std::sprintf(line, "v %.9g %.9g %.9g\n"
+			                                "vn %.9g %.9g %.9g\n",
+			                          p[0], p[1], p[2], n[0], n[1], n[2]);
+			file.write(line, size);
+		}
+		for(GLuint i=0; i<chunk->triangleCount; ++i)
+		{
+			const GLuint* t = chunk->indexes + i*3;
+			unsigned long long v0 = vertexCount + t[0] + 1;
+			unsigned long long v1 = vertexCount + t[1] + 1;
+			unsigned long long v2 = vertexCount + t[2] + 1;
+			GLint size = std::sprintf(line, "f %llu//%llu %llu//%llu "
+			                                "%llu//%llu\n",
+			                          v0, v0, v1, v1, v2, v2);
+			file.write(line, size);
+		}
+		vertexCount+= chunk->vertexCount;
+		triangleCount+= chunk->triangleCount;
+		queue.Release(chunk);
+	}
+
+	if(!file)
+		throw _FileWriteException(filename);
+	return triangleCount;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Write PLY
+GLuint64 write_chunks_ply(ChunkQueue& queue,
+                          const std::string& filename)
+                          throw(fw::FWException)
+{
+	std::ofstream file(filename.c_str(), std::ios::out | std::ios::binary);
+	if(!file)
+	{
+		_drain(queue);
+		throw _FileWriteException(filename);
+	}
+
+	// faces go to a temporary file, appended once all the vertices are
+	// streamed after a placeholder header
+	FILE* faces = std::tmpfile();
+	if(!faces)
+	{
+		_drain(queue);
+		throw _FileWriteException(filename);
+	}
+	const std::string placeholder = _ply_header(0, 0);
+	file.write(placeholder.c_str(), placeholder.size());
+	std::vector<GLubyte> bytes(TriangleChunk::VERTEX_CAPACITY*6*4);
+	GLuint64 vertexCount = 0, triangleCount = 0;
+	bool isOverflowing = false;
+	for(TriangleChunk* chunk = queue.Pop(); chunk; chunk = queue.Pop())
+	{
+		FW_TRACE_SCOPE("output", "extraction");
+		isOverflowing = isOverflowing
+		    || vertexCount + chunk->vertexCount > PLY_MAX_VERTEX_COUNT;
+		if(isOverflowing)
+		{
+			queue.Release(chunk);
+			continue;
+		}
+
+		GLubyte* vertex = &bytes[0];
+		for(GLuint i=0; i<chunk->vertexCount; ++i, vertex+=24)
+		{
+			_store_little_endian(chunk->positions + i*3, 3, vertex);
+			_store_little_endian(chunk->normals + i*3, 3, vertex+12);
+		}
+		file.write(reinterpret_cast<const char*>(&bytes[0]),
+		           vertex - &bytes[0]);
+
+		GLubyte* face = &bytes[0];
+		for(GLuint i=0; i<chunk->triangleCount; ++i, face+=13)
+		{
+			face[0] = 3;
+			for(GLuint k=0; k<3; ++k)
+			{
+				GLuint index = GLuint(vertexCount + chunk->indexes[i*3+k]);
+				face[1+k*4] = GLubyte(index);
+				face[2+k*4] = GLubyte(index >> 8);
+				face[3+k*4] = GLubyte(index >> 16);
+				face[4+k*4] = GLubyte(index >> 24);
+			}
+		}
+		std::fwrite(&bytes[0], 1, face - &bytes[0], faces);
+
+		vertexCount+= chunk->vertexCount;
+		triangleCount+= chunk->triangleCount;
+		queue.Release(chunk);
+	}
+	if(isOverflowing)
+	{
+		std::fclose(faces);
+		throw _PlyIndexOverflowException(filename);
+	}
+
+	// append the faces (rewind clears the error indicator of the failed
+	// writes, so it is checked before and after the copy)
+	if(0 != std::fflush(faces) || 0 != std::ferror(faces))
+	{
+		std::fclose(faces);
+		throw _FileWriteException(filename);
+	}
+	std::rewind(faces);
+	for(size_t size = std::fread(&bytes[0], 1, bytes.size(), faces);
+	    size > 0;
+	    size = std::fread(&bytes[0], 1, bytes.size(), faces))
+		file.write(reinterpret_cast<const char*>(&bytes[0]), size);
+	const bool isFacesError = 0 != std::ferror(faces);
+	std::fclose(faces);
+
+	// header with the counts (same size as the placeholder)
+	const std::string header = _ply_header(vertexCount, triangleCount);
+	file.seekp(0);
+	file.write(header.c_str(), header.size());
+	if(!file || isFacesError || header.size() != placeholder.size())
+		throw _FileWriteException(filename);
+	return triangleCount;
+}
+
+} // namespace mc
+
@@ -0,0 +1,38 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   ChunkWriter.hpp
+// \author J Dupuy
+// \brief  Mesh files written from a queue of triangle chunks.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MC_CHUNK_WRITER_HPP
+#define MC_CHUNK_WRITER_HPP
+
+#include <string>
+#include "Framework.hpp"
+#include "ChunkQueue.hpp"
+
+namespace mc
+{
+	// Write the chunks of a queue to a mesh file
+	// Consumer side of the queue: chunks are popped, written and released
+	// until the queue is closed, so memory stays bounded by the queue. Each
+	// chunk adds its vertices (with normals) and its indexed triangles, so
+	// vertices are welded within the chunks. If the file cannot be written,
+	// the queue is still drained (producers never block) and an exception is
+	// thrown once it is closed. Returns the number of triangles.
+		// Wavefront OBJ (text)
+	GLuint64 write_chunks_obj(ChunkQueue& queue,
+	                          const std::string& filename)
+	                          throw(fw::FWException);
+		// Stanford PLY (binary little endian, the element counts of the
+		// header are written last, the faces go through a temporary file;
+		// throws if the 32 bit indexes overflow)
+	GLuint64 write_chunks_ply(ChunkQueue& queue,
+	                          const std::string& filename)
+	                          throw(fw::FWException);
+
+} // namespace mc
+
+#endif
+
@@ -0,0 +1,847 @@
+#include "Decimation.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace mc
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// Constants
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// weight of the planes orthogonal to the open boundaries
+static const double BOUNDARY_WEIGHT = 4.0;
+
+// bricks of the parallel decimation (at least), rounds of bricks
+static const GLuint BRICK_COUNT_PER_THREAD = 4;
+static const GLuint BRICK_ROUND_COUNT      = 2;
+
+// no brick, several bricks
+static const GLuint INVALID_BRICK = ~0u;
+static const GLuint SHARED_BRICK  = ~0u - 1u;
+
+// vertex states
+enum
+{
+	VERTEX_FREE = 0, // collapses into a neighbour
+	VERTEX_LOCKED,   // does not move, free neighbours collapse into it
+	VERTEX_FROZEN    // does not move, nothing collapses into it
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Static functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Quadric of squared distances to planes (symmetric 4x4 matrix)
+struct _Quadric
+{
+	double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+};
+
+static void _add_plane(_Quadric& q,
+                       double a, double b, double c, double d,
+                       double weight)
+{
+	q.a2+= weight*a*a; q.ab+= weight*a*b; q.ac+= weight*a*c;
+	q.ad+= weight*a*d; q.b2+= weight*b*b; q.bc+= weight*b*c;
+	q.bd+= weight*b*d; q.c2+= weight*c*c; q.cd+= weight*c*d;
+	q.d2+= weight*d*d;
+}
+
+static void _add_quadric(_Quadric& q, const _Quadric& r)
+{
+	q.a2+= r.a2; q.ab+= r.ab; q.ac+= r.ac; q.ad+= r.ad; q.b2+= r.b2;
+	q.bc+= r.bc; q.bd+= r.bd; q.c2+= r.c2; q.cd+= r.cd; q.d2+= r.d2;
+}
+
+static double _evaluate(const _Quadric& q, const GLfloat* p)
+{
+	double x = p[0], y = p[1], z = p[2];
+	return q.a2*x*x + 2.0*q.ab*x*y + 2.0*q.ac*x*z + 2.0*q.ad*x
+	     + q.b2*y*y + 2.0*q.bc*y*z + 2.0*q.bd*y
+	     + q.c2*z*z + 2.0*q.cd*z
+	     + q.d2;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Normal of a triangle (not normalized, twice its area)
+static void _triangle_normal(const GLfloat* p0,
+                             const GLfloat* p1,
+                             const GLfloat* p2,
+                             double* normal)
+{
+	double e1[3] = {p1[0]-p0[0], p1[1]-p0[1], p1[2]-p0[2]};
+	double e2[3] = {p2[0]-p0[0], p2[1]-p0[1], p2[2]-p0[2]};
+	normal[0] = e1[1]*e2[2] - e1[2]*e2[1];
+	normal[1] = e1[2]*e2[0] - e1[0]*e2[2];
+	normal[2] = e1[0]*e2[1] - e1[1]*e2[0];
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Edges of the triangles, sorted (each edge once per triangle)
+struct _Edge
+{
+	GLuint a, b;     // a < b
+	GLuint triangle;
+
+	bool operator<(const _Edge& edge) const
+	{
+		return a < edge.a || (a == edge.a && b < edge.b);
+	}
+};
+
+static void _build_edges(const std::vector<GLuint>& indexes,
+                         std::vector<_Edge>& edges)
+{
+	edges.resize(indexes.size());
+	for(size_t i=0; i<indexes.size(); ++i)
+	{
+		GLuint a = indexes[i];
+		GLuint b = indexes[i - i%3 + (i+1)%3];
+		edges[i].a = std::min(a, b);
+		edges[i].b = std::max(a, b);
+		edges[i].triangle = GLuint(i/3);
+	}
+	std::sort(edges.begin(), edges.end());
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Quadrics of the vertices: planes of their triangles, and planes orthogonal
+// to the triangles along the open boundaries (builds the edges)
+static void _init_quadrics(const std::vector<GLfloat>& positions,
+                           const std::vector<GLuint>& indexes,
+                           std::vector<_Edge>& edges,
+                           std::vector<_Quadric>& quadrics)
+{
+	const _Quadric zero = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+	quadrics.assign(positions.size()/3, zero);
+
+	// planes of the triangles
+	for(size_t i=0; i<indexes.size(); i+=3)
+	{
+		const GLfloat* p0 = &positions[indexes[i]*3];
+		double n[3];
+		_triangle_normal(p0, &positions[indexes[i+1]*3],
+		                 &positions[indexes[i+2]*3], n);
+		double length = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+		if(length == 0.0)
+			continue;
+		n[0]/= length; n[1]/= length; n[2]/= length;
+		double d = -(n[0]*p0[0] + n[1]*p0[1] + n[2]*p0[2]);
+		for(GLuint k=0; k<3; ++k)
+			_add_plane(quadrics[indexes[i+k]], n[0], n[1], n[2], d, 1.0);
+	}
+
+	// planes orthogonal to the triangles along the open boundaries
+	_build_edges(indexes, edges);
+	for(size_t i=0; i<edges.size(); ++i)
+	{
+		bool isBoundary = (i == 0 || edges[i-1] < edges[i])
+		               && (i+1 == edges.size() || edges[i] < edges[i+1]);
+		if(!isBoundary)
+			continue;
+		const GLuint* triangle = &indexes[edges[i].triangle*3];
+		const GLfloat* a = &positions[edges[i].a*3];
+		const GLfloat* b = &positions[edges[i].b*3];
+		double n[3];
+		_triangle_normal(&positions[triangle[0]*3],
+		                 &positions[triangle[1]*3],
+		                 &positions[triangle[2]*3], n);
+		double e[3] = {b[0]-a[0], b[1]-a[1], b[2]-a[2]};
+		double m[3] = {e[1]*n[2] - e[2]*n[1],
+		               e[2]*n[0] - e[0]*n[2],
+		               e[0]*n[1] - e[1]*n[0]};
+		double length = std::sqrt(m[0]*m[0] + m[1]*m[1] + m[2]*m[2]);
+		if(length == 0.0)
+			continue;
+		m[0]/= length; m[1]/= length; m[2]/= length;
+		double d = -(m[0]*a[0] + m[1]*a[1] + m[2]*a[2]);
+		_add_plane(quadrics[edges[i].a], m[0], m[1], m[2], d,
+		           BOUNDARY_WEIGHT);
+		_add_plane(quadrics[edges[i].b], m[0], m[1], m[2], d,
+		           BOUNDARY_WEIGHT);
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Edge collapse: vertex u merged into vertex v
+struct _Collapse
+{
+	GLuint u, v;
+	double cost;
+
+	bool operator<(const _Collapse& collapse) const
+	{
+		return cost < collapse.cost;
+	}
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Decimator of a set of triangles
+// Works on a local copy of the vertices of the triangles. Collapses are
+// done in passes: the collapse candidates of the edges are sorted by cost,
+// and applied in order if none of their vertices were merged in the pass
+// yet, if no triangle of u flips and if the link condition holds. Degenerate
+// triangles are removed at the end of each pass.
+// Free vertices collapse into neighbours that are not frozen. The set must
+// hold all the triangles of the free vertices and of their neighbours that
+// are not frozen, the other triangles of the mesh are never looked at.
+class _Decimator
+{
+public:
+	// quadrics of the mesh vertices, computed from the triangles if NULL
+	_Decimator(const std::vector<GLfloat>& positions,
+	           const std::vector<GLubyte>& states,
+	           const std::vector<_Quadric>* quadrics,
+	           std::vector<GLuint>& indexes);
+
+	void Decimate(GLuint triangleCount, GLfloat maxError);
+
+	// map the triangles back to the vertices of the mesh, and the quadrics
+	// of the vertices that are not frozen (if quadrics is not NULL)
+	void Finish(std::vector<_Quadric>* quadrics);
+
+private:
+	bool _Flips(GLuint u, GLuint v, GLuint& degenerateCount);
+
+	std::vector<GLuint>&  mIndexes;   // local
+	std::vector<GLuint>   mVertices;  // local to mesh
+	std::vector<GLfloat>  mPositions;
+	std::vector<GLubyte>  mStates;
+	std::vector<_Quadric> mQuadrics;
+	std::vector<_Edge>    mEdges;
+	std::vector<GLuint>   mRemap;
+	std::vector<GLuint>   mOffsets;   // triangles of each vertex
+	std::vector<GLuint>   mTriangles;
+	std::vector<GLuint>   mLink;      // neighbours of u (see _Flips)
+	std::vector<GLuint>   mCommon;    // neighbours of u and v
+};
+
+_Decimator::_Decimator(const std::vector<GLfloat>& positions,
+                       const std::vector<GLubyte>& states,
+                       const std::vector<_Quadric>* quadrics,
+                       std::vector<GLuint>& indexes):
+	mIndexes(indexes)
+{
+	// local vertices
+	mVertices = indexes;
+	std::sort(mVertices.begin(), mVertices.end());
+	mVertices.erase(std::unique(mVertices.begin(), mVertices.end()),
+	                mVertices.end());
+	for(size_t i=0; i<mIndexes.size(); ++i)
+		mIndexes[i] = GLuint(std::lower_bound(mVertices.begin(),
+		                                      mVertices.end(),
+		                                      mIndexes[i])
+		                   - mVertices.begin());
+
+	const size_t vertexCount = mVertices.size();
+	mPositions.resize(vertexCount*3);
+	mStates.assign(vertexCount, VERTEX_FREE);
+	for(size_t i=0; i<vertexCount; ++i)
+	{
+		std::copy(&positions[mVertices[i]*3], &positions[mVertices[i]*3] + 3,
+		          &mPositions[i*3]);
+		if(!states.empty())
+			mStates[i] = states[mVertices[i]];
+	}
+	mRemap.resize(vertexCount);
+	mOffsets.resize(vertexCount+1);
+	if(quadrics)
+	{
+		mQuadrics.resize(vertexCount);
+		for(size_t i=0; i<vertexCount; ++i)
+			mQuadrics[i] = (*quadrics)[mVertices[i]];
+		_build_edges(mIndexes, mEdges);
+	}
+	else
+		_init_quadrics(mPositions, mIndexes, mEdges, mQuadrics);
+}
+
+// True if collapsing u into v flips a triangle of u, or if it breaks the
+// link condition: the neighbours of both u and v must be the opposite
+// vertices of the triangles of the edge, else two edges merge and the
+// surface pinches. Counts the triangles of the edge, which degenerate.
+bool _Decimator::_Flips(GLuint u, GLuint v, GLuint& degenerateCount)
+{
+	degenerateCount = 0;
+	mLink.clear();
+	for(GLuint i=mOffsets[u]; i<mOffsets[u+1]; ++i)
+	{
+		const GLuint* triangle = &mIndexes[mTriangles[i]*3];
+		GLuint r[3] = {mRemap[triangle[0]],
+		               mRemap[triangle[1]],
+		               mRemap[triangle[2]]};
+		if(r[0] == r[1] || r[1] == r[2] || r[2] == r[0])
+			continue; // already degenerate
+		for(GLuint k=0; k<3; ++k)
+			if(r[k] != u)
+				mLink.push_back(r[k]);
+		if(r[0] == v || r[1] == v || r[2] == v)
+		{
+			++degenerateCount;
+			continue;
+		}
+		double before[3], after[3];
+		_triangle_normal(&mPositions[r[0]*3], &mPositions[r[1]*3],
+		                 &mPositions[r[2]*3], before);
+		for(GLuint k=0; k<3; ++k)
+			if(r[k] == u)
+				r[k] = v;
+		_triangle_normal(&mPositions[r[0]*3], &mPositions[r[1]*3],
+		                 &mPositions[r[2]*3], after);
+		if(before[0]*after[0] + before[1]*after[1] + before[2]*after[2]
+		   <= 0.0)
+			return true;
+	}
+	std::sort(mLink.begin(), mLink.end());
+
+	// link condition
+	mCommon.clear();
+	for(GLuint i=mOffsets[v]; i<mOffsets[v+1]; ++i)
+	{
+		const GLuint* triangle = &mIndexes[mTriangles[i]*3];
+		GLuint r[3] = {mRemap[triangle[0]],
+		               mRemap[triangle[1]],
+		               mRemap[triangle[2]]};
+		if(r[0] == r[1] || r[1] == r[2] || r[2] == r[0])
+			continue;
+		for(GLuint k=0; k<3; ++k)
+			if(r[k] != v
+			   && std::binary_search(mLink.begin(), mLink.end(), r[k]))
+				mCommon.push_back(r[k]);
+	}
+	std::sort(mCommon.begin(), mCommon.end());
+	return GLuint(std::unique(mCommon.begin(), mCommon.end())
+	              - mCommon.begin()) > degenerateCount;
+}
+
+void _Decimator::Decimate(GLuint triangleCount, GLfloat maxError)
+{
+	const GLuint vertexCount = GLuint(mVertices.size());
+	const double maxCost = double(maxError)*double(maxError);
+	std::vector<GLubyte>   isBorder(vertexCount);
+	std::vector<GLubyte>   isMerged(vertexCount);
+	std::vector<_Collapse> collapses;
+
+	for(GLuint pass=0; mIndexes.size()/3 > triangleCount; ++pass)
+	{
+		const GLuint count = GLuint(mIndexes.size()/3);
+		if(pass > 0)
+			_build_edges(mIndexes, mEdges);
+
+		// vertices of the open boundaries
+		std::fill(isBorder.begin(), isBorder.end(), 0);
+		for(size_t i=0; i<mEdges.size(); ++i)
+			if((i == 0 || mEdges[i-1] < mEdges[i])
+			   && (i+1 == mEdges.size() || mEdges[i] < mEdges[i+1]))
+				isBorder[mEdges[i].a] = isBorder[mEdges[i].b] = 1;
+
+		// triangles of each vertex
+		std::fill(mOffsets.begin(), mOffsets.end(), 0);
+		for(size_t i=0; i<mIndexes.size(); ++i)
+			++mOffsets[mIndexes[i]+1];
+		for(GLuint i=0; i<vertexCount; ++i)
+			mOffsets[i+1]+= mOffsets[i];
+		mTriangles.resize(mIndexes.size());
+		for(size_t i=0; i<mIndexes.size(); ++i)
+			mTriangles[mOffsets[mIndexes[i]]++] = GLuint(i/3);
+		for(GLuint i=vertexCount; i>0; --i)
+			mOffsets[i] = mOffsets[i-1];
+		mOffsets[0] = 0;
+
+		// cheapest collapse of each edge: free vertices collapse into
+		// vertices that are not frozen, boundary vertices move along the
+		// boundary only
+		collapses.clear();
+		for(size_t i=0; i<mEdges.size(); )
+		{
+			size_t j = i+1;
+			while(j < mEdges.size() && !(mEdges[i] < mEdges[j]))
+				++j;
+			const bool isBoundary = j - i == 1;
+			const GLuint ends[2] = {mEdges[i].a, mEdges[i].b};
+			_Collapse best = {0, 0, maxCost};
+			bool isValid = false;
+			for(GLuint k=0; k<2; ++k)
+			{
+				GLuint u = ends[k], v = ends[1-k];
+				if(mStates[u] != VERTEX_FREE || mStates[v] == VERTEX_FROZEN
+				   || (isBorder[u] && !isBoundary))
+					continue;
+				const GLfloat* p = &mPositions[v*3];
+				double cost = _evaluate(mQuadrics[u], p)
+				            + _evaluate(mQuadrics[v], p);
+				if(cost <= best.cost)
+				{
+					best.u = u;
+					best.v = v;
+					best.cost = cost;
+					isValid = true;
+				}
+			}
+			if(isValid)
+				collapses.push_back(best);
+			i = j;
+		}
+		std::sort(collapses.begin(), collapses.end());
+
+		// collapse
+		for(GLuint i=0; i<vertexCount; ++i)
+			mRemap[i] = i;
+		std::fill(isMerged.begin(), isMerged.end(), 0);
+		GLuint removedCount = 0, collapseCount = 0;
+		for(size_t i=0; i<collapses.size(); ++i)
+		{
+			const GLuint u = collapses[i].u, v = collapses[i].v;
+			GLuint degenerateCount = 0;
+			if(isMerged[u] || isMerged[v] || _Flips(u, v, degenerateCount))
+				continue;
+			mRemap[u] = v;
+			_add_quadric(mQuadrics[v], mQuadrics[u]);
+			isMerged[u] = isMerged[v] = 1;
+			removedCount+= degenerateCount;
+			++collapseCount;
+			if(removedCount >= count - triangleCount)
+				break;
+		}
+		if(collapseCount == 0)
+			break;
+
+		// remove the degenerate triangles
+		size_t size = 0;
+		for(size_t i=0; i<mIndexes.size(); i+=3)
+		{
+			GLuint r[3] = {mRemap[mIndexes[i]],
+			               mRemap[mIndexes[i+1]],
+			               mRemap[mIndexes[i+2]]};
+			if(r[0] == r[1] || r[1] == r[2] || r[2] == r[0])
+				continue;
+			mIndexes[size++] = r[0];
+			mIndexes[size++] = r[1];
+			mIndexes[size++] = r[2];
+		}
+		mIndexes.resize(size);
+	}
+}
+
+void _Decimator::Finish(std::vector<_Quadric>* quadrics)
+{
+	for(size_t i=0; i<mIndexes.size(); ++i)
+		mIndexes[i] = mVertices[mIndexes[i]];
+	if(quadrics)
+		for(size_t i=0; i<mVertices.size(); ++i)
+			if(mStates[i] != VERTEX_FROZEN)
+				(*quadrics)[mVertices[i]] = mQuadrics[i];
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Decimate triangles (in place)
+// The quadrics of the vertices are read from quadrics (computed from the
+// triangles if NULL), and written to keptQuadrics after the collapses (if
+// not NULL, even if no triangle is removed).
+static void _decimate(const std::vector<GLfloat>& positions,
+                      const std::vector<GLubyte>& states,
+                      const std::vector<_Quadric>* quadrics,
+                      std::vector<GLuint>& indexes,
+                      GLuint triangleCount,
+                      GLfloat maxError,
+                      std::vector<_Quadric>* keptQuadrics)
+{
+	if(indexes.size()/3 <= triangleCount && !keptQuadrics)
+		return;
+	_Decimator decimator(positions, states, quadrics, indexes);
+	decimator.Decimate(triangleCount, maxError);
+	decimator.Finish(keptQuadrics);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Remove the unused vertices of a mesh
+static void _remove_unused_vertices(Mesh& mesh)
+{
+	std::vector<GLuint>&  indexes   = mesh.Indexes();
+	std::vector<GLfloat>& positions = mesh.Positions();
+	std::vector<GLfloat>& normals   = mesh.Normals();
+	const GLuint vertexCount = mesh.VertexCount();
+	const bool hasNormals    = mesh.HasNormals();
+
+	std::vector<GLuint> remap(vertexCount, 0);
+	for(size_t i=0; i<indexes.size(); ++i)
+		remap[indexes[i]] = 1;
+	GLuint next = 0;
+	for(GLuint v=0; v<vertexCount; ++v)
+	{
+		if(remap[v] == 0)
+			continue;
+		std::copy(&positions[v*3], &positions[v*3] + 3, &positions[next*3]);
+		if(hasNormals)
+			std::copy(&normals[v*3], &normals[v*3] + 3, &normals[next*3]);
+		remap[v] = next++;
+	}
+	positions.resize(next*3);
+	if(hasNormals)
+		normals.resize(next*3);
+	for(size_t i=0; i<indexes.size(); ++i)
+		indexes[i] = remap[indexes[i]];
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Decimate the triangles of the bricks
+// The vertices of a brick that are not frozen are its own, so the tasks
+// write their quadrics to distinct entries, and read the others only.
+class _DecimateBrickTask : public ThreadPool::Task
+{
+public:
+	_DecimateBrickTask(const std::vector<GLfloat>& positions,
+	                   const std::vector<GLubyte>& states,
+	                   std::vector< std::vector<GLuint> >& bricks,
+	                   const std::vector<GLuint>& triangleCounts,
+	                   GLfloat maxError,
+	                   const std::vector<_Quadric>* quadrics,
+	                   std::vector<_Quadric>& keptQuadrics):
+		mPositions(positions), mStates(states), mBricks(bricks),
+		mTriangleCounts(triangleCounts), mMaxError(maxError),
+		mQuadrics(quadrics), mKeptQuadrics(keptQuadrics) {}
+
+	void Run(GLuint brick, GLuint)
+	{
+		_decimate(mPositions, mStates, mQuadrics, mBricks[brick],
+		          mTriangleCounts[brick], mMaxError, &mKeptQuadrics);
+	}
+
+private:
+	const std::vector<GLfloat>&         mPositions;
+	const std::vector<GLubyte>&         mStates;
+	std::vector< std::vector<GLuint> >& mBricks;
+	const std::vector<GLuint>&          mTriangleCounts;
+	GLfloat                             mMaxError;
+	const std::vector<_Quadric>*        mQuadrics;
+	std::vector<_Quadric>&              mKeptQuadrics;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Decimate the triangles of a mesh by bricks: a grid of n^3 cells over the
+// bounding box
+// The triangles of each brick (by centroid) are decimated by a task of the
+// pool, with the vertices shared by several bricks frozen. A last pass
+// over the triangles around the shared vertices, with all the other
+// vertices locked, collapses them. The quadrics of the vertices are
+// carried in quadrics (computed from the triangles if hasQuadrics is
+// false).
+static void _decimate_bricks(const std::vector<GLfloat>& positions,
+                             std::vector<GLuint>& indexes,
+                             GLuint n,
+                             const GLfloat* boundsMin,
+                             const GLfloat* boundsMax,
+                             GLuint triangleCount,
+                             GLfloat maxError,
+                             ThreadPool& pool,
+                             std::vector<_Quadric>& quadrics,
+                             bool hasQuadrics)
+{
+	const GLuint count = GLuint(indexes.size()/3);
+
+	// brick of each triangle (by centroid), brick of each vertex
+	std::vector< std::vector<GLuint> > bricks(n*n*n);
+	std::vector<GLuint> vertexBricks(positions.size()/3, INVALID_BRICK);
+	for(size_t i=0; i<indexes.size(); i+=3)
+	{
+		GLuint brick = 0;
+		for(GLuint k=3; k>0; --k)
+		{
+			GLfloat centroid = (positions[indexes[i  ]*3+k-1]
+			                  + positions[indexes[i+1]*3+k-1]
+			                  + positions[indexes[i+2]*3+k-1]) / 3.0f;
+			GLfloat extent = boundsMax[k-1] - boundsMin[k-1];
+			GLuint cell = extent > 0.0f
+			            ? GLuint((centroid - boundsMin[k-1]) / extent * n)
+			            : 0;
+			brick = brick*n + std::min(cell, n-1);
+		}
+		bricks[brick].insert(bricks[brick].end(),
+		                     indexes.begin() + i, indexes.begin() + i + 3);
+		for(GLuint k=0; k<3; ++k)
+		{
+			GLuint& vertexBrick = vertexBricks[indexes[i+k]];
+			if(vertexBrick == INVALID_BRICK)
+				vertexBrick = brick;
+			else if(vertexBrick != brick)
+				vertexBrick = SHARED_BRICK;
+		}
+	}
+
+	// freeze the vertices shared by several bricks, their triangles are
+	// kept for the last pass
+	std::vector<GLubyte> states(vertexBricks.size());
+	for(size_t i=0; i<states.size(); ++i)
+		states[i] = vertexBricks[i] == SHARED_BRICK ? VERTEX_FROZEN
+		                                            : VERTEX_FREE;
+	std::vector<GLuint> triangleCounts(bricks.size());
+	const double ratio = double(triangleCount) / double(count);
+	for(size_t b=0; b<bricks.size(); ++b)
+	{
+		const std::vector<GLuint>& brick = bricks[b];
+		GLuint frozenCount = 0;
+		for(size_t i=0; i<brick.size(); i+=3)
+			frozenCount+= states[brick[i  ]] == VERTEX_FROZEN
+			           || states[brick[i+1]] == VERTEX_FROZEN
+			           || states[brick[i+2]] == VERTEX_FROZEN;
+		triangleCounts[b] = frozenCount
+		                  + GLuint(ratio * (brick.size()/3 - frozenCount));
+	}
+
+	// quadrics of the shared vertices, from all their triangles (the tasks
+	// write the quadrics of the other vertices)
+	if(!hasQuadrics)
+	{
+		std::vector<GLuint> triangles;
+		for(size_t i=0; i<indexes.size(); i+=3)
+			if(states[indexes[i  ]] == VERTEX_FROZEN
+			   || states[indexes[i+1]] == VERTEX_FROZEN
+			   || states[indexes[i+2]] == VERTEX_FROZEN)
+				triangles.insert(triangles.end(), indexes.begin() + i,
+				                 indexes.begin() + i + 3);
+		std::vector<_Edge> edges;
+		_init_quadrics(positions, triangles, edges, quadrics);
+	}
+
+	_DecimateBrickTask task(positions, states, bricks, triangleCounts,
+	                        maxError, hasQuadrics ? &quadrics : NULL,
+	                        quadrics);
+	pool.Run(GLuint(bricks.size()), task);
+	indexes.clear();
+	for(size_t b=0; b<bricks.size(); ++b)
+	{
+		indexes.insert(indexes.end(), bricks[b].begin(), bricks[b].end());
+		std::vector<GLuint>().swap(bricks[b]);
+	}
+
+	// last pass over the triangles around the shared vertices: the shared
+	// vertices are free, all the others are locked. The triangles of their
+	// neighbours are included, so the collapses see the whole
+	// neighbourhoods of both of their vertices.
+	std::vector<GLubyte> isNear(states.size(), 0);
+	for(size_t i=0; i<indexes.size(); i+=3)
+		if(states[indexes[i  ]] == VERTEX_FROZEN
+		   || states[indexes[i+1]] == VERTEX_FROZEN
+		   || states[indexes[i+2]] == VERTEX_FROZEN)
+			isNear[indexes[i]] = isNear[indexes[i+1]]
+			                   = isNear[indexes[i+2]] = 1;
+	std::vector<GLuint> border;
+	size_t size = 0;
+	for(size_t i=0; i<indexes.size(); i+=3)
+	{
+		GLuint* triangle = &indexes[i];
+		if(isNear[triangle[0]] || isNear[triangle[1]] || isNear[triangle[2]])
+			border.insert(border.end(), triangle, triangle + 3);
+		else
+		{
+			indexes[size++] = triangle[0];
+			indexes[size++] = triangle[1];
+			indexes[size++] = triangle[2];
+		}
+	}
+	indexes.resize(size);
+	for(size_t i=0; i<states.size(); ++i)
+		states[i] = states[i] == VERTEX_FROZEN ? VERTEX_FREE : VERTEX_LOCKED;
+	const GLuint keptCount = GLuint(size/3);
+	_decimate(positions, states, &quadrics, border,
+	          triangleCount > keptCount ? triangleCount - keptCount : 0,
+	          maxError, &quadrics);
+	indexes.insert(indexes.end(), border.begin(), border.end());
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Decimation
+//
+////////////////////////////////////////////////////////////////////////////////
+
+void decimate_mesh(Mesh& mesh, GLuint triangleCount, GLfloat maxError)
+{
+	if(mesh.TriangleCount() <= triangleCount)
+		return;
+	_decimate(mesh.Positions(), std::vector<GLubyte>(), NULL, mesh.Indexes(),
+	          triangleCount, maxError, NULL);
+	_remove_unused_vertices(mesh);
+}
+
+void decimate_mesh(Mesh& mesh,
+                   GLuint triangleCount,
+                   ThreadPool& pool,
+                   GLfloat maxError)
+{
+	const std::vector<GLfloat>& positions = mesh.Positions();
+	std::vector<GLuint>& indexes = mesh.Indexes();
+	if(mesh.TriangleCount() <= triangleCount)
+		return;
+
+	// bricks: grid of n^3 cells over the bounding box
+	GLuint n = 1;
+	while(n*n*n < BRICK_COUNT_PER_THREAD*pool.ThreadCount())
+		++n;
+	GLfloat boundsMin[3], boundsMax[3];
+	for(GLuint k=0; k<3; ++k)
+		boundsMin[k] = boundsMax[k] = positions[k];
+	for(size_t i=0; i<positions.size(); ++i)
+	{
+		boundsMin[i%3] = std::min(boundsMin[i%3], positions[i]);
+		boundsMax[i%3] = std::max(boundsMax[i%3], positions[i]);
+	}
+
+	// rounds of n^3, then (n+1)^3 bricks, whose borders do not overlap
+	// (but on the bounding box)
+	std::vector<_Quadric> quadrics;
+	for(GLuint round=0; round<BRICK_ROUND_COUNT
+	                    && indexes.size()/3 > triangleCount; ++round)
+		_decimate_bricks(positions, indexes, n + round, boundsMin, boundsMax,
+		                 triangleCount, maxError, pool, quadrics, round > 0);
+	_remove_unused_vertices(mesh);
+}
+
+} // namespace mc
+
+
+
+// Tests of the decimation: a closed surface stays closed and manifold (every
+// edge has two triangles of opposite orientations, the Euler characteristic
+// is kept), on the serial and the pool versions, down to a triangle count
+// or an error bound
+// (build with -DDECIMATION_TEST mc/*.cpp core/*.cpp Framework.cpp Trace.cpp
+// and the OpenGL libraries)
+#ifdef DECIMATION_TEST
+#include <cstdio>
+#include <cstdlib>
+#include "MarchingCube.hpp"
+
+// true if every half edge appears once, with its opposite
+static bool _is_closed(const mc::Mesh& mesh)
+{
+	const std::vector<GLuint>& indexes = mesh.Indexes();
+	std::vector<GLuint64> halfEdges(indexes.size());
+	for(size_t i=0; i<indexes.size(); ++i)
+		halfEdges[i] = GLuint64(indexes[i]) << 32
+		             | indexes[i - i%3 + (i+1)%3];
+	std::sort(halfEdges.begin(), halfEdges.end());
+	for(size_t i=0; i<halfEdges.size(); ++i)
+	{
+		GLuint64 opposite = halfEdges[i] << 32 | halfEdges[i] >> 32;
+		if((i > 0 && halfEdges[i-1] == halfEdges[i])
+		   || !std::binary_search(halfEdges.begin(), halfEdges.end(),
+		                          opposite))
+			return false;
+	}
+	return true;
+}
+
+// V - E + F of a closed mesh
+static GLint _euler_characteristic(const mc::Mesh& mesh)
+{
+	return GLint(mesh.VertexCount()) - GLint(mesh.TriangleCount()*3/2)
+	     + GLint(mesh.TriangleCount());
+}
+
+int main(int argc, char **argv)
+{
+	const GLuint SIZE = 64;
+	const GLuint THREAD_COUNTS[] = {0, 1, 3};
+	int failures = 0;
+
+	// bumpy sphere
+	mc::Volume volume(SIZE, SIZE, SIZE);
+	for(GLuint z=0; z<SIZE; ++z)
+	for(GLuint y=0; y<SIZE; ++y)
+	for(GLuint x=0; x<SIZE; ++x)
+		volume.At(x,y,z) = std::sqrt((x-30.0f)*(x-30.0f) + (y-32.0f)*(y-32.0f)
+		                             + (z-33.0f)*(z-33.0f))
+		                 - 20.0f + 2.0f*std::sin(x*0.4f)*std::sin(y*0.3f);
+	mc::Mesh original;
+	mc::extract_marching_cube(volume, 0.0f, original);
+	if(!_is_closed(original))
+	{
+		std::fprintf(stderr, "extracted surface is not closed\n");
+		return EXIT_FAILURE;
+	}
+	const GLint euler = _euler_characteristic(original);
+
+	// decimations: to 1/2 and 1/10 of the triangles, to an error bound
+	const GLuint count = original.TriangleCount();
+	const GLuint TRIANGLE_COUNTS[] = {count/2, count/10, 0};
+	const GLfloat MAX_ERRORS[] = {FLT_MAX, FLT_MAX, 0.1f};
+	for(GLuint d=0; d<3; ++d)
+	for(GLuint t=0; t<4; ++t)
+	{
+		mc::Mesh mesh;
+		GLuint threadCount = 0;
+		mesh.Positions() = original.Positions();
+		mesh.Normals()   = original.Normals();
+		mesh.Indexes()   = original.Indexes();
+		if(t == 0)
+			mc::decimate_mesh(mesh, TRIANGLE_COUNTS[d], MAX_ERRORS[d]);
+		else
+		{
+			mc::ThreadPool pool(THREAD_COUNTS[t-1],
+			                    mc::ThreadPool::PIN_MODE_NONE);
+			mc::decimate_mesh(mesh, TRIANGLE_COUNTS[d], pool, MAX_ERRORS[d]);
+			threadCount = pool.ThreadCount();
+		}
+		std::printf("%u -> %u triangles (%u threads)\n",
+		            count, mesh.TriangleCount(), threadCount);
+		if(!_is_closed(mesh) || _euler_characteristic(mesh) != euler
+		   || mesh.Normals().size() != mesh.Positions().size()
+		   || (TRIANGLE_COUNTS[d] && mesh.TriangleCount() > TRIANGLE_COUNTS[d])
+		   || mesh.TriangleCount() >= count)
+		{
+			++failures;
+			std::fprintf(stderr, "decimation failed\n");
+		}
+	}
+
+	// thin torus decimated as much as possible: collapses that pinch its
+	// tube break the link condition
+	const GLuint RING_COUNT = 24, RING_SIZE = 4;
+	mc::Mesh torus;
+	for(GLuint i=0; i<RING_COUNT; ++i)
+	for(GLuint j=0; j<RING_SIZE; ++j)
+	{
+		GLfloat u = 6.2831853f*i/RING_COUNT, v = 6.2831853f*j/RING_SIZE;
+		GLfloat r = 10.0f + std::cos(v);
+		torus.AddVertex(r*std::cos(u), r*std::sin(u), std::sin(v));
+		torus.AddNormal(std::cos(v)*std::cos(u), std::cos(v)*std::sin(u),
+		                std::sin(v));
+	}
+	for(GLuint i=0; i<RING_COUNT; ++i)
+	for(GLuint j=0; j<RING_SIZE; ++j)
+	{
+		GLuint i1 = (i+1)%RING_COUNT, j1 = (j+1)%RING_SIZE;
+		torus.AddTriangle(i*RING_SIZE+j, i1*RING_SIZE+j, i1*RING_SIZE+j1);
+		torus.AddTriangle(i*RING_SIZE+j, i1*RING_SIZE+j1, i*RING_SIZE+j1);
+	}
+	mc::decimate_mesh(torus, 0);
+	std::printf("torus: %u -> %u triangles\n",
+	            RING_COUNT*RING_SIZE*2, torus.TriangleCount());
+	if(torus.TriangleCount() == 0 || !_is_closed(torus)
+	   || _euler_characteristic(torus) != 0)
+	{
+		++failures;
+		std::fprintf(stderr, "torus decimation failed\n");
+	}
+	std::printf("%s (%d failures)\n", failures ? "FAILED" : "PASSED", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif // DECIMATION_TEST
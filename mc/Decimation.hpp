@@ -0,0 +1,47 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   Decimation.hpp
+// \author J Dupuy
+// \brief  Quadric error decimation of meshes.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MC_DECIMATION_HPP
+#define MC_DECIMATION_HPP
+
+#include <cfloat>
+#include "Mesh.hpp"
+
+namespace mc
+{
+	class ThreadPool;
+
+	// Decimate a mesh down to triangleCount triangles
+	// Edges are collapsed in order of quadric error (Garland and Heckbert
+	// 1997): a vertex is merged into a neighbour, whose position and normal
+	// are kept, if no triangle flips and if the link condition holds (the
+	// surface stays manifold). Vertices of the open boundaries only move
+	// along the boundary. Collapses stop at triangleCount, or before the
+	// distance to the planes of the merged triangles exceeds maxError.
+	// Unused vertices are removed, the others keep their order.
+	void decimate_mesh(Mesh& mesh,
+	                   GLuint triangleCount,
+	                   GLfloat maxError = FLT_MAX);
+
+	// Decimate a mesh on a thread pool
+	// The bounding box of the mesh is split in bricks, and the triangles of
+	// each brick (by centroid) are decimated by a task of the pool, with
+	// the vertices shared by several bricks frozen. A last pass over the
+	// triangles around the shared vertices, with all the other vertices
+	// locked, collapses them. The quadrics are carried from the bricks to
+	// the last pass, so maxError bounds the error as in the serial version.
+	// A second round, with one more brick along each axis, decimates the
+	// borders of the first bricks if triangleCount is not reached.
+	void decimate_mesh(Mesh& mesh,
+	                   GLuint triangleCount,
+	                   ThreadPool& pool,
+	                   GLfloat maxError = FLT_MAX);
+
+} // namespace mc
+
+#endif
+
@@ -0,0 +1,242 @@
+#include "DualContouring.hpp"
+#include "DualGrid.hpp"
+#include "MarchingCubeCell.hpp"
+#include "Arena.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace mc
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// Constants
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Jacobi sweeps for the eigen decomposition of the quadratic error
+static const GLuint JACOBI_SWEEP_COUNT = 8;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Static functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Eigen decomposition of a symmetric 3x3 matrix (cyclic Jacobi)
+// m is diagonalized in place, the columns of v are the eigenvectors.
+static void _symmetric_eigen(GLdouble m[3][3], GLdouble v[3][3])
+{
+	for(GLuint i=0; i<3; ++i)
+	for(GLuint j=0; j<3; ++j)
+		v[i][j] = i == j ? 1.0 : 0.0;
+
+	for(GLuint sweep=0; sweep<JACOBI_SWEEP_COUNT; ++sweep)
+	{
+		GLdouble off = m[0][1]*m[0][1] + m[0][2]*m[0][2] + m[1][2]*m[1][2];
+		if(off < 1e-24)
+			return;
+
+		for(GLuint p=0; p<2; ++p)
+		for(GLuint q=p+1; q<3; ++q)
+		{
+			if(std::fabs(m[p][q]) < 1e-30)
+				continue;
+
+			// rotation annihilating m[p][q]
+			GLdouble theta = (m[q][q] - m[p][p]) / (2.0*m[p][q]);
+			GLdouble t = (theta >= 0.0 ? 1.0 : -1.0)
+			           / (std::fabs(theta) + std::sqrt(theta*theta + 1.0));
+			GLdouble c = 1.0 / std::sqrt(t*t + 1.0);
+			GLdouble s = t*c;
+
+			for(GLuint k=0; k<3; ++k)
+			{
+				GLdouble mkp = m[k][p], mkq = m[k][q];
+				m[k][p] = c*mkp - s*mkq;
+				m[k][q] = s*mkp + c*mkq;
+			}
+			for(GLuint k=0; k<3; ++k)
+			{
+				GLdouble mpk = m[p][k], mqk = m[q][k];
+				m[p][k] = c*mpk - s*mqk;
+				m[q][k] = s*mpk + c*mqk;
+			}
+			for(GLuint k=0; k<3; ++k)
+			{
+				GLdouble vkp = v[k][p], vkq = v[k][q];
+				v[k][p] = c*vkp - s*vkq;
+				v[k][q] = s*vkp + c*vkq;
+			}
+		}
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Minimize the quadratic error |Ax-b|^2 around the mass point
+// (truncated pseudo inverse of AtA, eigenvalues below threshold*max are
+// discarded so the solution stays close to the mass point along flat
+// directions)
+static void _solve_qef(const GLdouble ata[3][3],
+                       const GLdouble* atb,
+                       const GLdouble* massPoint,
+                       GLdouble threshold,
+                       GLdouble* x)
+{
+	GLdouble m[3][3], v[3][3];
+	for(GLuint i=0; i<3; ++i)
+	for(GLuint j=0; j<3; ++j)
+		m[i][j] = ata[i][j];
+	_symmetric_eigen(m, v);
+
+	// residual at the mass point
+	GLdouble r[3];
+	for(GLuint i=0; i<3; ++i)
+		r[i] = atb[i] - ata[i][0]*massPoint[0]
+		              - ata[i][1]*massPoint[1]
+		              - ata[i][2]*massPoint[2];
+
+	GLdouble maxEigenvalue = std::max(m[0][0], std::max(m[1][1], m[2][2]));
+	for(GLuint i=0; i<3; ++i)
+		x[i] = massPoint[i];
+	for(GLuint k=0; k<3; ++k)
+	{
+		if(m[k][k] <= threshold*maxEigenvalue)
+			continue;
+		GLdouble d = (v[0][k]*r[0] + v[1][k]*r[1] + v[2][k]*r[2]) / m[k][k];
+		for(GLuint i=0; i<3; ++i)
+			x[i]+= v[i][k]*d;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Dual contouring extraction
+void extract_dual_contouring(const Volume& volume,
+                             GLfloat isolevel,
+                             Mesh& mesh,
+                             GLfloat qefThreshold)
+{
+	const GLuint W = volume.Width();
+	const GLuint H = volume.Height();
+	const GLuint D = volume.Depth();
+	const Vector3& origin  = volume.Origin();
+	const Vector3& spacing = volume.Spacing();
+
+	mesh.Clear();
+	if(W < 2 || H < 2 || D < 2)
+		return;
+
+	// cases of a slice, vertex indexes of two consecutive slices of cells
+	const size_t CELL_SLICE_SIZE = size_t(W-1)*size_t(H-1);
+	ArenaScope scope;
+	Arena& arena = scope.GetArena();
+	GLubyte* cases = arena.Allocate<GLubyte>(CELL_SLICE_SIZE);
+	GLuint* cellVertices = arena.Allocate<GLuint>(CELL_SLICE_SIZE*2);
+	std::fill(cellVertices, cellVertices + CELL_SLICE_SIZE*2,
+	          DUAL_INVALID_INDEX);
+
+	for(GLuint z=0; z<D-1; ++z)
+	{
+		// no sign changing edge if no cell is active
+		if(classify_dual_slice(volume, isolevel, z, cases) == 0)
+			continue;
+
+		// place the vertices of the active cells
+		for(GLuint y=0; y<H-1; ++y)
+		for(GLuint x=0; x<W-1; ++x)
+		{
+			GLuint cubeCase = cases[size_t(y)*(W-1) + x];
+			if(cubeCase == 0 || cubeCase == 255)
+				continue;
+
+			GLfloat values[8];
+			for(GLuint i=0; i<8; ++i)
+				values[i] = volume.At(x+(i&1), y+(i>>1&1), z+(i>>2));
+
+			// accumulate the tangent planes at the crossings
+			GLdouble ata[3][3] = {{0,0,0},{0,0,0},{0,0,0}};
+			GLdouble atb[3]    = {0,0,0};
+			GLdouble mass[3]   = {0,0,0};
+			GLfloat normal[3]  = {0,0,0};
+			GLuint count = 0;
+			for(GLuint e=0; e<12; ++e)
+			{
+				GLuint c0 = vertex_to_dual_corner(edge_lower_vertex(e));
+				GLuint c1 = vertex_to_dual_corner(edge_upper_vertex(e));
+				if((cubeCase >> c0 & 1u) == (cubeCase >> c1 & 1u))
+					continue;
+
+				GLfloat t = (isolevel - values[c0]) / (values[c1] - values[c0]);
+				GLfloat g0[3], g1[3];
+				volume.Gradient(x+(c0&1), y+(c0>>1&1), z+(c0>>2), g0);
+				volume.Gradient(x+(c1&1), y+(c1>>1&1), z+(c1>>2), g1);
+
+				GLdouble p[3], n[3];
+				const GLuint corner[3] = {x+(c0&1), y+(c0>>1&1), z+(c0>>2)};
+				for(GLuint a=0; a<3; ++a)
+				{
+					p[a] = origin[a] + spacing[a]*corner[a];
+					n[a] = g0[a] + t*(g1[a]-g0[a]);
+				}
+				p[edge_axis(e)]+= spacing[edge_axis(e)]*t;
+				GLdouble length = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+				if(length > 0.0)
+				{
+					n[0]/= length; n[1]/= length; n[2]/= length;
+				}
+
+				GLdouble d = n[0]*p[0] + n[1]*p[1] + n[2]*p[2];
+				for(GLuint i=0; i<3; ++i)
+				{
+					for(GLuint j=0; j<3; ++j)
+						ata[i][j]+= n[i]*n[j];
+					atb[i]+= n[i]*d;
+					mass[i]+= p[i];
+					normal[i]+= GLfloat(n[i]);
+				}
+				++count;
+			}
+			for(GLuint i=0; i<3; ++i)
+				mass[i]/= count;
+
+			// solve, and fall back to the mass point outside the cell
+			GLdouble vertex[3];
+			_solve_qef(ata, atb, mass, qefThreshold, vertex);
+			const GLuint cell[3] = {x, y, z};
+			for(GLuint a=0; a<3; ++a)
+			{
+				GLdouble lower = origin[a] + spacing[a]*cell[a];
+				if(vertex[a] < lower || vertex[a] > lower + spacing[a])
+				{
+					vertex[0] = mass[0];
+					vertex[1] = mass[1];
+					vertex[2] = mass[2];
+					break;
+				}
+			}
+
+			GLuint& index = cellVertices[  (z&1)*CELL_SLICE_SIZE
+			                             + size_t(y)*(W-1) + x ];
+			index = mesh.AddVertex(GLfloat(vertex[0]),
+			                       GLfloat(vertex[1]),
+			                       GLfloat(vertex[2]));
+			GLfloat length = std::sqrt(normal[0]*normal[0]
+			                         + normal[1]*normal[1]
+			                         + normal[2]*normal[2]);
+			if(length > 0.0f)
+				mesh.AddNormal(normal[0]/length,
+				               normal[1]/length,
+				               normal[2]/length);
+			else
+				mesh.AddNormal(0.0f, 0.0f, 0.0f);
+		}
+
+		connect_dual_slice(volume, z, cases, cellVertices, mesh);
+	}
+}
+
+} // namespace mc
+
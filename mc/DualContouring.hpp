@@ -0,0 +1,36 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   DualContouring.hpp
+// \author J Dupuy
+// \brief  CPU dual contouring isosurface extraction.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MC_DUAL_CONTOURING_HPP
+#define MC_DUAL_CONTOURING_HPP
+
+#include "Volume.hpp"
+#include "Mesh.hpp"
+
+namespace mc
+{
+	// Extract the isosurface of a volume with dual contouring
+	// Each cell crossed by the surface gets one vertex, which minimizes the
+	// quadratic error to the tangent planes at the edge crossings (Hermite
+	// data: linear interpolation for the positions, gradients of the volume
+	// for the normals, see Volume::Gradient). Vertices of the four cells
+	// around each sign changing edge are connected by a quad (two triangles),
+	// so sharp features are kept at low resolutions. Eigenvalues of the
+	// quadratic error below qefThreshold times the largest one are discarded,
+	// and vertices falling outside their cell are moved to the mass point of
+	// the crossings.
+	// Samples below the isolevel are inside the surface, normals are set. The
+	// mesh is cleared first.
+	void extract_dual_contouring(const Volume& volume,
+	                             GLfloat isolevel,
+	                             Mesh& mesh,
+	                             GLfloat qefThreshold = 0.1f);
+
+} // namespace mc
+
+#endif
+
@@ -0,0 +1,119 @@
+#include "DualGrid.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace mc
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// Static functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Add a quad (seen counter clockwise from the outside if not flipped)
+static void _add_quad(Mesh& mesh,
+                      GLuint i0, GLuint i1, GLuint i2, GLuint i3,
+                      bool flip)
+{
+#ifndef NDEBUG
+	assert(i0 != DUAL_INVALID_INDEX && i1 != DUAL_INVALID_INDEX
+	    && i2 != DUAL_INVALID_INDEX && i3 != DUAL_INVALID_INDEX);
+#endif
+	if(flip)
+		std::swap(i1, i3);
+	mesh.AddTriangle(i0, i1, i2);
+	mesh.AddTriangle(i0, i2, i3);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Classification
+GLuint classify_dual_slice(const Volume& volume,
+                           GLfloat isolevel,
+                           GLuint z,
+                           GLubyte* cases)
+{
+	FW_TRACE_SCOPE("classification", "extraction");
+	const GLuint W = volume.Width();
+	const GLuint H = volume.Height();
+	const size_t SLICE_SIZE = size_t(W)*size_t(H);
+	// offsets of the corners of a column of the cell (along y and z)
+	const size_t COLUMN_OFFSETS[4] = {0, W, SLICE_SIZE, SLICE_SIZE+W};
+	GLuint activeCount = 0;
+
+	for(GLuint y=0; y<H-1; ++y)
+	{
+		// the second column of a cell is the first column of the next one,
+		// so only one column (four samples) is loaded per cell
+		const GLfloat* column = volume.Samples() + z*SLICE_SIZE + size_t(y)*W;
+		GLuint cubeCase = 0;
+		for(GLuint x=0; x<W; ++x, ++column)
+		{
+			cubeCase = cubeCase >> 1 & 0x55u;
+			for(GLuint i=0; i<4; ++i)
+				cubeCase|= GLuint(column[COLUMN_OFFSETS[i]] < isolevel) << (2*i+1);
+			if(x == 0)
+				continue;
+			*cases++ = GLubyte(cubeCase);
+			activeCount+= GLuint(cubeCase != 0 && cubeCase != 255);
+		}
+	}
+	return activeCount;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Connection
+void connect_dual_slice(const Volume& volume,
+                        GLuint z,
+                        const GLubyte* cases,
+                        const GLuint* cellVertices,
+                        Mesh& mesh)
+{
+	const GLuint W = volume.Width();
+	const GLuint H = volume.Height();
+	const size_t CELL_SLICE_SIZE = size_t(W-1)*size_t(H-1);
+#define CELL_VERTEX(x,y,z) \
+	cellVertices[((z)&1)*CELL_SLICE_SIZE + size_t(y)*(W-1) + (x)]
+
+	for(GLuint y=0; y<H-1; ++y)
+	for(GLuint x=0; x<W-1; ++x)
+	{
+		// the edges starting at the first corner of the cell change sign
+		// only if the cell is active
+		GLuint cubeCase = *cases++;
+		if(cubeCase == 0 || cubeCase == 255)
+			continue;
+		bool inside = (cubeCase & 1u) != 0;
+
+		// edge along z
+		if(x > 0 && y > 0 && (cubeCase ^ cubeCase>>4) & 1u)
+			_add_quad(mesh,
+			          CELL_VERTEX(x-1,y-1,z), CELL_VERTEX(x,y-1,z),
+			          CELL_VERTEX(x,y,z),     CELL_VERTEX(x-1,y,z),
+			          !inside);
+		if(z == 0)
+			continue;
+
+		// edge along x
+		if(y > 0 && (cubeCase ^ cubeCase>>1) & 1u)
+			_add_quad(mesh,
+			          CELL_VERTEX(x,y-1,z-1), CELL_VERTEX(x,y,z-1),
+			          CELL_VERTEX(x,y,z),     CELL_VERTEX(x,y-1,z),
+			          !inside);
+
+		// edge along y
+		if(x > 0 && (cubeCase ^ cubeCase>>2) & 1u)
+			_add_quad(mesh,
+			          CELL_VERTEX(x-1,y,z-1), CELL_VERTEX(x-1,y,z),
+			          CELL_VERTEX(x,y,z),     CELL_VERTEX(x,y,z-1),
+			          !inside);
+	}
+#undef CELL_VERTEX
+}
+
+} // namespace mc
+
@@ -0,0 +1,48 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   DualGrid.hpp
+// \author J Dupuy
+// \brief  Steps shared by the dual extraction algorithms (dual contouring,
+//         surface nets).
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MC_DUAL_GRID_HPP
+#define MC_DUAL_GRID_HPP
+
+#include "Volume.hpp"
+#include "Mesh.hpp"
+
+namespace mc
+{
+	// Cells are processed slice by slice, with one vertex per active cell.
+	// Corners of a cell are numbered x | y<<1 | z<<2, and edges are those of
+	// the tables (see vertex_to_dual_corner in MarchingCubeCell.hpp).
+
+	// unset vertex index
+	const GLuint DUAL_INVALID_INDEX = ~0u;
+
+	// Classify the cells of slice z
+	// Writes the case of each cell ((Width-1)*(Height-1) values, x first, bit
+	// i is set if corner i is below the isolevel) and returns the number of
+	// cells crossed by the surface.
+	GLuint classify_dual_slice(const Volume& volume,
+	                           GLfloat isolevel,
+	                           GLuint z,
+	                           GLubyte* cases);
+
+	// Connect the vertices of the cells of slices z-1 and z
+	// Emits a quad (two triangles) around each sign changing edge whose four
+	// cells are in these slices (edges on the border of the volume are
+	// skipped). cases are the cases of slice z (see classify_dual_slice) and
+	// cellVertices holds the vertex indexes of two slices of cells, slice z
+	// starts at (z&1)*(Width-1)*(Height-1).
+	void connect_dual_slice(const Volume& volume,
+	                        GLuint z,
+	                        const GLubyte* cases,
+	                        const GLuint* cellVertices,
+	                        Mesh& mesh);
+
+} // namespace mc
+
+#endif
+
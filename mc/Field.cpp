@@ -0,0 +1,813 @@
+#include "Field.hpp"
+#include "Arena.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// SSE2 implementation of the tape evaluation (define MC_NO_SIMD to use the
+// scalar implementation). Operations are performed in the same order in both
+// implementations, so results are the same.
+#if !defined(MC_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#	define MC_USE_SSE2
+#	include <emmintrin.h>
+#endif
+
+namespace mc
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// Constants
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// unused child index
+static const GLuint NO_CHILD = ~0u;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Static functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Value of the noise lattice at integer coordinates, in [-1,1]
+// (xorshift mixing, so the SSE2 version needs no 32-bit multiply)
+static GLfloat _lattice_value(GLint x, GLint y, GLint z)
+{
+	GLuint h = GLuint(x) + (GLuint(y) << 11) + (GLuint(z) << 22);
+	h^= h << 13; h^= h >> 17; h^= h << 5;
+	h+= 0x9E3779B9u;
+	h^= h << 13; h^= h >> 17; h^= h << 5;
+	return GLfloat(GLint(h & 0xFFFFu)) * (2.0f/65535.0f) - 1.0f;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Value noise (trilinear interpolation of the lattice, smoothstep weights)
+static GLfloat _value_noise(GLfloat x, GLfloat y, GLfloat z)
+{
+	GLfloat fx = std::floor(x), fy = std::floor(y), fz = std::floor(z);
+	GLint ix = GLint(fx), iy = GLint(fy), iz = GLint(fz);
+	GLfloat tx = x - fx, ty = y - fy, tz = z - fz;
+	GLfloat sx = tx*tx*(3.0f - 2.0f*tx);
+	GLfloat sy = ty*ty*(3.0f - 2.0f*ty);
+	GLfloat sz = tz*tz*(3.0f - 2.0f*tz);
+	GLfloat v[8];
+	for(GLint i=0; i<8; ++i)
+		v[i] = _lattice_value(ix+(i&1), iy+(i>>1&1), iz+(i>>2));
+	GLfloat v00 = v[0] + sx*(v[1]-v[0]);
+	GLfloat v10 = v[2] + sx*(v[3]-v[2]);
+	GLfloat v01 = v[4] + sx*(v[5]-v[4]);
+	GLfloat v11 = v[6] + sx*(v[7]-v[6]);
+	GLfloat v0  = v00 + sy*(v10-v00);
+	GLfloat v1  = v01 + sy*(v11-v01);
+	return v0 + sz*(v1-v0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Signed distance to a box
+static GLfloat _box_distance(const GLfloat* params,
+                             GLfloat x, GLfloat y, GLfloat z)
+{
+	GLfloat qx = std::fabs(x - params[0]) - params[3];
+	GLfloat qy = std::fabs(y - params[1]) - params[4];
+	GLfloat qz = std::fabs(z - params[2]) - params[5];
+	GLfloat ox = std::max(qx, 0.0f);
+	GLfloat oy = std::max(qy, 0.0f);
+	GLfloat oz = std::max(qz, 0.0f);
+	return std::sqrt(ox*ox + oy*oy + oz*oz)
+	     + std::min(std::max(qx, std::max(qy, qz)), 0.0f);
+}
+
+
+#ifdef MC_USE_SSE2
+////////////////////////////////////////////////////////////////////////////////
+// SSE2 versions of the functions above (four points)
+static inline __m128 _abs_x4(__m128 x)
+{
+	return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+}
+
+static inline __m128 _floor_x4(__m128 x)
+{
+	__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+	return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+}
+
+static inline __m128 _lattice_value_x4(__m128i x, __m128i y, __m128i z)
+{
+	__m128i h = _mm_add_epi32(x, _mm_add_epi32(_mm_slli_epi32(y, 11),
+	                                           _mm_slli_epi32(z, 22)));
+	h = _mm_xor_si128(h, _mm_slli_epi32(h, 13));
+	h = _mm_xor_si128(h, _mm_srli_epi32(h, 17));
+	h = _mm_xor_si128(h, _mm_slli_epi32(h, 5));
+	h = _mm_add_epi32(h, _mm_set1_epi32(GLint(0x9E3779B9u)));
+	h = _mm_xor_si128(h, _mm_slli_epi32(h, 13));
+	h = _mm_xor_si128(h, _mm_srli_epi32(h, 17));
+	h = _mm_xor_si128(h, _mm_slli_epi32(h, 5));
+	__m128 v = _mm_cvtepi32_ps(_mm_and_si128(h, _mm_set1_epi32(0xFFFF)));
+	return _mm_sub_ps(_mm_mul_ps(v, _mm_set1_ps(2.0f/65535.0f)),
+	                  _mm_set1_ps(1.0f));
+}
+
+static inline __m128 _lerp_x4(__m128 a, __m128 b, __m128 t)
+{
+	return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+static inline __m128 _smoothstep_x4(__m128 t)
+{
+	return _mm_mul_ps(_mm_mul_ps(t, t),
+	                  _mm_sub_ps(_mm_set1_ps(3.0f),
+	                             _mm_mul_ps(_mm_set1_ps(2.0f), t)));
+}
+
+static inline __m128 _value_noise_x4(__m128 x, __m128 y, __m128 z)
+{
+	__m128 fx = _floor_x4(x), fy = _floor_x4(y), fz = _floor_x4(z);
+	__m128i ix = _mm_cvttps_epi32(fx);
+	__m128i iy = _mm_cvttps_epi32(fy);
+	__m128i iz = _mm_cvttps_epi32(fz);
+	__m128 sx = _smoothstep_x4(_mm_sub_ps(x, fx));
+	__m128 sy = _smoothstep_x4(_mm_sub_ps(y, fy));
+	__m128 sz = _smoothstep_x4(_mm_sub_ps(z, fz));
+	__m128i one = _mm_set1_epi32(1);
+	__m128i jx = _mm_add_epi32(ix, one);
+	__m128i jy = _mm_add_epi32(iy, one);
+	__m128i jz = _mm_add_epi32(iz, one);
+	__m128 v00 = _lerp_x4(_lattice_value_x4(ix, iy, iz),
+	                      _lattice_value_x4(jx, iy, iz), sx);
+	__m128 v10 = _lerp_x4(_lattice_value_x4(ix, jy, iz),
+	                      _lattice_value_x4(jx, jy, iz), sx);
+	__m128 v01 = _lerp_x4(_lattice_value_x4(ix, iy, jz),
+	                      _lattice_value_x4(jx, iy, jz), sx);
+	__m128 v11 = _lerp_x4(_lattice_value_x4(ix, jy, jz),
+	                      _lattice_value_x4(jx, jy, jz), sx);
+	return _lerp_x4(_lerp_x4(v00, v10, sy), _lerp_x4(v01, v11, sy), sz);
+}
+#endif // MC_USE_SSE2
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Field expression
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors
+FieldExpression::FieldExpression():
+	mNodes()
+{
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Manipulation
+GLuint FieldExpression::_AddNode(GLint type,
+                                 GLuint a, GLuint b,
+                                 const GLfloat* params, GLuint paramCount)
+{
+#ifndef NDEBUG
+	assert((a == NO_CHILD || a < mNodes.size())
+	    && (b == NO_CHILD || b < mNodes.size()));
+#endif
+	Node node;
+	node.type        = type;
+	node.children[0] = a;
+	node.children[1] = b;
+	std::fill(node.params, node.params+6, 0.0f);
+	std::copy(params, params+paramCount, node.params);
+	mNodes.push_back(node);
+	return GLuint(mNodes.size()-1);
+}
+
+GLuint FieldExpression::Sphere(const Vector3& center, GLfloat radius)
+{
+	GLfloat params[4] = {center[0], center[1], center[2], radius};
+	return _AddNode(NODE_SPHERE, NO_CHILD, NO_CHILD, params, 4);
+}
+
+GLuint FieldExpression::Box(const Vector3& center, const Vector3& halfSize)
+{
+	GLfloat params[6] = {center[0],   center[1],   center[2],
+	                     halfSize[0], halfSize[1], halfSize[2]};
+	return _AddNode(NODE_BOX, NO_CHILD, NO_CHILD, params, 6);
+}
+
+GLuint FieldExpression::Noise(GLfloat frequency, GLfloat amplitude)
+{
+	GLfloat params[2] = {frequency, amplitude};
+	return _AddNode(NODE_NOISE, NO_CHILD, NO_CHILD, params, 2);
+}
+
+GLuint FieldExpression::Union(GLuint a, GLuint b)
+{
+	return _AddNode(NODE_UNION, a, b, NULL, 0);
+}
+
+GLuint FieldExpression::Intersection(GLuint a, GLuint b)
+{
+	return _AddNode(NODE_INTERSECTION, a, b, NULL, 0);
+}
+
+GLuint FieldExpression::Difference(GLuint a, GLuint b)
+{
+	return _AddNode(NODE_DIFFERENCE, a, b, NULL, 0);
+}
+
+GLuint FieldExpression::Add(GLuint a, GLuint b)
+{
+	return _AddNode(NODE_ADD, a, b, NULL, 0);
+}
+
+void FieldExpression::Clear()
+{
+	mNodes.clear();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Queries
+GLuint FieldExpression::NodeCount() const
+{
+	return GLuint(mNodes.size());
+}
+
+GLfloat FieldExpression::Evaluate(GLuint node, const Vector3& point) const
+{
+#ifndef NDEBUG
+	assert(node < mNodes.size());
+#endif
+	const Node& n = mNodes[node];
+	const GLfloat* p = n.params;
+	switch(n.type)
+	{
+	case NODE_SPHERE:
+	{
+		GLfloat dx = point[0] - p[0];
+		GLfloat dy = point[1] - p[1];
+		GLfloat dz = point[2] - p[2];
+		return std::sqrt(dx*dx + dy*dy + dz*dz) - p[3];
+	}
+	case NODE_BOX:
+		return _box_distance(p, point[0], point[1], point[2]);
+	case NODE_NOISE:
+		return p[1]*_value_noise(point[0]*p[0], point[1]*p[0], point[2]*p[0]);
+	case NODE_UNION:
+		return std::min(Evaluate(n.children[0], point),
+		                Evaluate(n.children[1], point));
+	case NODE_INTERSECTION:
+		return std::max(Evaluate(n.children[0], point),
+		                Evaluate(n.children[1], point));
+	case NODE_DIFFERENCE:
+		return std::max(Evaluate(n.children[0], point),
+		                -Evaluate(n.children[1], point));
+	case NODE_ADD:
+		return Evaluate(n.children[0], point)
+		     + Evaluate(n.children[1], point);
+	}
+	return 0.0f;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Field tape
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors
+FieldTape::FieldTape():
+	mInstructions(), mStackSize(0)
+{
+}
+
+FieldTape::FieldTape(const FieldExpression& expression, GLuint root):
+	mInstructions(), mStackSize(0)
+{
+	Compile(expression, root);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Manipulation
+GLuint FieldTape::_Compile(const FieldExpression& expression, GLuint node)
+{
+	// emit children first, returns the stack size needed by the subtree
+	const FieldExpression::Node& n = expression.mNodes[node];
+	GLuint stackSize = 1;
+	if(n.children[0] != NO_CHILD)
+	{
+		GLuint a = _Compile(expression, n.children[0]);
+		GLuint b = _Compile(expression, n.children[1]);
+		stackSize = std::max(a, b+1);
+	}
+
+	Instruction instruction;
+	instruction.type = n.type;
+	std::copy(n.params, n.params+6, instruction.params);
+	mInstructions.push_back(instruction);
+	return stackSize;
+}
+
+void FieldTape::Compile(const FieldExpression& expression, GLuint root)
+{
+#ifndef NDEBUG
+	assert(root < expression.NodeCount());
+#endif
+	mInstructions.clear();
+	mStackSize = _Compile(expression, root);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Queries
+GLuint FieldTape::InstructionCount() const
+{
+	return GLuint(mInstructions.size());
+}
+
+GLuint FieldTape::StackSize() const
+{
+	return mStackSize;
+}
+
+void FieldTape::_EvaluateBlock(const GLfloat* x,
+                               const GLfloat* y,
+                               const GLfloat* z,
+                               GLfloat* stack) const
+{
+	// top of the stack
+	GLfloat* top = stack - BLOCK_SIZE;
+
+	for(size_t i=0; i<mInstructions.size(); ++i)
+	{
+		const GLint type = mInstructions[i].type;
+		const GLfloat* p = mInstructions[i].params;
+
+		// operators pop two blocks and push one
+		if(type >= FieldExpression::NODE_UNION)
+		{
+			GLfloat* a = top - BLOCK_SIZE;
+			const GLfloat* b = top;
+			top = a;
+#ifdef MC_USE_SSE2
+			for(GLuint j=0; j<BLOCK_SIZE; j+=4)
+			{
+				__m128 va = _mm_loadu_ps(a+j);
+				__m128 vb = _mm_loadu_ps(b+j);
+				__m128 r;
+				switch(type)
+				{
+				case FieldExpression::NODE_UNION:
+					r = _mm_min_ps(va, vb); break;
+				case FieldExpression::NODE_INTERSECTION:
+					r = _mm_max_ps(va, vb); break;
+				case FieldExpression::NODE_DIFFERENCE:
+					r = _mm_max_ps(va, _mm_xor_ps(vb, _mm_set1_ps(-0.0f)));
+					break;
+				default: // NODE_ADD
+					r = _mm_add_ps(va, vb); break;
+				}
+				_mm_storeu_ps(a+j, r);
+			}
+#else
+			for(GLuint j=0; j<BLOCK_SIZE; ++j)
+			{
+				switch(type)
+				{
+				case FieldExpression::NODE_UNION:
+					a[j] = std::min(a[j], b[j]); break;
+				case FieldExpression::NODE_INTERSECTION:
+					a[j] = std::max(a[j], b[j]); break;
+				case FieldExpression::NODE_DIFFERENCE:
+					a[j] = std::max(a[j], -b[j]); break;
+				default: // NODE_ADD
+					a[j] = a[j] + b[j]; break;
+				}
+			}
+#endif
+			continue;
+		}
+
+		// primitives push a block
+		top+= BLOCK_SIZE;
+#ifdef MC_USE_SSE2
+		for(GLuint j=0; j<BLOCK_SIZE; j+=4)
+		{
+			__m128 px = _mm_loadu_ps(x+j);
+			__m128 py = _mm_loadu_ps(y+j);
+			__m128 pz = _mm_loadu_ps(z+j);
+			__m128 r;
+			if(type == FieldExpression::NODE_SPHERE)
+			{
+				__m128 dx = _mm_sub_ps(px, _mm_set1_ps(p[0]));
+				__m128 dy = _mm_sub_ps(py, _mm_set1_ps(p[1]));
+				__m128 dz = _mm_sub_ps(pz, _mm_set1_ps(p[2]));
+				r = _mm_sub_ps(_mm_sqrt_ps(_mm_add_ps(_mm_add_ps(
+				                                      _mm_mul_ps(dx, dx),
+				                                      _mm_mul_ps(dy, dy)),
+				                                      _mm_mul_ps(dz, dz))),
+				               _mm_set1_ps(p[3]));
+			}
+			else if(type == FieldExpression::NODE_BOX)
+			{
+				__m128 zero = _mm_setzero_ps();
+				__m128 qx = _mm_sub_ps(_abs_x4(_mm_sub_ps(px, _mm_set1_ps(p[0]))),
+				                       _mm_set1_ps(p[3]));
+				__m128 qy = _mm_sub_ps(_abs_x4(_mm_sub_ps(py, _mm_set1_ps(p[1]))),
+				                       _mm_set1_ps(p[4]));
+				__m128 qz = _mm_sub_ps(_abs_x4(_mm_sub_ps(pz, _mm_set1_ps(p[2]))),
+				                       _mm_set1_ps(p[5]));
+				__m128 ox = _mm_max_ps(qx, zero);
+				__m128 oy = _mm_max_ps(qy, zero);
+				__m128 oz = _mm_max_ps(qz, zero);
+				__m128 outside = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(
+				                                        _mm_mul_ps(ox, ox),
+				                                        _mm_mul_ps(oy, oy)),
+				                                        _mm_mul_ps(oz, oz)));
+				__m128 inside = _mm_min_ps(_mm_max_ps(qx, _mm_max_ps(qy, qz)),
+				                           zero);
+				r = _mm_add_ps(outside, inside);
+			}
+			else // NODE_NOISE
+			{
+				__m128 f = _mm_set1_ps(p[0]);
+				r = _mm_mul_ps(_mm_set1_ps(p[1]),
+				               _value_noise_x4(_mm_mul_ps(px, f),
+				                               _mm_mul_ps(py, f),
+				                               _mm_mul_ps(pz, f)));
+			}
+			_mm_storeu_ps(top+j, r);
+		}
+#else
+		for(GLuint j=0; j<BLOCK_SIZE; ++j)
+		{
+			if(type == FieldExpression::NODE_SPHERE)
+			{
+				GLfloat dx = x[j] - p[0];
+				GLfloat dy = y[j] - p[1];
+				GLfloat dz = z[j] - p[2];
+				top[j] = std::sqrt(dx*dx + dy*dy + dz*dz) - p[3];
+			}
+			else if(type == FieldExpression::NODE_BOX)
+				top[j] = _box_distance(p, x[j], y[j], z[j]);
+			else // NODE_NOISE
+				top[j] = p[1]*_value_noise(x[j]*p[0], y[j]*p[0], z[j]*p[0]);
+		}
+#endif
+	}
+}
+
+void FieldTape::Evaluate(const GLfloat* x,
+                         const GLfloat* y,
+                         const GLfloat* z,
+                         GLfloat* values,
+                         size_t count) const
+{
+#ifndef NDEBUG
+	assert(!mInstructions.empty());
+#endif
+	ArenaScope scope;
+	GLfloat* stack = scope.GetArena().Allocate<GLfloat>(size_t(mStackSize)
+	                                                    * BLOCK_SIZE);
+	GLfloat bx[BLOCK_SIZE], by[BLOCK_SIZE], bz[BLOCK_SIZE];
+
+	for(size_t first=0; first<count; first+=BLOCK_SIZE)
+	{
+		// copy the points of the block (the last one is padded)
+		size_t n = std::min(size_t(BLOCK_SIZE), count-first);
+		for(size_t i=0; i<BLOCK_SIZE; ++i)
+		{
+			size_t j = first + std::min(i, n-1);
+			bx[i] = x[j];
+			by[i] = y[j];
+			bz[i] = z[j];
+		}
+		_EvaluateBlock(bx, by, bz, stack);
+		std::copy(stack, stack+n, values+first);
+	}
+}
+
+void FieldTape::EvaluateBounds(const Vector3& boxMin,
+                               const Vector3& boxMax,
+                               GLfloat& lower,
+                               GLfloat& upper) const
+{
+#ifndef NDEBUG
+	assert(!mInstructions.empty());
+#endif
+	ArenaScope scope;
+	GLfloat* stack = scope.GetArena().Allocate<GLfloat>(size_t(mStackSize)*2);
+	GLfloat* top = stack - 2;
+
+	for(size_t i=0; i<mInstructions.size(); ++i)
+	{
+		const GLint type = mInstructions[i].type;
+		const GLfloat* p = mInstructions[i].params;
+
+		if(type >= FieldExpression::NODE_UNION)
+		{
+			GLfloat* a = top - 2;
+			const GLfloat* b = top;
+			top = a;
+			switch(type)
+			{
+			case FieldExpression::NODE_UNION:
+				a[0] = std::min(a[0], b[0]);
+				a[1] = std::min(a[1], b[1]);
+				break;
+			case FieldExpression::NODE_INTERSECTION:
+				a[0] = std::max(a[0], b[0]);
+				a[1] = std::max(a[1], b[1]);
+				break;
+			case FieldExpression::NODE_DIFFERENCE:
+				a[0] = std::max(a[0], -b[1]);
+				a[1] = std::max(a[1], -b[0]);
+				break;
+			default: // NODE_ADD
+				a[0]+= b[0];
+				a[1]+= b[1];
+				break;
+			}
+			continue;
+		}
+
+		top+= 2;
+		if(type == FieldExpression::NODE_SPHERE)
+		{
+			// distances to the closest and farthest points of the box
+			GLfloat near2 = 0.0f, far2 = 0.0f;
+			for(GLuint j=0; j<3; ++j)
+			{
+				GLfloat d0 = boxMin[j] - p[j];
+				GLfloat d1 = boxMax[j] - p[j];
+				GLfloat n = d0 > 0.0f ? d0 : (d1 < 0.0f ? d1 : 0.0f);
+				GLfloat f = std::max(std::fabs(d0), std::fabs(d1));
+				near2+= n*n;
+				far2+= f*f;
+			}
+			top[0] = std::sqrt(near2) - p[3];
+			top[1] = std::sqrt(far2)  - p[3];
+		}
+		else if(type == FieldExpression::NODE_BOX)
+		{
+			// distance fields are 1-Lipschitz
+			GLfloat c[3], h2 = 0.0f;
+			for(GLuint j=0; j<3; ++j)
+			{
+				c[j] = 0.5f*(boxMin[j] + boxMax[j]);
+				h2+= 0.25f*(boxMax[j] - boxMin[j])*(boxMax[j] - boxMin[j]);
+			}
+			GLfloat d = _box_distance(p, c[0], c[1], c[2]);
+			GLfloat h = std::sqrt(h2);
+			top[0] = d - h;
+			top[1] = d + h;
+		}
+		else // NODE_NOISE
+		{
+			top[0] = -std::fabs(p[1]);
+			top[1] = +std::fabs(p[1]);
+		}
+	}
+	lower = stack[0];
+	upper = stack[1];
+}
+
+GLuint FieldTape::Sample(Volume& volume,
+                         GLfloat isolevel,
+                         GLuint brickSize) const
+{
+#ifndef NDEBUG
+	assert(brickSize > 0);
+#endif
+	const GLuint size[3] = {volume.Width(), volume.Height(), volume.Depth()};
+	const Vector3& origin  = volume.Origin();
+	const Vector3& spacing = volume.Spacing();
+	const size_t brickSampleCount = size_t(brickSize)*brickSize*brickSize;
+	ArenaScope scope;
+	Arena& arena = scope.GetArena();
+	GLfloat* x = arena.Allocate<GLfloat>(brickSampleCount);
+	GLfloat* y = arena.Allocate<GLfloat>(brickSampleCount);
+	GLfloat* z = arena.Allocate<GLfloat>(brickSampleCount);
+	GLfloat* values = arena.Allocate<GLfloat>(brickSampleCount);
+	GLuint evaluatedCount = 0;
+
+	for(GLuint bz=0; bz<size[2]; bz+=brickSize)
+	for(GLuint by=0; by<size[1]; by+=brickSize)
+	for(GLuint bx=0; bx<size[0]; bx+=brickSize)
+	{
+		const GLuint first[3] = {bx, by, bz};
+		GLuint last[3];
+		Vector3 boxMin, boxMax;
+		for(GLuint a=0; a<3; ++a)
+		{
+			last[a] = std::min(first[a]+brickSize, size[a]);
+			boxMin[a] = origin[a] + spacing[a]*(GLfloat(first[a]) - 2.0f);
+			boxMax[a] = origin[a] + spacing[a]*(GLfloat(last[a]-1) + 2.0f);
+		}
+
+		// fill bricks proven empty or full with the bound
+		GLfloat lower, upper;
+		EvaluateBounds(boxMin, boxMax, lower, upper);
+		if(lower >= isolevel || upper < isolevel)
+		{
+			GLfloat value = lower >= isolevel ? lower : upper;
+			for(GLuint k=first[2]; k<last[2]; ++k)
+			for(GLuint j=first[1]; j<last[1]; ++j)
+			{
+				GLfloat* row = &volume.At(first[0], j, k);
+				std::fill(row, row + (last[0]-first[0]), value);
+			}
+			continue;
+		}
+
+		// evaluate
+		size_t count = 0;
+		for(GLuint k=first[2]; k<last[2]; ++k)
+		for(GLuint j=first[1]; j<last[1]; ++j)
+		for(GLuint i=first[0]; i<last[0]; ++i, ++count)
+		{
+			x[count] = origin[0] + spacing[0]*i;
+			y[count] = origin[1] + spacing[1]*j;
+			z[count] = origin[2] + spacing[2]*k;
+		}
+		Evaluate(x, y, z, values, count);
+		count = 0;
+		for(GLuint k=first[2]; k<last[2]; ++k)
+		for(GLuint j=first[1]; j<last[1]; ++j)
+		{
+			GLuint rowSize = last[0]-first[0];
+			std::copy(values + count, values + count + rowSize,
+			          &volume.At(first[0], j, k));
+			count+= rowSize;
+		}
+		++evaluatedCount;
+	}
+	volume.ClearGradients();
+	return evaluatedCount;
+}
+
+} // namespace mc
+
+
+
+// Tests of the tape: values against the expression tree on random points,
+// bounds against the values in random boxes, and marching cube meshes of
+// sampled volumes with and without the skipped bricks
+// (build with -DFIELD_TEST mc/*.cpp core/*.cpp Framework.cpp Trace.cpp and
+// the OpenGL libraries, with and without -DMC_NO_SIMD)
+#ifdef FIELD_TEST
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "MarchingCube.hpp"
+
+static GLfloat _random_float(GLfloat minimum, GLfloat maximum)
+{
+	return minimum + (maximum-minimum)*GLfloat(std::rand())/GLfloat(RAND_MAX);
+}
+
+// a few shapes with every node type (the noise subtree is shared)
+static GLuint _build_field(mc::FieldExpression& expression, GLuint field)
+{
+	GLuint sphere = expression.Sphere(Vector3(0.1f, -0.2f, 0.05f), 0.7f);
+	GLuint box    = expression.Box(Vector3(-0.2f, 0.1f, 0.0f),
+	                               Vector3(0.5f, 0.3f, 0.6f));
+	GLuint noise  = expression.Noise(4.0f, 0.08f);
+	switch(field)
+	{
+	case 0:
+		return sphere;
+	case 1:
+		return expression.Union(expression.Add(sphere, noise),
+		                        expression.Add(box, noise));
+	case 2:
+		return expression.Difference(box, expression.Sphere(
+		                             Vector3(0.3f, 0.2f, 0.1f), 0.4f));
+	default:
+		return expression.Add(expression.Intersection(
+		                      expression.Union(sphere, box),
+		                      expression.Box(Vector3(0.0f, 0.0f, 0.0f),
+		                                     Vector3(0.8f, 0.8f, 0.8f))),
+		                      noise);
+	}
+}
+
+// same triangles, vertices and normals
+static bool _equal_meshes(const mc::Mesh& m1, const mc::Mesh& m2)
+{
+	return m1.Positions() == m2.Positions()
+	    && m1.Normals()   == m2.Normals()
+	    && m1.Indexes()   == m2.Indexes();
+}
+
+int main(int argc, char **argv)
+{
+	const GLuint FIELD_COUNT = 4;
+	const size_t POINT_COUNT = 1000; // not a multiple of the block size
+	const GLuint BOX_COUNT   = 500;
+	const GLuint SIZE = 48;
+	int failures = 0;
+	std::srand(1);
+
+	for(GLuint f=0; f<FIELD_COUNT; ++f)
+	{
+		mc::FieldExpression expression;
+		GLuint root = _build_field(expression, f);
+		mc::FieldTape tape(expression, root);
+
+		// tape against the tree
+		std::vector<GLfloat> x(POINT_COUNT), y(POINT_COUNT), z(POINT_COUNT);
+		std::vector<GLfloat> values(POINT_COUNT);
+		for(size_t i=0; i<POINT_COUNT; ++i)
+		{
+			x[i] = _random_float(-1.5f, 1.5f);
+			y[i] = _random_float(-1.5f, 1.5f);
+			z[i] = _random_float(-1.5f, 1.5f);
+		}
+		tape.Evaluate(&x[0], &y[0], &z[0], &values[0], POINT_COUNT);
+		for(size_t i=0; i<POINT_COUNT; ++i)
+		{
+			GLfloat value = expression.Evaluate(root,
+			                                    Vector3(x[i], y[i], z[i]));
+			if(std::fabs(value - values[i]) > 1e-5f)
+			{
+				++failures;
+				std::fprintf(stderr, "field %u: tape %g, tree %g\n",
+				             f, values[i], value);
+				break;
+			}
+		}
+
+		// bounds contain the values of the points of the boxes
+		for(GLuint b=0; b<BOX_COUNT; ++b)
+		{
+			Vector3 boxMin, boxMax;
+			for(GLuint a=0; a<3; ++a)
+			{
+				boxMin[a] = _random_float(-1.5f, 1.5f);
+				boxMax[a] = boxMin[a] + _random_float(0.0f, 0.5f);
+			}
+			GLfloat lower, upper;
+			tape.EvaluateBounds(boxMin, boxMax, lower, upper);
+			bool isValid = true;
+			for(GLuint i=0; i<64 && isValid; ++i)
+			{
+				Vector3 point(_random_float(boxMin[0], boxMax[0]),
+				              _random_float(boxMin[1], boxMax[1]),
+				              _random_float(boxMin[2], boxMax[2]));
+				GLfloat value = expression.Evaluate(root, point);
+				isValid = value >= lower - 1e-5f && value <= upper + 1e-5f;
+			}
+			if(!isValid)
+			{
+				++failures;
+				std::fprintf(stderr, "field %u: value out of [%g, %g]\n",
+				             f, lower, upper);
+				break;
+			}
+		}
+
+		// sampling with skipped bricks against dense sampling (not a
+		// multiple of the brick size)
+		mc::Volume skipped(SIZE, SIZE+3, SIZE-5), dense(SIZE, SIZE+3, SIZE-5);
+		const GLfloat step = 2.4f/GLfloat(SIZE-1);
+		const Vector3 origin(-1.2f, -1.2f, -1.2f), spacing(step, step, step);
+		skipped.SetOrigin(origin);
+		skipped.SetSpacing(spacing);
+		dense.SetOrigin(origin);
+		dense.SetSpacing(spacing);
+		GLuint brickCount = ((SIZE+7)/8)*((SIZE+10)/8)*((SIZE+2)/8);
+		GLuint evaluatedCount = tape.Sample(skipped, 0.0f, 8);
+		std::vector<GLfloat> px, py, pz;
+		for(GLuint k=0; k<dense.Depth(); ++k)
+		for(GLuint j=0; j<dense.Height(); ++j)
+		for(GLuint i=0; i<dense.Width(); ++i)
+		{
+			px.push_back(origin[0] + spacing[0]*i);
+			py.push_back(origin[1] + spacing[1]*j);
+			pz.push_back(origin[2] + spacing[2]*k);
+		}
+		tape.Evaluate(&px[0], &py[0], &pz[0], dense.Samples(), px.size());
+		mc::Mesh skippedMesh, denseMesh;
+		mc::extract_marching_cube(skipped, 0.0f, skippedMesh);
+		mc::extract_marching_cube(dense, 0.0f, denseMesh);
+		if(evaluatedCount == brickCount || denseMesh.TriangleCount() == 0
+		   || !_equal_meshes(skippedMesh, denseMesh))
+		{
+			++failures;
+			std::fprintf(stderr, "field %u: %u/%u bricks evaluated, "
+			             "%u/%u triangles\n", f, evaluatedCount, brickCount,
+			             skippedMesh.TriangleCount(),
+			             denseMesh.TriangleCount());
+		}
+	}
+
+	std::printf("%s (%d failures)\n", failures ? "FAILED" : "PASSED", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif // FIELD_TEST
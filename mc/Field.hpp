@@ -0,0 +1,158 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   Field.hpp
+// \author J Dupuy
+// \brief  Procedural signed distance fields, evaluated over blocks of points.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MC_FIELD_HPP
+#define MC_FIELD_HPP
+
+#include <vector>
+#include "glew.hpp"
+#include "Algebra.hpp"
+#include "Volume.hpp"
+
+namespace mc
+{
+	// Field expression
+	// Tree of primitives and operators, built bottom up: each function creates
+	// a node and returns its index, which is used to reference it as a child.
+	// Values are negative inside.
+	class FieldExpression
+	{
+	public:
+		// Node types
+		enum
+		{
+			NODE_SPHERE = 0,    // center, radius
+			NODE_BOX,           // center, half size
+			NODE_NOISE,         // value noise: frequency, amplitude
+			NODE_UNION,         // min(a,b)
+			NODE_INTERSECTION,  // max(a,b)
+			NODE_DIFFERENCE,    // max(a,-b)
+			NODE_ADD            // a+b
+		};
+
+		// Constructors / Destructor
+		FieldExpression();
+
+		// Manipulation
+			// primitives
+		GLuint Sphere(const Vector3& center, GLfloat radius);
+		GLuint Box(const Vector3& center, const Vector3& halfSize);
+		GLuint Noise(GLfloat frequency, GLfloat amplitude);
+			// operators
+		GLuint Union(GLuint a, GLuint b);
+		GLuint Intersection(GLuint a, GLuint b);
+		GLuint Difference(GLuint a, GLuint b);
+		GLuint Add(GLuint a, GLuint b);
+		void Clear();
+
+		// Queries
+		GLuint NodeCount() const;
+			// evaluate a node at a point, by walking the tree (reference
+			// for the tape, slow)
+		GLfloat Evaluate(GLuint node, const Vector3& point) const;
+
+	private:
+		// Non copyable
+		FieldExpression(const FieldExpression& expression);
+		FieldExpression& operator=(const FieldExpression& expression);
+
+		// Internal manipulation
+		GLuint _AddNode(GLint type,
+		                GLuint a, GLuint b,
+		                const GLfloat* params, GLuint paramCount);
+
+		// Node
+		struct Node
+		{
+			GLint   type;
+			GLuint  children[2];
+			GLfloat params[6];
+		};
+		friend class FieldTape;
+
+		// Members
+		std::vector<Node> mNodes;
+	};
+
+
+	// Field tape
+	// Expression compiled into a flat list of instructions (postfix order),
+	// evaluated for blocks of BLOCK_SIZE points at a time on a stack of
+	// blocks, with SSE2 if available (define MC_NO_SIMD to use the scalar
+	// implementation, results are the same). Shared subtrees are evaluated
+	// once per reference.
+	// Bounds of the field over a box are computed with interval arithmetic,
+	// so bricks of a volume can be proven empty or full before sampling.
+	class FieldTape
+	{
+	public:
+		// Constants
+		enum {BLOCK_SIZE = 64};
+
+		// Constructors / Destructor
+		FieldTape();
+			// see Compile
+		FieldTape(const FieldExpression& expression, GLuint root);
+
+		// Manipulation
+			// compile the subtree of a node
+		void Compile(const FieldExpression& expression, GLuint root);
+
+		// Queries
+		GLuint InstructionCount() const;
+		GLuint StackSize()        const;
+			// evaluate the field at points (coordinates are not interleaved)
+		void Evaluate(const GLfloat* x,
+		              const GLfloat* y,
+		              const GLfloat* z,
+		              GLfloat* values,
+		              size_t count) const;
+			// bounds of the field over a box
+		void EvaluateBounds(const Vector3& boxMin,
+		                    const Vector3& boxMax,
+		                    GLfloat& lower,
+		                    GLfloat& upper) const;
+			// sample the field at the samples of a volume
+			// Bricks of brickSize^3 samples are proven empty or full if the
+			// bounds of the field, over the brick grown by two samples, do
+			// not contain the isolevel. Their samples are then set to the
+			// bound instead of being evaluated, which changes neither the
+			// crossings nor the gradients used by the extractors. Stored
+			// gradients of the volume are cleared. Returns the number of
+			// evaluated bricks.
+		GLuint Sample(Volume& volume,
+		              GLfloat isolevel,
+		              GLuint brickSize = 8) const;
+
+	private:
+		// Non copyable
+		FieldTape(const FieldTape& tape);
+		FieldTape& operator=(const FieldTape& tape);
+
+		// Internal manipulation
+		GLuint _Compile(const FieldExpression& expression, GLuint node);
+		void _EvaluateBlock(const GLfloat* x,
+		                    const GLfloat* y,
+		                    const GLfloat* z,
+		                    GLfloat* stack) const;
+
+		// Instruction
+		struct Instruction
+		{
+			GLint   type;
+			GLfloat params[6];
+		};
+
+		// Members
+		std::vector<Instruction> mInstructions;
+		GLuint mStackSize;
+	};
+
+} // namespace mc
+
+#endif
+
@@ -0,0 +1,386 @@
+#include "Inflate.hpp"
+
+#include <algorithm>
+
+namespace mc
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// Constants
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// longest Huffman code
+static const GLuint MAX_CODE_LENGTH = 15;
+
+// literal / length and distance symbols
+static const GLuint LITERAL_COUNT  = 288;
+static const GLuint DISTANCE_COUNT = 30;
+
+// lengths and distances of the symbols 257.. and 0..
+static const GLushort LENGTH_BASES[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const GLubyte LENGTH_EXTRA_BITS[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const GLushort DISTANCE_BASES[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+	8193, 12289, 16385, 24577 };
+static const GLubyte DISTANCE_EXTRA_BITS[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// order of the code length code lengths
+static const GLubyte CODE_LENGTH_ORDER[19] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// gzip header flags
+enum
+{
+	GZIP_FLAG_HCRC    = 0x02,
+	GZIP_FLAG_EXTRA   = 0x04,
+	GZIP_FLAG_NAME    = 0x08,
+	GZIP_FLAG_COMMENT = 0x10
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Canonical Huffman code: number of codes of each length, and symbols
+// sorted by code
+struct _Huffman
+{
+	GLushort counts[MAX_CODE_LENGTH+1];
+	GLushort symbols[LITERAL_COUNT];
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Inflater
+// Decodes the blocks of a deflate stream (RFC 1951), codes are read bit by
+// bit, from the shortest.
+class _Inflater
+{
+public:
+	_Inflater(const GLubyte* data, size_t size,
+	          std::vector<GLubyte>& output, size_t maxSize):
+		mData(data), mSize(size), mPosition(0), mBits(0), mBitCount(0),
+		mOutput(output), mMaxSize(maxSize), mIsValid(true) {}
+
+	// decompress a deflate stream from the current position (returns false
+	// on errors, stops when maxSize is reached)
+	bool Inflate(size_t windowBegin)
+	{
+		GLuint isLast = 0;
+		while(!isLast && mIsValid && mOutput.size() < mMaxSize)
+		{
+			isLast = Bits(1);
+			switch(Bits(2))
+			{
+			case 0: _Stored(); break;
+			case 1: _Fixed(windowBegin); break;
+			case 2: _Dynamic(windowBegin); break;
+			default: mIsValid = false;
+			}
+		}
+		// rest of the last byte
+		mBits = mBitCount = 0;
+		return mIsValid;
+	}
+
+	// bytes
+	size_t Position() const {return mPosition;}
+	void Skip(size_t count) {mPosition = std::min(mSize, mPosition + count);}
+	bool AtEnd() const {return mPosition >= mSize;}
+	GLuint Byte()
+	{
+		if(mPosition >= mSize)
+		{
+			mIsValid = false;
+			return 0;
+		}
+		return mData[mPosition++];
+	}
+
+	// read count bits (count <= 24)
+	GLuint Bits(GLuint count)
+	{
+		GLuint bits = mBits;
+		while(mBitCount < count)
+		{
+			if(mPosition >= mSize)
+			{
+				mIsValid = false;
+				return 0;
+			}
+			bits|= GLuint(mData[mPosition++]) << mBitCount;
+			mBitCount+= 8;
+		}
+		mBits = bits >> count;
+		mBitCount-= count;
+		return bits & ((1u << count) - 1u);
+	}
+
+	bool IsValid() const {return mIsValid;}
+
+private:
+	// build a code from the lengths of its symbols (false if the lengths
+	// are over subscribed)
+	static bool _Build(_Huffman& code, const GLubyte* lengths, GLuint count)
+	{
+		std::fill(code.counts, code.counts + MAX_CODE_LENGTH+1, 0);
+		for(GLuint s=0; s<count; ++s)
+			++code.counts[lengths[s]];
+		GLint left = 1;
+		for(GLuint length=1; length<=MAX_CODE_LENGTH; ++length)
+		{
+			left = left*2 - code.counts[length];
+			if(left < 0)
+				return false;
+		}
+		GLushort offsets[MAX_CODE_LENGTH+1];
+		offsets[1] = 0;
+		for(GLuint length=1; length<MAX_CODE_LENGTH; ++length)
+			offsets[length+1] = offsets[length] + code.counts[length];
+		for(GLuint s=0; s<count; ++s)
+			if(lengths[s] != 0)
+				code.symbols[offsets[lengths[s]]++] = GLushort(s);
+		return true;
+	}
+
+	// decode a symbol (-1 on errors)
+	GLint _Decode(const _Huffman& code)
+	{
+		GLint value = 0, first = 0, index = 0;
+		for(GLuint length=1; length<=MAX_CODE_LENGTH; ++length)
+		{
+			value|= GLint(Bits(1));
+			GLint count = code.counts[length];
+			if(value - count < first)
+				return code.symbols[index + value - first];
+			index+= count;
+			first = (first + count) << 1;
+			value<<= 1;
+		}
+		mIsValid = false;
+		return -1;
+	}
+
+	// uncompressed block
+	void _Stored()
+	{
+		mBits = mBitCount = 0;
+		GLuint length  = Byte(); length|= Byte() << 8;
+		GLuint inverse = Byte(); inverse|= Byte() << 8;
+		if(!mIsValid || length != (~inverse & 0xFFFFu)
+		   || mPosition + length > mSize)
+		{
+			mIsValid = false;
+			return;
+		}
+		length = GLuint(std::min(size_t(length), mMaxSize - mOutput.size()));
+		mOutput.insert(mOutput.end(), mData + mPosition,
+		               mData + mPosition + length);
+		mPosition+= length;
+	}
+
+	// block with the fixed codes
+	void _Fixed(size_t windowBegin)
+	{
+		GLubyte lengths[LITERAL_COUNT];
+		std::fill(lengths,       lengths + 144, 8);
+		std::fill(lengths + 144, lengths + 256, 9);
+		std::fill(lengths + 256, lengths + 280, 7);
+		std::fill(lengths + 280, lengths + 288, 8);
+		_Huffman literals, distances;
+		_Build(literals, lengths, LITERAL_COUNT);
+		std::fill(lengths, lengths + DISTANCE_COUNT, 5);
+		_Build(distances, lengths, DISTANCE_COUNT);
+		_Codes(literals, distances, windowBegin);
+	}
+
+	// block with its own codes
+	void _Dynamic(size_t windowBegin)
+	{
+		GLuint literalCount  = Bits(5) + 257;
+		GLuint distanceCount = Bits(5) + 1;
+		GLuint lengthCount   = Bits(4) + 4;
+		if(literalCount > 286 || distanceCount > DISTANCE_COUNT)
+		{
+			mIsValid = false;
+			return;
+		}
+
+		// code of the code lengths
+		GLubyte lengths[LITERAL_COUNT + DISTANCE_COUNT];
+		std::fill(lengths, lengths + 19, 0);
+		for(GLuint i=0; i<lengthCount; ++i)
+			lengths[CODE_LENGTH_ORDER[i]] = GLubyte(Bits(3));
+		_Huffman lengthCode;
+		if(!_Build(lengthCode, lengths, 19))
+		{
+			mIsValid = false;
+			return;
+		}
+
+		// code lengths of the literals and distances
+		GLuint index = 0;
+		while(index < literalCount + distanceCount && mIsValid)
+		{
+			GLint symbol = _Decode(lengthCode);
+			if(symbol < 16)
+			{
+				lengths[index++] = GLubyte(symbol);
+				continue;
+			}
+			GLubyte length = 0;
+			GLuint repeat;
+			if(symbol == 16)
+			{
+				if(index == 0)
+				{
+					mIsValid = false;
+					return;
+				}
+				length = lengths[index-1];
+				repeat = 3 + Bits(2);
+			}
+			else if(symbol == 17)
+				repeat = 3 + Bits(3);
+			else
+				repeat = 11 + Bits(7);
+			if(index + repeat > literalCount + distanceCount)
+			{
+				mIsValid = false;
+				return;
+			}
+			std::fill(lengths + index, lengths + index + repeat, length);
+			index+= repeat;
+		}
+		if(!mIsValid || lengths[256] == 0)
+		{
+			mIsValid = false;
+			return;
+		}
+
+		_Huffman literals, distances;
+		if(!_Build(literals, lengths, literalCount)
+		   || !_Build(distances, lengths + literalCount, distanceCount))
+		{
+			mIsValid = false;
+			return;
+		}
+		_Codes(literals, distances, windowBegin);
+	}
+
+	// literals and copies of a compressed block
+	void _Codes(const _Huffman& literals,
+	            const _Huffman& distances,
+	            size_t windowBegin)
+	{
+		while(mIsValid && mOutput.size() < mMaxSize)
+		{
+			GLint symbol = _Decode(literals);
+			if(symbol < 0)
+				return;
+			if(symbol < 256)
+			{
+				mOutput.push_back(GLubyte(symbol));
+				continue;
+			}
+			if(symbol == 256)
+				return;
+
+			symbol-= 257;
+			if(symbol >= 29)
+			{
+				mIsValid = false;
+				return;
+			}
+			size_t length = LENGTH_BASES[symbol]
+			              + Bits(LENGTH_EXTRA_BITS[symbol]);
+			GLint distanceSymbol = _Decode(distances);
+			if(distanceSymbol < 0 || distanceSymbol >= GLint(DISTANCE_COUNT))
+			{
+				mIsValid = false;
+				return;
+			}
+			size_t distance = DISTANCE_BASES[distanceSymbol]
+			                + Bits(DISTANCE_EXTRA_BITS[distanceSymbol]);
+			if(!mIsValid || distance > mOutput.size() - windowBegin)
+			{
+				mIsValid = false;
+				return;
+			}
+			// copies may overlap their source
+			length = std::min(length, mMaxSize - mOutput.size());
+			size_t source = mOutput.size() - distance;
+			for(size_t i=0; i<length; ++i)
+				mOutput.push_back(mOutput[source + i]);
+		}
+	}
+
+	const GLubyte*        mData;
+	size_t                mSize;
+	size_t                mPosition;
+	GLuint                mBits;
+	GLuint                mBitCount;
+	std::vector<GLubyte>& mOutput;
+	size_t                mMaxSize;
+	bool                  mIsValid;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Inflate
+bool inflate(const GLubyte* data,
+             size_t size,
+             std::vector<GLubyte>& output,
+             size_t maxSize)
+{
+	if(maxSize != size_t(-1))
+		maxSize+= output.size();
+	_Inflater inflater(data, size, output, maxSize);
+
+	// zlib (compression method 8, header check)
+	if(size >= 2 && (data[0] & 0x0F) == 8 && (data[0]*256u + data[1]) % 31 == 0)
+	{
+		if(data[1] & 0x20)
+			return false; // preset dictionary
+		inflater.Skip(2);
+		bool isValid = inflater.Inflate(output.size());
+		return isValid && (maxSize == size_t(-1) || output.size() == maxSize);
+	}
+
+	// gzip members
+	if(size < 2 || data[0] != 0x1F || data[1] != 0x8B)
+		return false;
+	while(!inflater.AtEnd() && output.size() < maxSize)
+	{
+		if(inflater.Byte() != 0x1F || inflater.Byte() != 0x8B
+		   || inflater.Byte() != 8)
+			return false;
+		GLuint flags = inflater.Byte();
+		inflater.Skip(6); // time, extra flags, os
+		if(flags & GZIP_FLAG_EXTRA)
+		{
+			GLuint length = inflater.Byte();
+			length|= inflater.Byte() << 8;
+			inflater.Skip(length);
+		}
+		if(flags & GZIP_FLAG_NAME)
+			while(inflater.IsValid() && inflater.Byte() != 0);
+		if(flags & GZIP_FLAG_COMMENT)
+			while(inflater.IsValid() && inflater.Byte() != 0);
+		if(flags & GZIP_FLAG_HCRC)
+			inflater.Skip(2);
+		if(!inflater.IsValid() || !inflater.Inflate(output.size()))
+			return false;
+		inflater.Skip(8); // crc, size
+	}
+	return maxSize == size_t(-1) || output.size() == maxSize;
+}
+
+} // namespace mc
+
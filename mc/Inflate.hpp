@@ -0,0 +1,31 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   Inflate.hpp
+// \author J Dupuy
+// \brief  Deflate decompression, for the compressed volume files.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MC_INFLATE_HPP
+#define MC_INFLATE_HPP
+
+#include <vector>
+#include "glew.hpp"
+
+namespace mc
+{
+	// Decompress a deflate stream with a zlib or a gzip wrapper (detected
+	// from the first bytes, concatenated gzip members are decompressed one
+	// after the other). Decompressed bytes are appended to output, and
+	// decompression stops as soon as maxSize bytes are out, so the beginning
+	// of large streams can be read alone. Checksums are not verified.
+	// Returns false if the stream is invalid, or ends before maxSize bytes
+	// when maxSize is set.
+	bool inflate(const GLubyte* data,
+	             size_t size,
+	             std::vector<GLubyte>& output,
+	             size_t maxSize = size_t(-1));
+
+} // namespace mc
+
+#endif
+
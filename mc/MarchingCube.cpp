@@ -0,0 +1,950 @@
+#include "MarchingCube.hpp"
+#include "Arena.hpp"
+#include "BrickVolume.hpp"
+#include "ChunkQueue.hpp"
+#include "MarchingCubeCell.hpp"
+#include "MarchingCubeTables.hpp"
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace mc
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// Constants
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// unset vertex index
+static const GLuint INVALID_INDEX = ~0u;
+
+// Newton iterations for the cubic interpolation
+static const GLuint CUBIC_ITERATION_COUNT = 4;
+
+// cell slices extracted by a producer between two pushes
+static const GLuint PRODUCER_SLICE_COUNT = 16;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Crossing of the isolevel along an edge (in [0,1])
+// v0, v1 are the values at the ends of the edge and d0, d1 their derivatives
+// along the edge. The cubic crossing is the root of the Hermite polynomial,
+// found with Newton iterations kept inside a bisection bracket.
+static GLfloat _edge_crossing(GLfloat v0, GLfloat v1,
+                              GLfloat d0, GLfloat d1,
+                              GLfloat isolevel,
+                              GLint interpolationMode)
+{
+	GLfloat t = (isolevel - v0) / (v1 - v0);
+	if(INTERPOLATION_MODE_LINEAR == interpolationMode)
+		return t;
+
+	GLfloat lower = 0.0f, upper = 1.0f;
+	bool inside = v0 < isolevel;
+	for(GLuint i=0; i<CUBIC_ITERATION_COUNT; ++i)
+	{
+		GLfloat t2 = t*t, t3 = t2*t;
+		GLfloat f  = (2.0f*t3 - 3.0f*t2 + 1.0f)*v0 + (t3 - 2.0f*t2 + t)*d0
+		           + (3.0f*t2 - 2.0f*t3)*v1        + (t3 - t2)*d1
+		           - isolevel;
+		GLfloat df = (6.0f*t2 - 6.0f*t)*(v0 - v1)
+		           + (3.0f*t2 - 4.0f*t + 1.0f)*d0 + (3.0f*t2 - 2.0f*t)*d1;
+		if(f == 0.0f)
+			break;
+		if((f < 0.0f) == inside)
+			lower = t;
+		else
+			upper = t;
+		GLfloat next = df != 0.0f ? t - f/df : lower;
+		t = next >= lower && next <= upper ? next : 0.5f*(lower + upper);
+	}
+	return t;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Add a normal to a mesh (normalized, zero vectors are kept)
+static void _add_normal(Mesh& mesh, const GLfloat* n)
+{
+	GLfloat length = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+	if(length > 0.0f)
+		mesh.AddNormal(n[0]/length, n[1]/length, n[2]/length);
+	else
+		mesh.AddNormal(0.0f, 0.0f, 0.0f);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Gradients of the samples of slice z (central differences, one sided on the
+// borders, as Volume::Gradient), xyz interleaved
+static void _compute_gradient_slice(const Volume& volume,
+                                    GLuint z,
+                                    GLfloat* gradients)
+{
+	const GLuint size[3]   = {volume.Width(), volume.Height(), volume.Depth()};
+	const size_t stride[3] = {1, size[0], size_t(size[0])*size[1]};
+	const Vector3& spacing = volume.Spacing();
+	const GLfloat* samples = volume.Samples();
+	for(GLuint y=0; y<size[1]; ++y)
+	for(GLuint x=0; x<size[0]; ++x, gradients+=3)
+	{
+		const GLuint p[3]  = {x, y, z};
+		const size_t index = z*stride[2] + y*stride[1] + x;
+		for(GLuint a=0; a<3; ++a)
+		{
+			GLuint lower = p[a] > 0 ? 1 : 0;
+			GLuint upper = p[a]+1 < size[a] ? 1 : 0;
+			if(lower + upper == 0)
+				gradients[a] = 0.0f;
+			else
+				gradients[a] = (samples[index + upper*stride[a]]
+				                - samples[index - lower*stride[a]])
+				             / (GLfloat(lower + upper) * spacing[a]);
+		}
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Edge vertex cache
+// Vertex indexes of the edges of two consecutive slices of samples (three
+// edges per sample, along x, y and z), so vertices are shared between cells.
+// The gradients of the two slices are computed once per slice, or read from
+// the volume if stored. Indexes and gradients are allocated in an arena.
+class _EdgeVertexCache
+{
+public:
+	_EdgeVertexCache(const Volume& volume,
+	                 GLfloat isolevel,
+	                 GLint interpolationMode,
+	                 Mesh& mesh,
+	                 Arena& arena):
+		mVolume(volume), mMesh(mesh), mIsolevel(isolevel),
+		mInterpolationMode(interpolationMode),
+		mSliceSize(size_t(volume.Width())*volume.Height())
+	{
+		mIndexes = arena.Allocate<GLuint>(mSliceSize*3*2);
+		std::fill(mIndexes, mIndexes + mSliceSize*3*2, INVALID_INDEX);
+		mGradients      = volume.Gradients();
+		mGradientSlices = NULL == mGradients
+		                ? arena.Allocate<GLfloat>(mSliceSize*3*2) : NULL;
+		mGradientSliceZ[0] = mGradientSliceZ[1] = INVALID_INDEX;
+	}
+
+	// reset the indexes of slice z
+	void ResetSlice(GLuint z)
+	{
+		std::fill(mIndexes + (z&1)*mSliceSize*3,
+		          mIndexes + (z&1)*mSliceSize*3 + mSliceSize*3,
+		          INVALID_INDEX);
+	}
+
+	// compute the gradients of slices z and z+1, if not already done
+	// (must be called before the vertices of the cells of slice z are made)
+	void PrepareGradients(GLuint z)
+	{
+		if(NULL != mGradients)
+			return;
+		for(GLuint i=z; i<=z+1; ++i)
+			if(mGradientSliceZ[i&1] != i)
+			{
+				_compute_gradient_slice(mVolume, i,
+				                        mGradientSlices + (i&1)*mSliceSize*3);
+				mGradientSliceZ[i&1] = i;
+			}
+	}
+
+	// indexes of slice z (three per sample, INVALID_INDEX if unset)
+	const GLuint* Slice(GLuint z) const
+	{
+		return mIndexes + (z&1)*mSliceSize*3;
+	}
+
+	// get the vertex of an edge of cell (x,y,z) (created if needed)
+	// values are the samples at the corners of the cell
+	GLuint Vertex(GLuint x, GLuint y, GLuint z,
+	              GLuint edge,
+	              const GLfloat* values)
+	{
+		const GLuint lower = edge_lower_vertex(edge);
+		const GLuint upper = edge_upper_vertex(edge);
+		GLuint ex = x + vertex_offset(lower, 0);
+		GLuint ey = y + vertex_offset(lower, 1);
+		GLuint ez = z + vertex_offset(lower, 2);
+		GLuint axis = edge_axis(edge);
+		GLuint& index = mIndexes[  (ez&1)*mSliceSize*3
+		                         + (size_t(ey)*mVolume.Width() + ex)*3
+		                         + axis ];
+		if(index == INVALID_INDEX)
+		{
+			// position and normal along the edge
+			const Vector3& o = mVolume.Origin();
+			const Vector3& s = mVolume.Spacing();
+			const GLfloat* g0 = _Gradient(ex, ey, ez);
+			const GLfloat* g1 = _Gradient(ex + (axis == 0), ey + (axis == 1),
+			                              ez + (axis == 2));
+			GLfloat t = _edge_crossing(values[lower],
+			                           values[upper],
+			                           g0[axis]*s[axis],
+			                           g1[axis]*s[axis],
+			                           mIsolevel,
+			                           mInterpolationMode);
+			GLfloat p[3] = {GLfloat(ex), GLfloat(ey), GLfloat(ez)};
+			p[axis]+= t;
+			index = mMesh.AddVertex(o[0] + s[0]*p[0],
+			                        o[1] + s[1]*p[1],
+			                        o[2] + s[2]*p[2]);
+			GLfloat n[3] = {g0[0] + t*(g1[0]-g0[0]),
+			                g0[1] + t*(g1[1]-g0[1]),
+			                g0[2] + t*(g1[2]-g0[2])};
+			_add_normal(mMesh, n);
+		}
+		return index;
+	}
+
+private:
+	// gradient at a sample of the prepared slices
+	const GLfloat* _Gradient(GLuint x, GLuint y, GLuint z) const
+	{
+		const size_t sample = size_t(y)*mVolume.Width() + x;
+		if(NULL != mGradients)
+			return mGradients + (z*mSliceSize + sample)*3;
+#ifndef NDEBUG
+		assert(mGradientSliceZ[z&1] == z);
+#endif
+		return mGradientSlices + ((z&1)*mSliceSize + sample)*3;
+	}
+
+	GLuint*        mIndexes;
+	const GLfloat* mGradients;      // stored by the volume, or NULL
+	GLfloat*       mGradientSlices; // two slices, if not stored
+	GLuint         mGradientSliceZ[2];
+	const Volume&  mVolume;
+	Mesh&          mMesh;
+	GLfloat        mIsolevel;
+	GLint          mInterpolationMode;
+	size_t         mSliceSize;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Check if a case has an ambiguous face (two diagonally opposite corners
+// inside, the two others outside)
+static bool _has_ambiguous_face(GLuint cubeCase)
+{
+	for(GLuint f=0; f<6; ++f)
+	{
+		const GLint* c = &FACE_TO_VERTICES[f*4];
+		GLuint in0 = cubeCase >> c[0] & 1u, in1 = cubeCase >> c[1] & 1u;
+		GLuint in2 = cubeCase >> c[2] & 1u, in3 = cubeCase >> c[3] & 1u;
+		if(in0 == in2 && in1 == in3 && in0 != in1)
+			return true;
+	}
+	return false;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Polygonize a cell by tracing the isoline on its faces
+// On each face, the isoline enters the inside region through an edge and
+// leaves it through another. Ambiguous faces are resolved with the asymptotic
+// decider, which only depends on the face samples, so adjacent cells always
+// agree and the surface is closed. The loops formed on the cell boundary are
+// triangulated (with a center vertex if they have more than five edges).
+static void _polygonize_faces(const GLfloat* values,
+                              GLuint cubeCase,
+                              GLfloat isolevel,
+                              GLuint x, GLuint y, GLuint z,
+                              _EdgeVertexCache& cache,
+                              Mesh& mesh)
+{
+	GLint next[12];
+	for(GLuint i=0; i<12; ++i)
+		next[i] = -1;
+
+	// connect the edges face by face
+	for(GLuint f=0; f<6; ++f)
+	{
+		const GLint* c = &FACE_TO_VERTICES[f*4];
+		const GLint* e = &FACE_TO_EDGES[f*4];
+		GLuint in[4];
+		for(GLuint k=0; k<4; ++k)
+			in[k] = cubeCase >> c[k] & 1u;
+
+		if(in[0] == in[2] && in[1] == in[3] && in[0] != in[1])
+		{
+			// inside corners are i and i+2, the isoline enters through
+			// edges i+3 and i+1 and leaves through edges i and i+2
+			GLuint i = in[0] ? 0 : 1;
+			GLfloat v0 = values[c[0]], v1 = values[c[1]];
+			GLfloat v2 = values[c[2]], v3 = values[c[3]];
+			// value of the bilinear interpolant at its saddle point
+			GLfloat saddle = (v0*v2 - v1*v3) / (v0 + v2 - v1 - v3);
+			if(saddle < isolevel)
+			{
+				// inside corners are connected
+				next[e[(i+3)&3]] = e[(i+2)&3];
+				next[e[(i+1)&3]] = e[i];
+			}
+			else
+			{
+				next[e[(i+3)&3]] = e[i];
+				next[e[(i+1)&3]] = e[(i+2)&3];
+			}
+		}
+		else
+		{
+			GLint enter = -1, leave = -1;
+			for(GLuint k=0; k<4; ++k)
+			{
+				if(!in[k] && in[(k+1)&3])
+					enter = e[k];
+				else if(in[k] && !in[(k+1)&3])
+					leave = e[k];
+			}
+			if(enter >= 0)
+				next[enter] = leave;
+		}
+	}
+
+	// trace the loops and triangulate them
+	for(GLuint first=0; first<12; ++first)
+	{
+		if(next[first] < 0)
+			continue;
+
+		GLuint loop[12];
+		GLuint count = 0;
+		GLint edge = first;
+		while(next[edge] >= 0)
+		{
+			loop[count++] = cache.Vertex(x, y, z, edge, values);
+			GLint nextEdge = next[edge];
+			next[edge] = -1;
+			edge = nextEdge;
+		}
+
+		if(count <= 5)
+		{
+			for(GLuint i=1; i+1<count; ++i)
+				mesh.AddTriangle(loop[0], loop[i], loop[i+1]);
+		}
+		else
+		{
+			GLfloat center[3] = {0.0f, 0.0f, 0.0f};
+			GLfloat normal[3] = {0.0f, 0.0f, 0.0f};
+			const std::vector<GLfloat>& positions = mesh.Positions();
+			const std::vector<GLfloat>& normals   = mesh.Normals();
+			for(GLuint i=0; i<count; ++i)
+			for(GLuint j=0; j<3; ++j)
+			{
+				center[j]+= positions[loop[i]*3+j];
+				normal[j]+= normals[loop[i]*3+j];
+			}
+			GLuint centerIndex = mesh.AddVertex(center[0]/count,
+			                                    center[1]/count,
+			                                    center[2]/count);
+			_add_normal(mesh, normal);
+			for(GLuint i=0; i<count; ++i)
+				mesh.AddTriangle(centerIndex, loop[i], loop[(i+1)%count]);
+		}
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Extract the cells of slices [z0, z1[ of a volume
+// The vertex indexes of the edges of sample slices z0 and z1 are copied to
+// firstSlice and lastSlice if they are not NULL.
+static void _extract_slab(const Volume& volume,
+                          GLfloat isolevel,
+                          GLuint z0, GLuint z1,
+                          GLint topologyMode,
+                          GLint interpolationMode,
+                          Mesh& mesh,
+                          GLuint* firstSlice,
+                          GLuint* lastSlice)
+{
+	const GLuint W = volume.Width();
+	const GLuint H = volume.Height();
+	const GLfloat* samples = volume.Samples();
+
+	// sample offsets of the corners
+	const size_t SLICE_SIZE = size_t(W)*size_t(H);
+	size_t cornerOffsets[8];
+	for(GLuint i=0; i<8; ++i)
+		cornerOffsets[i] = vertex_offset(i, 0)
+		                 + vertex_offset(i, 1)*size_t(W)
+		                 + vertex_offset(i, 2)*SLICE_SIZE;
+
+	ArenaScope scope;
+	_EdgeVertexCache cache(volume, isolevel, interpolationMode, mesh,
+	                       scope.GetArena());
+	GLubyte* cases = scope.GetArena().Allocate<GLubyte>(size_t(W-1)*(H-1));
+	for(GLuint z=z0; z<z1; ++z)
+	{
+		cache.ResetSlice(z+1);
+
+		// compute cases
+		GLuint activeCount = 0;
+		{
+			FW_TRACE_SCOPE("classification", "extraction");
+			GLubyte* cellCase = cases;
+			for(GLuint y=0; y<H-1; ++y)
+			for(GLuint x=0; x<W-1; ++x, ++cellCase)
+			{
+				const GLfloat* cell = samples + z*SLICE_SIZE + size_t(y)*W + x;
+				GLuint cubeCase = 0;
+				for(GLuint i=0; i<8; ++i)
+					cubeCase|= GLuint(cell[cornerOffsets[i]] < isolevel) << i;
+				*cellCase = GLubyte(cubeCase);
+				activeCount+= GLuint(cubeCase != 0 && cubeCase != 255);
+			}
+		}
+
+		// emit the faces of the active cells
+		FW_TRACE_BEGIN(interpolationTrace, "interpolation", "extraction");
+		if(activeCount > 0)
+			cache.PrepareGradients(z);
+		const GLubyte* cellCase = cases;
+		for(GLuint y=0; y<H-1 && activeCount > 0; ++y)
+		for(GLuint x=0; x<W-1; ++x, ++cellCase)
+		{
+			const GLuint cubeCase = *cellCase;
+			if(cubeCase == 0 || cubeCase == 255)
+				continue;
+			const GLfloat* cell = samples + z*SLICE_SIZE + size_t(y)*W + x;
+			GLfloat values[8];
+			for(GLuint i=0; i<8; ++i)
+				values[i] = cell[cornerOffsets[i]];
+
+			// resolve ambiguous faces
+			if(TOPOLOGY_MODE_ASYMPTOTIC_DECIDER == topologyMode
+			   && _has_ambiguous_face(cubeCase))
+			{
+				_polygonize_faces(values, cubeCase, isolevel,
+				                  x, y, z, cache, mesh);
+				continue;
+			}
+
+			// emit faces
+			for(GLuint f =  CASE_TO_FACE_OFFSET[cubeCase];
+			           f <  CASE_TO_FACE_OFFSET[cubeCase+1];
+			         ++f)
+			{
+				GLuint edges = FACE_EDGES_PACKED[f];
+				GLuint i0 = cache.Vertex(x, y, z, edges & 0xF, values);
+				GLuint i1 = cache.Vertex(x, y, z, edges>>4 & 0xF, values);
+				GLuint i2 = cache.Vertex(x, y, z, edges>>8, values);
+				// tables wind faces towards the lower values
+				mesh.AddTriangle(i0, i2, i1);
+			}
+		}
+		FW_TRACE_END(interpolationTrace);
+
+		// slice z0 is reset by the next iteration
+		if(z == z0 && firstSlice)
+			std::copy(cache.Slice(z0), cache.Slice(z0) + SLICE_SIZE*3,
+			          firstSlice);
+	}
+	if(lastSlice)
+		std::copy(cache.Slice(z1), cache.Slice(z1) + SLICE_SIZE*3, lastSlice);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Slab of a parallel extraction
+struct _Slab
+{
+	Mesh                mesh;
+	std::vector<GLuint> firstSlice;
+	std::vector<GLuint> lastSlice;
+	std::vector<GLuint> remap;          // local to global vertex indexes
+	GLuint              vertexOffset;   // first vertex made by the slab
+	GLuint              triangleOffset; // in the global mesh
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Extract the slabs of a volume
+class _ExtractSlabTask : public ThreadPool::Task
+{
+public:
+	_ExtractSlabTask(const Volume& volume,
+	                 GLfloat isolevel,
+	                 GLint topologyMode,
+	                 GLint interpolationMode,
+	                 ThreadPool& pool,
+	                 _Slab* slabs):
+		mVolume(volume), mIsolevel(isolevel), mTopologyMode(topologyMode),
+		mInterpolationMode(interpolationMode), mPool(pool), mSlabs(slabs) {}
+
+	void Run(GLuint index, GLuint)
+	{
+		// cells of slab i are the ones with their lower corner in the
+		// samples of slab i
+		const GLuint cellDepth = mVolume.Depth() - 1;
+		GLuint z0 = std::min(mVolume.SlabBegin(index, mPool), cellDepth);
+		GLuint z1 = std::min(mVolume.SlabBegin(index+1, mPool), cellDepth);
+		if(z0 == z1)
+			return;
+
+		const size_t sliceSize = size_t(mVolume.Width())*mVolume.Height();
+		_Slab& slab = mSlabs[index];
+		slab.firstSlice.resize(sliceSize*3);
+		slab.lastSlice.resize(sliceSize*3);
+		_extract_slab(mVolume, mIsolevel, z0, z1,
+		              mTopologyMode, mInterpolationMode,
+		              slab.mesh, &slab.firstSlice[0], &slab.lastSlice[0]);
+	}
+
+private:
+	const Volume& mVolume;
+	GLfloat       mIsolevel;
+	GLint         mTopologyMode;
+	GLint         mInterpolationMode;
+	ThreadPool&   mPool;
+	_Slab*        mSlabs;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Extract the slabs of a volume into a queue, by groups of slices
+class _ProduceSlabTask : public ThreadPool::Task
+{
+public:
+	_ProduceSlabTask(const Volume& volume,
+	                 GLfloat isolevel,
+	                 GLint topologyMode,
+	                 GLint interpolationMode,
+	                 ThreadPool& pool,
+	                 ChunkQueue& queue,
+	                 GLuint64* triangleCounts):
+		mVolume(volume), mIsolevel(isolevel), mTopologyMode(topologyMode),
+		mInterpolationMode(interpolationMode), mPool(pool), mQueue(queue),
+		mTriangleCounts(triangleCounts) {}
+
+	void Run(GLuint index, GLuint)
+	{
+		const GLuint cellDepth = mVolume.Depth() - 1;
+		GLuint z0 = std::min(mVolume.SlabBegin(index, mPool), cellDepth);
+		GLuint z1 = std::min(mVolume.SlabBegin(index+1, mPool), cellDepth);
+		Mesh mesh;
+		for(GLuint z=z0; z<z1; z+=PRODUCER_SLICE_COUNT)
+		{
+			mesh.Clear();
+			_extract_slab(mVolume, mIsolevel,
+			              z, std::min(z+PRODUCER_SLICE_COUNT, z1),
+			              mTopologyMode, mInterpolationMode,
+			              mesh, NULL, NULL);
+			push_mesh_triangles(mesh, mQueue);
+			mTriangleCounts[index]+= mesh.TriangleCount();
+		}
+	}
+
+private:
+	const Volume& mVolume;
+	GLfloat       mIsolevel;
+	GLint         mTopologyMode;
+	GLint         mInterpolationMode;
+	ThreadPool&   mPool;
+	ChunkQueue&   mQueue;
+	GLuint64*     mTriangleCounts;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Copy the slab meshes to the global mesh
+class _MergeSlabTask : public ThreadPool::Task
+{
+public:
+	_MergeSlabTask(_Slab* slabs, Mesh& mesh):
+		mSlabs(slabs), mMesh(mesh) {}
+
+	void Run(GLuint index, GLuint)
+	{
+		const _Slab& slab = mSlabs[index];
+		const std::vector<GLfloat>& positions = slab.mesh.Positions();
+		const std::vector<GLfloat>& normals   = slab.mesh.Normals();
+		const std::vector<GLuint>& indexes    = slab.mesh.Indexes();
+		std::vector<GLfloat>& meshPositions   = mMesh.Positions();
+		std::vector<GLfloat>& meshNormals     = mMesh.Normals();
+		std::vector<GLuint>& meshIndexes      = mMesh.Indexes();
+
+		// welded vertices are written by the previous slab
+		for(size_t v=0; v<slab.remap.size(); ++v)
+		{
+			const size_t global = slab.remap[v];
+			if(global < slab.vertexOffset)
+				continue;
+			for(GLuint j=0; j<3; ++j)
+			{
+				meshPositions[global*3+j] = positions[v*3+j];
+				meshNormals[global*3+j]   = normals[v*3+j];
+			}
+		}
+		for(size_t i=0; i<indexes.size(); ++i)
+			meshIndexes[size_t(slab.triangleOffset)*3 + i]
+				= slab.remap[indexes[i]];
+	}
+
+private:
+	_Slab* mSlabs;
+	Mesh&  mMesh;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Marching cube extraction
+void extract_marching_cube(const Volume& volume,
+                           GLfloat isolevel,
+                           Mesh& mesh,
+                           GLint topologyMode,
+                           GLint interpolationMode)
+{
+	mesh.Clear();
+	if(volume.Width() < 2 || volume.Height() < 2 || volume.Depth() < 2)
+		return;
+	_extract_slab(volume, isolevel, 0, volume.Depth()-1,
+	              topologyMode, interpolationMode, mesh, NULL, NULL);
+}
+
+void extract_marching_cube(const Volume& volume,
+                           GLfloat isolevel,
+                           Mesh& mesh,
+                           ThreadPool& pool,
+                           GLint topologyMode,
+                           GLint interpolationMode)
+{
+	mesh.Clear();
+	if(volume.Width() < 2 || volume.Height() < 2 || volume.Depth() < 2)
+		return;
+
+	// extract the slabs
+	const GLuint slabCount = pool.ThreadCount();
+	const size_t sliceSize = size_t(volume.Width())*volume.Height();
+	_Slab* slabs = new _Slab[slabCount];
+	_ExtractSlabTask extractTask(volume, isolevel, topologyMode,
+	                             interpolationMode, pool, slabs);
+	pool.Run(slabCount, extractTask);
+
+	// the vertices of the edges of the slice shared by two slabs are
+	// created by both, those of the second are welded to those of the
+	// first; the others are numbered in order, as in a serial extraction
+	GLuint vertexCount = 0, triangleCount = 0;
+	const _Slab* previous = NULL;
+	for(GLuint i=0; i<slabCount; ++i)
+	{
+		_Slab& slab = slabs[i];
+		if(slab.firstSlice.empty())
+			continue;
+		slab.remap.assign(slab.mesh.VertexCount(), INVALID_INDEX);
+		if(previous)
+			for(size_t e=0; e<sliceSize*3; ++e)
+				if(e % 3 != 2 && slab.firstSlice[e] != INVALID_INDEX)
+				{
+#ifndef NDEBUG
+					assert(previous->lastSlice[e] != INVALID_INDEX);
+#endif
+					slab.remap[slab.firstSlice[e]]
+						= previous->remap[previous->lastSlice[e]];
+				}
+		slab.vertexOffset = vertexCount;
+		for(size_t v=0; v<slab.remap.size(); ++v)
+			if(slab.remap[v] == INVALID_INDEX)
+				slab.remap[v] = vertexCount++;
+		slab.triangleOffset = triangleCount;
+		triangleCount+= slab.mesh.TriangleCount();
+		std::vector<GLuint>().swap(slab.firstSlice);
+		previous = &slab;
+	}
+
+	// copy the slab meshes
+	mesh.Positions().resize(size_t(vertexCount)*3);
+	mesh.Normals().resize(size_t(vertexCount)*3);
+	mesh.Indexes().resize(size_t(triangleCount)*3);
+	_MergeSlabTask mergeTask(slabs, mesh);
+	pool.Run(slabCount, mergeTask);
+	delete[] slabs;
+}
+
+GLuint64 extract_marching_cube(const Volume& volume,
+                               GLfloat isolevel,
+                               ChunkQueue& queue,
+                               ThreadPool& pool,
+                               GLint topologyMode,
+                               GLint interpolationMode)
+{
+	if(volume.Width() < 2 || volume.Height() < 2 || volume.Depth() < 2)
+		return 0;
+
+	const GLuint slabCount = pool.ThreadCount();
+	std::vector<GLuint64> triangleCounts(slabCount, 0);
+	_ProduceSlabTask produceTask(volume, isolevel, topologyMode,
+	                             interpolationMode, pool, queue,
+	                             &triangleCounts[0]);
+	pool.Run(slabCount, produceTask);
+
+	GLuint64 triangleCount = 0;
+	for(GLuint i=0; i<slabCount; ++i)
+		triangleCount+= triangleCounts[i];
+	return triangleCount;
+}
+
+void extract_marching_cube(const BrickVolume& volume,
+                           GLfloat isolevel,
+                           Mesh& mesh,
+                           GLint topologyMode,
+                           GLint interpolationMode)
+{
+	const GLuint D = volume.Depth();
+	mesh.Clear();
+	if(volume.Width() < 2 || volume.Height() < 2 || D < 2)
+		return;
+
+	const size_t sliceSize = size_t(volume.Width())*volume.Height();
+	std::vector<GLuint> firstSlice(sliceSize*3), lastSlice(sliceSize*3);
+	std::vector<GLuint> previousSlice; // global indexes of the last slice
+	std::vector<GLuint> remap;
+	Volume slab;
+	Mesh slabMesh;
+	for(GLuint z0=0; z0<D-1; z0+=volume.BrickSize())
+	{
+		// samples of the cells of slices [z0, z1[ and of their gradients
+		GLuint z1 = std::min(z0 + volume.BrickSize(), D-1);
+		GLuint first = z0 > 0 ? z0-1 : 0;
+		GLuint end   = std::min(z1+2, D);
+		volume.DecompressSlices(first, end, slab);
+		slabMesh.Clear();
+		_extract_slab(slab, isolevel, z0-first, z1-first,
+		              topologyMode, interpolationMode, slabMesh,
+		              &firstSlice[0], &lastSlice[0]);
+
+		// weld the vertices of slice z0, append the others
+		const std::vector<GLfloat>& positions = slabMesh.Positions();
+		const std::vector<GLfloat>& normals   = slabMesh.Normals();
+		const std::vector<GLuint>& indexes    = slabMesh.Indexes();
+		remap.assign(slabMesh.VertexCount(), INVALID_INDEX);
+		for(size_t e=0; e<previousSlice.size(); ++e)
+			if(e % 3 != 2 && firstSlice[e] != INVALID_INDEX)
+				remap[firstSlice[e]] = previousSlice[e];
+		for(size_t v=0; v<remap.size(); ++v)
+			if(remap[v] == INVALID_INDEX)
+			{
+				remap[v] = mesh.AddVertex(positions[v*3],
+				                          positions[v*3+1],
+				                          positions[v*3+2]);
+				mesh.AddNormal(normals[v*3], normals[v*3+1], normals[v*3+2]);
+			}
+		for(size_t i=0; i<indexes.size(); i+=3)
+			mesh.AddTriangle(remap[indexes[i]],
+			                 remap[indexes[i+1]],
+			                 remap[indexes[i+2]]);
+
+		previousSlice.resize(sliceSize*3);
+		for(size_t e=0; e<sliceSize*3; ++e)
+			previousSlice[e] = lastSlice[e] != INVALID_INDEX
+			                 ? remap[lastSlice[e]] : INVALID_INDEX;
+	}
+}
+
+} // namespace mc
+
+
+// Benchmark of the face tables
+// (build with -DMARCHING_CUBE_BENCHMARK mc/*.cpp core/*.cpp Framework.cpp
+// Trace.cpp and the OpenGL libraries)
+#ifdef MARCHING_CUBE_BENCHMARK
+#include <cmath>
+#include <cstdio>
+#include "Framework.hpp"
+
+// walk the faces of each case with the original table
+static GLuint _walk_edge_connect_list(const std::vector<GLubyte>& cases)
+{
+	GLuint sum = 0;
+	for(size_t i=0; i<cases.size(); ++i)
+	{
+		const GLint* faces = &EDGE_CONNECT_LIST[cases[i]*5*4];
+		for(GLint f=0; f<CASE_TO_FACE_COUNT[cases[i]]; ++f)
+			sum+= faces[f*4] + faces[f*4+1] + faces[f*4+2];
+	}
+	return sum;
+}
+
+// walk the faces of each case with the packed table
+static GLuint _walk_face_edges_packed(const std::vector<GLubyte>& cases)
+{
+	GLuint sum = 0;
+	for(size_t i=0; i<cases.size(); ++i)
+	{
+		for(GLuint f =  CASE_TO_FACE_OFFSET[cases[i]];
+		           f <  CASE_TO_FACE_OFFSET[cases[i]+1];
+		         ++f)
+		{
+			GLuint edges = FACE_EDGES_PACKED[f];
+			sum+= (edges & 0xF) + (edges>>4 & 0xF) + (edges>>8);
+		}
+	}
+	return sum;
+}
+
+int main(int argc, char **argv)
+{
+	const GLuint SIZE = 192;
+	const GLuint RUN_COUNT = 10;
+	mc::Volume volume(SIZE, SIZE, SIZE);
+	mc::Mesh mesh;
+	std::vector<GLubyte> cases;
+
+	// gyroid, lots of surface cells
+	for(GLuint z=0; z<SIZE; ++z)
+	for(GLuint y=0; y<SIZE; ++y)
+	for(GLuint x=0; x<SIZE; ++x)
+		volume.At(x,y,z) = std::sin(x*0.3f)*std::cos(y*0.3f)
+		                 + std::sin(y*0.3f)*std::cos(z*0.3f)
+		                 + std::sin(z*0.3f)*std::cos(x*0.3f);
+
+	// cases of the non empty cells
+	for(GLuint z=0; z<SIZE-1; ++z)
+	for(GLuint y=0; y<SIZE-1; ++y)
+	for(GLuint x=0; x<SIZE-1; ++x)
+	{
+		GLuint cubeCase = 0;
+		for(GLuint i=0; i<8; ++i)
+			cubeCase|= GLuint(volume.At(x+mc::vertex_offset(i, 0),
+			                            y+mc::vertex_offset(i, 1),
+			                            z+mc::vertex_offset(i, 2)) < 0.0f) << i;
+		if(cubeCase != 0 && cubeCase != 255)
+			cases.push_back(GLubyte(cubeCase));
+	}
+
+	fw::TimerStatistics edgeConnectList, faceEdgesPacked, extraction;
+	GLuint check[2] = {0, 0};
+	for(GLuint i=0; i<RUN_COUNT; ++i)
+	{
+		{
+			fw::ScopedTimer timer(edgeConnectList);
+			check[0]+= _walk_edge_connect_list(cases);
+		}
+		{
+			fw::ScopedTimer timer(faceEdgesPacked);
+			check[1]+= _walk_face_edges_packed(cases);
+		}
+		{
+			fw::ScopedTimer timer(extraction);
+			mc::extract_marching_cube(volume, 0.0f, mesh,
+			                          mc::TOPOLOGY_MODE_TABLES);
+		}
+	}
+
+	std::printf("%u non empty cells, %u triangles (check %s)\n",
+	            GLuint(cases.size()),
+	            mesh.TriangleCount(),
+	            check[0] == check[1] ? "ok" : "FAILED");
+	std::printf("table sizes: EDGE_CONNECT_LIST %u bytes, packed %u bytes\n",
+	            GLuint(sizeof(EDGE_CONNECT_LIST)+sizeof(CASE_TO_FACE_COUNT)),
+	            GLuint(sizeof(FACE_EDGES_PACKED)+sizeof(CASE_TO_FACE_OFFSET)));
+	std::printf("EDGE_CONNECT_LIST walk: %8.3f ms (min %8.3f ms)\n",
+	            edgeConnectList.Mean()*1e-6, edgeConnectList.Min()*1e-6);
+	std::printf("FACE_EDGES_PACKED walk: %8.3f ms (min %8.3f ms)\n",
+	            faceEdgesPacked.Mean()*1e-6, faceEdgesPacked.Min()*1e-6);
+	std::printf("extraction:             %8.3f ms (min %8.3f ms)\n",
+	            extraction.Mean()*1e-6, extraction.Min()*1e-6);
+	return 0;
+}
+#endif // MARCHING_CUBE_BENCHMARK
+
+
+// Tests of the asymptotic decider on white noise (most cells are ambiguous):
+// closed and consistently oriented meshes (each half edge has one opposite
+// half edge), and the same mesh on a thread pool as the serial extraction
+// (build with -DMARCHING_CUBE_TEST mc/*.cpp core/*.cpp Framework.cpp
+// Trace.cpp and the OpenGL libraries)
+#ifdef MARCHING_CUBE_TEST
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+
+// each half edge has one opposite half edge, and no other half edge with
+// the same vertices
+static bool _is_closed_oriented(const mc::Mesh& mesh)
+{
+	std::map<std::pair<GLuint, GLuint>, GLuint> halfEdges;
+	const std::vector<GLuint>& indexes = mesh.Indexes();
+	for(size_t i=0; i<indexes.size(); ++i)
+	{
+		GLuint i0 = indexes[i], i1 = indexes[i - i%3 + (i+1)%3];
+		if(i0 == i1)
+			return false;
+		++halfEdges[std::make_pair(i0, i1)];
+	}
+	std::map<std::pair<GLuint, GLuint>, GLuint>::const_iterator it;
+	for(it = halfEdges.begin(); it != halfEdges.end(); ++it)
+	{
+		std::map<std::pair<GLuint, GLuint>, GLuint>::const_iterator opposite
+			= halfEdges.find(std::make_pair(it->first.second,
+			                                it->first.first));
+		if(it->second != 1 || opposite == halfEdges.end()
+		   || opposite->second != 1)
+			return false;
+	}
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	// noise inside, positive on the borders so the surface is closed
+	const GLuint W = 37, H = 30, D = 41;
+	const GLint INTERPOLATION_MODES[] = {mc::INTERPOLATION_MODE_LINEAR,
+	                                     mc::INTERPOLATION_MODE_CUBIC};
+	int failures = 0;
+	mc::ThreadPool pool(4);
+	mc::Volume volume;
+	volume.Resize(W, H, D, pool);
+	std::srand(1);
+	for(GLuint z=0; z<D; ++z)
+	for(GLuint y=0; y<H; ++y)
+	for(GLuint x=0; x<W; ++x)
+	{
+		bool isBorder = x == 0 || y == 0 || z == 0
+		             || x == W-1 || y == H-1 || z == D-1;
+		volume.At(x,y,z) = isBorder ? 1.0f
+		                 : 2.0f*GLfloat(std::rand())/GLfloat(RAND_MAX) - 1.0f;
+	}
+
+	for(GLuint i=0; i<2; ++i)
+	{
+		mc::Mesh serial, parallel;
+		mc::extract_marching_cube(volume, 0.0f, serial,
+		                          mc::TOPOLOGY_MODE_ASYMPTOTIC_DECIDER,
+		                          INTERPOLATION_MODES[i]);
+		mc::extract_marching_cube(volume, 0.0f, parallel, pool,
+		                          mc::TOPOLOGY_MODE_ASYMPTOTIC_DECIDER,
+		                          INTERPOLATION_MODES[i]);
+		if(serial.TriangleCount() == 0 || !_is_closed_oriented(serial))
+		{
+			++failures;
+			std::fprintf(stderr, "open mesh (interpolation mode %d, "
+			             "%u triangles)\n", INTERPOLATION_MODES[i],
+			             serial.TriangleCount());
+		}
+		if(serial.Positions() != parallel.Positions()
+		   || serial.Normals() != parallel.Normals()
+		   || serial.Indexes() != parallel.Indexes())
+		{
+			++failures;
+			std::fprintf(stderr, "pool mesh differs (interpolation mode %d, "
+			             "%u/%u triangles)\n", INTERPOLATION_MODES[i],
+			             parallel.TriangleCount(), serial.TriangleCount());
+		}
+	}
+
+	std::printf("%s (%d failures)\n", failures ? "FAILED" : "PASSED", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif // MARCHING_CUBE_TEST
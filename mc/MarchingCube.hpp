@@ -0,0 +1,101 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   MarchingCube.hpp
+// \author J Dupuy
+// \brief  CPU marching cube isosurface extraction.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MC_MARCHING_CUBE_HPP
+#define MC_MARCHING_CUBE_HPP
+
+#include "Volume.hpp"
+#include "Mesh.hpp"
+
+namespace mc
+{
+	class BrickVolume;
+	class ChunkQueue;
+	class ThreadPool;
+
+	// Topology modes
+	enum
+	{
+		// GPU Gems 3 tables, ambiguous faces are always resolved the same
+		// way, regardless of the samples
+		TOPOLOGY_MODE_TABLES = 0,
+		// ambiguous faces are resolved with the asymptotic decider, so the
+		// surface follows the bilinear interpolant on the faces of the cells
+		// (cells without ambiguous faces still use the tables)
+		TOPOLOGY_MODE_ASYMPTOTIC_DECIDER
+	};
+
+	// Interpolation modes
+	enum
+	{
+		// linear interpolation of the samples along the edges
+		INTERPOLATION_MODE_LINEAR = 0,
+		// cubic Hermite interpolation of the samples and of the gradients
+		// along the edges (closer crossings on curved fields)
+		INTERPOLATION_MODE_CUBIC
+	};
+
+	// Extract the isosurface of a volume
+	// Samples below the isolevel are inside the surface. Vertices are shared
+	// between adjacent cells and placed at the crossings of the edges, their
+	// normals interpolate the gradients of the volume (see Volume::Gradient;
+	// store them with Volume::ComputeGradients to extract several isolevels).
+	// The mesh is cleared first.
+	void extract_marching_cube(const Volume& volume,
+	                           GLfloat isolevel,
+	                           Mesh& mesh,
+	                           GLint topologyMode = TOPOLOGY_MODE_TABLES,
+	                           GLint interpolationMode
+	                                        = INTERPOLATION_MODE_LINEAR);
+
+	// Extract the isosurface of a volume on a thread pool
+	// Cells are split in pool.ThreadCount() slabs along z (see
+	// Volume::SlabBegin), extracted by the tasks of the pool in their own
+	// meshes. The vertices of the slices shared by two slabs are welded and
+	// the meshes are concatenated: the result is the same as the serial
+	// extraction. Resize the volume with the same pool, so each slab is read
+	// from the memory of the NUMA node extracting it.
+	void extract_marching_cube(const Volume& volume,
+	                           GLfloat isolevel,
+	                           Mesh& mesh,
+	                           ThreadPool& pool,
+	                           GLint topologyMode = TOPOLOGY_MODE_TABLES,
+	                           GLint interpolationMode
+	                                        = INTERPOLATION_MODE_LINEAR);
+
+	// Extract the isosurface of a volume on a thread pool, into a queue
+	// Producer side of the queue (see ChunkQueue): the task extracting slab
+	// i (as above) pushes the triangles of each group of slices as soon as
+	// they are made, so a writer popping the queue on another thread (see
+	// ChunkWriter.hpp) runs during the extraction. Vertices are only shared
+	// within the chunks. The queue is not closed. Returns the number of
+	// triangles.
+	GLuint64 extract_marching_cube(const Volume& volume,
+	                               GLfloat isolevel,
+	                               ChunkQueue& queue,
+	                               ThreadPool& pool,
+	                               GLint topologyMode = TOPOLOGY_MODE_TABLES,
+	                               GLint interpolationMode
+	                                        = INTERPOLATION_MODE_LINEAR);
+
+	// Extract the isosurface of a compressed volume
+	// Cells are extracted by slabs of one brick along z, decompressed just
+	// before classification (with a slice of margin for the gradients), and
+	// the vertices shared by two slabs are welded. Only the slab and the
+	// brick cache of the volume are decompressed at a time; with the default
+	// cache each brick is decompressed once.
+	void extract_marching_cube(const BrickVolume& volume,
+	                           GLfloat isolevel,
+	                           Mesh& mesh,
+	                           GLint topologyMode = TOPOLOGY_MODE_TABLES,
+	                           GLint interpolationMode
+	                                        = INTERPOLATION_MODE_LINEAR);
+
+} // namespace mc
+
+#endif
+
@@ -0,0 +1,59 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   MarchingCubeCell.hpp
+// \author J Dupuy
+// \brief  Cell conventions shared by the marching cube extraction algorithms
+//         (uniform grid, adaptive octree).
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MC_MARCHING_CUBE_CELL_HPP
+#define MC_MARCHING_CUBE_CELL_HPP
+
+#include "glew.hpp"
+#include "MarchingCubeTables.hpp"
+
+namespace mc
+{
+	// Vertices, edges and faces of a cell are those of the tables (see
+	// MarchingCubeTables.hpp and marchingCube.glsl): FACE_TO_VERTICES and
+	// FACE_TO_EDGES are used as is, the functions below derive the rest.
+
+	// offset of a vertex along an axis (0 or 1)
+	inline GLuint vertex_offset(GLuint vertex, GLuint axis)
+	{
+		return VERTEX_OFFSETS[vertex*3 + axis];
+	}
+
+	// index of a vertex in the numbering of the dual grid (x | y<<1 | z<<2)
+	inline GLuint vertex_to_dual_corner(GLuint vertex)
+	{
+		return vertex_offset(vertex, 0)
+		     | vertex_offset(vertex, 1) << 1
+		     | vertex_offset(vertex, 2) << 2;
+	}
+
+	// axis of an edge (0, 1 or 2 for x, y or z)
+	inline GLuint edge_axis(GLuint edge)
+	{
+		GLuint v0 = EDGE_TO_VERTICES[edge*2], v1 = EDGE_TO_VERTICES[edge*2+1];
+		if(vertex_offset(v0, 0) != vertex_offset(v1, 0))
+			return 0;
+		return vertex_offset(v0, 1) != vertex_offset(v1, 1) ? 1 : 2;
+	}
+
+	// vertices of an edge, at its lower and upper ends along its axis
+	inline GLuint edge_lower_vertex(GLuint edge)
+	{
+		GLuint v0 = EDGE_TO_VERTICES[edge*2], v1 = EDGE_TO_VERTICES[edge*2+1];
+		return vertex_offset(v0, edge_axis(edge)) == 0 ? v0 : v1;
+	}
+	inline GLuint edge_upper_vertex(GLuint edge)
+	{
+		GLuint v0 = EDGE_TO_VERTICES[edge*2], v1 = EDGE_TO_VERTICES[edge*2+1];
+		return vertex_offset(v0, edge_axis(edge)) == 0 ? v1 : v0;
+	}
+
+} // namespace mc
+
+#endif
+
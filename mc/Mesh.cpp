@@ -0,0 +1,75 @@
+#include "Mesh.hpp"
+
+#include <cassert>
+
+namespace mc
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors
+Mesh::Mesh():
+	mPositions(), mNormals(), mIndexes()
+{
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Manipulation
+void Mesh::Clear()
+{
+	mPositions.clear();
+	mNormals.clear();
+	mIndexes.clear();
+}
+
+void Mesh::Swap(Mesh& mesh)
+{
+	mPositions.swap(mesh.mPositions);
+	mNormals.swap(mesh.mNormals);
+	mIndexes.swap(mesh.mIndexes);
+}
+
+GLuint Mesh::AddVertex(GLfloat x, GLfloat y, GLfloat z)
+{
+	mPositions.push_back(x);
+	mPositions.push_back(y);
+	mPositions.push_back(z);
+	return GLuint(mPositions.size()/3 - 1);
+}
+
+void Mesh::AddNormal(GLfloat x, GLfloat y, GLfloat z)
+{
+	mNormals.push_back(x);
+	mNormals.push_back(y);
+	mNormals.push_back(z);
+}
+
+void Mesh::AddTriangle(GLuint i0, GLuint i1, GLuint i2)
+{
+#ifndef NDEBUG
+	assert(i0 < VertexCount() && i1 < VertexCount() && i2 < VertexCount());
+#endif
+	mIndexes.push_back(i0);
+	mIndexes.push_back(i1);
+	mIndexes.push_back(i2);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Access
+std::vector<GLfloat>& Mesh::Positions()             {return mPositions;}
+std::vector<GLfloat>& Mesh::Normals()               {return mNormals;}
+std::vector<GLuint>& Mesh::Indexes()                {return mIndexes;}
+const std::vector<GLfloat>& Mesh::Positions() const {return mPositions;}
+const std::vector<GLfloat>& Mesh::Normals()   const {return mNormals;}
+const std::vector<GLuint>& Mesh::Indexes()    const {return mIndexes;}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Queries
+GLuint Mesh::VertexCount()   const {return GLuint(mPositions.size()/3);}
+GLuint Mesh::TriangleCount() const {return GLuint(mIndexes.size()/3);}
+bool Mesh::HasNormals()      const {return !mNormals.empty();}
+
+} // namespace mc
+
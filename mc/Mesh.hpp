@@ -0,0 +1,61 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   Mesh.hpp
+// \author J Dupuy
+// \brief  Indexed triangle mesh produced by the extraction algorithms.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MC_MESH_HPP
+#define MC_MESH_HPP
+
+#include <vector>
+#include "glew.hpp"
+
+namespace mc
+{
+	// Indexed triangle mesh
+	// Positions and normals are xyz interleaved, normals are optional (empty
+	// or one per vertex). Triangles are counter clockwise when seen from the
+	// outside (lower values).
+	class Mesh
+	{
+	public:
+		// Constructors / Destructor
+		Mesh();
+
+		// Manipulation
+		void Clear();
+		void Swap(Mesh& mesh);
+			// returns the index of the vertex
+		GLuint AddVertex(GLfloat x, GLfloat y, GLfloat z);
+		void AddNormal(GLfloat x, GLfloat y, GLfloat z);
+		void AddTriangle(GLuint i0, GLuint i1, GLuint i2);
+
+		// Access
+		std::vector<GLfloat>& Positions();
+		std::vector<GLfloat>& Normals();
+		std::vector<GLuint>& Indexes();
+		const std::vector<GLfloat>& Positions() const;
+		const std::vector<GLfloat>& Normals()   const;
+		const std::vector<GLuint>& Indexes()    const;
+
+		// Queries
+		GLuint VertexCount()   const;
+		GLuint TriangleCount() const;
+		bool HasNormals()      const;
+
+	private:
+		// Non copyable
+		Mesh(const Mesh& mesh);
+		Mesh& operator=(const Mesh& mesh);
+
+		// Members
+		std::vector<GLfloat> mPositions;
+		std::vector<GLfloat> mNormals;
+		std::vector<GLuint>  mIndexes;
+	};
+
+} // namespace mc
+
+#endif
+
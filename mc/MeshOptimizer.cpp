@@ -0,0 +1,488 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace mc
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// Constants
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// no vertex
+static const GLuint INVALID_INDEX = ~0u;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Static functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// FIFO cache simulation: a vertex is in the cache if less than cacheSize
+// vertices were transformed since its own transform (timestamps start at 0,
+// time at cacheSize+1; adding cacheSize+1 to the time flushes the cache).
+// Returns the number of misses of a triangle.
+static GLuint _cache_misses(const GLuint* triangle,
+                            std::vector<GLuint>& timestamps,
+                            GLuint& time,
+                            GLuint cacheSize)
+{
+	GLuint misses = 0;
+	for(GLuint i=0; i<3; ++i)
+		if(time - timestamps[triangle[i]] > cacheSize)
+		{
+			timestamps[triangle[i]] = time++;
+			++misses;
+		}
+	return misses;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Cluster of triangles, and its sort key
+struct _Cluster
+{
+	GLuint  begin, end; // triangles
+	GLfloat key;
+};
+
+static bool _is_cluster_outer(const _Cluster& a, const _Cluster& b)
+{
+	return a.key > b.key;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Mesh optimization
+//
+////////////////////////////////////////////////////////////////////////////////
+
+GLfloat compute_acmr(const Mesh& mesh, GLuint cacheSize)
+{
+	const std::vector<GLuint>& indexes = mesh.Indexes();
+	if(indexes.empty())
+		return 0.0f;
+
+	std::vector<GLuint> timestamps(mesh.VertexCount(), 0);
+	GLuint time = cacheSize + 1;
+	GLuint misses = 0;
+	for(size_t i=0; i<indexes.size(); i+=3)
+		misses+= _cache_misses(&indexes[i], timestamps, time, cacheSize);
+	return GLfloat(misses) / GLfloat(mesh.TriangleCount());
+}
+
+void optimize_vertex_cache(Mesh& mesh, GLuint cacheSize)
+{
+	std::vector<GLuint>& indexes = mesh.Indexes();
+	const GLuint vertexCount = mesh.VertexCount();
+	const GLuint triangleCount = mesh.TriangleCount();
+	if(triangleCount == 0)
+		return;
+
+	// triangles of each vertex, and live triangle counts (not emitted yet)
+	std::vector<GLuint> live(vertexCount, 0);
+	std::vector<GLuint> offsets(vertexCount+1, 0);
+	std::vector<GLuint> triangles(indexes.size());
+	for(size_t i=0; i<indexes.size(); ++i)
+		++live[indexes[i]];
+	for(GLuint v=0; v<vertexCount; ++v)
+		offsets[v+1] = offsets[v] + live[v];
+	{
+		std::vector<GLuint> cursors(offsets.begin(), offsets.end()-1);
+		for(size_t i=0; i<indexes.size(); ++i)
+			triangles[cursors[indexes[i]]++] = GLuint(i/3);
+	}
+
+	std::vector<GLuint>  output;
+	std::vector<GLuint>  timestamps(vertexCount, 0);
+	std::vector<GLuint>  deadEnds;  // vertices of the emitted triangles
+	std::vector<GLuint>  candidates; // vertices of the last fan
+	std::vector<GLubyte> isEmitted(triangleCount, 0);
+	output.reserve(indexes.size());
+	deadEnds.reserve(indexes.size());
+	GLuint time   = cacheSize + 1;
+	GLuint cursor = 0; // vertices below have no live triangles
+	while(live[cursor] == 0)
+		++cursor;
+	GLuint fan = cursor;
+
+	while(fan != INVALID_INDEX)
+	{
+		// emit the live triangles of the fan
+		candidates.clear();
+		for(GLuint i=offsets[fan]; i<offsets[fan+1]; ++i)
+		{
+			GLuint t = triangles[i];
+			if(isEmitted[t])
+				continue;
+			for(GLuint j=0; j<3; ++j)
+			{
+				GLuint v = indexes[t*3+j];
+				output.push_back(v);
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				--live[v];
+				if(time - timestamps[v] > cacheSize)
+					timestamps[v] = time++;
+			}
+			isEmitted[t] = 1;
+		}
+
+		// next fan: the oldest candidate that stays in the cache while its
+		// own triangles are emitted, else any candidate with live triangles
+		fan = INVALID_INDEX;
+		GLint priority = -1;
+		for(size_t i=0; i<candidates.size(); ++i)
+		{
+			GLuint v = candidates[i];
+			if(live[v] == 0)
+				continue;
+			GLint p = 0;
+			if(time - timestamps[v] + 2*live[v] <= cacheSize)
+				p = GLint(time - timestamps[v]);
+			if(p > priority)
+			{
+				priority = p;
+				fan = v;
+			}
+		}
+
+		// dead end: last vertex with live triangles, else next one in order
+		while(fan == INVALID_INDEX && !deadEnds.empty())
+		{
+			if(live[deadEnds.back()] > 0)
+				fan = deadEnds.back();
+			deadEnds.pop_back();
+		}
+		while(fan == INVALID_INDEX && cursor < vertexCount)
+		{
+			if(live[cursor] > 0)
+				fan = cursor;
+			else
+				++cursor;
+		}
+	}
+	indexes.swap(output);
+}
+
+void optimize_overdraw(Mesh& mesh, GLfloat threshold, GLuint cacheSize)
+{
+	std::vector<GLuint>& indexes = mesh.Indexes();
+	const std::vector<GLfloat>& positions = mesh.Positions();
+	const GLuint triangleCount = mesh.TriangleCount();
+	if(triangleCount == 0)
+		return;
+
+	// hard boundaries: triangles that miss the cache three times (new
+	// patches of the vertex cache order)
+	std::vector<GLuint> patches;
+	std::vector<GLuint> timestamps(mesh.VertexCount(), 0);
+	GLuint time = cacheSize + 1;
+	for(GLuint t=0; t<triangleCount; ++t)
+		if(_cache_misses(&indexes[t*3], timestamps, time, cacheSize) == 3
+		   || t == 0)
+			patches.push_back(t);
+	patches.push_back(triangleCount);
+
+	// soft boundaries: a patch is split each time the miss ratio since the
+	// last split (cache flushed) reaches threshold times the ratio of the
+	// patch
+	std::vector<GLuint> boundaries;
+	std::fill(timestamps.begin(), timestamps.end(), 0);
+	time = cacheSize + 1;
+	for(size_t i=0; i+1<patches.size(); ++i)
+	{
+		const GLuint begin = patches[i], end = patches[i+1];
+		GLuint misses = 0;
+		time+= cacheSize + 1;
+		for(GLuint t=begin; t<end; ++t)
+			misses+= _cache_misses(&indexes[t*3], timestamps, time, cacheSize);
+		const GLfloat ratio = threshold * misses / GLfloat(end - begin);
+
+		boundaries.push_back(begin);
+		time+= cacheSize + 1;
+		GLuint runningMisses = 0, runningCount = 0;
+		for(GLuint t=begin; t<end; ++t)
+		{
+			runningMisses+= _cache_misses(&indexes[t*3], timestamps, time,
+			                              cacheSize);
+			++runningCount;
+			if(GLfloat(runningMisses) <= ratio * runningCount)
+			{
+				boundaries.push_back(t+1);
+				time+= cacheSize + 1;
+				runningMisses = runningCount = 0;
+			}
+		}
+		// the last cluster is empty, or did not reach the ratio: merge it
+		// with the previous one
+		if(boundaries.back() != begin)
+			boundaries.pop_back();
+	}
+	boundaries.push_back(triangleCount);
+
+	// centroid of the mesh
+	GLfloat centroid[3] = {0.0f, 0.0f, 0.0f};
+	for(size_t i=0; i<indexes.size(); ++i)
+		for(GLuint k=0; k<3; ++k)
+			centroid[k]+= positions[indexes[i]*3+k];
+	for(GLuint k=0; k<3; ++k)
+		centroid[k]/= GLfloat(indexes.size());
+
+	// sort keys: area weighted normal and centroid of each cluster
+	std::vector<_Cluster> clusters(boundaries.size()-1);
+	for(size_t c=0; c<clusters.size(); ++c)
+	{
+		_Cluster& cluster = clusters[c];
+		cluster.begin = boundaries[c];
+		cluster.end   = boundaries[c+1];
+
+		GLfloat normal[3] = {0.0f, 0.0f, 0.0f};
+		GLfloat center[3] = {0.0f, 0.0f, 0.0f};
+		GLfloat area = 0.0f;
+		for(GLuint t=cluster.begin; t<cluster.end; ++t)
+		{
+			const GLfloat* p0 = &positions[indexes[t*3  ]*3];
+			const GLfloat* p1 = &positions[indexes[t*3+1]*3];
+			const GLfloat* p2 = &positions[indexes[t*3+2]*3];
+			GLfloat e1[3] = {p1[0]-p0[0], p1[1]-p0[1], p1[2]-p0[2]};
+			GLfloat e2[3] = {p2[0]-p0[0], p2[1]-p0[1], p2[2]-p0[2]};
+			GLfloat n[3]  = {e1[1]*e2[2] - e1[2]*e2[1],
+			                 e1[2]*e2[0] - e1[0]*e2[2],
+			                 e1[0]*e2[1] - e1[1]*e2[0]};
+			GLfloat a = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+			for(GLuint k=0; k<3; ++k)
+			{
+				normal[k]+= n[k];
+				center[k]+= a * (p0[k] + p1[k] + p2[k]) / 3.0f;
+			}
+			area+= a;
+		}
+		GLfloat length = std::sqrt(normal[0]*normal[0]
+		                         + normal[1]*normal[1]
+		                         + normal[2]*normal[2]);
+		cluster.key = 0.0f;
+		if(area > 0.0f && length > 0.0f)
+			for(GLuint k=0; k<3; ++k)
+				cluster.key+= (center[k]/area - centroid[k])
+				            * normal[k] / length;
+	}
+
+	// emit the clusters, outer ones first
+	std::stable_sort(clusters.begin(), clusters.end(), _is_cluster_outer);
+	std::vector<GLuint> output;
+	output.reserve(indexes.size());
+	for(size_t c=0; c<clusters.size(); ++c)
+		output.insert(output.end(),
+		              indexes.begin() + clusters[c].begin*3,
+		              indexes.begin() + clusters[c].end*3);
+	indexes.swap(output);
+}
+
+void optimize_vertex_fetch(Mesh& mesh)
+{
+	std::vector<GLuint>&  indexes   = mesh.Indexes();
+	std::vector<GLfloat>& positions = mesh.Positions();
+	std::vector<GLfloat>& normals   = mesh.Normals();
+	const GLuint vertexCount = mesh.VertexCount();
+
+	// new index of each vertex
+	std::vector<GLuint> remap(vertexCount, INVALID_INDEX);
+	GLuint next = 0;
+	for(size_t i=0; i<indexes.size(); ++i)
+		if(remap[indexes[i]] == INVALID_INDEX)
+			remap[indexes[i]] = next++;
+	for(GLuint v=0; v<vertexCount; ++v)
+		if(remap[v] == INVALID_INDEX)
+			remap[v] = next++;
+
+	// remap
+	for(size_t i=0; i<indexes.size(); ++i)
+		indexes[i] = remap[indexes[i]];
+	std::vector<GLfloat> remapped(positions.size());
+	for(GLuint v=0; v<vertexCount; ++v)
+		std::copy(&positions[v*3], &positions[v*3] + 3, &remapped[remap[v]*3]);
+	positions.swap(remapped);
+	if(mesh.HasNormals())
+	{
+		remapped.resize(normals.size());
+		for(GLuint v=0; v<vertexCount; ++v)
+			std::copy(&normals[v*3], &normals[v*3] + 3, &remapped[remap[v]*3]);
+		normals.swap(remapped);
+	}
+}
+
+void optimize_mesh(Mesh& mesh, GLfloat overdrawThreshold, GLuint cacheSize)
+{
+	optimize_vertex_cache(mesh, cacheSize);
+	optimize_overdraw(mesh, overdrawThreshold, cacheSize);
+	optimize_vertex_fetch(mesh);
+}
+
+} // namespace mc
+
+
+// Benchmark of the mesh optimization passes
+// (build with -DMESH_OPTIMIZER_BENCHMARK mc/*.cpp core/*.cpp Framework.cpp
+// Trace.cpp and the OpenGL libraries)
+#ifdef MESH_OPTIMIZER_BENCHMARK
+#include <cstdio>
+#include "Framework.hpp"
+#include "MarchingCube.hpp"
+
+int main(int argc, char **argv)
+{
+	const GLuint SIZE = 128;
+	mc::Volume volume(SIZE, SIZE, SIZE);
+	mc::Mesh mesh;
+
+	// gyroid
+	for(GLuint z=0; z<SIZE; ++z)
+	for(GLuint y=0; y<SIZE; ++y)
+	for(GLuint x=0; x<SIZE; ++x)
+		volume.At(x,y,z) = std::sin(x*0.1f)*std::cos(y*0.1f)
+		                 + std::sin(y*0.1f)*std::cos(z*0.1f)
+		                 + std::sin(z*0.1f)*std::cos(x*0.1f);
+	mc::extract_marching_cube(volume, 0.0f, mesh);
+	std::printf("%u vertices, %u triangles\n",
+	            mesh.VertexCount(), mesh.TriangleCount());
+
+	const GLuint CACHE_SIZES[] = {8, 16, 32};
+	for(GLuint i=0; i<3; ++i)
+		std::printf("ACMR (cache of %2u) extraction order: %.3f\n",
+		            CACHE_SIZES[i], mc::compute_acmr(mesh, CACHE_SIZES[i]));
+
+	fw::Timer timer;
+	timer.Start();
+	mc::optimize_vertex_cache(mesh);
+	timer.Stop();
+	std::printf("vertex cache: %8.3f ms\n", timer.Ticks()*1e3);
+	for(GLuint i=0; i<3; ++i)
+		std::printf("ACMR (cache of %2u) vertex cache order: %.3f\n",
+		            CACHE_SIZES[i], mc::compute_acmr(mesh, CACHE_SIZES[i]));
+
+	timer.Start();
+	mc::optimize_overdraw(mesh);
+	timer.Stop();
+	std::printf("overdraw:     %8.3f ms\n", timer.Ticks()*1e3);
+	timer.Start();
+	mc::optimize_vertex_fetch(mesh);
+	timer.Stop();
+	std::printf("vertex fetch: %8.3f ms\n", timer.Ticks()*1e3);
+	for(GLuint i=0; i<3; ++i)
+		std::printf("ACMR (cache of %2u) final order: %.3f\n",
+		            CACHE_SIZES[i], mc::compute_acmr(mesh, CACHE_SIZES[i]));
+	return 0;
+}
+#endif // MESH_OPTIMIZER_BENCHMARK
+
+
+
+// Tests of the optimization passes: every pass keeps the triangles (same
+// vertices, same winding), the vertex cache pass lowers the ACMR, the
+// overdraw pass raises it by at most its threshold, and the vertex fetch
+// pass numbers the vertices in order of first use
+// (build with -DMESH_OPTIMIZER_TEST mc/*.cpp core/*.cpp Framework.cpp
+// Trace.cpp and the OpenGL libraries)
+#ifdef MESH_OPTIMIZER_TEST
+#include <cstdio>
+#include <cstdlib>
+#include "MarchingCube.hpp"
+
+// triangles as position and normal triples, starting with their smallest
+// vertex (which keeps the winding), sorted
+static std::vector<std::vector<GLfloat> > _triangles(const mc::Mesh& mesh)
+{
+	std::vector<std::vector<GLfloat> > triangles(mesh.TriangleCount());
+	for(GLuint t=0; t<mesh.TriangleCount(); ++t)
+	{
+		std::vector<GLfloat> vertices[3];
+		for(GLuint i=0; i<3; ++i)
+		{
+			GLuint v = mesh.Indexes()[t*3+i];
+			vertices[i].assign(&mesh.Positions()[v*3],
+			                   &mesh.Positions()[v*3] + 3);
+			vertices[i].insert(vertices[i].end(), &mesh.Normals()[v*3],
+			                   &mesh.Normals()[v*3] + 3);
+		}
+		GLuint first = std::min_element(vertices, vertices + 3) - vertices;
+		for(GLuint i=0; i<3; ++i)
+			triangles[t].insert(triangles[t].end(),
+			                    vertices[(first+i)%3].begin(),
+			                    vertices[(first+i)%3].end());
+	}
+	std::sort(triangles.begin(), triangles.end());
+	return triangles;
+}
+
+int main(int argc, char **argv)
+{
+	const GLuint SIZE = 48;
+	const GLfloat THRESHOLD = 1.05f;
+	int failures = 0;
+
+	// gyroid, and an unused vertex
+	mc::Volume volume(SIZE, SIZE, SIZE);
+	for(GLuint z=0; z<SIZE; ++z)
+	for(GLuint y=0; y<SIZE; ++y)
+	for(GLuint x=0; x<SIZE; ++x)
+		volume.At(x,y,z) = std::sin(x*0.2f)*std::cos(y*0.2f)
+		                 + std::sin(y*0.2f)*std::cos(z*0.2f)
+		                 + std::sin(z*0.2f)*std::cos(x*0.2f);
+	mc::Mesh mesh;
+	mc::extract_marching_cube(volume, 0.1f, mesh);
+	mesh.AddVertex(-1.0f, -1.0f, -1.0f);
+	mesh.AddNormal(0.0f, 0.0f, 1.0f);
+	const std::vector<std::vector<GLfloat> > triangles = _triangles(mesh);
+	const GLuint vertexCount = mesh.VertexCount();
+
+	const char* const PASSES[] = {"vertex cache", "overdraw",
+	                              "vertex fetch", "all"};
+	GLfloat acmr = mc::compute_acmr(mesh);
+	for(GLuint p=0; p<4; ++p)
+	{
+		if(p == 0)
+			mc::optimize_vertex_cache(mesh);
+		else if(p == 1)
+			mc::optimize_overdraw(mesh, THRESHOLD);
+		else if(p == 2)
+			mc::optimize_vertex_fetch(mesh);
+		else
+			mc::optimize_mesh(mesh, THRESHOLD);
+		const GLfloat passAcmr = mc::compute_acmr(mesh);
+		std::printf("%-12s ACMR %.3f -> %.3f\n", PASSES[p], acmr, passAcmr);
+
+		bool isValid = mesh.VertexCount() == vertexCount
+		            && mesh.Normals().size() == mesh.Positions().size()
+		            && _triangles(mesh) == triangles;
+		if(p == 0)
+			isValid&= passAcmr < acmr;
+		else if(p == 1)
+			isValid&= passAcmr <= acmr*THRESHOLD;
+		else if(p == 2)
+		{
+			// first uses are 0, 1, 2... and the unused vertex is last
+			GLuint next = 0;
+			for(size_t i=0; i<mesh.Indexes().size(); ++i)
+				if(mesh.Indexes()[i] == next)
+					++next;
+				else
+					isValid&= mesh.Indexes()[i] < next;
+			isValid&= next == vertexCount-1
+			        && mesh.Positions()[next*3] == -1.0f;
+		}
+		if(!isValid)
+		{
+			++failures;
+			std::fprintf(stderr, "%s pass failed\n", PASSES[p]);
+		}
+		acmr = passAcmr;
+	}
+	std::printf("%s (%d failures)\n", failures ? "FAILED" : "PASSED", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif // MESH_OPTIMIZER_TEST
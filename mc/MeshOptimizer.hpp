@@ -0,0 +1,61 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   MeshOptimizer.hpp
+// \author J Dupuy
+// \brief  Triangle and vertex reordering of meshes for rendering.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MC_MESH_OPTIMIZER_HPP
+#define MC_MESH_OPTIMIZER_HPP
+
+#include "Mesh.hpp"
+
+namespace mc
+{
+	// Constants
+	enum
+	{
+		// entries of the post transform vertex cache
+		VERTEX_CACHE_SIZE = 16
+	};
+
+	// Average cache miss ratio: transformed vertices per triangle, with a
+	// FIFO post transform cache (0.5 is the limit of large regular grids, 3
+	// means no reuse at all)
+	GLfloat compute_acmr(const Mesh& mesh,
+	                     GLuint cacheSize = VERTEX_CACHE_SIZE);
+
+	// Reorder the triangles for the post transform vertex cache
+	// Tipsify (Sander et al. 2007): triangles are emitted by fans around a
+	// vertex, the next fanning vertex is a vertex of the last fans still in
+	// the cache after its own fan, or the last vertex with triangles left.
+	// Linear in the number of triangles.
+	void optimize_vertex_cache(Mesh& mesh,
+	                           GLuint cacheSize = VERTEX_CACHE_SIZE);
+
+	// Reorder clusters of triangles to reduce overdraw
+	// The triangles are split in clusters where all the vertices of a
+	// triangle miss the cache, and where the miss ratio of a cluster reaches
+	// threshold times the ratio of the whole patch. Clusters are sorted from
+	// the outside in (dot product of their normal and of their offset from
+	// the centroid of the mesh), the order of the triangles of a cluster is
+	// kept. Run it after optimize_vertex_cache: the ACMR grows by at most
+	// threshold.
+	void optimize_overdraw(Mesh& mesh,
+	                       GLfloat threshold = 1.05f,
+	                       GLuint cacheSize = VERTEX_CACHE_SIZE);
+
+	// Reorder the vertices in the order of their first use by the triangles
+	// (unused vertices go last), so vertex fetches are sequential. Indexes,
+	// positions and normals are remapped.
+	void optimize_vertex_fetch(Mesh& mesh);
+
+	// The three passes above, in order
+	void optimize_mesh(Mesh& mesh,
+	                   GLfloat overdrawThreshold = 1.05f,
+	                   GLuint cacheSize = VERTEX_CACHE_SIZE);
+
+} // namespace mc
+
+#endif
+
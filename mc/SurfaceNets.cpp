@@ -0,0 +1,107 @@
+#include "SurfaceNets.hpp"
+#include "DualGrid.hpp"
+#include "MarchingCubeCell.hpp"
+#include "Arena.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace mc
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// Surface nets extraction
+void extract_surface_nets(const Volume& volume,
+                          GLfloat isolevel,
+                          Mesh& mesh)
+{
+	const GLuint W = volume.Width();
+	const GLuint H = volume.Height();
+	const GLuint D = volume.Depth();
+	const Vector3& origin  = volume.Origin();
+	const Vector3& spacing = volume.Spacing();
+	const GLfloat* samples = volume.Samples();
+
+	mesh.Clear();
+	if(W < 2 || H < 2 || D < 2)
+		return;
+
+	// sample offsets of the corners
+	const size_t SLICE_SIZE = size_t(W)*size_t(H);
+	size_t cornerOffsets[8];
+	for(GLuint i=0; i<8; ++i)
+		cornerOffsets[i] = (i&1) + (i>>1&1)*size_t(W) + (i>>2)*SLICE_SIZE;
+
+	// cases of a slice, vertex indexes of two consecutive slices of cells
+	const size_t CELL_SLICE_SIZE = size_t(W-1)*size_t(H-1);
+	ArenaScope scope;
+	Arena& arena = scope.GetArena();
+	GLubyte* cases = arena.Allocate<GLubyte>(CELL_SLICE_SIZE);
+	GLuint* cellVertices = arena.Allocate<GLuint>(CELL_SLICE_SIZE*2);
+	std::fill(cellVertices, cellVertices + CELL_SLICE_SIZE*2,
+	          DUAL_INVALID_INDEX);
+
+	for(GLuint z=0; z<D-1; ++z)
+	{
+		// no sign changing edge if no cell is active
+		if(classify_dual_slice(volume, isolevel, z, cases) == 0)
+			continue;
+
+		// place the vertices of the active cells
+		for(GLuint y=0; y<H-1; ++y)
+		for(GLuint x=0; x<W-1; ++x)
+		{
+			GLuint cubeCase = cases[size_t(y)*(W-1) + x];
+			if(cubeCase == 0 || cubeCase == 255)
+				continue;
+
+			const GLfloat* cell = samples + z*SLICE_SIZE + size_t(y)*W + x;
+			GLfloat values[8];
+			for(GLuint i=0; i<8; ++i)
+				values[i] = cell[cornerOffsets[i]];
+
+			// average the crossings (in cell space)
+			GLfloat p[3] = {0.0f, 0.0f, 0.0f};
+			GLuint count = 0;
+			for(GLuint e=0; e<12; ++e)
+			{
+				GLuint c0 = vertex_to_dual_corner(edge_lower_vertex(e));
+				GLuint c1 = vertex_to_dual_corner(edge_upper_vertex(e));
+				if((cubeCase >> c0 & 1u) == (cubeCase >> c1 & 1u))
+					continue;
+
+				GLfloat t = (isolevel - values[c0]) / (values[c1] - values[c0]);
+				p[0]+= GLfloat(c0&1);
+				p[1]+= GLfloat(c0>>1&1);
+				p[2]+= GLfloat(c0>>2);
+				p[edge_axis(e)]+= t;
+				++count;
+			}
+
+			GLuint& index = cellVertices[  (z&1)*CELL_SLICE_SIZE
+			                             + size_t(y)*(W-1) + x ];
+			index = mesh.AddVertex(origin[0] + spacing[0]*(x + p[0]/count),
+			                       origin[1] + spacing[1]*(y + p[1]/count),
+			                       origin[2] + spacing[2]*(z + p[2]/count));
+
+			// gradient of the cell at its center
+			GLfloat n[3];
+			n[0] = (values[1]-values[0] + values[3]-values[2]
+			      + values[5]-values[4] + values[7]-values[6]) / spacing[0];
+			n[1] = (values[2]-values[0] + values[3]-values[1]
+			      + values[6]-values[4] + values[7]-values[5]) / spacing[1];
+			n[2] = (values[4]-values[0] + values[5]-values[1]
+			      + values[6]-values[2] + values[7]-values[3]) / spacing[2];
+			GLfloat length = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+			if(length > 0.0f)
+				mesh.AddNormal(n[0]/length, n[1]/length, n[2]/length);
+			else
+				mesh.AddNormal(0.0f, 0.0f, 0.0f);
+		}
+
+		connect_dual_slice(volume, z, cases, cellVertices, mesh);
+	}
+}
+
+} // namespace mc
+
@@ -0,0 +1,31 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   SurfaceNets.hpp
+// \author J Dupuy
+// \brief  CPU surface nets isosurface extraction (fast previews).
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MC_SURFACE_NETS_HPP
+#define MC_SURFACE_NETS_HPP
+
+#include "Volume.hpp"
+#include "Mesh.hpp"
+
+namespace mc
+{
+	// Extract the isosurface of a volume with surface nets
+	// Each cell crossed by the surface gets one vertex, at the average of the
+	// edge crossings, and the vertices of the four cells around each sign
+	// changing edge are connected by a quad (two triangles). Normals are the
+	// gradients of the cells at their centers. Faster than marching cubes,
+	// with no lookup table, but sharp features are smoothed out.
+	// Samples below the isolevel are inside the surface. The mesh is cleared
+	// first.
+	void extract_surface_nets(const Volume& volume,
+	                          GLfloat isolevel,
+	                          Mesh& mesh);
+
+} // namespace mc
+
+#endif
+
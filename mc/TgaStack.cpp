@@ -0,0 +1,756 @@
+#include "TgaStack.hpp"
+#include "Arena.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+
+#ifdef _WIN32
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#else
+#	include <dirent.h>
+#endif // _WIN32
+
+namespace mc
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// Constants
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// image types
+enum
+{
+	TGA_TYPE_COLOUR_MAPPED     = 1,
+	TGA_TYPE_TRUE_COLOUR       = 2,
+	TGA_TYPE_LUMINANCE         = 3,
+	TGA_TYPE_COLOUR_MAPPED_RLE = 9,
+	TGA_TYPE_TRUE_COLOUR_RLE   = 10,
+	TGA_TYPE_LUMINANCE_RLE     = 11
+};
+
+// header size (in bytes)
+static const GLuint TGA_HEADER_SIZE = 18;
+
+// unset slice
+static const GLuint INVALID_INDEX = ~0u;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Exceptions
+//
+////////////////////////////////////////////////////////////////////////////////
+class _TgaSliceException : public fw::FWException
+{
+public:
+	_TgaSliceException(const std::string& file, const std::string& log)
+	{
+		mMessage = "Could not read TGA slice " + file + ": " + log + ".";
+	}
+};
+
+class _TgaColourMapIndexException : public fw::FWException
+{
+public:
+	_TgaColourMapIndexException()
+	{
+		mMessage = "invalid colour map index";
+	}
+};
+
+class _DirectoryException : public fw::FWException
+{
+public:
+	_DirectoryException(const std::string& directory)
+	{
+		mMessage = "Could not list directory " + directory + ".";
+	}
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Static functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Compare file names, numbers by value
+static bool _natural_less(const std::string& a, const std::string& b)
+{
+	size_t i = 0, j = 0;
+	while(i < a.size() && j < b.size())
+	{
+		if(std::isdigit(static_cast<unsigned char>(a[i]))
+		   && std::isdigit(static_cast<unsigned char>(b[j])))
+		{
+			// skip leading zeros, longer numbers are larger
+			size_t i0 = i, j0 = j;
+			while(i0 < a.size() && a[i0] == '0') ++i0;
+			while(j0 < b.size() && b[j0] == '0') ++j0;
+			size_t i1 = i0, j1 = j0;
+			while(i1 < a.size() && std::isdigit(static_cast<unsigned char>(a[i1])))
+				++i1;
+			while(j1 < b.size() && std::isdigit(static_cast<unsigned char>(b[j1])))
+				++j1;
+			if(i1 - i0 != j1 - j0)
+				return i1 - i0 < j1 - j0;
+			int order = a.compare(i0, i1 - i0, b, j0, j1 - j0);
+			if(order != 0)
+				return order < 0;
+			i = i1;
+			j = j1;
+		}
+		else
+		{
+			if(a[i] != b[j])
+				return a[i] < b[j];
+			++i;
+			++j;
+		}
+	}
+	return a.size() - i < b.size() - j;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// TGA header
+struct _TgaHeader
+{
+	GLuint width;
+	GLuint height;
+	GLuint type;
+	GLuint pixelSize;        // in bytes (indexes for colour mapped images)
+	GLuint colourMapFirst;
+	GLuint colourMapLength;
+	GLuint colourMapEntrySize; // in bytes
+	bool   isTopOrigin;
+	bool   isRightOrigin;
+	size_t colourMapOffset;
+	size_t pixelOffset;
+};
+
+// read a header (false if unsupported)
+static bool _read_tga_header(const GLubyte* data,
+                             size_t size,
+                             _TgaHeader& header)
+{
+	if(size < TGA_HEADER_SIZE)
+		return false;
+	header.type               = data[2];
+	header.colourMapFirst     = data[3] | data[4] << 8;
+	header.colourMapLength    = data[1] ? data[5] | data[6] << 8 : 0;
+	header.colourMapEntrySize = (data[7] + 7) / 8;
+	header.width              = data[12] | data[13] << 8;
+	header.height             = data[14] | data[15] << 8;
+	header.pixelSize          = (data[16] + 7) / 8;
+	header.isRightOrigin      = (data[17] & 0x10) != 0;
+	header.isTopOrigin        = (data[17] & 0x20) != 0;
+	header.colourMapOffset    = TGA_HEADER_SIZE + data[0];
+	header.pixelOffset        = header.colourMapOffset
+	                          + size_t(header.colourMapLength)
+	                          * header.colourMapEntrySize;
+
+	bool isColourMapped = header.type == TGA_TYPE_COLOUR_MAPPED
+	                   || header.type == TGA_TYPE_COLOUR_MAPPED_RLE;
+	bool isLuminance    = header.type == TGA_TYPE_LUMINANCE
+	                   || header.type == TGA_TYPE_LUMINANCE_RLE;
+	bool isTrueColour   = header.type == TGA_TYPE_TRUE_COLOUR
+	                   || header.type == TGA_TYPE_TRUE_COLOUR_RLE;
+	if(isColourMapped)
+		return header.colourMapLength > 0
+		    && (header.pixelSize == 1 || header.pixelSize == 2)
+		    && header.colourMapEntrySize >= 2
+		    && header.colourMapEntrySize <= 4
+		    && header.pixelOffset <= size;
+	if(isLuminance)
+		return (header.pixelSize == 1 || header.pixelSize == 2)
+		    && header.pixelOffset <= size;
+	return isTrueColour && header.pixelSize >= 2 && header.pixelSize <= 4
+	    && header.pixelOffset <= size;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Scalar of a pixel: luminance, or luminance of a BGR colour (15 bits in
+// two bytes, 24 or 32 bits)
+static GLfloat _tga_scalar(const GLubyte* pixel, GLuint size, bool isLuminance)
+{
+	if(isLuminance)
+		return GLfloat(pixel[0]); // alpha is ignored
+	GLuint b, g, r;
+	if(size == 2)
+	{
+		GLuint bgr = pixel[0] | pixel[1] << 8;
+		b = (bgr & 0x1F) << 3;
+		g = (bgr >> 5 & 0x1F) << 3;
+		r = (bgr >> 10 & 0x1F) << 3;
+	}
+	else
+	{
+		b = pixel[0];
+		g = pixel[1];
+		r = pixel[2];
+	}
+	return 0.299f*r + 0.587f*g + 0.114f*b;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Slice writer
+// Writes runs of samples in image order (rows from the origin of the
+// image), to their place in a slice of the volume (bottom row first, left
+// to right).
+class _SliceWriter
+{
+public:
+	_SliceWriter(const _TgaHeader& header, GLfloat* slice):
+		mSlice(slice), mWidth(header.width), mHeight(header.height),
+		mIsTopOrigin(header.isTopOrigin),
+		mIsRightOrigin(header.isRightOrigin), mX(0), mY(0)
+	{
+		mRow = _Row(0);
+	}
+
+	// number of samples left
+	size_t Remaining() const
+	{
+		return size_t(mHeight - mY)*mWidth - mX;
+	}
+
+	// write count copies of a value (count <= Remaining())
+	void Fill(GLfloat value, GLuint count)
+	{
+		while(count > 0)
+		{
+			GLuint n = std::min(count, mWidth - mX);
+			if(mIsRightOrigin)
+				std::fill(mRow + (mWidth - mX - n), mRow + (mWidth - mX),
+				          value);
+			else
+				std::fill(mRow + mX, mRow + mX + n, value);
+			count-= n;
+			_Advance(n);
+		}
+	}
+
+	// write a value
+	void Put(GLfloat value)
+	{
+		mRow[mIsRightOrigin ? mWidth - 1 - mX : mX] = value;
+		_Advance(1);
+	}
+
+private:
+	GLfloat* _Row(GLuint y) const
+	{
+		return mSlice + size_t(mIsTopOrigin ? mHeight - 1 - y : y)*mWidth;
+	}
+
+	void _Advance(GLuint count)
+	{
+		mX+= count;
+		if(mX == mWidth)
+		{
+			mX = 0;
+			if(++mY < mHeight)
+				mRow = _Row(mY);
+		}
+	}
+
+	GLfloat* mSlice;
+	GLfloat* mRow;
+	GLuint   mWidth;
+	GLuint   mHeight;
+	bool     mIsTopOrigin;
+	bool     mIsRightOrigin;
+	GLuint   mX;
+	GLuint   mY;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Slice sink: writes the packets of fw::walk_tga_packets to a slice, as the
+// scalars of their pixels (colour mapped pixels are looked up in the
+// scalars of the colour map)
+class _SliceSink
+{
+public:
+	_SliceSink(const _TgaHeader& header,
+	           const GLfloat* colours,
+	           _SliceWriter& writer):
+		mWriter(writer), mColours(colours),
+		mColourFirst(header.colourMapFirst),
+		mColourCount(header.colourMapLength),
+		mPixelSize(header.pixelSize),
+		mIsLuminance(header.type == TGA_TYPE_LUMINANCE
+		             || header.type == TGA_TYPE_LUMINANCE_RLE) {}
+
+	void Run(const GLubyte* pixel, GLuint count) throw(fw::FWException)
+	{
+		mWriter.Fill(_Scalar(pixel), count);
+	}
+
+	void Raw(const GLubyte* pixels, GLuint count) throw(fw::FWException)
+	{
+		for(GLuint i=0; i<count; ++i, pixels+=mPixelSize)
+			mWriter.Put(_Scalar(pixels));
+	}
+
+private:
+	GLfloat _Scalar(const GLubyte* pixel) const throw(fw::FWException)
+	{
+		if(!mColours)
+			return _tga_scalar(pixel, mPixelSize, mIsLuminance);
+		GLuint index = mPixelSize == 1 ? pixel[0] : pixel[0] | pixel[1] << 8;
+		index-= mColourFirst;
+		if(index >= mColourCount)
+			throw _TgaColourMapIndexException();
+		return mColours[index];
+	}
+
+	_SliceWriter&  mWriter;
+	const GLfloat* mColours;
+	GLuint         mColourFirst;
+	GLuint         mColourCount;
+	GLuint         mPixelSize;
+	bool           mIsLuminance;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Decode a TGA image to a slice (false if the data is truncated, throws if
+// a colour map index is out of the map)
+static bool _decode_tga(const GLubyte* data,
+                        size_t size,
+                        const _TgaHeader& header,
+                        GLfloat* slice) throw(fw::FWException)
+{
+	const bool isRle = header.type >= TGA_TYPE_COLOUR_MAPPED_RLE;
+	const bool isColourMapped = header.type == TGA_TYPE_COLOUR_MAPPED
+	                         || header.type == TGA_TYPE_COLOUR_MAPPED_RLE;
+
+	// scalars of the colour map
+	ArenaScope scope;
+	GLfloat* colours = NULL;
+	if(isColourMapped)
+	{
+		colours = scope.GetArena().Allocate<GLfloat>(header.colourMapLength);
+		for(GLuint i=0; i<header.colourMapLength; ++i)
+			colours[i] = _tga_scalar(data + header.colourMapOffset
+			                         + size_t(i)*header.colourMapEntrySize,
+			                         header.colourMapEntrySize, false);
+	}
+
+	_SliceWriter writer(header, slice);
+	_SliceSink sink(header, colours, writer);
+	return fw::walk_tga_packets(data + header.pixelOffset, data + size,
+	                            isRle, header.pixelSize, writer.Remaining(),
+	                            sink);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Read a file (in an arena)
+static GLubyte* _read_file(const std::string& filename,
+                           Arena& arena,
+                           size_t& size)
+{
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+	if(!file)
+		return NULL;
+	file.seekg(0, std::ios::end);
+	size = size_t(file.tellg());
+	file.seekg(0, std::ios::beg);
+	GLubyte* data = arena.Allocate<GLubyte>(std::max(size, size_t(1)));
+	file.read(reinterpret_cast<char*>(data), std::streamsize(size));
+	return file ? data : NULL;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Decode the slices of the slabs of a volume
+class _DecodeSliceTask : public ThreadPool::Task
+{
+public:
+	_DecodeSliceTask(const std::vector<std::string>& filenames,
+	                 Volume& volume,
+	                 ThreadPool& pool):
+		mFilenames(filenames), mVolume(volume), mPool(pool),
+		mFailedSlice(INVALID_INDEX) {}
+
+	void Run(GLuint slab, GLuint)
+	{
+		const size_t sliceSize = size_t(mVolume.Width())*mVolume.Height();
+		const GLuint z1 = mVolume.SlabBegin(slab+1, mPool);
+		for(GLuint z=mVolume.SlabBegin(slab, mPool); z<z1; ++z)
+		{
+			ArenaScope scope;
+			size_t size = 0;
+			GLubyte* data = _read_file(mFilenames[z], scope.GetArena(), size);
+			_TgaHeader header;
+			std::string failure;
+			if(!data)
+				failure = "file not read";
+			else if(!_read_tga_header(data, size, header))
+				failure = "unsupported image";
+			else if(header.width != mVolume.Width()
+			        || header.height != mVolume.Height())
+				failure = "image of another size";
+			else try
+			{
+				if(!_decode_tga(data, size, header,
+				                mVolume.Samples() + z*sliceSize))
+					failure = "truncated data";
+			}
+			catch(fw::FWException& e)
+			{
+				failure = e.what();
+			}
+			if(!failure.empty())
+			{
+				_Fail(z, failure);
+				return;
+			}
+		}
+	}
+
+	// first slice that failed, INVALID_INDEX if none, and why
+	GLuint FailedSlice()         const {return mFailedSlice;}
+	const std::string& Failure() const {return mFailure;}
+
+private:
+	// keep the first failure
+	void _Fail(GLuint z, const std::string& failure)
+	{
+		fw::ScopedLock lock(mMutex);
+		if(z < mFailedSlice)
+		{
+			mFailedSlice = z;
+			mFailure     = failure;
+		}
+	}
+
+	const std::vector<std::string>& mFilenames;
+	Volume&                         mVolume;
+	ThreadPool&                     mPool;
+	fw::Mutex                       mMutex;
+	GLuint                          mFailedSlice;
+	std::string                     mFailure;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Slice stacks
+//
+////////////////////////////////////////////////////////////////////////////////
+
+void list_tga_slices(const std::string& directory,
+                     std::vector<std::string>& filenames)
+                     throw(fw::FWException)
+{
+	std::string prefix = directory;
+	if(!prefix.empty() && prefix[prefix.size()-1] != '/'
+	   && prefix[prefix.size()-1] != '\\')
+		prefix+= '/';
+
+	std::vector<std::string> names;
+#ifdef _WIN32
+	WIN32_FIND_DATAA entry;
+	HANDLE handle = FindFirstFileA((prefix + "*").c_str(), &entry);
+	if(handle == INVALID_HANDLE_VALUE)
+		throw _DirectoryException(directory);
+	do
+		names.push_back(entry.cFileName);
+	while(FindNextFileA(handle, &entry));
+	FindClose(handle);
+#else
+	DIR* dir = opendir(directory.c_str());
+	if(!dir)
+		throw _DirectoryException(directory);
+	for(dirent* entry = readdir(dir); entry; entry = readdir(dir))
+		names.push_back(entry->d_name);
+	closedir(dir);
+#endif
+
+	filenames.clear();
+	for(size_t i=0; i<names.size(); ++i)
+	{
+		const std::string& name = names[i];
+		if(name.size() > 4
+		   && (name.compare(name.size()-4, 4, ".tga") == 0
+		       || name.compare(name.size()-4, 4, ".TGA") == 0))
+			filenames.push_back(name);
+	}
+	std::sort(filenames.begin(), filenames.end(), _natural_less);
+	for(size_t i=0; i<filenames.size(); ++i)
+		filenames[i] = prefix + filenames[i];
+}
+
+void read_volume_tga_slices(const std::vector<std::string>& filenames,
+                            Volume& volume,
+                            ThreadPool& pool)
+                            throw(fw::FWException)
+{
+	if(filenames.empty())
+	{
+		volume.Resize(0, 0, 0);
+		return;
+	}
+
+	// size of the slices
+	_TgaHeader header;
+	{
+		ArenaScope scope;
+		size_t size = 0;
+		GLubyte* data = _read_file(filenames[0], scope.GetArena(), size);
+		if(!data)
+			throw _TgaSliceException(filenames[0], "file not read");
+		if(!_read_tga_header(data, size, header))
+			throw _TgaSliceException(filenames[0], "unsupported image");
+	}
+
+	volume.Resize(header.width, header.height, GLuint(filenames.size()),
+	              pool);
+	_DecodeSliceTask task(filenames, volume, pool);
+	pool.Run(pool.ThreadCount(), task);
+	if(task.FailedSlice() != INVALID_INDEX)
+		throw _TgaSliceException(filenames[task.FailedSlice()],
+		                         task.Failure());
+}
+
+void read_volume_tga_slices(const std::string& directory,
+                            Volume& volume,
+                            ThreadPool& pool)
+                            throw(fw::FWException)
+{
+	std::vector<std::string> filenames;
+	list_tga_slices(directory, filenames);
+	read_volume_tga_slices(filenames, volume, pool);
+}
+
+} // namespace mc
+
+
+
+// Tests of the slice stacks: slices of all the image types and origins are
+// read back, and slices with a colour map index out of the map or with
+// truncated data are rejected
+// (build with -DTGA_STACK_TEST mc/*.cpp core/*.cpp Framework.cpp Trace.cpp
+// and the OpenGL libraries)
+#ifdef TGA_STACK_TEST
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+static const GLuint WIDTH = 9, HEIGHT = 4;
+static const GLuint MAP_FIRST = 2;
+
+// grey level of a sample (multiple of 8, so 15 bits colours are exact)
+static GLuint _grey(GLuint x, GLuint y, GLuint z)
+{
+	return 8*((x/3 + y + z) % 32);
+}
+
+// header of an image
+static std::string _tga_header(GLuint type,
+                               GLuint mapLength,
+                               GLuint pixelBits,
+                               GLuint descriptor)
+{
+	const GLubyte header[mc::TGA_HEADER_SIZE] = {
+		0, GLubyte(mapLength ? 1 : 0), GLubyte(type),
+		GLubyte(MAP_FIRST), 0,
+		GLubyte(mapLength & 0xFF), GLubyte(mapLength >> 8),
+		GLubyte(mapLength ? 16 : 0),
+		0, 0, 0, 0,
+		GLubyte(WIDTH), 0, GLubyte(HEIGHT), 0,
+		GLubyte(pixelBits), GLubyte(descriptor)
+	};
+	return std::string(reinterpret_cast<const char*>(header),
+	                   mc::TGA_HEADER_SIZE);
+}
+
+// pixels of a slice in file order, as the bytes of the given type
+static std::vector<std::string> _tga_pixels(GLuint z,
+                                            GLuint type,
+                                            GLuint descriptor)
+{
+	std::vector<std::string> pixels;
+	for(GLuint row=0; row<HEIGHT; ++row)
+	for(GLuint column=0; column<WIDTH; ++column)
+	{
+		GLuint x = descriptor & 0x10 ? WIDTH-1-column : column;
+		GLuint y = descriptor & 0x20 ? HEIGHT-1-row : row;
+		GLuint grey = _grey(x,y,z);
+		std::string pixel;
+		if(type == mc::TGA_TYPE_LUMINANCE || type == mc::TGA_TYPE_LUMINANCE_RLE)
+			pixel.append(1, char(grey));
+		else if(type == mc::TGA_TYPE_TRUE_COLOUR
+		        || type == mc::TGA_TYPE_TRUE_COLOUR_RLE)
+			pixel.append(3, char(grey));
+		else
+			pixel.append(1, char(MAP_FIRST + grey/8));
+		pixels.push_back(pixel);
+	}
+	return pixels;
+}
+
+// encode pixels: runs of equal pixels, raw packets of the others
+static std::string _tga_encode(const std::vector<std::string>& pixels,
+                               bool isRle)
+{
+	std::string data;
+	for(size_t i=0; i<pixels.size(); )
+	{
+		if(!isRle)
+		{
+			data+= pixels[i++];
+			continue;
+		}
+		size_t n = 1;
+		while(i+n < pixels.size() && n < 128 && pixels[i+n] == pixels[i])
+			++n;
+		if(n > 1)
+		{
+			data+= char(0x80 | (n-1));
+			data+= pixels[i];
+		}
+		else
+		{
+			while(i+n < pixels.size() && n < 128
+			      && pixels[i+n] != pixels[i+n-1])
+				++n;
+			data+= char(n-1);
+			for(size_t j=0; j<n; ++j)
+				data+= pixels[i+j];
+		}
+		i+= n;
+	}
+	return data;
+}
+
+// colour map of 32 greys, BGR555
+static std::string _tga_colour_map()
+{
+	std::string map;
+	for(GLuint i=0; i<32; ++i)
+	{
+		GLuint bgr = i | i << 5 | i << 10;
+		map+= char(bgr & 0xFF);
+		map+= char(bgr >> 8);
+	}
+	return map;
+}
+
+static void _write(const std::string& filename, const std::string& contents)
+{
+	std::ofstream file(filename.c_str(), std::ios::out | std::ios::binary);
+	file.write(contents.data(), std::streamsize(contents.size()));
+}
+
+int main(int argc, char **argv)
+{
+	// type, bits per pixel and descriptor (origin) of each slice
+	const GLuint SLICES[][3] = {
+		{mc::TGA_TYPE_LUMINANCE,         8,  0x00},
+		{mc::TGA_TYPE_LUMINANCE_RLE,     8,  0x20},
+		{mc::TGA_TYPE_TRUE_COLOUR,       24, 0x10},
+		{mc::TGA_TYPE_TRUE_COLOUR_RLE,   24, 0x30},
+		{mc::TGA_TYPE_COLOUR_MAPPED,     8,  0x20},
+		{mc::TGA_TYPE_COLOUR_MAPPED_RLE, 8,  0x10}
+	};
+	const GLuint SLICE_COUNT = sizeof(SLICES)/sizeof(SLICES[0]);
+	int failures = 0;
+
+	std::vector<std::string> filenames;
+	std::vector<std::string> images;
+	for(GLuint z=0; z<SLICE_COUNT; ++z)
+	{
+		const GLuint type = SLICES[z][0];
+		const bool isColourMapped = type == mc::TGA_TYPE_COLOUR_MAPPED
+		                         || type == mc::TGA_TYPE_COLOUR_MAPPED_RLE;
+		std::string image = _tga_header(type, isColourMapped ? 32 : 0,
+		                                SLICES[z][1], SLICES[z][2]);
+		if(isColourMapped)
+			image+= _tga_colour_map();
+		image+= _tga_encode(_tga_pixels(z, type, SLICES[z][2]),
+		                    type >= mc::TGA_TYPE_COLOUR_MAPPED_RLE);
+		char filename[32];
+		std::sprintf(filename, "_slice_%u.tga", z);
+		filenames.push_back(filename);
+		images.push_back(image);
+		_write(filename, image);
+	}
+
+	for(GLuint t=0; t<2; ++t)
+	{
+		mc::ThreadPool pool(t == 0 ? 1 : 3, mc::ThreadPool::PIN_MODE_NONE);
+		mc::Volume volume;
+		try
+		{
+			mc::read_volume_tga_slices(filenames, volume, pool);
+		}
+		catch(fw::FWException& e)
+		{
+			++failures;
+			std::fprintf(stderr, "%s\n", e.what());
+			continue;
+		}
+		bool isValid = volume.Width() == WIDTH && volume.Height() == HEIGHT
+		            && volume.Depth() == SLICE_COUNT;
+		for(GLuint z=0; isValid && z<SLICE_COUNT; ++z)
+		for(GLuint y=0; y<HEIGHT; ++y)
+		for(GLuint x=0; x<WIDTH; ++x)
+			if(std::fabs(volume.At(x,y,z) - GLfloat(_grey(x,y,z))) > 1e-3f)
+			{
+				std::fprintf(stderr, "slice %u: sample %u %u is %f, not "
+				             "%u\n", z, x, y, volume.At(x,y,z),
+				             _grey(x,y,z));
+				isValid = false;
+			}
+		failures+= isValid ? 0 : 1;
+	}
+
+	// invalid slices: an index out of the map (last slice), data truncated
+	// in the middle of a packet (first slice)
+	const char* const FAILURES[] = {"invalid colour map index",
+	                                "truncated data"};
+	for(GLuint f=0; f<2; ++f)
+	{
+		const GLuint z = f == 0 ? SLICE_COUNT-1 : 0;
+		std::string image = images[z];
+		if(f == 0)
+			image[image.size()-1] = char(MAP_FIRST + 32);
+		else
+			image.resize(image.size()-1);
+		_write(filenames[z], image);
+
+		mc::ThreadPool pool(3, mc::ThreadPool::PIN_MODE_NONE);
+		mc::Volume volume;
+		try
+		{
+			mc::read_volume_tga_slices(filenames, volume, pool);
+			++failures;
+			std::fprintf(stderr, "%s accepted\n", FAILURES[f]);
+		}
+		catch(fw::FWException& e)
+		{
+			if(!std::strstr(e.what(), FAILURES[f]))
+			{
+				++failures;
+				std::fprintf(stderr, "unexpected error: %s\n", e.what());
+			}
+		}
+		_write(filenames[z], images[z]);
+	}
+
+	for(GLuint z=0; z<SLICE_COUNT; ++z)
+		std::remove(filenames[z].c_str());
+	std::printf("%s (%d failures)\n", failures ? "FAILED" : "PASSED", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif // TGA_STACK_TEST
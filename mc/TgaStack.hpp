@@ -0,0 +1,48 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   TgaStack.hpp
+// \author J Dupuy
+// \brief  Volume assembled from a stack of TGA slices.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MC_TGA_STACK_HPP
+#define MC_TGA_STACK_HPP
+
+#include <string>
+#include <vector>
+#include "Framework.hpp"
+#include "ThreadPool.hpp"
+#include "Volume.hpp"
+
+namespace mc
+{
+	// List the TGA files of a directory, in the order of the numbers in
+	// their names (slice_2.tga comes before slice_10.tga)
+	void list_tga_slices(const std::string& directory,
+	                     std::vector<std::string>& filenames)
+	                     throw(fw::FWException);
+
+	// Read a stack of TGA slices
+	// File i is slice z = i of the volume, all the slices must have the same
+	// size. Uncompressed and RLE images are supported, luminance, true colour
+	// and colour mapped. Samples are the luminance values of the pixels, or
+	// the luminance of their colours (Rec. 601 weights), in [0, 255]. Row 0
+	// of the volume is the bottom row of the images.
+	// The volume is resized with the pool (see Volume::Resize), and each task
+	// decodes the slices of its slab: a slice is read in one block and its
+	// pixels are written to their place in the volume, runs and flips
+	// included, without intermediate images.
+	void read_volume_tga_slices(const std::vector<std::string>& filenames,
+	                            Volume& volume,
+	                            ThreadPool& pool)
+	                            throw(fw::FWException);
+		// slices of a directory (see list_tga_slices)
+	void read_volume_tga_slices(const std::string& directory,
+	                            Volume& volume,
+	                            ThreadPool& pool)
+	                            throw(fw::FWException);
+
+} // namespace mc
+
+#endif
+
@@ -0,0 +1,464 @@
+#include "ThreadPool.hpp"
+#include "Arena.hpp"
+#include "Atomic.hpp"
+#include "Framework.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+#ifndef _WIN32
+#	include <pthread.h>
+#	include <unistd.h>
+#endif // _WIN32
+
+namespace mc
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// Constants
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// highest NUMA node looked up
+static const GLuint MAX_NODE_COUNT = 64;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Topology
+// Processors of each NUMA node (nodes without processors are skipped). Falls
+// back to a single node with all the processors.
+typedef std::vector< std::vector<GLuint> > _Topology;
+
+#ifndef _WIN32
+// parse a cpulist file ("0-3,8-11")
+static void _read_cpu_list(FILE* file, std::vector<GLuint>& processors)
+{
+	unsigned first, last;
+	while(std::fscanf(file, "%u", &first) == 1)
+	{
+		last = first;
+		int c = std::fgetc(file);
+		if(c == '-')
+		{
+			if(std::fscanf(file, "%u", &last) != 1)
+				return;
+			c = std::fgetc(file);
+		}
+		for(unsigned i=first; i<=last; ++i)
+			processors.push_back(i);
+		if(c != ',')
+			return;
+	}
+}
+#endif
+
+static void _read_topology(_Topology& topology)
+{
+	topology.clear();
+#ifdef _WIN32
+	ULONG highestNode = 0;
+	if(GetNumaHighestNodeNumber(&highestNode))
+		for(ULONG node=0; node<=highestNode && node<MAX_NODE_COUNT; ++node)
+		{
+			ULONGLONG mask = 0;
+			if(!GetNumaNodeProcessorMask(UCHAR(node), &mask) || !mask)
+				continue;
+			topology.push_back(std::vector<GLuint>());
+			for(GLuint i=0; i<64; ++i)
+				if(mask >> i & 1u)
+					topology.back().push_back(i);
+		}
+#elif defined(__linux__)
+	cpu_set_t allowed;
+	bool hasAllowed = 0 == sched_getaffinity(0, sizeof(allowed), &allowed);
+	for(GLuint node=0; node<MAX_NODE_COUNT; ++node)
+	{
+		char path[64];
+		std::sprintf(path, "/sys/devices/system/node/node%u/cpulist", node);
+		FILE* file = std::fopen(path, "r");
+		if(!file)
+			continue;
+		std::vector<GLuint> processors;
+		_read_cpu_list(file, processors);
+		std::fclose(file);
+		// processors the process may run on
+		std::vector<GLuint> usable;
+		for(size_t i=0; i<processors.size(); ++i)
+			if(!hasAllowed || (processors[i] < CPU_SETSIZE
+			                   && CPU_ISSET(processors[i], &allowed)))
+				usable.push_back(processors[i]);
+		if(!usable.empty())
+			topology.push_back(usable);
+	}
+#endif
+
+	if(topology.empty())
+	{
+		GLuint processorCount = 1;
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		processorCount = std::max(GLuint(info.dwNumberOfProcessors), 1u);
+#else
+		long count = sysconf(_SC_NPROCESSORS_ONLN);
+		processorCount = count > 0 ? GLuint(count) : 1u;
+#endif
+		topology.push_back(std::vector<GLuint>());
+		for(GLuint i=0; i<processorCount; ++i)
+			topology.back().push_back(i);
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// ThreadPool
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// System
+struct ThreadPool::System
+{
+	fw::Mutex              mutex;
+	fw::ConditionVariable  start; // signaled by Run
+	fw::ConditionVariable  done;  // signaled by the last worker
+#ifdef _WIN32
+	std::vector<HANDLE>    threads;
+#else
+	std::vector<pthread_t> threads;
+#endif
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors / Destructor
+ThreadPool::ThreadPool(GLuint threadCount, GLint pinMode):
+	mWorkers(), mNodeTasks(), mNodeCount(1), mArePinned(false),
+	mTask(NULL), mTaskCount(0), mGeneration(0), mPendingCount(0),
+	mStolenCount(0), mIsQuitting(false), mSystem(new System)
+{
+	_Topology topology;
+	_read_topology(topology);
+	mNodeCount = GLuint(topology.size());
+	if(PIN_MODE_AUTO == pinMode)
+		pinMode = mNodeCount > 1 ? PIN_MODE_NODE : PIN_MODE_NONE;
+	if(threadCount == 0)
+		for(GLuint n=0; n<mNodeCount; ++n)
+			threadCount+= GLuint(topology[n].size());
+
+	// contiguous workers per node, in proportion of their processors
+	// (the processors of a node are used in turn)
+	std::vector<GLuint> nodeWorkerCount(mNodeCount, 0);
+	mWorkers.resize(threadCount);
+	for(GLuint i=0; i<threadCount; ++i)
+	{
+		Worker& worker = mWorkers[i];
+		worker.pool  = this;
+		worker.index = i;
+		worker.node  = GLuint(GLuint64(i)*mNodeCount/threadCount);
+		const std::vector<GLuint>& processors = topology[worker.node];
+		GLuint local = nodeWorkerCount[worker.node]++;
+		worker.processor = PIN_MODE_PROCESSOR == pinMode
+		                 ? GLint(processors[local % processors.size()])
+		                 : -1;
+	}
+	mNodeTasks.resize(mNodeCount);
+
+	// start the threads
+	const bool isPinned = PIN_MODE_NONE != pinMode;
+	mArePinned = isPinned;
+	for(GLuint i=0; i<threadCount; ++i)
+	{
+		Worker& worker = mWorkers[i];
+		const std::vector<GLuint>& processors
+			= worker.processor >= 0
+			? std::vector<GLuint>(1, GLuint(worker.processor))
+			: topology[worker.node];
+#ifdef _WIN32
+		HANDLE thread = CreateThread(NULL, 0, &ThreadPool::_WorkerMain,
+		                             &worker, 0, NULL);
+#ifndef NDEBUG
+		assert(thread != NULL);
+#endif
+		if(isPinned)
+		{
+			DWORD_PTR mask = 0;
+			for(size_t p=0; p<processors.size(); ++p)
+				mask|= DWORD_PTR(1) << processors[p];
+			mArePinned&= 0 != SetThreadAffinityMask(thread, mask);
+		}
+#else
+		pthread_t thread;
+		int error = pthread_create(&thread, NULL, &ThreadPool::_WorkerMain,
+		                           &worker);
+#ifndef NDEBUG
+		assert(error == 0);
+#endif
+		(void)error;
+#	ifdef __linux__
+		if(isPinned)
+		{
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			for(size_t p=0; p<processors.size(); ++p)
+				CPU_SET(processors[p], &set);
+			mArePinned&= 0 == pthread_setaffinity_np(thread, sizeof(set),
+			                                         &set);
+		}
+#	else
+		mArePinned = false;
+#	endif
+#endif
+		mSystem->threads.push_back(thread);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		fw::ScopedLock lock(mSystem->mutex);
+		mIsQuitting = true;
+		mSystem->start.Broadcast();
+	}
+
+	for(size_t i=0; i<mSystem->threads.size(); ++i)
+	{
+#ifdef _WIN32
+		WaitForSingleObject(mSystem->threads[i], INFINITE);
+		CloseHandle(mSystem->threads[i]);
+#else
+		pthread_join(mSystem->threads[i], NULL);
+#endif
+	}
+	delete mSystem;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Manipulation
+void ThreadPool::Run(GLuint taskCount, Task& task)
+{
+	if(taskCount == 0)
+		return;
+
+	// tasks of each node
+	for(GLuint n=0; n<mNodeCount; ++n)
+	{
+		mNodeTasks[n].next = SlabBegin(n, mNodeCount, taskCount);
+		mNodeTasks[n].end  = SlabBegin(n+1, mNodeCount, taskCount);
+	}
+
+	fw::ScopedLock lock(mSystem->mutex);
+#ifndef NDEBUG
+	assert(mPendingCount == 0 && "ThreadPool::Run is not reentrant");
+#endif
+	mTask         = &task;
+	mTaskCount    = taskCount;
+	mPendingCount = GLuint(mWorkers.size());
+	mStolenCount  = 0;
+	++mGeneration;
+	mSystem->start.Broadcast();
+	while(mPendingCount > 0)
+		mSystem->done.Wait(mSystem->mutex);
+	mTask = NULL;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Queries
+GLuint ThreadPool::ThreadCount() const
+{
+	return GLuint(mWorkers.size());
+}
+
+GLuint ThreadPool::NodeCount() const
+{
+	return mNodeCount;
+}
+
+GLuint ThreadPool::WorkerNode(GLuint worker) const
+{
+#ifndef NDEBUG
+	assert(worker < mWorkers.size());
+#endif
+	return mWorkers[worker].node;
+}
+
+GLuint ThreadPool::TaskNode(GLuint index, GLuint taskCount) const
+{
+#ifndef NDEBUG
+	assert(index < taskCount);
+#endif
+	GLuint node = 0;
+	while(SlabBegin(node+1, mNodeCount, taskCount) <= index)
+		++node;
+	return node;
+}
+
+bool ThreadPool::ArePinned() const
+{
+	return mArePinned;
+}
+
+GLuint ThreadPool::StolenTaskCount() const
+{
+	return fw::atomic_load(&mStolenCount);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Slabs
+GLuint ThreadPool::SlabBegin(GLuint index, GLuint count, GLuint size)
+{
+#ifndef NDEBUG
+	assert(index <= count && count > 0);
+#endif
+	return GLuint(GLuint64(index)*size/count);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Internal manipulation
+#ifdef _WIN32
+unsigned long __stdcall ThreadPool::_WorkerMain(void* worker)
+#else
+void* ThreadPool::_WorkerMain(void* worker)
+#endif
+{
+	Worker& self = *static_cast<Worker*>(worker);
+	ThreadPool& pool = *self.pool;
+	System& system = *pool.mSystem;
+	GLuint generation = 0;
+	for(;;)
+	{
+		{
+			fw::ScopedLock lock(system.mutex);
+			while(!pool.mIsQuitting && pool.mGeneration == generation)
+				system.start.Wait(system.mutex);
+			if(pool.mIsQuitting)
+				break;
+			generation = pool.mGeneration;
+		}
+
+		pool._Work(self.index);
+
+		fw::ScopedLock lock(system.mutex);
+		if(--pool.mPendingCount == 0)
+			system.done.Broadcast();
+	}
+
+	// the scratch memory of the tasks
+	Arena::ReleaseThreadArena();
+	return 0;
+}
+
+void ThreadPool::_Work(GLuint worker)
+{
+	// own node first, then the others
+	const GLuint home = mWorkers[worker].node;
+	for(GLuint k=0; k<mNodeCount; ++k)
+	{
+		NodeTasks& tasks = mNodeTasks[(home + k) % mNodeCount];
+		for(;;)
+		{
+			GLuint index = fw::atomic_fetch_add(&tasks.next, 1);
+			if(index >= tasks.end)
+				break;
+			mTask->Run(index, worker);
+			if(k > 0)
+				fw::atomic_fetch_add(&mStolenCount, 1);
+		}
+	}
+}
+
+} // namespace mc
+
+
+// Tests of the pool: every task runs once, and the parallel extraction
+// matches the serial one, for all the pin modes
+// (build with -DTHREAD_POOL_TEST mc/*.cpp core/*.cpp Framework.cpp Trace.cpp
+// and the OpenGL libraries)
+#ifdef THREAD_POOL_TEST
+#include <cmath>
+#include <cstdlib>
+#include "MarchingCube.hpp"
+#include "Volume.hpp"
+
+class _CountTask : public mc::ThreadPool::Task
+{
+public:
+	explicit _CountTask(volatile GLuint* counts): mCounts(counts) {}
+	void Run(GLuint index, GLuint) {fw::atomic_fetch_add(mCounts + index, 1);}
+private:
+	volatile GLuint* mCounts;
+};
+
+static bool _equal(const mc::Mesh& m1, const mc::Mesh& m2)
+{
+	return m1.Positions() == m2.Positions()
+	    && m1.Normals()   == m2.Normals()
+	    && m1.Indexes()   == m2.Indexes();
+}
+
+int main(int argc, char **argv)
+{
+	const GLint PIN_MODES[] = { mc::ThreadPool::PIN_MODE_AUTO,
+	                            mc::ThreadPool::PIN_MODE_NONE,
+	                            mc::ThreadPool::PIN_MODE_NODE,
+	                            mc::ThreadPool::PIN_MODE_PROCESSOR };
+	const GLuint THREAD_COUNTS[] = {0, 1, 3, 8};
+	const GLuint SIZE = 61, TASK_COUNT = 1000;
+	int failures = 0;
+
+	mc::Volume serialVolume(SIZE, SIZE, SIZE);
+	for(GLuint z=0; z<SIZE; ++z)
+	for(GLuint y=0; y<SIZE; ++y)
+	for(GLuint x=0; x<SIZE; ++x)
+		serialVolume.At(x,y,z) = std::sin(x*0.3f)*std::cos(y*0.3f)
+		                       + std::sin(y*0.3f)*std::cos(z*0.3f)
+		                       + std::sin(z*0.3f)*std::cos(x*0.3f);
+	mc::Mesh serial;
+	mc::extract_marching_cube(serialVolume, 0.1f, serial,
+	                          mc::TOPOLOGY_MODE_ASYMPTOTIC_DECIDER,
+	                          mc::INTERPOLATION_MODE_CUBIC);
+
+	for(GLuint m=0; m<4; ++m)
+	for(GLuint t=0; t<4; ++t)
+	{
+		mc::ThreadPool pool(THREAD_COUNTS[t], PIN_MODES[m]);
+
+		std::vector<GLuint> counts(TASK_COUNT, 0);
+		_CountTask countTask(&counts[0]);
+		pool.Run(TASK_COUNT, countTask);
+		for(GLuint i=0; i<TASK_COUNT; ++i)
+			if(counts[i] != 1)
+			{
+				++failures;
+				std::fprintf(stderr, "task %u ran %u times\n", i, counts[i]);
+				break;
+			}
+
+		mc::Volume volume;
+		volume.Resize(SIZE, SIZE, SIZE, pool);
+		std::copy(serialVolume.Samples(),
+		          serialVolume.Samples() + serialVolume.SampleCount(),
+		          volume.Samples());
+		mc::Mesh parallel;
+		mc::extract_marching_cube(volume, 0.1f, parallel, pool,
+		                          mc::TOPOLOGY_MODE_ASYMPTOTIC_DECIDER,
+		                          mc::INTERPOLATION_MODE_CUBIC);
+		if(!_equal(serial, parallel))
+		{
+			++failures;
+			std::fprintf(stderr, "extraction failed (%u threads, pin mode "
+			                     "%d)\n", pool.ThreadCount(), PIN_MODES[m]);
+		}
+		std::printf("%u threads, %u nodes, pin mode %d, pinned %d\n",
+		            pool.ThreadCount(), pool.NodeCount(), PIN_MODES[m],
+		            int(pool.ArePinned()));
+	}
+	std::printf("%s (%d failures)\n", failures ? "FAILED" : "PASSED", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif // THREAD_POOL_TEST
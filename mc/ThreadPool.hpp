@@ -0,0 +1,130 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   ThreadPool.hpp
+// \author J Dupuy
+// \brief  NUMA aware pool of worker threads for the extraction algorithms.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MC_THREAD_POOL_HPP
+#define MC_THREAD_POOL_HPP
+
+#include <vector>
+#include "glew.hpp"
+
+namespace mc
+{
+	// Thread pool
+	// Workers are spread over the NUMA nodes of the machine (read from
+	// /sys/devices/system/node on Linux, a single node elsewhere) and are
+	// pinned to the processors of their node by default if there are several
+	// nodes (see the pin modes).
+	// Tasks run by Run are split in contiguous ranges, one per node, in
+	// order: with tasks working on slabs of a volume (see SlabBegin), slab i
+	// is always processed on the same node, so memory first touched by a task
+	// (see Volume::Resize) is local to the workers reading it later. Workers
+	// take the tasks of their node first, and help other nodes once it is
+	// done.
+	class ThreadPool
+	{
+	public:
+		// Task
+		class Task
+		{
+		public:
+			virtual ~Task() {}
+			// index is in [0, taskCount[, worker in [0, ThreadCount()[
+			virtual void Run(GLuint index, GLuint worker) = 0;
+		};
+
+		// Pin modes
+		enum
+		{
+			// PIN_MODE_NODE if the machine has several nodes, else
+			// PIN_MODE_NONE
+			PIN_MODE_AUTO = 0,
+			// workers run anywhere
+			PIN_MODE_NONE,
+			// workers run on the processors of their node
+			PIN_MODE_NODE,
+			// each worker runs on one processor of its node (processors
+			// are used in turn)
+			PIN_MODE_PROCESSOR
+		};
+
+		// Constructors / Destructor
+			// threadCount = 0 uses one thread per processor
+		explicit ThreadPool(GLuint threadCount = 0,
+		                    GLint pinMode = PIN_MODE_AUTO);
+		~ThreadPool();
+
+		// Manipulation
+			// run tasks [0, taskCount[ and wait for them to complete (not
+			// reentrant: tasks must not call Run)
+		void Run(GLuint taskCount, Task& task);
+
+		// Queries
+		GLuint ThreadCount()                const;
+		GLuint NodeCount()                  const;
+			// node of a worker
+		GLuint WorkerNode(GLuint worker)    const;
+			// node running a task first
+		GLuint TaskNode(GLuint index, GLuint taskCount) const;
+		bool ArePinned()                    const;
+			// number of tasks run by workers of another node in the last Run
+		GLuint StolenTaskCount()            const;
+
+		// Slabs: split size in count contiguous ranges (first of slab index,
+		// SlabBegin(count, count, size) = size)
+		static GLuint SlabBegin(GLuint index, GLuint count, GLuint size);
+
+	private:
+		// Non copyable
+		ThreadPool(const ThreadPool& pool);
+		ThreadPool& operator=(const ThreadPool& pool);
+
+		// Internal manipulation
+#ifdef _WIN32
+		static unsigned long __stdcall _WorkerMain(void* worker);
+#else
+		static void* _WorkerMain(void* worker);
+#endif
+		void _Work(GLuint worker);
+
+		// Tasks of a node
+		struct NodeTasks
+		{
+			volatile GLuint next;
+			GLuint          end;
+			char            padding[56]; // one cache line per node
+		};
+
+		// Worker
+		struct Worker
+		{
+			ThreadPool* pool;
+			GLuint      index;
+			GLuint      node;
+			GLint       processor; // -1 if not pinned to a processor
+		};
+
+		// Threads and synchronization objects (os specific)
+		struct System;
+
+		// Members
+		std::vector<Worker>    mWorkers;
+		std::vector<NodeTasks> mNodeTasks;
+		GLuint                 mNodeCount;
+		bool                   mArePinned;
+		Task*                  mTask;
+		GLuint                 mTaskCount;
+		GLuint                 mGeneration; // incremented by Run
+		GLuint                 mPendingCount; // workers still running
+		volatile GLuint        mStolenCount;
+		bool                   mIsQuitting;
+		System*                mSystem;
+	};
+
+} // namespace mc
+
+#endif
+
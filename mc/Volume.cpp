@@ -0,0 +1,201 @@
+#include "Volume.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace mc
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// Zero the samples of a slab
+class _ZeroSlabTask : public ThreadPool::Task
+{
+public:
+	_ZeroSlabTask(Volume& volume, ThreadPool& pool):
+		mVolume(volume), mPool(pool) {}
+
+	void Run(GLuint slab, GLuint)
+	{
+		const size_t sliceSize = size_t(mVolume.Width())*mVolume.Height();
+		GLfloat* samples = mVolume.Samples();
+		std::fill(samples + mVolume.SlabBegin(slab, mPool)*sliceSize,
+		          samples + mVolume.SlabBegin(slab+1, mPool)*sliceSize,
+		          0.0f);
+	}
+
+private:
+	Volume&     mVolume;
+	ThreadPool& mPool;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors / Destructor
+Volume::Volume():
+	mSamples(NULL), mSampleCount(0), mGradients(),
+	mWidth(0), mHeight(0), mDepth(0),
+	mSpacing(1,1,1), mOrigin(0,0,0)
+{
+}
+
+Volume::Volume(GLuint width, GLuint height, GLuint depth):
+	mSamples(NULL), mSampleCount(0), mGradients(),
+	mWidth(0), mHeight(0), mDepth(0),
+	mSpacing(1,1,1), mOrigin(0,0,0)
+{
+	Resize(width, height, depth);
+}
+
+Volume::~Volume()
+{
+	delete[] mSamples;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Manipulation
+void Volume::Resize(GLuint width, GLuint height, GLuint depth)
+{
+	_Allocate(width, height, depth);
+	std::fill(mSamples, mSamples + mSampleCount, 0.0f);
+}
+
+void Volume::Resize(GLuint width, GLuint height, GLuint depth,
+                    ThreadPool& pool)
+{
+	_Allocate(width, height, depth);
+	_ZeroSlabTask task(*this, pool);
+	pool.Run(pool.ThreadCount(), task);
+}
+
+void Volume::SetSpacing(const Vector3& spacing)
+{
+#ifndef NDEBUG
+	assert(spacing[0] > 0.0f && spacing[1] > 0.0f && spacing[2] > 0.0f);
+#endif
+	mSpacing = spacing;
+}
+
+void Volume::SetOrigin(const Vector3& origin)
+{
+	mOrigin = origin;
+}
+
+void Volume::ComputeGradients()
+{
+	// compute with the gradients unset, so central differences are used
+	std::vector<GLfloat> gradients(mSampleCount*3);
+	GLfloat* gradient = gradients.empty() ? NULL : &gradients[0];
+	ClearGradients();
+	for(GLuint z=0; z<mDepth; ++z)
+	for(GLuint y=0; y<mHeight; ++y)
+	for(GLuint x=0; x<mWidth; ++x, gradient+=3)
+		Gradient(x, y, z, gradient);
+	mGradients.swap(gradients);
+}
+
+void Volume::ClearGradients()
+{
+	std::vector<GLfloat>().swap(mGradients);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Access
+const GLfloat& Volume::At(GLuint x, GLuint y, GLuint z) const
+{
+#ifndef NDEBUG
+	assert(x < mWidth && y < mHeight && z < mDepth);
+#endif
+	return mSamples[(size_t(z)*mHeight + y)*mWidth + x];
+}
+
+GLfloat& Volume::At(GLuint x, GLuint y, GLuint z)
+{
+	return const_cast<GLfloat&>
+	       ((static_cast<const Volume&>(*this)).At(x, y, z));
+}
+
+const GLfloat* Volume::Samples() const
+{
+	return mSamples;
+}
+
+GLfloat* Volume::Samples()
+{
+	return mSamples;
+}
+
+const GLfloat* Volume::Gradients() const
+{
+	return mGradients.empty() ? NULL : &mGradients[0];
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Queries
+GLuint Volume::Width()           const {return mWidth;}
+GLuint Volume::Height()          const {return mHeight;}
+GLuint Volume::Depth()           const {return mDepth;}
+size_t Volume::SampleCount()     const {return mSampleCount;}
+const Vector3& Volume::Spacing() const {return mSpacing;}
+const Vector3& Volume::Origin()  const {return mOrigin;}
+bool Volume::HasGradients()      const {return !mGradients.empty();}
+
+GLuint Volume::SlabBegin(GLuint slab, const ThreadPool& pool) const
+{
+	return ThreadPool::SlabBegin(slab, pool.ThreadCount(), mDepth);
+}
+
+void Volume::Gradient(GLuint x, GLuint y, GLuint z, GLfloat* gradient) const
+{
+#ifndef NDEBUG
+	assert(x < mWidth && y < mHeight && z < mDepth);
+#endif
+	const size_t index = (size_t(z)*mHeight + y)*mWidth + x;
+	if(!mGradients.empty())
+	{
+		gradient[0] = mGradients[index*3];
+		gradient[1] = mGradients[index*3+1];
+		gradient[2] = mGradients[index*3+2];
+		return;
+	}
+
+	const GLuint p[3]      = {x, y, z};
+	const GLuint size[3]   = {mWidth, mHeight, mDepth};
+	const size_t stride[3] = {1, mWidth, size_t(mWidth)*mHeight};
+	for(GLuint a=0; a<3; ++a)
+	{
+		GLuint lower = p[a] > 0 ? 1 : 0;
+		GLuint upper = p[a]+1 < size[a] ? 1 : 0;
+		if(lower + upper == 0)
+			gradient[a] = 0.0f;
+		else
+			gradient[a] = (mSamples[index + upper*stride[a]]
+			               - mSamples[index - lower*stride[a]])
+			            / (GLfloat(lower + upper) * mSpacing[a]);
+	}
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Internal manipulation
+void Volume::_Allocate(GLuint width, GLuint height, GLuint depth)
+{
+	// new[] leaves the samples uninitialized: large blocks are mapped
+	// lazily, and pages are placed when first written
+	delete[] mSamples;
+	mSamples     = NULL;
+	mSampleCount = size_t(width)*size_t(height)*size_t(depth);
+	if(mSampleCount > 0)
+		mSamples = new GLfloat[mSampleCount];
+	mWidth  = width;
+	mHeight = height;
+	mDepth  = depth;
+	ClearGradients();
+}
+
+} // namespace mc
+
@@ -0,0 +1,96 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   Volume.hpp
+// \author J Dupuy
+// \brief  Scalar volume for isosurface extraction.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MC_VOLUME_HPP
+#define MC_VOLUME_HPP
+
+#include <vector>
+#include "glew.hpp"
+#include "Algebra.hpp"
+
+namespace mc
+{
+	class ThreadPool;
+
+	// Scalar volume
+	// Samples are stored x first, then y, then z. Sample (x,y,z) is located at
+	// Origin() + Spacing()*(x,y,z) in world space. Gradients can be stored
+	// once, so they are not recomputed for each extraction (at a cost of three
+	// floats per sample).
+	// On NUMA machines, memory pages are placed on the node of the thread
+	// that touches them first: resizing with a thread pool zeroes slab i of
+	// the samples (see SlabBegin) on the workers of the node running task i,
+	// so parallel extractions on the same pool read local memory.
+	class Volume
+	{
+	public:
+		// Constructors / Destructor
+		Volume();
+		Volume(GLuint width, GLuint height, GLuint depth);
+		~Volume();
+
+		// Manipulation
+			// resize the volume (samples are set to zero)
+		void Resize(GLuint width, GLuint height, GLuint depth);
+			// resize the volume, samples are set to zero by the workers of
+			// the pool, slab by slab
+		void Resize(GLuint width, GLuint height, GLuint depth,
+		            ThreadPool& pool);
+		void SetSpacing(const Vector3& spacing);
+		void SetOrigin(const Vector3& origin);
+			// store the gradients of the samples (must be called again
+			// after the samples or the spacing are modified)
+		void ComputeGradients();
+		void ClearGradients();
+
+		// Access
+		GLfloat& At(GLuint x, GLuint y, GLuint z);
+		const GLfloat& At(GLuint x, GLuint y, GLuint z) const;
+		GLfloat* Samples();
+		const GLfloat* Samples() const;
+			// stored gradients, xyz interleaved (NULL if not stored)
+		const GLfloat* Gradients() const;
+
+		// Queries
+		GLuint Width()           const;
+		GLuint Height()          const;
+		GLuint Depth()           const;
+		size_t SampleCount()     const;
+		const Vector3& Spacing() const;
+		const Vector3& Origin()  const;
+		bool HasGradients()      const;
+			// first z of slab i, out of pool.ThreadCount() slabs (samples
+			// [SlabBegin(i), SlabBegin(i+1)[ of the z axis)
+		GLuint SlabBegin(GLuint slab, const ThreadPool& pool) const;
+			// gradient at a sample, in world space (stored, or central
+			// differences, one sided on the borders)
+		void Gradient(GLuint x, GLuint y, GLuint z, GLfloat* gradient) const;
+
+	private:
+		// Non copyable
+		Volume(const Volume& volume);
+		Volume& operator=(const Volume& volume);
+
+		// Internal manipulation
+			// allocate the samples (memory is not touched)
+		void _Allocate(GLuint width, GLuint height, GLuint depth);
+
+		// Members
+		GLfloat*             mSamples;
+		size_t               mSampleCount;
+		std::vector<GLfloat> mGradients; // xyz interleaved, or empty
+		GLuint  mWidth;
+		GLuint  mHeight;
+		GLuint  mDepth;
+		Vector3 mSpacing;
+		Vector3 mOrigin;
+	};
+
+} // namespace mc
+
+#endif
+
@@ -0,0 +1,861 @@
+#include "VolumeFile.hpp"
+#include "Arena.hpp"
+#include "Atomic.hpp"
+#include "Inflate.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace mc
+{
+
+////////////////////////////////////////////////////////////////////////////////
+// Constants
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// sample types
+enum
+{
+	SAMPLE_TYPE_INT8 = 0,
+	SAMPLE_TYPE_UINT8,
+	SAMPLE_TYPE_INT16,
+	SAMPLE_TYPE_UINT16,
+	SAMPLE_TYPE_INT32,
+	SAMPLE_TYPE_UINT32,
+	SAMPLE_TYPE_FLOAT,
+	SAMPLE_TYPE_DOUBLE,
+	SAMPLE_TYPE_COUNT
+};
+
+// sizes of the sample types (in bytes)
+static const GLuint SAMPLE_TYPE_SIZES[SAMPLE_TYPE_COUNT] = {1,1,2,2,4,4,4,8};
+
+// names of the sample types
+static const char* const NRRD_TYPE_NAMES[][2] = {
+	{"signed char", "int8"}, {"int8_t", "int8"},
+	{"uchar", "uint8"}, {"unsigned char", "uint8"}, {"uint8_t", "uint8"},
+	{"short", "int16"}, {"short int", "int16"}, {"signed short", "int16"},
+	{"signed short int", "int16"}, {"int16_t", "int16"},
+	{"ushort", "uint16"}, {"unsigned short", "uint16"},
+	{"unsigned short int", "uint16"}, {"uint16_t", "uint16"},
+	{"int", "int32"}, {"signed int", "int32"}, {"int32_t", "int32"},
+	{"uint", "uint32"}, {"unsigned int", "uint32"}, {"uint32_t", "uint32"}
+};
+static const GLuint NRRD_TYPE_NAME_COUNT = sizeof(NRRD_TYPE_NAMES)
+                                          / sizeof(NRRD_TYPE_NAMES[0]);
+static const char* const SAMPLE_TYPE_NAMES[SAMPLE_TYPE_COUNT] = {
+	"int8", "uint8", "int16", "uint16", "int32", "uint32", "float", "double"
+};
+static const char* const MET_TYPE_NAMES[SAMPLE_TYPE_COUNT] = {
+	"MET_CHAR", "MET_UCHAR", "MET_SHORT", "MET_USHORT",
+	"MET_INT", "MET_UINT", "MET_FLOAT", "MET_DOUBLE"
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Exceptions
+//
+////////////////////////////////////////////////////////////////////////////////
+class _FileReadException : public fw::FWException
+{
+public:
+	_FileReadException(const std::string& file)
+	{
+		mMessage = "Could not read file " + file + ".";
+	}
+};
+
+class _VolumeFileException : public fw::FWException
+{
+public:
+	_VolumeFileException(const std::string& file, const std::string& log)
+	{
+		mMessage = "Could not read volume file " + file + ": " + log + ".";
+	}
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Static functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Volume header
+struct _VolumeHeader
+{
+	GLuint      size[3];
+	GLint       sampleType;     // -1 if unset
+	bool        isBigEndian;
+	bool        isCompressed;
+	std::string dataFile;       // empty if the data follows the header
+	GLint64     dataOffset;     // of the data in its file
+	GLint64     byteSkip;       // bytes skipped in the (decompressed) data,
+	                            // -1 if the raw data ends the file
+	size_t      compressedSize; // 0 if unknown
+	Vector3     spacing;
+	Vector3     origin;
+
+	_VolumeHeader():
+		sampleType(-1), isBigEndian(false), isCompressed(false),
+		dataFile(), dataOffset(0), byteSkip(0), compressedSize(0),
+		spacing(1,1,1), origin(0,0,0)
+	{
+		size[0] = size[1] = size[2] = 0;
+	}
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Strings
+static std::string _trim(const std::string& s)
+{
+	size_t first = s.find_first_not_of(" \t\r\n");
+	if(first == std::string::npos)
+		return "";
+	return s.substr(first, s.find_last_not_of(" \t\r\n") - first + 1);
+}
+
+static std::string _lower(std::string s)
+{
+	for(size_t i=0; i<s.size(); ++i)
+		s[i] = char(std::tolower(static_cast<unsigned char>(s[i])));
+	return s;
+}
+
+// directory of a file (with its separator, empty if none)
+static std::string _directory(const std::string& filename)
+{
+	size_t separator = filename.find_last_of("/\\");
+	return separator == std::string::npos ? ""
+	                                      : filename.substr(0, separator+1);
+}
+
+// path of a data file named in a header
+static std::string _data_path(const std::string& header,
+                              const std::string& dataFile)
+{
+	bool isAbsolute = (!dataFile.empty()
+	                   && (dataFile[0] == '/' || dataFile[0] == '\\'))
+	                || (dataFile.size() > 1 && dataFile[1] == ':');
+	return isAbsolute ? dataFile : _directory(header) + dataFile;
+}
+
+// parse three numbers (separated by spaces, commas or parentheses)
+template<typename T>
+static bool _parse_triple(const std::string& value, T* triple)
+{
+	std::string s = value;
+	for(size_t i=0; i<s.size(); ++i)
+		if(s[i] == ',' || s[i] == '(' || s[i] == ')')
+			s[i] = ' ';
+	std::istringstream stream(s);
+	return !(stream >> triple[0] >> triple[1] >> triple[2]).fail();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// NRRD space directions: lengths of the axes, "none" is a unit axis
+static bool _parse_nrrd_directions(const std::string& value, Vector3& spacing)
+{
+	std::istringstream stream(value);
+	std::string direction;
+	for(GLuint a=0; a<3; ++a)
+	{
+		if(!(stream >> direction))
+			return false;
+		if(direction == "none")
+		{
+			spacing[a] = 1.0f;
+			continue;
+		}
+		GLfloat v[3];
+		if(!_parse_triple(direction, v))
+			return false;
+		GLfloat length = std::sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+		spacing[a] = length > 0.0f ? length : 1.0f;
+	}
+	return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Read a NRRD header
+static void _read_nrrd_header(const std::string& filename,
+                              _VolumeHeader& header) throw(fw::FWException)
+{
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+	if(!file)
+		throw _FileReadException(filename);
+
+	std::string line;
+	std::getline(file, line);
+	if(line.compare(0, 7, "NRRD000") != 0)
+		throw _VolumeFileException(filename, "not a NRRD file");
+
+	bool hasDataFile = false;
+	while(std::getline(file, line))
+	{
+		line = _trim(line);
+		if(line.empty())
+			break; // data follows
+		if(line[0] == '#' || line.find(":=") != std::string::npos)
+			continue; // comments, key/value pairs
+
+		size_t colon = line.find(':');
+		if(colon == std::string::npos)
+			throw _VolumeFileException(filename, "invalid line " + line);
+		std::string key   = _lower(_trim(line.substr(0, colon)));
+		std::string value = _trim(line.substr(colon+1));
+
+		if(key == "type")
+		{
+			std::string type = _lower(value);
+			for(GLuint i=0; i<NRRD_TYPE_NAME_COUNT; ++i)
+				if(type == NRRD_TYPE_NAMES[i][0])
+					type = NRRD_TYPE_NAMES[i][1];
+			for(GLint i=0; i<SAMPLE_TYPE_COUNT; ++i)
+				if(type == SAMPLE_TYPE_NAMES[i])
+					header.sampleType = i;
+			if(header.sampleType < 0)
+				throw _VolumeFileException(filename,
+				                           "unsupported type " + value);
+		}
+		else if(key == "dimension")
+		{
+			if(value != "3")
+				throw _VolumeFileException(filename,
+				                           "dimension is not 3");
+		}
+		else if(key == "sizes")
+		{
+			if(!_parse_triple(value, header.size))
+				throw _VolumeFileException(filename, "invalid sizes");
+		}
+		else if(key == "endian")
+			header.isBigEndian = _lower(value) == "big";
+		else if(key == "encoding")
+		{
+			std::string encoding = _lower(value);
+			if(encoding == "gzip" || encoding == "gz")
+				header.isCompressed = true;
+			else if(encoding != "raw")
+				throw _VolumeFileException(filename,
+				                           "unsupported encoding " + value);
+		}
+		else if(key == "spacings")
+		{
+			GLfloat spacing[3];
+			if(!_parse_triple(value, spacing))
+				throw _VolumeFileException(filename, "invalid spacings");
+			for(GLuint a=0; a<3; ++a)
+				header.spacing[a] = spacing[a] > 0.0f ? spacing[a] : 1.0f;
+		}
+		else if(key == "space directions")
+		{
+			if(!_parse_nrrd_directions(value, header.spacing))
+				throw _VolumeFileException(filename,
+				                           "invalid space directions");
+		}
+		else if(key == "space origin")
+		{
+			GLfloat origin[3];
+			if(!_parse_triple(value, origin))
+				throw _VolumeFileException(filename, "invalid space origin");
+			header.origin = Vector3(origin[0], origin[1], origin[2]);
+		}
+		else if(key == "data file" || key == "datafile")
+		{
+			if(value.compare(0, 4, "LIST") == 0
+			   || value.find(' ') != std::string::npos)
+				throw _VolumeFileException(filename,
+				                           "multiple data files");
+			header.dataFile = value;
+			hasDataFile = true;
+		}
+		else if(key == "byte skip" || key == "byteskip")
+		{
+			std::istringstream stream(value);
+			if(!(stream >> header.byteSkip) || header.byteSkip < -1)
+				throw _VolumeFileException(filename, "invalid byte skip");
+		}
+		else if(key == "line skip" || key == "lineskip")
+		{
+			if(value != "0")
+				throw _VolumeFileException(filename,
+				                           "unsupported line skip");
+		}
+	}
+
+	// attached data starts after the empty line
+	if(!hasDataFile)
+	{
+		if(!file)
+			throw _VolumeFileException(filename, "no data");
+		header.dataOffset = GLint64(file.tellg());
+	}
+	if(header.isCompressed && header.byteSkip < 0)
+		throw _VolumeFileException(filename, "invalid byte skip");
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Read a MetaImage header
+static void _read_mhd_header(const std::string& filename,
+                             _VolumeHeader& header) throw(fw::FWException)
+{
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+	if(!file)
+		throw _FileReadException(filename);
+
+	bool hasSpacing = false, hasDataFile = false;
+	std::string line;
+	while(!hasDataFile && std::getline(file, line))
+	{
+		line = _trim(line);
+		if(line.empty())
+			continue;
+		size_t equal = line.find('=');
+		if(equal == std::string::npos)
+			throw _VolumeFileException(filename, "invalid line " + line);
+		std::string key   = _lower(_trim(line.substr(0, equal)));
+		std::string value = _trim(line.substr(equal+1));
+		bool isTrue = _lower(value) == "true" || value == "1";
+
+		if(key == "ndims")
+		{
+			if(value != "3")
+				throw _VolumeFileException(filename,
+				                           "dimension is not 3");
+		}
+		else if(key == "dimsize")
+		{
+			if(!_parse_triple(value, header.size))
+				throw _VolumeFileException(filename, "invalid DimSize");
+		}
+		else if(key == "elementtype")
+		{
+			for(GLint i=0; i<SAMPLE_TYPE_COUNT; ++i)
+				if(value == MET_TYPE_NAMES[i])
+					header.sampleType = i;
+			if(header.sampleType < 0)
+				throw _VolumeFileException(filename,
+				                           "unsupported type " + value);
+		}
+		else if(key == "elementspacing"
+		        || (key == "elementsize" && !hasSpacing))
+		{
+			GLfloat spacing[3];
+			if(!_parse_triple(value, spacing))
+				throw _VolumeFileException(filename, "invalid spacing");
+			for(GLuint a=0; a<3; ++a)
+				header.spacing[a] = spacing[a] > 0.0f ? spacing[a] : 1.0f;
+			hasSpacing|= key == "elementspacing";
+		}
+		else if(key == "offset" || key == "origin" || key == "position")
+		{
+			GLfloat origin[3];
+			if(!_parse_triple(value, origin))
+				throw _VolumeFileException(filename, "invalid offset");
+			header.origin = Vector3(origin[0], origin[1], origin[2]);
+		}
+		else if(key == "binarydatabyteordermsb"
+		        || key == "elementbyteordermsb")
+			header.isBigEndian = isTrue;
+		else if(key == "compresseddata")
+			header.isCompressed = isTrue;
+		else if(key == "compresseddatasize")
+		{
+			std::istringstream stream(value);
+			stream >> header.compressedSize;
+		}
+		else if(key == "headersize")
+		{
+			std::istringstream stream(value);
+			if(!(stream >> header.byteSkip) || header.byteSkip < -1)
+				throw _VolumeFileException(filename, "invalid HeaderSize");
+		}
+		else if(key == "elementnumberofchannels")
+		{
+			if(value != "1")
+				throw _VolumeFileException(filename,
+				                           "multiple channels");
+		}
+		else if(key == "elementdatafile")
+		{
+			// last field of the header
+			if(value == "LIST" || value.find('%') != std::string::npos)
+				throw _VolumeFileException(filename,
+				                           "multiple data files");
+			if(value != "LOCAL")
+				header.dataFile = value;
+			else
+				header.dataOffset = GLint64(file.tellg());
+			hasDataFile = true;
+		}
+	}
+	if(!hasDataFile || !file)
+		throw _VolumeFileException(filename, "no data");
+	// HeaderSize skips bytes of raw data files only
+	if(header.isCompressed)
+		header.byteSkip = 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Convert samples to floats
+static bool _is_big_endian_host()
+{
+	const GLuint one = 1;
+	return *reinterpret_cast<const GLubyte*>(&one) == 0;
+}
+
+template<typename T>
+static void _convert_samples(const GLubyte* bytes,
+                             size_t count,
+                             bool swapBytes,
+                             GLfloat* samples)
+{
+	GLubyte swapped[sizeof(T)];
+	for(size_t i=0; i<count; ++i, bytes+=sizeof(T))
+	{
+		T value;
+		if(swapBytes)
+		{
+			std::reverse_copy(bytes, bytes + sizeof(T), swapped);
+			std::memcpy(&value, swapped, sizeof(T));
+		}
+		else
+			std::memcpy(&value, bytes, sizeof(T));
+		samples[i] = GLfloat(value);
+	}
+}
+
+static void _convert(const GLubyte* bytes,
+                     size_t count,
+                     GLint sampleType,
+                     bool swapBytes,
+                     GLfloat* samples)
+{
+	switch(sampleType)
+	{
+	case SAMPLE_TYPE_INT8:
+		_convert_samples<signed char>(bytes, count, false, samples); break;
+	case SAMPLE_TYPE_UINT8:
+		_convert_samples<GLubyte>(bytes, count, false, samples); break;
+	case SAMPLE_TYPE_INT16:
+		_convert_samples<GLshort>(bytes, count, swapBytes, samples); break;
+	case SAMPLE_TYPE_UINT16:
+		_convert_samples<GLushort>(bytes, count, swapBytes, samples); break;
+	case SAMPLE_TYPE_INT32:
+		_convert_samples<GLint>(bytes, count, swapBytes, samples); break;
+	case SAMPLE_TYPE_UINT32:
+		_convert_samples<GLuint>(bytes, count, swapBytes, samples); break;
+	case SAMPLE_TYPE_FLOAT:
+		_convert_samples<GLfloat>(bytes, count, swapBytes, samples); break;
+	case SAMPLE_TYPE_DOUBLE:
+		_convert_samples<GLdouble>(bytes, count, swapBytes, samples); break;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Decode the slabs of a region
+// Slices of the region are read from the data file (raw data, each task
+// has its own stream) or from decompressed bytes.
+class _DecodeSlabTask : public ThreadPool::Task
+{
+public:
+	_DecodeSlabTask(const _VolumeHeader& header,
+	                const std::string& dataPath,
+	                GLint64 dataBegin,
+	                const GLubyte* bytes,
+	                const GLuint* first,
+	                Volume& volume,
+	                ThreadPool& pool):
+		mHeader(header), mDataPath(dataPath), mDataBegin(dataBegin),
+		mBytes(bytes), mFirst(first), mVolume(volume), mPool(pool),
+		mHasFailed(0) {}
+
+	void Run(GLuint slab, GLuint)
+	{
+		const GLuint W = mHeader.size[0], H = mHeader.size[1];
+		const size_t sampleSize = SAMPLE_TYPE_SIZES[mHeader.sampleType];
+		const bool swapBytes = mHeader.isBigEndian != _is_big_endian_host();
+		const GLuint width = mVolume.Width(), height = mVolume.Height();
+		// rows of the region in a slice
+		const size_t rowsSize = size_t(height)*W*sampleSize;
+		const GLuint z0 = mVolume.SlabBegin(slab, mPool);
+		const GLuint z1 = mVolume.SlabBegin(slab+1, mPool);
+		if(z0 == z1)
+			return;
+
+		ArenaScope scope;
+		std::ifstream file;
+		GLubyte* buffer = NULL;
+		if(!mBytes)
+		{
+			file.open(mDataPath.c_str(), std::ios::in | std::ios::binary);
+			buffer = scope.GetArena().Allocate<GLubyte>(rowsSize);
+		}
+		for(GLuint z=z0; z<z1; ++z)
+		{
+			GLint64 offset = GLint64((size_t(z + mFirst[2])*H + mFirst[1])
+			                         *W*sampleSize);
+			const GLubyte* rows = mBytes + offset;
+			if(!mBytes)
+			{
+				file.seekg(std::streamoff(mDataBegin + offset));
+				file.read(reinterpret_cast<char*>(buffer),
+				          std::streamsize(rowsSize));
+				if(!file)
+				{
+					fw::atomic_store(&mHasFailed, 1);
+					return;
+				}
+				rows = buffer;
+			}
+			for(GLuint y=0; y<height; ++y)
+				_convert(rows + (size_t(y)*W + mFirst[0])*sampleSize,
+				         width, mHeader.sampleType, swapBytes,
+				         mVolume.Samples()
+				         + (size_t(z)*height + y)*width);
+		}
+	}
+
+	bool HasFailed() const {return fw::atomic_load(&mHasFailed) != 0;}
+
+private:
+	const _VolumeHeader& mHeader;
+	const std::string&   mDataPath;
+	GLint64              mDataBegin;
+	const GLubyte*       mBytes;
+	const GLuint*        mFirst;
+	Volume&              mVolume;
+	ThreadPool&          mPool;
+	volatile GLuint      mHasFailed;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Read the samples of a region
+static void _read_samples(const std::string& filename,
+                          const _VolumeHeader& header,
+                          Volume& volume,
+                          ThreadPool& pool,
+                          const VolumeRegion& region) throw(fw::FWException)
+{
+	if(header.sampleType < 0)
+		throw _VolumeFileException(filename, "no type");
+	if(!header.size[0] || !header.size[1] || !header.size[2])
+		throw _VolumeFileException(filename, "no sizes");
+
+	// region
+	GLuint first[3] = {region.x, region.y, region.z};
+	GLuint count[3] = {region.width, region.height, region.depth};
+	for(GLuint a=0; a<3; ++a)
+	{
+		if(first[a] >= header.size[a])
+			throw _VolumeFileException(filename, "region out of the volume");
+		if(count[a] == 0)
+			count[a] = header.size[a] - first[a];
+		if(count[a] > header.size[a] - first[a])
+			throw _VolumeFileException(filename, "region out of the volume");
+	}
+
+	// data
+	const std::string dataPath = header.dataFile.empty()
+	                           ? filename
+	                           : _data_path(filename, header.dataFile);
+	const GLuint64 sliceSize = GLuint64(header.size[0])*header.size[1]
+	                         * SAMPLE_TYPE_SIZES[header.sampleType];
+	const GLuint64 dataSize = sliceSize*header.size[2];
+	std::ifstream file(dataPath.c_str(), std::ios::in | std::ios::binary);
+	if(!file)
+		throw _FileReadException(dataPath);
+	file.seekg(0, std::ios::end);
+	const GLint64 fileSize = GLint64(file.tellg());
+
+	GLint64 dataBegin = header.dataOffset + header.byteSkip;
+	std::vector<GLubyte> bytes;
+	if(header.isCompressed)
+	{
+		// decompress up to the last slice of the region
+		GLint64 compressedSize = header.compressedSize > 0
+		                       ? GLint64(header.compressedSize)
+		                       : fileSize - header.dataOffset;
+		if(compressedSize <= 0
+		   || header.dataOffset + compressedSize > fileSize)
+			throw _VolumeFileException(filename, "truncated data");
+		std::vector<GLubyte> compressed(static_cast<size_t>(compressedSize));
+		file.seekg(std::streamoff(header.dataOffset));
+		file.read(reinterpret_cast<char*>(&compressed[0]),
+		          std::streamsize(compressed.size()));
+		size_t size = size_t(header.byteSkip
+		                     + sliceSize*(first[2] + count[2]));
+		bytes.reserve(size);
+		if(!file || !inflate(&compressed[0], compressed.size(), bytes, size))
+			throw _VolumeFileException(filename, "invalid compressed data");
+		dataBegin = header.byteSkip;
+	}
+	else
+	{
+		if(header.byteSkip < 0)
+			dataBegin = fileSize - GLint64(dataSize);
+		if(dataBegin < 0 || dataBegin + GLint64(dataSize) > fileSize)
+			throw _VolumeFileException(filename, "truncated data");
+	}
+	file.close();
+
+	// decode the slabs
+	volume.Resize(count[0], count[1], count[2], pool);
+	volume.SetSpacing(header.spacing);
+	volume.SetOrigin(Vector3(header.origin[0] + header.spacing[0]*first[0],
+	                         header.origin[1] + header.spacing[1]*first[1],
+	                         header.origin[2] + header.spacing[2]*first[2]));
+	_DecodeSlabTask task(header, dataPath, dataBegin,
+	                     bytes.empty() ? NULL : &bytes[0] + dataBegin,
+	                     first, volume, pool);
+	pool.Run(pool.ThreadCount(), task);
+	if(task.HasFailed())
+		throw _FileReadException(dataPath);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Readers
+//
+////////////////////////////////////////////////////////////////////////////////
+
+void read_volume_nrrd(const std::string& filename,
+                      Volume& volume,
+                      ThreadPool& pool,
+                      const VolumeRegion& region) throw(fw::FWException)
+{
+	_VolumeHeader header;
+	_read_nrrd_header(filename, header);
+	_read_samples(filename, header, volume, pool, region);
+}
+
+void read_volume_mhd(const std::string& filename,
+                     Volume& volume,
+                     ThreadPool& pool,
+                     const VolumeRegion& region) throw(fw::FWException)
+{
+	_VolumeHeader header;
+	_read_mhd_header(filename, header);
+	_read_samples(filename, header, volume, pool, region);
+}
+
+void read_volume(const std::string& filename,
+                 Volume& volume,
+                 ThreadPool& pool,
+                 const VolumeRegion& region) throw(fw::FWException)
+{
+	size_t dot = filename.find_last_of('.');
+	std::string extension = dot == std::string::npos
+	                      ? "" : _lower(filename.substr(dot+1));
+	if(extension == "nrrd" || extension == "nhdr")
+		read_volume_nrrd(filename, volume, pool, region);
+	else if(extension == "mhd" || extension == "mha")
+		read_volume_mhd(filename, volume, pool, region);
+	else
+		throw _VolumeFileException(filename, "unknown extension");
+}
+
+} // namespace mc
+
+
+
+// Tests of the readers: a volume written as an attached big endian NRRD, a
+// detached little endian MetaImage and a zlib compressed MetaImage is read
+// back, whole and by region
+// (build with -DVOLUME_FILE_TEST mc/*.cpp core/*.cpp Framework.cpp Trace.cpp
+// and the OpenGL libraries)
+#ifdef VOLUME_FILE_TEST
+#include <cstdlib>
+#include "ThreadPool.hpp"
+
+static const GLuint SIZE_X = 7, SIZE_Y = 5, SIZE_Z = 9;
+
+static GLfloat _sample(GLuint x, GLuint y, GLuint z)
+{
+	return GLfloat(x + 10*y + 100*z);
+}
+
+// append the samples, converted to T, in the given byte order
+template<typename T>
+static void _append_samples(std::string& bytes, bool isBigEndian)
+{
+	for(GLuint z=0; z<SIZE_Z; ++z)
+	for(GLuint y=0; y<SIZE_Y; ++y)
+	for(GLuint x=0; x<SIZE_X; ++x)
+	{
+		T value = T(_sample(x,y,z));
+		char b[sizeof(T)];
+		std::memcpy(b, &value, sizeof(T));
+		if(isBigEndian != mc::_is_big_endian_host())
+			std::reverse(b, b + sizeof(T));
+		bytes.append(b, sizeof(T));
+	}
+}
+
+// zlib stream of stored (uncompressed) deflate blocks, no checksum
+static std::string _zlib_stored(const std::string& data)
+{
+	std::string stream("\x78\x01", 2);
+	size_t begin = 0;
+	do
+	{
+		size_t length = std::min(data.size() - begin, size_t(1000));
+		bool isFinal  = begin + length == data.size();
+		char header[5] = {char(isFinal ? 1 : 0),
+		                  char(length & 0xFF), char(length >> 8),
+		                  char(~length & 0xFF), char((~length >> 8) & 0xFF)};
+		stream.append(header, 5);
+		stream.append(data, begin, length);
+		begin+= length;
+	} while(begin < data.size());
+	return stream.append(4, '\0');
+}
+
+static void _write(const char* filename, const std::string& contents)
+{
+	std::ofstream file(filename, std::ios::out | std::ios::binary);
+	file.write(contents.data(), std::streamsize(contents.size()));
+}
+
+static int _check(const char* filename,
+                  mc::ThreadPool& pool,
+                  const mc::VolumeRegion& region,
+                  const Vector3& spacing,
+                  const Vector3& origin)
+{
+	mc::Volume volume;
+	try
+	{
+		mc::read_volume(filename, volume, pool, region);
+	}
+	catch(fw::FWException& e)
+	{
+		std::fprintf(stderr, "%s: %s\n", filename, e.what());
+		return 1;
+	}
+	GLuint width  = region.width  ? region.width  : SIZE_X - region.x;
+	GLuint height = region.height ? region.height : SIZE_Y - region.y;
+	GLuint depth  = region.depth  ? region.depth  : SIZE_Z - region.z;
+	bool isValid = volume.Width() == width
+	            && volume.Height() == height
+	            && volume.Depth() == depth;
+	for(GLuint z=0; isValid && z<depth; ++z)
+	for(GLuint y=0; y<height; ++y)
+	for(GLuint x=0; x<width; ++x)
+		isValid&= volume.At(x,y,z)
+		       == _sample(region.x + x, region.y + y, region.z + z);
+	for(GLuint a=0; a<3; ++a)
+	{
+		isValid&= volume.Spacing()[a] == spacing[a];
+		isValid&= volume.Origin()[a] == origin[a] + spacing[a]
+		           * (a == 0 ? region.x : a == 1 ? region.y : region.z);
+	}
+	if(!isValid)
+		std::fprintf(stderr, "%s: invalid volume (region %u %u %u)\n",
+		             filename, region.x, region.y, region.z);
+	return isValid ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+	const mc::VolumeRegion REGIONS[] = { mc::VolumeRegion(),
+	                                     mc::VolumeRegion(2,1,3,4,3,5),
+	                                     mc::VolumeRegion(0,0,8,0,0,0) };
+	const Vector3 SPACING(0.5f, 1.0f, 2.0f), ORIGIN(1.0f, -2.0f, 3.0f);
+	const char* const FILENAMES[] = {"_test.nrrd", "_test.mhd", "_test.mha"};
+	int failures = 0;
+
+	// attached big endian shorts
+	std::string nrrd = "NRRD0004\n"
+	                   "# test volume\n"
+	                   "type: short\n"
+	                   "dimension: 3\n"
+	                   "sizes: 7 5 9\n"
+	                   "endian: big\n"
+	                   "encoding: raw\n"
+	                   "spacings: 0.5 1 2\n"
+	                   "space origin: (1,-2,3)\n"
+	                   "\n";
+	_append_samples<GLshort>(nrrd, true);
+	_write(FILENAMES[0], nrrd);
+
+	// detached little endian floats, after a skipped header
+	_write(FILENAMES[1], "ObjectType = Image\n"
+	                     "NDims = 3\n"
+	                     "DimSize = 7 5 9\n"
+	                     "ElementType = MET_FLOAT\n"
+	                     "ElementSpacing = 0.5 1 2\n"
+	                     "Offset = 1 -2 3\n"
+	                     "BinaryDataByteOrderMSB = False\n"
+	                     "HeaderSize = 3\n"
+	                     "ElementDataFile = _test.raw\n");
+	std::string raw = "abc";
+	_append_samples<GLfloat>(raw, false);
+	_write("_test.raw", raw);
+
+	// attached compressed unsigned shorts
+	std::string samples;
+	_append_samples<GLushort>(samples, false);
+	std::string compressed = _zlib_stored(samples);
+	std::ostringstream mha;
+	mha << "NDims = 3\n"
+	       "DimSize = 7 5 9\n"
+	       "ElementType = MET_USHORT\n"
+	       "ElementSpacing = 0.5 1 2\n"
+	       "Offset = 1 -2 3\n"
+	       "CompressedData = True\n"
+	       "CompressedDataSize = " << compressed.size() << "\n"
+	       "ElementDataFile = LOCAL\n" << compressed;
+	_write(FILENAMES[2], mha.str());
+
+	for(GLuint t=0; t<3; ++t)
+	{
+		mc::ThreadPool pool(t == 0 ? 1 : 3, mc::ThreadPool::PIN_MODE_NONE);
+		for(GLuint f=0; f<3; ++f)
+		for(GLuint r=0; r<3; ++r)
+			failures+= _check(FILENAMES[f], pool, REGIONS[r],
+			                  SPACING, ORIGIN);
+	}
+
+	// regions out of the volume and truncated data are rejected
+	mc::ThreadPool pool(2, mc::ThreadPool::PIN_MODE_NONE);
+	mc::Volume volume;
+	try
+	{
+		mc::read_volume(FILENAMES[0], volume, pool,
+		                mc::VolumeRegion(2,1,3,6,3,5));
+		++failures;
+		std::fprintf(stderr, "region out of the volume accepted\n");
+	}
+	catch(fw::FWException&) {}
+	try
+	{
+		_write(FILENAMES[0], nrrd.substr(0, nrrd.size() - 1));
+		mc::read_volume(FILENAMES[0], volume, pool);
+		++failures;
+		std::fprintf(stderr, "truncated data accepted\n");
+	}
+	catch(fw::FWException&) {}
+
+	for(GLuint f=0; f<3; ++f)
+		std::remove(FILENAMES[f]);
+	std::remove("_test.raw");
+	std::printf("%s (%d failures)\n", failures ? "FAILED" : "PASSED", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif // VOLUME_FILE_TEST
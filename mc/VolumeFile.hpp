@@ -0,0 +1,67 @@
+////////////////////////////////////////////////////////////////////////////////
+// \file   VolumeFile.hpp
+// \author J Dupuy
+// \brief  Volume readers for the NRRD and MetaImage file formats.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MC_VOLUME_FILE_HPP
+#define MC_VOLUME_FILE_HPP
+
+#include <string>
+#include "Framework.hpp"
+#include "ThreadPool.hpp"
+#include "Volume.hpp"
+
+namespace mc
+{
+	// Region of the samples of a volume file
+	// Sizes of zero extend the region to the end of the volume.
+	struct VolumeRegion
+	{
+		GLuint x, y, z;              // first sample
+		GLuint width, height, depth; // in samples
+
+		VolumeRegion():
+			x(0), y(0), z(0), width(0), height(0), depth(0) {}
+		VolumeRegion(GLuint x, GLuint y, GLuint z,
+		             GLuint width, GLuint height, GLuint depth):
+			x(x), y(y), z(z), width(width), height(height), depth(depth) {}
+	};
+
+
+	// Read a region of a volume file
+	// Three dimensional scalar volumes are supported, with 8, 16 and 32 bits
+	// integer, float or double samples, in either byte order, stored raw or
+	// compressed (gzip for NRRD, zlib for MetaImage), in the header file or
+	// in a separate data file. Samples are converted to floats. Spacing and
+	// origin are read from the header (axis aligned volumes: the lengths of
+	// the axes are the spacing) and the origin is moved to the first sample
+	// of the region.
+	// The volume is resized with the pool (see Volume::Resize), and its slabs
+	// are decoded by the tasks of the pool: each task reads and converts the
+	// slices of its slab from its own file stream for raw data. Compressed
+	// data is decompressed first, up to the last byte of the region.
+		// NRRD (.nrrd, .nhdr with detached data)
+	void read_volume_nrrd(const std::string& filename,
+	                      Volume& volume,
+	                      ThreadPool& pool,
+	                      const VolumeRegion& region = VolumeRegion())
+	                      throw(fw::FWException);
+		// MetaImage (.mhd with detached data, .mha)
+	void read_volume_mhd(const std::string& filename,
+	                     Volume& volume,
+	                     ThreadPool& pool,
+	                     const VolumeRegion& region = VolumeRegion())
+	                     throw(fw::FWException);
+		// one of the above, from the extension of the file
+	void read_volume(const std::string& filename,
+	                 Volume& volume,
+	                 ThreadPool& pool,
+	                 const VolumeRegion& region = VolumeRegion())
+	                 throw(fw::FWException);
+
+} // namespace mc
+
+#endif
+
@@ -14,9 +14,12 @@ solution "OpenGL"
 		kind "ConsoleApp" -- Shouldn't this be in configuration section ?
 		files { "*.hpp", "*.cpp" }
 		files { "core/*.cpp" }
+		files { "mc/*.hpp", "mc/*.cpp" }
 		includedirs {
+		"./",
 		"include",
-		"core"
+		"core",
+		"mc"
 		}
 		objdir "obj"
 
@@ -33,7 +36,7 @@ solution "OpenGL"
 -- Linux x86 platform gmake
 		configuration {"linux", "gmake", "x32"}
 			linkoptions {
-			"-Wl,-rpath,./lib/linux/lin32 -L./lib/linux/lin32 -lGLEW -lglut -lAntTweakBar"
+			"-Wl,-rpath,./lib/linux/lin32 -L./lib/linux/lin32 -lGLEW -lglut -lAntTweakBar -lpthread"
 			}
 			libdirs {
 			"lib/linux/lin32"
@@ -42,7 +45,7 @@ solution "OpenGL"
 -- Linux x64 platform gmake
 		configuration {"linux", "gmake", "x64"}
 			linkoptions {
-			"-Wl,-rpath,./lib/linux/lin64 -L./lib/linux/lin64 -lGLEW -lglut -lAntTweakBar"
+			"-Wl,-rpath,./lib/linux/lin64 -L./lib/linux/lin64 -lGLEW -lglut -lAntTweakBar -lpthread"
 			}
 			libdirs {
 			"lib/linux/lin64"